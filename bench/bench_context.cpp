@@ -0,0 +1,24 @@
+#include <benchmark/benchmark.h>
+#include <VMat/simd.h>
+#include <string>
+
+// The VMat build options the numbers depend on, stored in the "context" of the JSON output so
+// regress.py can tell runs of different configurations apart.
+namespace
+{
+const bool registered = []{
+    const std::string buildType = VMAT_BENCH_BUILD_TYPE;
+    benchmark::AddCustomContext("vmat_build_type",buildType.empty() ? "none" : buildType);
+#ifdef VMAT_SIMD_AVX2
+    benchmark::AddCustomContext("vmat_avx2","on");
+#else
+    benchmark::AddCustomContext("vmat_avx2","off");
+#endif
+#ifdef VMAT_FAST_MATH
+    benchmark::AddCustomContext("vmat_fast_math","on");
+#else
+    benchmark::AddCustomContext("vmat_fast_math","off");
+#endif
+    return true;
+}();
+}
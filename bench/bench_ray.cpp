@@ -0,0 +1,52 @@
+#include "bench_util.h"
+#include <VMat/transformation.h>
+using namespace vm;
+using namespace bench;
+
+namespace
+{
+// rays from points around the unit cube toward points inside of it, most of them hit
+std::vector<Ray> raysIntoCube(std::size_t n,Float scale,unsigned seed){
+    const auto from = randomVectors(n,seed),to = randomVectors(n,seed + 1);
+    std::vector<Ray> rays(n);
+    for(std::size_t i = 0;i<n;i++){
+        const auto o = Point3f(from[i].x,from[i].y,from[i].z) * (3 * scale) + Vector3f(scale,scale,scale) * 0.5f;
+        const auto target = Point3f(to[i].x,to[i].y,to[i].z) * (0.5f * scale) + Vector3f(scale,scale,scale) * 0.5f;
+        rays[i] = Ray(target - o,o);
+    }
+    return rays;
+}
+}
+
+static void BM_Bound3Intersect(benchmark::State & state){
+    const Bound3f bound({0,0,0},{1,1,1});
+    const auto rays = raysIntoCube(Batch,1,1);
+    for(auto _ : state){
+        int hits = 0;
+        for(std::size_t i = 0;i<Batch;i++){
+            Float t0,t1;
+            hits += bound.Intersect(rays[i],&t0,&t1);
+        }
+        benchmark::DoNotOptimize(hits);
+    }
+    setItems(state);
+}
+BENCHMARK(BM_Bound3Intersect);
+
+// A full RayIntervalIter walk per ray through a grid of range(0)^3 cells, the items are rays and
+// the Cells counter the rate of visited cells
+static void BM_GridIntersectWith(benchmark::State & state){
+    const int cells = int(state.range(0));
+    const Bound3i bound({0,0,0},{cells * 16,cells * 16,cells * 16});
+    const auto grid = bound.GenGrid(Vec3i(cells,cells,cells));
+    const auto rays = raysIntoCube(Batch,Float(cells * 16),2);
+    std::int64_t visited = 0;
+    for(auto _ : state){
+        for(std::size_t i = 0;i<Batch;i++)
+            for(auto it = grid.IntersectWith(rays[i]);it.Valid();++it) visited++;
+        benchmark::DoNotOptimize(visited);
+    }
+    setItems(state);
+    state.counters["Cells"] = benchmark::Counter(double(visited),benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_GridIntersectWith)->Arg(4)->Arg(16)->Arg(64);
@@ -0,0 +1,156 @@
+#include "bench_util.h"
+#include <VMat/arithmetic.h>
+#include <VMat/lowdiscrepancy.h>
+#include <VMat/rng.h>
+#include <VMat/sampling.h>
+using namespace vm;
+using namespace bench;
+
+// scalar sample warps of arithmetic.h
+
+#define VMAT_BENCH_WARP(name, Result, call)                      \
+    static void BM_##name(benchmark::State & state){             \
+        const auto u = randomSamples(Batch,1);                    \
+        std::vector<Result> out(Batch);                           \
+        for(auto _ : state){                                      \
+            for(std::size_t i = 0;i<Batch;i++) out[i] = call;     \
+            benchmark::DoNotOptimize(out.data());                 \
+            benchmark::ClobberMemory();                           \
+        }                                                         \
+        setItems(state);                                          \
+    }                                                             \
+    BENCHMARK(BM_##name);
+
+VMAT_BENCH_WARP(uniformSampleSphere,Vector3f,uniformSampleSphere(u[i]))
+VMAT_BENCH_WARP(uniformSampleHemiSphere,Vector3f,uniformSampleHemiSphere(u[i]))
+VMAT_BENCH_WARP(uniformSampleDisk,Point2f,uniformSampleDisk(u[i]))
+VMAT_BENCH_WARP(concentricDiskSample,Point2f,concentricDiskSample(u[i]))
+VMAT_BENCH_WARP(cosineSampleHemiSphere,Vector3f,cosineSampleHemiSphere(u[i]))
+VMAT_BENCH_WARP(cosineSampleHemiSphereWithShiness,Vector3f,cosineSampleHemiSphereWithShiness(u[i],20))
+VMAT_BENCH_WARP(uniformSampleCone,Vector3f,uniformSampleCone(u[i],0.3f))
+VMAT_BENCH_WARP(uniformSampleTriangle,Point2f,uniformSampleTriangle(u[i]))
+#undef VMAT_BENCH_WARP
+
+// batched warps of sampling.h, SoA and array forms
+
+static void BM_uniformSampleSphereSoA(benchmark::State & state){
+    const auto u0 = randomFloats(Batch,0,1,1),u1 = randomFloats(Batch,0,1,2);
+    std::vector<float> x(Batch),y(Batch),z(Batch);
+    for(auto _ : state){
+        uniformSampleSphere(u0.data(),u1.data(),Batch,x.data(),y.data(),z.data());
+        benchmark::ClobberMemory();
+    }
+    setItems(state);
+}
+BENCHMARK(BM_uniformSampleSphereSoA);
+
+static void BM_cosineSampleHemiSphereSoA(benchmark::State & state){
+    const auto u0 = randomFloats(Batch,0,1,1),u1 = randomFloats(Batch,0,1,2);
+    std::vector<float> x(Batch),y(Batch),z(Batch);
+    for(auto _ : state){
+        cosineSampleHemiSphere(u0.data(),u1.data(),Batch,x.data(),y.data(),z.data());
+        benchmark::ClobberMemory();
+    }
+    setItems(state);
+}
+BENCHMARK(BM_cosineSampleHemiSphereSoA);
+
+static void BM_uniformSampleConeArray(benchmark::State & state){
+    const auto u = randomSamples(Batch,1);
+    std::vector<Vector3f> out(Batch);
+    for(auto _ : state){
+        uniformSampleCone(u.data(),Batch,std::cos(0.3f),out.data());
+        benchmark::ClobberMemory();
+    }
+    setItems(state);
+}
+BENCHMARK(BM_uniformSampleConeArray);
+
+static void BM_concentricDiskSampleArray(benchmark::State & state){
+    const auto u = randomSamples(Batch,1);
+    std::vector<Point2f> out(Batch);
+    for(auto _ : state){
+        concentricDiskSample(u.data(),Batch,out.data());
+        benchmark::ClobberMemory();
+    }
+    setItems(state);
+}
+BENCHMARK(BM_concentricDiskSampleArray);
+
+// sample sequences, one pixel per Batch samples, scalar and block forms
+
+template <typename S>
+static void sequence2D(benchmark::State & state,const S & sampler){
+    std::vector<Point2f> out(Batch);
+    int pixel = 0;
+    for(auto _ : state){
+        const Point2i p(pixel % 64,pixel / 64 % 64);
+        for(std::size_t i = 0;i<Batch;i++) out[i] = sampler.Get2D(p,std::uint32_t(i),2);
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+        pixel++;
+    }
+    setItems(state);
+}
+
+template <typename S>
+static void sequence2DBlock(benchmark::State & state,const S & sampler){
+    std::vector<float> u0(Batch),u1(Batch);
+    int pixel = 0;
+    for(auto _ : state){
+        sampler.Get2D(Point2i(pixel % 64,pixel / 64 % 64),0,Batch,2,u0.data(),u1.data());
+        benchmark::ClobberMemory();
+        pixel++;
+    }
+    setItems(state);
+}
+
+static void BM_SobolGet2D(benchmark::State & state){ sequence2D(state,SobolSampler(1)); }
+static void BM_SobolGet2DBlock(benchmark::State & state){ sequence2DBlock(state,SobolSampler(1)); }
+static void BM_HaltonGet2D(benchmark::State & state){ sequence2D(state,HaltonSampler(1)); }
+static void BM_HaltonGet2DBlock(benchmark::State & state){ sequence2DBlock(state,HaltonSampler(1)); }
+static void BM_StratifiedGet2D(benchmark::State & state){ sequence2D(state,StratifiedSampler(32,32,1)); }
+static void BM_StratifiedGet2DBlock(benchmark::State & state){ sequence2DBlock(state,StratifiedSampler(32,32,1)); }
+BENCHMARK(BM_SobolGet2D);
+BENCHMARK(BM_SobolGet2DBlock);
+BENCHMARK(BM_HaltonGet2D);
+BENCHMARK(BM_HaltonGet2DBlock);
+BENCHMARK(BM_StratifiedGet2D);
+BENCHMARK(BM_StratifiedGet2DBlock);
+
+static void BM_PhiloxGet2D(benchmark::State & state){
+    std::vector<Point2f> out(Batch);
+    int pixel = 0;
+    for(auto _ : state){
+        const Point2i p(pixel % 64,pixel / 64 % 64);
+        for(std::size_t i = 0;i<Batch;i++) out[i] = PhiloxRNG(p,std::uint32_t(i),1).Get2D(2);
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+        pixel++;
+    }
+    setItems(state);
+}
+BENCHMARK(BM_PhiloxGet2D);
+
+static void BM_PhiloxGet2DBlock(benchmark::State & state){
+    std::vector<float> u0(Batch),u1(Batch);
+    int pixel = 0;
+    for(auto _ : state){
+        PhiloxRNG::Get2D(Point2i(pixel % 64,pixel / 64 % 64),0,Batch,2,u0.data(),u1.data(),1);
+        benchmark::ClobberMemory();
+        pixel++;
+    }
+    setItems(state);
+}
+BENCHMARK(BM_PhiloxGet2DBlock);
+
+static void BM_PhiloxUniform8(benchmark::State & state){
+    const PhiloxRNG rng({1,2},3,1);
+    for(auto _ : state){
+        Float8 sum = Float8::Zero();
+        for(std::size_t i = 0;i<Batch;i += 8) sum += rng.Uniform8(std::uint32_t(i));
+        benchmark::DoNotOptimize(sum);
+    }
+    setItems(state);
+}
+BENCHMARK(BM_PhiloxUniform8);
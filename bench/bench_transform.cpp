@@ -0,0 +1,80 @@
+#include "bench_util.h"
+#include <VMat/transformation.h>
+using namespace vm;
+using namespace bench;
+
+namespace
+{
+std::vector<Transform> randomTransforms(std::size_t n,unsigned seed){
+    const auto axes = randomVectors(n,seed);
+    const auto f = randomFloats(4 * n,0.5f,2,seed + 1);
+    std::vector<Transform> t(n);
+    for(std::size_t i = 0;i<n;i++)
+        t[i] = Translate(f[4 * i],-f[4 * i + 1],f[4 * i + 2]) * Rotate(axes[i],f[4 * i + 3] * 90) * Scale(f[4 * i + 1],f[4 * i + 2],f[4 * i + 3]);
+    return t;
+}
+}
+
+static void BM_Matrix4x4Mul(benchmark::State & state){
+    const auto t = randomTransforms(Batch,1);
+    std::vector<Matrix4x4> out(Batch);
+    for(auto _ : state){
+        for(std::size_t i = 0;i<Batch;i++) out[i] = Matrix4x4::Mul(t[i].Matrix(),t[Batch - 1 - i].Matrix());
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    setItems(state);
+}
+BENCHMARK(BM_Matrix4x4Mul);
+
+static void BM_Matrix4x4Inversed(benchmark::State & state){
+    const auto t = randomTransforms(Batch,2);
+    std::vector<Matrix4x4> out(Batch);
+    for(auto _ : state){
+        for(std::size_t i = 0;i<Batch;i++) out[i] = t[i].Matrix().Inversed();
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    setItems(state);
+}
+BENCHMARK(BM_Matrix4x4Inversed);
+
+static void BM_TransformPoint(benchmark::State & state){
+    const auto t = randomTransforms(1,3)[0];
+    const auto v = randomVectors(Batch,4);
+    std::vector<Point3f> out(Batch);
+    for(auto _ : state){
+        for(std::size_t i = 0;i<Batch;i++) out[i] = t * Point3f(v[i].x,v[i].y,v[i].z);
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    setItems(state);
+}
+BENCHMARK(BM_TransformPoint);
+
+static void BM_TransformVector(benchmark::State & state){
+    const auto t = randomTransforms(1,5)[0];
+    const auto v = randomVectors(Batch,6);
+    std::vector<Vector3f> out(Batch);
+    for(auto _ : state){
+        for(std::size_t i = 0;i<Batch;i++) out[i] = t * v[i];
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    setItems(state);
+}
+BENCHMARK(BM_TransformVector);
+
+static void BM_TransformRay(benchmark::State & state){
+    const auto t = randomTransforms(1,7)[0];
+    const auto d = randomVectors(Batch,8),o = randomVectors(Batch,9);
+    std::vector<Ray> rays(Batch),out(Batch);
+    for(std::size_t i = 0;i<Batch;i++) rays[i] = Ray(d[i],Point3f(o[i].x,o[i].y,o[i].z));
+    for(auto _ : state){
+        for(std::size_t i = 0;i<Batch;i++) out[i] = t * rays[i];
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    setItems(state);
+}
+BENCHMARK(BM_TransformRay);
@@ -0,0 +1,42 @@
+#ifndef BENCH_UTIL_H_
+#define BENCH_UTIL_H_
+
+#include <benchmark/benchmark.h>
+#include <VMat/geometry.h>
+#include <random>
+#include <vector>
+
+// Every benchmark runs over a batch of Batch inputs per iteration and reports items per second,
+// so the numbers stay comparable when the batch changes.
+namespace bench
+{
+constexpr std::size_t Batch = 1024;
+
+inline std::vector<float> randomFloats(std::size_t n,float lo,float hi,unsigned seed){
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> dist(lo,hi);
+    std::vector<float> v(n);
+    for(auto & x : v) x = dist(rng);
+    return v;
+}
+
+inline std::vector<vm::Vector3f> randomVectors(std::size_t n,unsigned seed){
+    const auto f = randomFloats(3 * n,-1,1,seed);
+    std::vector<vm::Vector3f> v(n);
+    for(std::size_t i = 0;i<n;i++) v[i] = vm::Vector3f(f[3 * i],f[3 * i + 1],f[3 * i + 2]);
+    return v;
+}
+
+inline std::vector<vm::Point2f> randomSamples(std::size_t n,unsigned seed){
+    const auto f = randomFloats(2 * n,0,1,seed);
+    std::vector<vm::Point2f> v(n);
+    for(std::size_t i = 0;i<n;i++) v[i] = vm::Point2f(f[2 * i],f[2 * i + 1]);
+    return v;
+}
+
+inline void setItems(benchmark::State & state,std::size_t perIteration = Batch){
+    state.SetItemsProcessed(std::int64_t(state.iterations()) * std::int64_t(perIteration));
+}
+}
+
+#endif
@@ -0,0 +1,107 @@
+#include "bench_util.h"
+#include <VMat/numeric.h>
+using namespace vm;
+using namespace bench;
+
+static void BM_Vector3fMulAdd(benchmark::State & state){
+    const auto a = randomVectors(Batch,1),b = randomVectors(Batch,2);
+    std::vector<Vector3f> out(Batch);
+    for(auto _ : state){
+        for(std::size_t i = 0;i<Batch;i++) out[i] = a[i] + b[i] * 0.5f;
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    setItems(state);
+}
+BENCHMARK(BM_Vector3fMulAdd);
+
+static void BM_Vector3fDot(benchmark::State & state){
+    const auto a = randomVectors(Batch,1),b = randomVectors(Batch,2);
+    for(auto _ : state){
+        Float sum = 0;
+        for(std::size_t i = 0;i<Batch;i++) sum += Vector3f::Dot(a[i],b[i]);
+        benchmark::DoNotOptimize(sum);
+    }
+    setItems(state);
+}
+BENCHMARK(BM_Vector3fDot);
+
+static void BM_Vector3fCross(benchmark::State & state){
+    const auto a = randomVectors(Batch,1),b = randomVectors(Batch,2);
+    std::vector<Vector3f> out(Batch);
+    for(auto _ : state){
+        for(std::size_t i = 0;i<Batch;i++) out[i] = Vector3f::Cross(a[i],b[i]);
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    setItems(state);
+}
+BENCHMARK(BM_Vector3fCross);
+
+static void BM_Vector3fNormalized(benchmark::State & state){
+    const auto a = randomVectors(Batch,1);
+    std::vector<Vector3f> out(Batch);
+    for(auto _ : state){
+        for(std::size_t i = 0;i<Batch;i++) out[i] = a[i].Normalized();
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    setItems(state);
+}
+BENCHMARK(BM_Vector3fNormalized);
+
+static void BM_Linear3D(benchmark::State & state){
+    const Size2 dim(256,256);
+    std::vector<Point3i> p(Batch);
+    std::mt19937 rng(3);
+    for(auto & q : p) q = Point3i(int(rng() % 256),int(rng() % 256),int(rng() % 256));
+    for(auto _ : state){
+        std::size_t sum = 0;
+        for(std::size_t i = 0;i<Batch;i++) sum += Linear(p[i],dim);
+        benchmark::DoNotOptimize(sum);
+    }
+    setItems(state);
+}
+BENCHMARK(BM_Linear3D);
+
+static void BM_Dim3D(benchmark::State & state){
+    const Size2 dim(256,256);
+    std::vector<std::size_t> l(Batch);
+    std::mt19937 rng(4);
+    for(auto & x : l) x = rng() % (256 * 256 * 256);
+    std::vector<Point3i> out(Batch);
+    for(auto _ : state){
+        for(std::size_t i = 0;i<Batch;i++) out[i] = Dim(l[i],dim);
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    setItems(state);
+}
+BENCHMARK(BM_Dim3D);
+
+static void BM_Linear2D(benchmark::State & state){
+    std::vector<Point2i> p(Batch);
+    std::mt19937 rng(5);
+    for(auto & q : p) q = Point2i(int(rng() % 1024),int(rng() % 1024));
+    for(auto _ : state){
+        std::size_t sum = 0;
+        for(std::size_t i = 0;i<Batch;i++) sum += Linear(p[i],1024);
+        benchmark::DoNotOptimize(sum);
+    }
+    setItems(state);
+}
+BENCHMARK(BM_Linear2D);
+
+static void BM_Dim2D(benchmark::State & state){
+    std::vector<std::size_t> l(Batch);
+    std::mt19937 rng(6);
+    for(auto & x : l) x = rng() % (1024 * 1024);
+    std::vector<Point2i> out(Batch);
+    for(auto _ : state){
+        for(std::size_t i = 0;i<Batch;i++) out[i] = Dim(l[i],std::size_t(1024));
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    setItems(state);
+}
+BENCHMARK(BM_Dim2D);
@@ -0,0 +1,220 @@
+#!/usr/bin/env python3
+"""Compares a run of vmat_bench against a stored baseline and fails on significant slowdowns.
+
+Each benchmark is run --repetitions times. Its throughput (items per second) is compared to
+the baseline with Welch's t-test. A benchmark regresses when its mean throughput drops by more
+than --threshold and the one-sided p-value is below --alpha. The report gives the relative change
+and its confidence interval for every benchmark.
+
+Usage:
+    regress.py --bench build/bench/vmat_bench --update      # record bench/baseline.json
+    regress.py --bench build/bench/vmat_bench               # compare, exit 1 on regression
+    regress.py --input run.json                             # compare an existing run
+
+Only the Python standard library is needed. The baseline is only meaningful on the machine and
+build configuration it was recorded with, whose description is stored along with it: the host,
+and the CMake build type, VMAT_ENABLE_AVX2 and VMAT_ENABLE_FAST_MATH of vmat_bench. Comparing
+against a baseline of another machine or configuration prints a warning.
+"""
+
+import argparse
+import json
+import math
+import os
+import platform
+import statistics
+import subprocess
+import sys
+import tempfile
+
+DEFAULT_BASELINE = os.path.join(os.path.dirname(os.path.abspath(__file__)), "baseline.json")
+
+
+def incomplete_beta(a, b, x):
+    """The regularized incomplete beta function I_x(a, b), by Lentz's continued fraction."""
+    if x <= 0:
+        return 0.0
+    if x >= 1:
+        return 1.0
+    if x > (a + 1) / (a + b + 2):
+        return 1.0 - incomplete_beta(b, a, 1 - x)
+    front = math.exp(math.lgamma(a + b) - math.lgamma(a) - math.lgamma(b) + a * math.log(x) + b * math.log(1 - x)) / a
+    tiny = 1e-300
+    f, c, d = 1.0, 1.0, 0.0
+    for i in range(200):
+        m = i // 2
+        if i == 0:
+            numerator = 1.0
+        elif i % 2 == 0:
+            numerator = m * (b - m) * x / ((a + 2 * m - 1) * (a + 2 * m))
+        else:
+            numerator = -(a + m) * (a + b + m) * x / ((a + 2 * m) * (a + 2 * m + 1))
+        d = 1 + numerator * d
+        d = 1 / (d if abs(d) > tiny else tiny)
+        c = 1 + numerator / c
+        c = c if abs(c) > tiny else tiny
+        f *= c * d
+        if abs(1 - c * d) < 1e-12:
+            break
+    return front * (f - 1)
+
+
+def t_cdf(t, df):
+    """The cumulative distribution function of Student's t distribution."""
+    x = df / (df + t * t)
+    tail = 0.5 * incomplete_beta(df / 2, 0.5, x)
+    return 1 - tail if t > 0 else tail
+
+
+def t_quantile(p, df):
+    """The inverse of t_cdf by bisection, for confidence intervals."""
+    lo, hi = -1e3, 1e3
+    for _ in range(200):
+        mid = (lo + hi) / 2
+        if t_cdf(mid, df) < p:
+            lo = mid
+        else:
+            hi = mid
+    return (lo + hi) / 2
+
+
+def summarize(samples):
+    return {
+        "mean": statistics.fmean(samples),
+        "stdev": statistics.stdev(samples) if len(samples) > 1 else 0.0,
+        "n": len(samples),
+    }
+
+
+def welch(base, new, confidence):
+    """One-sided p-value of new being slower than base, and the confidence interval of the
+    difference of the means."""
+    vb = base["stdev"] ** 2 / base["n"]
+    vn = new["stdev"] ** 2 / new["n"]
+    diff = new["mean"] - base["mean"]
+    se = math.sqrt(vb + vn)
+    if se == 0:
+        return (0.0 if diff < 0 else 1.0), (diff, diff)
+    denominator = (vb * vb / (base["n"] - 1) if base["n"] > 1 else 0) + (vn * vn / (new["n"] - 1) if new["n"] > 1 else 0)
+    df = (vb + vn) ** 2 / denominator if denominator > 0 else 1.0
+    p = t_cdf(diff / se, df)
+    half = t_quantile(0.5 + confidence / 2, df) * se
+    return p, (diff - half, diff + half)
+
+
+def run_bench(bench, repetitions, min_time, bench_filter):
+    with tempfile.NamedTemporaryFile(suffix=".json", delete=False) as f:
+        out = f.name
+    try:
+        # Interleaving the repetitions of all benchmarks spreads slow drifts of the machine over
+        # them, so the drift shows up in the variance instead of biasing a few benchmarks
+        cmd = [bench, f"--benchmark_repetitions={repetitions}", f"--benchmark_min_time={min_time}",
+               "--benchmark_enable_random_interleaving=true", "--benchmark_out_format=json", f"--benchmark_out={out}"]
+        if bench_filter:
+            cmd.append(f"--benchmark_filter={bench_filter}")
+        subprocess.run(cmd, check=True, stdout=subprocess.DEVNULL)
+        with open(out) as f:
+            return json.load(f)
+    finally:
+        os.unlink(out)
+
+
+def collect(run):
+    """Maps each benchmark name to the throughput of its repetitions."""
+    samples = {}
+    for b in run["benchmarks"]:
+        if b.get("run_type", "iteration") != "iteration":
+            continue
+        name = b.get("run_name", b["name"])
+        if "items_per_second" in b:
+            value = b["items_per_second"]
+        else:
+            value = 1e9 / b["real_time"] if b.get("time_unit", "ns") == "ns" else 1 / b["real_time"]
+        samples.setdefault(name, []).append(value)
+    return samples
+
+
+def context(run):
+    ctx = run.get("context", {})
+    return {
+        "host": ctx.get("host_name", platform.node()),
+        "cpus": ctx.get("num_cpus"),
+        "mhz": ctx.get("mhz_per_cpu"),
+        "library_build_type": ctx.get("library_build_type"),
+        # added to the context by bench_context.cpp
+        "vmat_build_type": ctx.get("vmat_build_type"),
+        "vmat_avx2": ctx.get("vmat_avx2"),
+        "vmat_fast_math": ctx.get("vmat_fast_math"),
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--bench", help="path of the vmat_bench executable")
+    parser.add_argument("--input", help="a Google Benchmark JSON output to use instead of running --bench")
+    parser.add_argument("--baseline", default=DEFAULT_BASELINE)
+    parser.add_argument("--update", action="store_true", help="write the run as the new baseline")
+    parser.add_argument("--repetitions", type=int, default=10)
+    parser.add_argument("--min-time", type=float, default=0.05, help="seconds per repetition")
+    parser.add_argument("--filter", default="", help="regular expression selecting benchmarks")
+    parser.add_argument("--threshold", type=float, default=0.1, help="relative slowdown tolerated")
+    parser.add_argument("--alpha", type=float, default=0.01, help="significance level of the test")
+    args = parser.parse_args()
+
+    if args.input:
+        with open(args.input) as f:
+            run = json.load(f)
+    elif args.bench:
+        run = run_bench(args.bench, args.repetitions, args.min_time, args.filter)
+    else:
+        parser.error("either --bench or --input is required")
+    current = {name: summarize(s) for name, s in collect(run).items() if len(s) > 1}
+    if not current:
+        print("error: the run has no benchmark with at least two repetitions", file=sys.stderr)
+        return 2
+
+    if args.update:
+        with open(args.baseline, "w") as f:
+            json.dump({"context": context(run), "benchmarks": current}, f, indent=2, sort_keys=True)
+            f.write("\n")
+        print(f"wrote {len(current)} benchmarks to {args.baseline}")
+        return 0
+
+    if not os.path.exists(args.baseline):
+        print(f"error: no baseline at {args.baseline}, record one with --update", file=sys.stderr)
+        return 2
+    with open(args.baseline) as f:
+        baseline = json.load(f)
+    if baseline.get("context") != context(run):
+        print(f"warning: the baseline was recorded on {baseline.get('context')}, this run is {context(run)}")
+
+    confidence = 1 - 2 * args.alpha
+    regressions = []
+    print(f"{'benchmark':44} {'baseline':>12} {'current':>12} {'change':>8}  {int(confidence * 100)}% interval")
+    for name in sorted(current):
+        new = current[name]
+        base = baseline["benchmarks"].get(name)
+        if base is None:
+            print(f"{name:44} {'new':>12} {new['mean']:12.4g}")
+            continue
+        p, (lo, hi) = welch(base, new, confidence)
+        change = new["mean"] / base["mean"] - 1
+        regressed = change < -args.threshold and p < args.alpha
+        flag = "  REGRESSION" if regressed else ""
+        print(f"{name:44} {base['mean']:12.4g} {new['mean']:12.4g} {change:+8.1%}  "
+              f"[{lo / base['mean']:+.1%}, {hi / base['mean']:+.1%}]{flag}")
+        if regressed:
+            regressions.append(name)
+    for name in sorted(set(baseline["benchmarks"]) - set(current)):
+        if not args.filter:
+            print(f"{name:44} missing from this run")
+
+    if regressions:
+        print(f"\n{len(regressions)} significant regression(s): {', '.join(regressions)}")
+        return 1
+    print("\nno significant regression")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
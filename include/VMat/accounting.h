@@ -0,0 +1,251 @@
+#ifndef ACCOUNTING_H_
+#define ACCOUNTING_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * Accounting of the work the library does implicitly: matrix inversions, vector normalizations
+ * and NaN checks, attributed to the call sites that caused them.
+ *
+ * The counting is compiled in only when VMAT_ACCOUNTING is defined (CMake option
+ * VMAT_ENABLE_ACCOUNTING), otherwise VMAT_ACCOUNT() and VMAT_ACCOUNTING_SITE() expand to nothing.
+ *
+ * VMAT_ACCOUNTING_SITE( "name" ) names the call site for the rest of the scope. The library
+ * declares sites in its entry points that invert implicitly, such as the Transform setters. Work
+ * is attributed to the outermost and the innermost site open on the thread, so a site declared
+ * around a frame phase shows which entry points it called and what they cost. Site names must be
+ * string literals or otherwise outlive the accounting.
+ */
+
+#ifdef VMAT_ACCOUNTING
+#define VMAT_ACCOUNTING_CONCAT_( a, b ) a##b
+#define VMAT_ACCOUNTING_CONCAT( a, b ) VMAT_ACCOUNTING_CONCAT_( a, b )
+#define VMAT_ACCOUNT( counter ) ::vm::Account( ::vm::AccountingStats::counter )
+#define VMAT_ACCOUNTING_SITE( name ) const ::vm::AccountingSite VMAT_ACCOUNTING_CONCAT( vmatAccountingSite, __LINE__ )( name )
+#else
+#define VMAT_ACCOUNT( counter )
+#define VMAT_ACCOUNTING_SITE( name )
+#endif
+
+namespace vm
+{
+struct AccountingStats
+{
+	enum Counter
+	{
+		Inversions,		 // Matrix3x3::Inversed() and Matrix4x4::Inversed()
+		Normalizations,	 // Normalize() and Normalized() of the vector types
+		NaNChecks,		 // IsNaN(), run by the assertions of the vector types in debug builds
+		CounterCount
+	};
+
+	struct Counts
+	{
+		std::uint64_t Counters[ CounterCount ] = {};
+
+		std::uint64_t operator[]( Counter c ) const { return Counters[ c ]; }
+
+		void Merge( const Counts &c )
+		{
+			for ( int i = 0; i < CounterCount; i++ ) Counters[ i ] += c.Counters[ i ];
+		}
+	};
+
+	/**
+	 * \brief The counts by site, keyed by "outer > inner", or by the site alone when only one is
+	 * open. Work outside of any site is keyed by "(unattributed)".
+	 */
+	std::map<std::string, Counts> Sites;
+
+	std::uint64_t operator[]( Counter c ) const
+	{
+		std::uint64_t n = 0;
+		for ( const auto &s : Sites ) n += s.second[ c ];
+		return n;
+	}
+
+	void Merge( const AccountingStats &s )
+	{
+		for ( const auto &c : s.Sites ) Sites[ c.first ].Merge( c.second );
+	}
+
+	void Report( std::ostream &os ) const
+	{
+		static const char *const names[ CounterCount ] = { "inversions", "normalizations", "NaN checks" };
+		for ( int i = 0; i < CounterCount; i++ ) os << names[ i ] << ": " << ( *this )[ Counter( i ) ] << "\n";
+		for ( const auto &s : Sites ) {
+			os << "  " << s.first << ":";
+			for ( int i = 0; i < CounterCount; i++ ) {
+				if ( s.second.Counters[ i ] != 0 ) os << " " << names[ i ] << " " << s.second.Counters[ i ];
+			}
+			os << "\n";
+		}
+	}
+
+	friend std::ostream &operator<<( std::ostream &os, const AccountingStats &s )
+	{
+		s.Report( os );
+		return os;
+	}
+};
+
+namespace detail
+{
+/**
+ * \brief The open sites and the counts of one thread. The owning thread takes the uncontended
+ * mutex for every count, which is acceptable in a diagnostic build.
+ */
+struct AccountingCounters
+{
+	static constexpr int MaxDepth = 16;
+	static constexpr const char *Unattributed = "(unattributed)";
+
+	const char *Stack[ MaxDepth ] = {};
+	int Depth = 0;
+	std::mutex Mutex;
+	std::map<std::pair<const char *, const char *>, AccountingStats::Counts> Sites;
+
+	void Add( AccountingStats::Counter c )
+	{
+		const auto inner = Depth == 0 ? Unattributed : Stack[ ( std::min )( Depth, MaxDepth ) - 1 ];
+		const auto outer = Depth == 0 ? Unattributed : Stack[ 0 ];
+		std::lock_guard<std::mutex> lk( Mutex );
+		Sites[ { outer, inner } ].Counters[ c ]++;
+	}
+
+	void AddTo( AccountingStats &s, bool clear = false )
+	{
+		std::lock_guard<std::mutex> lk( Mutex );
+		for ( const auto &c : Sites ) {
+			auto key = std::string( c.first.first );
+			if ( c.first.second != c.first.first ) key += std::string( " > " ) + c.first.second;
+			s.Sites[ key ].Merge( c.second );
+		}
+		if ( clear ) Sites.clear();
+	}
+
+	void Reset()
+	{
+		std::lock_guard<std::mutex> lk( Mutex );
+		Sites.clear();
+	}
+};
+
+struct AccountingRegistry
+{
+	std::mutex Mutex;
+	std::vector<AccountingCounters *> Live;
+	AccountingStats Retired;
+
+	static AccountingRegistry &Instance()
+	{
+		static AccountingRegistry registry;
+		return registry;
+	}
+};
+
+struct ThreadAccountingCounters
+{
+	AccountingCounters Counters;
+
+	ThreadAccountingCounters()
+	{
+		auto &r = AccountingRegistry::Instance();
+		std::lock_guard<std::mutex> lk( r.Mutex );
+		r.Live.push_back( &Counters );
+	}
+
+	~ThreadAccountingCounters()
+	{
+		auto &r = AccountingRegistry::Instance();
+		std::lock_guard<std::mutex> lk( r.Mutex );
+		Counters.AddTo( r.Retired );
+		for ( auto &c : r.Live ) {
+			if ( c == &Counters ) {
+				c = r.Live.back();
+				r.Live.pop_back();
+				break;
+			}
+		}
+	}
+
+	static AccountingCounters &Get()
+	{
+		thread_local ThreadAccountingCounters counters;
+		return counters.Counters;
+	}
+};
+}  // namespace detail
+
+/**
+ * \brief Counts one unit of \a c for the sites open on the calling thread
+ */
+inline void Account( AccountingStats::Counter c )
+{
+	detail::ThreadAccountingCounters::Get().Add( c );
+}
+
+/**
+ * \brief Names the call site of the work counted during its lifetime
+ */
+class AccountingSite
+{
+public:
+	explicit AccountingSite( const char *name )
+	{
+		auto &t = detail::ThreadAccountingCounters::Get();
+		if ( t.Depth < detail::AccountingCounters::MaxDepth ) t.Stack[ t.Depth ] = name;
+		t.Depth++;
+	}
+	AccountingSite( const AccountingSite & ) = delete;
+	AccountingSite &operator=( const AccountingSite & ) = delete;
+	~AccountingSite() { detail::ThreadAccountingCounters::Get().Depth--; }
+};
+
+/**
+ * \brief The merged counts of all threads. Counts of threads still working may be partial.
+ */
+inline AccountingStats CollectAccountingStats()
+{
+	auto &r = detail::AccountingRegistry::Instance();
+	std::lock_guard<std::mutex> lk( r.Mutex );
+	auto s = r.Retired;
+	for ( const auto c : r.Live ) c->AddTo( s );
+	return s;
+}
+
+/**
+ * \brief Clears the counts of all threads
+ */
+inline void ResetAccountingStats()
+{
+	auto &r = detail::AccountingRegistry::Instance();
+	std::lock_guard<std::mutex> lk( r.Mutex );
+	r.Retired = AccountingStats();
+	for ( const auto c : r.Live ) c->Reset();
+}
+
+/**
+ * \brief Ends a frame: returns the counts since the previous call, or since the last reset, and
+ * clears them.
+ */
+inline AccountingStats EndAccountingFrame()
+{
+	auto &r = detail::AccountingRegistry::Instance();
+	std::lock_guard<std::mutex> lk( r.Mutex );
+	auto s = std::move( r.Retired );
+	r.Retired = AccountingStats();
+	for ( const auto c : r.Live ) c->AddTo( s, true );
+	return s;
+}
+
+}  // namespace vm
+
+#endif	// ACCOUNTING_H_
@@ -4,6 +4,7 @@
 #include <algorithm>
 #include <cassert>
 #include "geometry.h"
+#include "fastmath.h"
 
 /*
 	* Sample Functions
@@ -19,7 +20,9 @@ namespace vm
 		const auto y = 1 - 2 * p[0];
 		const auto r = std::sqrt(std::max(Float(0), Float(1 - y * y)));
 		const auto phi = 2 * Pi*p[1];
-		return Vector3f(r*std::cos(phi), y, r*std::sin(phi));
+		Float sinPhi, cosPhi;
+		SinCos(phi, sinPhi, cosPhi);
+		return Vector3f(r*cosPhi, y, r*sinPhi);
 	}
 
 	inline
@@ -29,7 +32,9 @@ namespace vm
 		Float y = p[0];
 		Float sinTheta = std::sqrt(std::max((Float)0, 1 - y * y));
 		Float phi = 2 * Pi*p[1];
-		return Vector3f(std::cos(phi)*sinTheta, y, std::sin(phi)*sinTheta);
+		Float sinPhi, cosPhi;
+		SinCos(phi, sinPhi, cosPhi);
+		return Vector3f(cosPhi*sinTheta, y, sinPhi*sinTheta);
 	}
 
 	inline constexpr
@@ -45,7 +50,9 @@ namespace vm
 	{
 		Float r = std::sqrt(p[0]);
 		Float theta = 2 * Pi*p[1];
-		return Point2f(r*std::sin(theta), r*std::cos(theta));
+		Float sinTheta, cosTheta;
+		SinCos(theta, sinTheta, cosTheta);
+		return Point2f(r*sinTheta, r*cosTheta);
 	}
 
 	inline
@@ -68,17 +75,28 @@ namespace vm
 			theta = (Pi/2.f) - (Pi/4.f) * (offset.x/ offset.y);
 		}
 
-		return r * Point2f(std::cos(theta),std::sin(theta));
+		Float sinTheta, cosTheta;
+		SinCos(theta, sinTheta, cosTheta);
+		return r * Point2f(cosTheta,sinTheta);
 	}
 
 	inline
 	Vector3f
 	cosineSampleHemiSphereWithShiness(const Point2f &p, Float shiness)
 	{
-		Float phi, theta;
-		phi = p[0] * 2 * Pi;
-		theta = shiness < 0 ? asin(sqrt(p[1])) : acos(pow(p[1], 1 / (shiness + 1)));
-		return Vector3f(sin(theta)*cos(phi), cos(theta), sin(theta)*sin(phi));
+		const Float phi = p[0] * 2 * Pi;
+		// theta itself is never needed, its sine and cosine follow from the inverted cdf directly
+		Float cosTheta, sinTheta;
+		if (shiness < 0) {
+			sinTheta = std::sqrt(p[1]);
+			cosTheta = std::sqrt(1 - p[1]);
+		} else {
+			cosTheta = Pow(p[1], 1 / (shiness + 1));
+			sinTheta = std::sqrt(std::max(Float(0), 1 - cosTheta * cosTheta));
+		}
+		Float sinPhi, cosPhi;
+		SinCos(phi, sinPhi, cosPhi);
+		return Vector3f(sinTheta*cosPhi, cosTheta, sinTheta*sinPhi);
 	}
 
 	inline
@@ -86,8 +104,9 @@ namespace vm
 	cosineSampleHemiSphere(const Point2f &p)
 	{
 		Point2f sampleFromDisk = uniformSampleDisk(p);
-		Float y = std::sqrt(std::max(Float(0), 1 - sampleFromDisk[0] * sampleFromDisk[0] - sampleFromDisk[1] * sampleFromDisk[1]));
-		return Vector3f(sampleFromDisk[0], y, sampleFromDisk[2]);
+		// The squared radius of the disk sample is p[0], which avoids the cancellation of 1 - x^2 - z^2 at the rim
+		Float y = std::sqrt(std::max(Float(0), 1 - p[0]));
+		return Vector3f(sampleFromDisk[0], y, sampleFromDisk[1]);
 	}
 
 	inline
@@ -104,7 +123,9 @@ namespace vm
 		Float cosTheta = (Float(1) - p[0]) + p[0] * angle;
 		Float sinTheta = std::sqrt(Float(1) - cosTheta * cosTheta);
 		Float phi = p[1] * 2 * Pi;
-		return Vector3f(std::cos(phi)*sinTheta, cosTheta, std::sin(phi)*sinTheta);
+		Float sinPhi, cosPhi;
+		SinCos(phi, sinPhi, cosPhi);
+		return Vector3f(cosPhi*sinTheta, cosTheta, sinPhi*sinTheta);
 	}
 
 	inline
@@ -251,7 +272,7 @@ namespace vm
 
 	inline
 	void
-	rungeKutta4(Point3f* x, Vector3f* v, Vector3f acc, Float dt)
+	rungeKutta4(Point3f* x, Vector3f* v, Vector3f acc, Float dt, Float damping = 0.9f)
 	{
 		Point3f p1 = *x;
 		Vector3f v1 = *v;
@@ -273,28 +294,35 @@ namespace vm
 		Vector3f vfinal = *v + (dt / 6.0) * (a1 + 2 * a2 + 2 * a3 + a4);
 
 		*x = xfinal;
-		*v = 0.9f * (vfinal);
+		*v = damping * (vfinal);
 	}
 
 	inline
 	void 
-	integrateEuler(Point3f * x, Vector3f * v, Vector3f acc, float dt) 
+	integrateEuler(Point3f * x, Vector3f * v, Vector3f acc, float dt, Float damping = 0.9f)
 	{
 		*x = *x + *v * dt;
-		*v = 0.9f* (*v + acc * dt);
+		*v = damping * (*v + acc * dt);
 	}
 
+	/*
+	 * Solves a*t^2 + b*t + c = 0, t1 receives (-b + sqrt(delta)) / 2a and t2 (-b - sqrt(delta)) / 2a.
+	 * The discriminant is computed in double, and the root whose formula would subtract nearly equal
+	 * numbers is computed as c / q instead, see Press et al., Numerical Recipes, 5.6.
+	 */
 	inline
 	bool
 	quadraticEquation(Float a, Float b, Float c, Float& t1, Float& t2)
 	{
 		if (a == 0)return false;
-		const auto delta = b * b - 4 * a * c;
+		const auto delta = double(b) * b - 4 * double(a) * c;
 		if (delta < 0)return false;
-		const auto inv = 1 / (2 * a);
 		const auto rd = std::sqrt(delta);
-		t1 = (-b + rd) * inv;
-		t2 = (-b - rd) * inv;
+		// q has the magnitude of the larger root times a, q / a and c / q are the two roots
+		const auto q = b < 0 ? -0.5 * (b - rd) : -0.5 * (b + rd);
+		const auto large = q / a, small = q == 0 ? 0.0 : c / q;
+		t1 = Float(b < 0 ? large : small);
+		t2 = Float(b < 0 ? small : large);
 		return true;
 	}
 }
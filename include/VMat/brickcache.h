@@ -0,0 +1,434 @@
+#ifndef BRICKCACHE_H_
+#define BRICKCACHE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "geometry.h"
+#include "numeric.h"
+#include "pagetable.h"
+
+namespace vm
+{
+/**
+ * \brief A read-only memory mapping of a whole file
+ */
+class MappedFile
+{
+public:
+	MappedFile() = default;
+
+	explicit MappedFile( const std::string &fileName )
+	{
+#ifdef _WIN32
+		file = CreateFileA( fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr );
+		if ( file == INVALID_HANDLE_VALUE ) throw std::runtime_error( "MappedFile: cannot open " + fileName );
+		LARGE_INTEGER size;
+		if ( !GetFileSizeEx( file, &size ) ) {
+			Close();
+			throw std::runtime_error( "MappedFile: cannot stat " + fileName );
+		}
+		mapping = CreateFileMappingA( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+		if ( mapping == nullptr ) {
+			Close();
+			throw std::runtime_error( "MappedFile: cannot map " + fileName );
+		}
+		data = static_cast<const unsigned char *>( MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 ) );
+		if ( data == nullptr ) {
+			Close();
+			throw std::runtime_error( "MappedFile: cannot map " + fileName );
+		}
+		size_ = static_cast<std::size_t>( size.QuadPart );
+#else
+		fd = open( fileName.c_str(), O_RDONLY );
+		if ( fd < 0 ) throw std::runtime_error( "MappedFile: cannot open " + fileName );
+		struct stat st;
+		if ( fstat( fd, &st ) != 0 ) {
+			Close();
+			throw std::runtime_error( "MappedFile: cannot stat " + fileName );
+		}
+		size_ = static_cast<std::size_t>( st.st_size );
+		auto p = size_ ? mmap( nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0 ) : MAP_FAILED;
+		if ( p == MAP_FAILED ) {
+			Close();
+			throw std::runtime_error( "MappedFile: cannot map " + fileName );
+		}
+		// Bricks are gathered from scattered rows, read-ahead of the kernel mostly wastes bandwidth
+		madvise( p, size_, MADV_RANDOM );
+		data = static_cast<const unsigned char *>( p );
+#endif
+	}
+
+	MappedFile( const MappedFile & ) = delete;
+	MappedFile &operator=( const MappedFile & ) = delete;
+
+	MappedFile( MappedFile &&f ) noexcept
+	{
+		*this = std::move( f );
+	}
+
+	MappedFile &operator=( MappedFile &&f ) noexcept
+	{
+		if ( this != &f ) {
+			Close();
+			std::swap( data, f.data );
+			std::swap( size_, f.size_ );
+#ifdef _WIN32
+			std::swap( file, f.file );
+			std::swap( mapping, f.mapping );
+#else
+			std::swap( fd, f.fd );
+#endif
+		}
+		return *this;
+	}
+
+	~MappedFile()
+	{
+		Close();
+	}
+
+	const unsigned char *Data() const { return data; }
+	std::size_t Size() const { return size_; }
+	bool IsOpen() const { return data != nullptr; }
+
+private:
+	void Close()
+	{
+#ifdef _WIN32
+		if ( data ) UnmapViewOfFile( data );
+		if ( mapping ) CloseHandle( mapping );
+		if ( file != INVALID_HANDLE_VALUE ) CloseHandle( file );
+		mapping = nullptr;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if ( data ) munmap( const_cast<unsigned char *>( data ), size_ );
+		if ( fd >= 0 ) close( fd );
+		fd = -1;
+#endif
+		data = nullptr;
+		size_ = 0;
+	}
+
+	const unsigned char *data = nullptr;
+	std::size_t size_ = 0;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#else
+	int fd = -1;
+#endif
+};
+
+struct BrickCacheStats
+{
+	std::uint64_t Hits = 0;
+	std::uint64_t Misses = 0;
+	std::uint64_t Evictions = 0;
+
+	double HitRate() const
+	{
+		const auto total = Hits + Misses;
+		return total ? double( Hits ) / double( total ) : 0.0;
+	}
+};
+
+/**
+ * \brief A fixed budget cache of the bricks of a raw volume file.
+ *
+ * The raw file stores the whole volume with x varying fastest. Brick (i, j, k) covers the voxels
+ * [(i, j, k) * BrickSize, (i + 1, j + 1, k + 1) * BrickSize), the part outside of the volume is zero filled.
+ * Slots are recycled with the CLOCK approximation of LRU. A brick is pinned as long as a Handle
+ * referring to it is alive and pinned bricks are never evicted.
+ *
+ * Residency is kept in a PageTable, so requests hitting the cache do not take the lock and
+ * samplers can translate voxel addresses into the slot storage directly.
+ */
+class BrickCache
+{
+	struct SlotEntry
+	{
+		std::atomic<int> Pins{ 0 };
+		std::atomic<bool> Referenced{ false };
+		Point3i Cell;
+		bool Used = false;
+	};
+
+public:
+	/**
+	 * \brief Keeps a brick resident while alive
+	 */
+	class Handle
+	{
+	public:
+		Handle() = default;
+		Handle( const Handle & ) = delete;
+		Handle &operator=( const Handle & ) = delete;
+		Handle( Handle &&h ) noexcept :
+		  cache( h.cache ), slot( h.slot ), cell( h.cell )
+		{
+			h.cache = nullptr;
+		}
+		Handle &operator=( Handle &&h ) noexcept
+		{
+			if ( this != &h ) {
+				Release();
+				cache = h.cache;
+				slot = h.slot;
+				cell = h.cell;
+				h.cache = nullptr;
+			}
+			return *this;
+		}
+		~Handle()
+		{
+			Release();
+		}
+
+		bool Valid() const { return cache != nullptr; }
+
+		/**
+		 * \brief The voxels of the brick, x varies fastest
+		 */
+		const unsigned char *Data() const
+		{
+			return cache->storage.get() + std::size_t( slot ) * cache->brickBytes;
+		}
+
+		template <typename T>
+		const T *Voxels() const
+		{
+			return reinterpret_cast<const T *>( Data() );
+		}
+
+		int Slot() const { return slot; }
+		const Point3i &CellIndex() const { return cell; }
+
+		void Release()
+		{
+			if ( cache ) cache->slots[ slot ].Pins.fetch_sub( 1, std::memory_order_release );
+			cache = nullptr;
+		}
+
+	private:
+		friend class BrickCache;
+		Handle( BrickCache *cache, int slot, const Point3i &cell ) :
+		  cache( cache ), slot( slot ), cell( cell ) {}
+		BrickCache *cache = nullptr;
+		int slot = -1;
+		Point3i cell;
+	};
+
+	/**
+	 * \param voxelBytes The size of a voxel in bytes
+	 * \param memoryBudget The bytes available for brick storage, at least one brick
+	 */
+	BrickCache( const std::string &fileName, const Size3 &volumeDimension, std::size_t voxelBytes,
+				const Vec3i &brickSize, std::size_t memoryBudget ) :
+	  VolumeDimension( volumeDimension ),
+	  BrickSize( brickSize ),
+	  GridDimension( int( RoundUpDivide( volumeDimension.x, brickSize.x ) ),
+					 int( RoundUpDivide( volumeDimension.y, brickSize.y ) ),
+					 int( RoundUpDivide( volumeDimension.z, brickSize.z ) ) ),
+	  file( fileName ),
+	  voxelBytes( voxelBytes ),
+	  brickBytes( std::size_t( brickSize.Prod() ) * voxelBytes ),
+	  table( GridDimension, brickSize )
+	{
+		if ( file.Size() < volumeDimension.Prod() * voxelBytes ) {
+			throw std::runtime_error( "BrickCache: " + fileName + " is smaller than the volume" );
+		}
+		slotCount = int( ( std::min )( memoryBudget / brickBytes, GridDimension.Prod() ) );
+		if ( slotCount == 0 ) throw std::runtime_error( "BrickCache: the memory budget is smaller than a brick" );
+		storage.reset( new unsigned char[ std::size_t( slotCount ) * brickBytes ] );
+		slots.reset( new SlotEntry[ slotCount ] );
+	}
+
+	/**
+	 * \brief Returns a pinned handle of the brick \a cell, loading it on a miss.
+	 * Throws std::runtime_error if every slot is pinned.
+	 */
+	Handle Request( const Point3i &cell )
+	{
+		auto slot = table.Lookup( cell );
+		if ( slot != PageTable::Unmapped && TryPin( cell, slot ) ) {
+			hits.fetch_add( 1, std::memory_order_relaxed );
+			return Handle( this, slot, cell );
+		}
+
+		std::lock_guard<std::mutex> lk( mutex );
+		// another thread may have loaded it meanwhile
+		slot = table.Lookup( cell );
+		if ( slot != PageTable::Unmapped && TryPin( cell, slot ) ) {
+			hits.fetch_add( 1, std::memory_order_relaxed );
+			return Handle( this, slot, cell );
+		}
+		misses.fetch_add( 1, std::memory_order_relaxed );
+		slot = Victim();
+		auto &s = slots[ slot ];
+		if ( s.Used ) evictions.fetch_add( 1, std::memory_order_relaxed );
+		Load( cell, storage.get() + std::size_t( slot ) * brickBytes );
+		s.Cell = cell;
+		s.Used = true;
+		s.Referenced.store( true, std::memory_order_relaxed );
+		s.Pins.fetch_add( 1, std::memory_order_seq_cst );
+		table.Map( cell, slot );
+		return Handle( this, slot, cell );
+	}
+
+	/**
+	 * \brief Requests the brick of every cell of \a grid entered by \a ray in traversal order
+	 * and calls \a func(const Handle &, const RayIntervalIter &) for it.
+	 * \a func may return false to stop the traversal.
+	 *
+	 * \a grid must have the same dimension as the brick grid of the cache
+	 */
+	template <typename T, typename F>
+	void RequestAlong( const Grid<T> &grid, const Ray &ray, F &&func )
+	{
+		assert( grid.GridDimension == GridDimension );
+		for ( auto iter = grid.IntersectWith( ray ); iter.Valid(); ++iter ) {
+			const auto handle = Request( iter.CellIndex );
+			if constexpr ( std::is_same<decltype( func( handle, iter ) ), bool>::value ) {
+				if ( !func( handle, iter ) ) return;
+			} else {
+				func( handle, iter );
+			}
+		}
+	}
+
+	bool Contains( const Point3i &cell ) const
+	{
+		return table.Lookup( cell ) != PageTable::Unmapped;
+	}
+
+	/**
+	 * \brief The residency of the bricks. Slot i starts at i * BrickBytes() in the storage
+	 */
+	const PageTable &Table() const { return table; }
+
+	BrickCacheStats Stats() const
+	{
+		BrickCacheStats s;
+		s.Hits = hits.load( std::memory_order_relaxed );
+		s.Misses = misses.load( std::memory_order_relaxed );
+		s.Evictions = evictions.load( std::memory_order_relaxed );
+		return s;
+	}
+
+	void ResetStats()
+	{
+		hits = 0;
+		misses = 0;
+		evictions = 0;
+	}
+
+	int SlotCount() const { return slotCount; }
+	std::size_t BrickBytes() const { return brickBytes; }
+
+	const Size3 VolumeDimension;
+	const Vec3i BrickSize;
+	const Vec3i GridDimension;
+
+private:
+	/**
+	 * \brief Pins \a slot if it still holds \a cell.
+	 *
+	 * The pin is published before the table is read again while an eviction unmaps the brick
+	 * before it reads the pins, so at least one of both sides backs off. That needs the re-read
+	 * to be ordered after the pin like a seq_cst load: the fence keeps the acquire load of
+	 * Lookup() from seeing the stale mapping on weakly ordered hardware.
+	 */
+	bool TryPin( const Point3i &cell, int slot )
+	{
+		auto &s = slots[ slot ];
+		s.Pins.fetch_add( 1, std::memory_order_seq_cst );
+		std::atomic_thread_fence( std::memory_order_seq_cst );
+		if ( table.Lookup( cell ) != slot ) {
+			s.Pins.fetch_sub( 1, std::memory_order_release );
+			return false;
+		}
+		s.Referenced.store( true, std::memory_order_relaxed );
+		return true;
+	}
+
+	/**
+	 * \brief Advances the clock hand to the first unpinned slot without a second chance left
+	 */
+	int Victim()
+	{
+		// Two sweeps clear every reference bit, a third one can only fail because of pins
+		for ( int i = 0; i < 3 * slotCount; i++ ) {
+			const auto slot = hand;
+			hand = ( hand + 1 ) % slotCount;
+			auto &s = slots[ slot ];
+			if ( s.Pins.load( std::memory_order_seq_cst ) > 0 ) continue;
+			if ( s.Used && s.Referenced.exchange( false, std::memory_order_relaxed ) ) continue;
+			if ( s.Used ) {
+				table.Unmap( s.Cell );
+				if ( s.Pins.load( std::memory_order_seq_cst ) > 0 ) {
+					// pinned by a lock-free hit in between
+					table.Map( s.Cell, slot );
+					continue;
+				}
+			}
+			return slot;
+		}
+		throw std::runtime_error( "BrickCache: every slot is pinned" );
+	}
+
+	void Load( const Point3i &cell, unsigned char *dst ) const
+	{
+		VMAT_TRACE_ZONE( "BrickCache::Load" );
+		const Size3 begin( std::size_t( cell.x ) * BrickSize.x, std::size_t( cell.y ) * BrickSize.y, std::size_t( cell.z ) * BrickSize.z );
+		const Size3 end( ( std::min )( begin.x + BrickSize.x, VolumeDimension.x ),
+						 ( std::min )( begin.y + BrickSize.y, VolumeDimension.y ),
+						 ( std::min )( begin.z + BrickSize.z, VolumeDimension.z ) );
+		const auto rowBytes = ( end.x - begin.x ) * voxelBytes;
+		const auto brickRowBytes = std::size_t( BrickSize.x ) * voxelBytes;
+		if ( end.x - begin.x < std::size_t( BrickSize.x ) || end.y - begin.y < std::size_t( BrickSize.y ) || end.z - begin.z < std::size_t( BrickSize.z ) ) {
+			std::memset( dst, 0, brickBytes );
+		}
+		for ( auto z = begin.z; z < end.z; z++ ) {
+			for ( auto y = begin.y; y < end.y; y++ ) {
+				const auto src = file.Data() + ( begin.x + VolumeDimension.x * ( y + VolumeDimension.y * z ) ) * voxelBytes;
+				const auto offset = ( ( y - begin.y ) + std::size_t( BrickSize.y ) * ( z - begin.z ) ) * brickRowBytes;
+				std::memcpy( dst + offset, src, rowBytes );
+			}
+		}
+	}
+
+	const MappedFile file;
+	const std::size_t voxelBytes;
+	const std::size_t brickBytes;
+	int slotCount = 0;
+	int hand = 0;
+	std::unique_ptr<unsigned char[]> storage;
+	std::unique_ptr<SlotEntry[]> slots;
+	PageTable table;
+	mutable std::mutex mutex;
+	std::atomic<std::uint64_t> hits{ 0 }, misses{ 0 }, evictions{ 0 };
+};
+
+}  // namespace vm
+
+#endif	// BRICKCACHE_H_
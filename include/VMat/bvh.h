@@ -0,0 +1,825 @@
+#ifndef BVH_H_
+#define BVH_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "geometry.h"
+#include "numeric.h"
+#include "parallel.h"
+
+namespace vm
+{
+/**
+ * \brief A bounding volume hierarchy over an array of primitive bounds.
+ *
+ * Nodes are stored flattened in depth-first order: the first child of an interior node directly
+ * follows it and only the offset of the second child is stored, so a node is 32 bytes and a
+ * traversal mostly walks forward in memory. Leaves refer to a range of PrimitiveIndices().
+ */
+class BVHTreeAccelerator
+{
+public:
+	struct alignas( 32 ) Node
+	{
+		Bound3f Bound;
+		union
+		{
+			int PrimitiveOffset;	// leaf
+			int SecondChildOffset;	// interior
+		};
+		std::uint16_t PrimitiveCount = 0;  // 0 for interior nodes
+		std::uint8_t Axis = 0;
+
+		bool IsLeaf() const { return PrimitiveCount > 0; }
+	};
+
+	/**
+	 * \brief The deepest hierarchy the traversal stack can hold
+	 */
+	static constexpr int MaxDepth = 64;
+
+	enum class SplitMethod
+	{
+		/**
+		 * \brief Binned SAH splits. Slower to build, faster to traverse
+		 */
+		SAH,
+		/**
+		 * \brief Splits at the Morton code prefixes of the centroids (LBVH), for data changing every frame
+		 */
+		Linear
+	};
+
+	BVHTreeAccelerator() = default;
+
+	/**
+	 * \brief Builds the hierarchy over \a count primitive bounds.
+	 *
+	 * Both methods run in parallel: the SAH build spawns threads for large subtrees and bins large
+	 * ranges with ParallelFor, the linear build sorts the Morton codes with a parallel radix sort
+	 * and creates every node independently.
+	 *
+	 * \param maxPrimitivesInNode Leaves hold at most this many primitives
+	 */
+	BVHTreeAccelerator( const Bound3f *bounds, std::size_t count, int maxPrimitivesInNode = 4, SplitMethod method = SplitMethod::SAH ) :
+	  primitiveBounds( bounds, bounds + count ),
+	  maxPrimitivesInNode( Clamp( maxPrimitivesInNode, 1, 0xffff ) ),
+	  method( method )
+	{
+		Build();
+	}
+
+	explicit BVHTreeAccelerator( const std::vector<Bound3f> &bounds, int maxPrimitivesInNode = 4, SplitMethod method = SplitMethod::SAH ) :
+	  BVHTreeAccelerator( bounds.data(), bounds.size(), maxPrimitivesInNode, method ) {}
+
+	const std::vector<Node> &Nodes() const { return nodes; }
+	const std::vector<int> &PrimitiveIndices() const { return indices; }
+	const std::vector<Bound3f> &PrimitiveBounds() const { return primitiveBounds; }
+	std::size_t PrimitiveCount() const { return primitiveBounds.size(); }
+
+	Bound3f WorldBound() const
+	{
+		return nodes.empty() ? Bound3f() : nodes[ 0 ].Bound;
+	}
+
+	/**
+	 * \brief The expected cost of a ray traversal relative to one primitive intersection,
+	 * with a node visit costing 1/8 of it
+	 */
+	Float SAHCost() const
+	{
+		const auto area = WorldBound().SurfaceArea();
+		return area > 0 ? static_cast<Float>( weightedArea / area ) : 0;
+	}
+
+	/**
+	 * \brief SAHCost() right after the last build
+	 */
+	Float BuildSAHCost() const { return buildCost; }
+
+	/**
+	 * \brief Replaces the bounds of all primitives and refits every node bottom-up.
+	 *
+	 * The depth-first layout stores every subtree contiguously with children after their parent,
+	 * so subtrees are refitted in parallel, each by a single backward sweep over its nodes.
+	 *
+	 * \param maxDegradation The hierarchy is rebuilt if SAHCost() exceeds BuildSAHCost() by more
+	 * than this fraction. The default never rebuilds.
+	 * \return true if the hierarchy was rebuilt
+	 */
+	bool Refit( const Bound3f *bounds, Float maxDegradation = MAX_VALUE )
+	{
+		std::copy( bounds, bounds + primitiveBounds.size(), primitiveBounds.begin() );
+		RefitAll();
+		return RebuildIfDegraded( maxDegradation );
+	}
+
+	/**
+	 * \brief Replaces the bounds of \a count primitives and refits only their ancestors, so the
+	 * cost scales with the number of changed primitives rather than with the scene.
+	 *
+	 * \sa Refit(const Bound3f *, Float)
+	 */
+	bool Refit( const int *primitives, const Bound3f *bounds, std::size_t count, Float maxDegradation = MAX_VALUE )
+	{
+		if ( nodes.empty() ) return false;
+		if ( ++stamp == 0 ) {
+			std::fill( dirty.begin(), dirty.end(), 0 );
+			stamp = 1;
+		}
+		std::vector<int> changed;
+		for ( std::size_t k = 0; k < count; k++ ) {
+			primitiveBounds[ primitives[ k ] ] = bounds[ k ];
+			for ( auto i = leafOf[ primitives[ k ] ]; i >= 0 && dirty[ i ] != stamp; i = parents[ i ] ) {
+				dirty[ i ] = stamp;
+				changed.push_back( i );
+			}
+		}
+		if ( changed.size() * 4 > nodes.size() ) {
+			RefitAll();
+		} else {
+			// Children follow their parent, so descending indices visit the nodes bottom-up
+			std::sort( changed.begin(), changed.end(), std::greater<int>() );
+			for ( const auto i : changed ) {
+				weightedArea -= NodeWeight( nodes[ i ] ) * nodes[ i ].Bound.SurfaceArea();
+				RefitNode( i );
+				weightedArea += NodeWeight( nodes[ i ] ) * nodes[ i ].Bound.SurfaceArea();
+			}
+		}
+		return RebuildIfDegraded( maxDegradation );
+	}
+
+	bool Refit( const std::vector<int> &primitives, const std::vector<Bound3f> &bounds, Float maxDegradation = MAX_VALUE )
+	{
+		assert( primitives.size() == bounds.size() );
+		return Refit( primitives.data(), bounds.data(), primitives.size(), maxDegradation );
+	}
+
+	/**
+	 * \brief Finds the closest intersection along \a ray.
+	 *
+	 * \a intersectPrimitive(int primitive, Float &tMax) is called for every primitive in a leaf the
+	 * ray reaches. It returns true on a hit and then shortens \a tMax to the hit distance, which
+	 * culls the nodes behind the hit.
+	 *
+	 * \return true if any primitive was hit
+	 */
+	template <typename F>
+	bool Intersect( const Ray &ray, F &&intersectPrimitive ) const
+	{
+		if ( nodes.empty() ) return false;
+		Float tMax = ray.tMax;
+		const Vec3f invDir( 1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z );
+		int stack[ MaxDepth ];
+		int top = 0, current = 0;
+		bool hit = false;
+		for ( ;; ) {
+			const auto &node = nodes[ current ];
+			if ( IntersectNode( node.Bound, ray, invDir, tMax ) ) {
+				if ( node.IsLeaf() ) {
+					for ( int i = 0; i < node.PrimitiveCount; i++ ) {
+						if ( intersectPrimitive( indices[ node.PrimitiveOffset + i ], tMax ) ) hit = true;
+					}
+					if ( top == 0 ) break;
+					current = stack[ --top ];
+				} else if ( ray.negDirection[ node.Axis ] ) {
+					// Visit the child nearer to the ray origin first
+					stack[ top++ ] = current + 1;
+					current = node.SecondChildOffset;
+				} else {
+					stack[ top++ ] = node.SecondChildOffset;
+					current = current + 1;
+				}
+			} else {
+				if ( top == 0 ) break;
+				current = stack[ --top ];
+			}
+		}
+		return hit;
+	}
+
+private:
+	struct BuildNode
+	{
+		Bound3f Bound;
+		BuildNode *Children[ 2 ] = { nullptr, nullptr };
+		int First = 0, Count = 0, Axis = 0;
+	};
+
+	/**
+	 * \brief Node storage of one build task. A deque keeps the nodes in place while it grows
+	 */
+	using Arena = std::deque<BuildNode>;
+
+	/**
+	 * \brief A primitive as seen by the builder. Records are partitioned in place, so the binning
+	 * passes stream through memory instead of chasing indices
+	 */
+	struct BuildRecord
+	{
+		Bound3f Bound;
+		int Primitive;
+
+		Float Centroid( int axis ) const { return ( Bound.min[ axis ] + Bound.max[ axis ] ) * Float( 0.5 ); }
+	};
+
+	struct BuildContext
+	{
+		std::vector<BuildRecord> Records;
+		std::mutex Mutex;
+		std::vector<std::unique_ptr<Arena>> Arenas;
+		std::atomic<std::size_t> NodeCount{ 0 };
+		int SpawnDepth = 0;
+
+		Arena *NewArena()
+		{
+			std::lock_guard<std::mutex> lk( Mutex );
+			Arenas.emplace_back( new Arena );
+			return Arenas.back().get();
+		}
+	};
+
+	static constexpr int BinCount = 16;
+	static constexpr std::size_t SmallRange = 16;
+	static constexpr std::size_t ParallelBinning = 128 * 1024;
+	static constexpr std::size_t ParallelSubtree = 16 * 1024;
+
+	/**
+	 * \brief The bound of a set of primitives and the bound of their centroids
+	 */
+	struct Extent
+	{
+		Bound3f Bound, Centroid;
+
+		void UnionWith( const Extent &e )
+		{
+			Bound = Bound.UnionWith( e.Bound );
+			Centroid = Centroid.UnionWith( e.Centroid );
+		}
+	};
+
+	struct Bins
+	{
+		Extent Bin[ BinCount ];
+		int Count[ BinCount ] = {};
+	};
+
+	static bool IntersectNode( const Bound3f &b, const Ray &ray, const Vec3f &invDir, Float tMax )
+	{
+		const auto &neg = ray.negDirection;
+		auto t0 = ( b[ neg[ 0 ] ].x - ray.o.x ) * invDir.x;
+		auto t1 = ( b[ 1 - neg[ 0 ] ].x - ray.o.x ) * invDir.x;
+		const auto ty0 = ( b[ neg[ 1 ] ].y - ray.o.y ) * invDir.y;
+		const auto ty1 = ( b[ 1 - neg[ 1 ] ].y - ray.o.y ) * invDir.y;
+		if ( t0 > ty1 || ty0 > t1 ) return false;
+		t0 = ( std::max )( t0, ty0 );
+		t1 = ( std::min )( t1, ty1 );
+		const auto tz0 = ( b[ neg[ 2 ] ].z - ray.o.z ) * invDir.z;
+		const auto tz1 = ( b[ 1 - neg[ 2 ] ].z - ray.o.z ) * invDir.z;
+		if ( t0 > tz1 || tz0 > t1 ) return false;
+		t0 = ( std::max )( t0, tz0 );
+		t1 = ( std::min )( t1, tz1 );
+		return t0 <= tMax && t1 >= 0;
+	}
+
+	/**
+	 * \brief Bound3::UnionWith in place, for the per-primitive loops of the build
+	 */
+	static void Grow( Bound3f &b, const Bound3f &a )
+	{
+		for ( int i = 0; i < 3; i++ ) {
+			b.min[ i ] = ( std::min )( b.min[ i ], a.min[ i ] );
+			b.max[ i ] = ( std::max )( b.max[ i ], a.max[ i ] );
+		}
+	}
+
+	static void Grow( Bound3f &b, const Point3f &p )
+	{
+		for ( int i = 0; i < 3; i++ ) {
+			b.min[ i ] = ( std::min )( b.min[ i ], p[ i ] );
+			b.max[ i ] = ( std::max )( b.max[ i ], p[ i ] );
+		}
+	}
+
+	/**
+	 * \brief Reduces the records [begin, end) with \a func(partial, record), in parallel for large ranges
+	 */
+	template <typename R, typename F, typename C>
+	static R Reduce( const BuildContext &ctx, std::size_t begin, std::size_t end, F &&func, C &&combine )
+	{
+		R result;
+		if ( end - begin < ParallelBinning ) {
+			for ( auto i = begin; i < end; i++ ) func( result, ctx.Records[ i ] );
+			return result;
+		}
+		const std::size_t grain = 32 * 1024;
+		std::vector<R> partial( ( end - begin + grain - 1 ) / grain );
+		ParallelFor( begin, end, grain, [ & ]( std::size_t b, std::size_t e ) {
+			auto &r = partial[ ( b - begin ) / grain ];
+			for ( auto i = b; i < e; i++ ) func( r, ctx.Records[ i ] );
+		} );
+		for ( const auto &r : partial ) combine( result, r );
+		return result;
+	}
+
+	void BuildSAH()
+	{
+		VMAT_TRACE_ZONE( "BVHTreeAccelerator::BuildSAH" );
+		nodes.clear();
+		indices.resize( primitiveBounds.size() );
+		if ( primitiveBounds.empty() ) return;
+
+		BuildContext ctx;
+		ctx.Records.resize( primitiveBounds.size() );
+		for ( std::size_t i = 0; i < primitiveBounds.size(); i++ ) {
+			ctx.Records[ i ] = BuildRecord{ primitiveBounds[ i ], static_cast<int>( i ) };
+		}
+		// Spawning stops once there are a few subtrees per hardware thread
+		for ( unsigned n = 1; n < 4 * HardwareConcurrency(); n *= 2 ) ctx.SpawnDepth++;
+
+		const auto root = BuildRange( ctx, *ctx.NewArena(), 0, primitiveBounds.size(), ComputeExtent( ctx, 0, primitiveBounds.size() ), 0 );
+		nodes.reserve( ctx.NodeCount.load() );
+		Flatten( root, 0 );
+		for ( std::size_t i = 0; i < indices.size(); i++ ) indices[ i ] = ctx.Records[ i ].Primitive;
+	}
+
+	static Extent ComputeExtent( const BuildContext &ctx, std::size_t begin, std::size_t end )
+	{
+		return Reduce<Extent>(
+		  ctx, begin, end,
+		  []( Extent &e, const BuildRecord &r ) {
+			  Grow( e.Bound, r.Bound );
+			  Grow( e.Centroid, Point3f( r.Centroid( 0 ), r.Centroid( 1 ), r.Centroid( 2 ) ) );
+		  },
+		  []( Extent &a, const Extent &b ) { a.UnionWith( b ); } );
+	}
+
+	/**
+	 * \brief Builds the subtree over the records [begin, end), whose bounds are \a extent
+	 */
+	BuildNode *BuildRange( BuildContext &ctx, Arena &arena, std::size_t begin, std::size_t end, const Extent &extent, int depth )
+	{
+		arena.emplace_back();
+		auto node = &arena.back();
+		ctx.NodeCount.fetch_add( 1, std::memory_order_relaxed );
+		const auto count = end - begin;
+		node->Bound = extent.Bound;
+
+		auto makeLeaf = [ & ]() {
+			node->First = static_cast<int>( begin );
+			node->Count = static_cast<int>( count );
+			return node;
+		};
+		if ( count == 1 ) return makeLeaf();
+
+		const auto axis = extent.Centroid.MaximumExtent();
+		const auto cmin = extent.Centroid.min[ axis ], cmax = extent.Centroid.max[ axis ];
+		auto mid = begin + count / 2;
+		Extent children[ 2 ];
+		bool childrenKnown = false;
+		const auto area = extent.Bound.SurfaceArea();
+		if ( cmax > cmin && count <= SmallRange ) {
+			// Few primitives: sorting them and sweeping every split is cheaper than binning
+			const auto first = ctx.Records.begin() + begin;
+			std::sort( first, first + count, [ axis ]( const BuildRecord &a, const BuildRecord &b ) { return a.Centroid( axis ) < b.Centroid( axis ); } );
+			Float areaAbove[ SmallRange ];
+			Bound3f acc;
+			for ( auto i = count - 1; i > 0; i-- ) {
+				acc = acc.UnionWith( first[ i ].Bound );
+				areaAbove[ i ] = acc.SurfaceArea();
+			}
+			acc = Bound3f();
+			Float minCost = MAX_VALUE;
+			std::size_t minSplit = 1;
+			for ( std::size_t i = 1; i < count; i++ ) {
+				acc = acc.UnionWith( first[ i - 1 ].Bound );
+				const auto cost = i * acc.SurfaceArea() + ( count - i ) * areaAbove[ i ];
+				if ( cost < minCost ) {
+					minCost = cost;
+					minSplit = i;
+				}
+			}
+			const auto splitCost = Float( 0.125 ) + ( area > 0 ? minCost / area : Float( count ) );
+			if ( count <= std::size_t( maxPrimitivesInNode ) && splitCost >= count ) return makeLeaf();
+			mid = begin + minSplit;
+		} else if ( cmax > cmin ) {
+			const auto scale = BinCount / ( cmax - cmin );
+			auto binOf = [ & ]( const BuildRecord &r ) {
+				return ( std::min )( BinCount - 1, static_cast<int>( ( r.Centroid( axis ) - cmin ) * scale ) );
+			};
+			const auto bins = Reduce<Bins>(
+			  ctx, begin, end,
+			  [ & ]( Bins &b, const BuildRecord &r ) {
+				  const auto i = binOf( r );
+				  b.Count[ i ]++;
+				  Grow( b.Bin[ i ].Bound, r.Bound );
+				  Grow( b.Bin[ i ].Centroid, Point3f( r.Centroid( 0 ), r.Centroid( 1 ), r.Centroid( 2 ) ) );
+			  },
+			  []( Bins &a, const Bins &b ) {
+				  for ( int i = 0; i < BinCount; i++ ) {
+					  a.Count[ i ] += b.Count[ i ];
+					  a.Bin[ i ].UnionWith( b.Bin[ i ] );
+				  }
+			  } );
+
+			// Sweep from the right to get the area and count above each split, then from the left
+			Float areaAbove[ BinCount ];
+			int countAbove[ BinCount ];
+			Bound3f acc;
+			int n = 0;
+			for ( int i = BinCount - 1; i > 0; i-- ) {
+				acc = acc.UnionWith( bins.Bin[ i ].Bound );
+				n += bins.Count[ i ];
+				areaAbove[ i ] = acc.SurfaceArea();
+				countAbove[ i ] = n;
+			}
+			acc = Bound3f();
+			n = 0;
+			Float minCost = MAX_VALUE;
+			int minSplit = 0;
+			for ( int i = 0; i < BinCount - 1; i++ ) {
+				acc = acc.UnionWith( bins.Bin[ i ].Bound );
+				n += bins.Count[ i ];
+				const auto cost = n * acc.SurfaceArea() + countAbove[ i + 1 ] * areaAbove[ i + 1 ];
+				if ( cost < minCost ) {
+					minCost = cost;
+					minSplit = i;
+				}
+			}
+
+			// Costs relative to one primitive intersection, a node visit costs 1/8 of it
+			const auto splitCost = Float( 0.125 ) + ( area > 0 ? minCost / area : Float( count ) );
+			if ( count <= std::size_t( maxPrimitivesInNode ) && splitCost >= count ) return makeLeaf();
+			const auto first = ctx.Records.begin();
+			mid = std::partition( first + begin, first + end, [ & ]( const BuildRecord &r ) { return binOf( r ) <= minSplit; } ) - first;
+			if ( mid == begin || mid == end ) {
+				mid = begin + count / 2;
+			} else {
+				for ( int i = 0; i < BinCount; i++ ) children[ i > minSplit ].UnionWith( bins.Bin[ i ] );
+				childrenKnown = true;
+			}
+		} else if ( count <= std::size_t( maxPrimitivesInNode ) ) {
+			return makeLeaf();
+		}
+		if ( !childrenKnown ) {
+			children[ 0 ] = ComputeExtent( ctx, begin, mid );
+			children[ 1 ] = ComputeExtent( ctx, mid, end );
+		}
+
+		node->Axis = axis;
+		if ( depth < ctx.SpawnDepth && count >= ParallelSubtree ) {
+			auto &leftArena = *ctx.NewArena();
+			std::exception_ptr error;
+			std::thread left( [ & ]() {
+				try {
+					node->Children[ 0 ] = BuildRange( ctx, leftArena, begin, mid, children[ 0 ], depth + 1 );
+				} catch ( ... ) {
+					error = std::current_exception();
+				}
+			} );
+			try {
+				node->Children[ 1 ] = BuildRange( ctx, arena, mid, end, children[ 1 ], depth + 1 );
+			} catch ( ... ) {
+				left.join();
+				throw;
+			}
+			left.join();
+			if ( error ) std::rethrow_exception( error );
+		} else {
+			node->Children[ 0 ] = BuildRange( ctx, arena, begin, mid, children[ 0 ], depth + 1 );
+			node->Children[ 1 ] = BuildRange( ctx, arena, mid, end, children[ 1 ], depth + 1 );
+		}
+		return node;
+	}
+
+	void Build()
+	{
+		if ( method == SplitMethod::Linear )
+			BuildLinear();
+		else
+			BuildSAH();
+
+		// Links for refitting: the parent of every node and the leaf of every primitive
+		parents.assign( nodes.size(), -1 );
+		leafOf.assign( primitiveBounds.size(), -1 );
+		dirty.assign( nodes.size(), 0 );
+		stamp = 0;
+		ParallelFor( 0, nodes.size(), 16 * 1024, [ & ]( std::size_t b, std::size_t e ) {
+			for ( auto i = b; i < e; i++ ) {
+				const auto &node = nodes[ i ];
+				if ( node.IsLeaf() ) {
+					for ( int k = 0; k < node.PrimitiveCount; k++ ) leafOf[ indices[ node.PrimitiveOffset + k ] ] = static_cast<int>( i );
+				} else {
+					parents[ i + 1 ] = parents[ node.SecondChildOffset ] = static_cast<int>( i );
+				}
+			}
+		} );
+		weightedArea = 0;
+		for ( const auto &node : nodes ) weightedArea += NodeWeight( node ) * node.Bound.SurfaceArea();
+		buildCost = SAHCost();
+	}
+
+	static double NodeWeight( const Node &node )
+	{
+		return node.IsLeaf() ? node.PrimitiveCount : 0.125;
+	}
+
+	void RefitNode( std::size_t i )
+	{
+		auto &node = nodes[ i ];
+		if ( node.IsLeaf() ) {
+			Bound3f b;
+			for ( int k = 0; k < node.PrimitiveCount; k++ ) Grow( b, primitiveBounds[ indices[ node.PrimitiveOffset + k ] ] );
+			node.Bound = b;
+		} else {
+			node.Bound = nodes[ i + 1 ].Bound.UnionWith( nodes[ node.SecondChildOffset ].Bound );
+		}
+	}
+
+	void RefitAll()
+	{
+		VMAT_TRACE_ZONE( "BVHTreeAccelerator::RefitAll" );
+		if ( nodes.empty() ) return;
+		// Split the tree into subtrees of at most this many nodes plus the nodes above them
+		const auto maxSubtree = ( std::max )( nodes.size() / ( 4 * HardwareConcurrency() ), std::size_t( 1024 ) );
+		std::vector<std::pair<std::size_t, std::size_t>> subtrees;
+		std::vector<std::size_t> top;
+		auto split = [ & ]( std::size_t i, std::size_t end, auto &&self ) -> void {
+			if ( end - i <= maxSubtree || nodes[ i ].IsLeaf() ) {
+				subtrees.emplace_back( i, end );
+				return;
+			}
+			top.push_back( i );
+			const std::size_t second = nodes[ i ].SecondChildOffset;
+			self( i + 1, second, self );
+			self( second, end, self );
+		};
+		split( 0, nodes.size(), split );
+
+		std::vector<double> partial( subtrees.size() );
+		ParallelFor( 0, subtrees.size(), 1, [ & ]( std::size_t b, std::size_t e ) {
+			for ( auto s = b; s < e; s++ ) {
+				double sum = 0;
+				for ( auto i = subtrees[ s ].second; i-- > subtrees[ s ].first; ) {
+					RefitNode( i );
+					sum += NodeWeight( nodes[ i ] ) * nodes[ i ].Bound.SurfaceArea();
+				}
+				partial[ s ] = sum;
+			}
+		} );
+		weightedArea = 0;
+		for ( const auto p : partial ) weightedArea += p;
+		for ( auto it = top.rbegin(); it != top.rend(); ++it ) {
+			RefitNode( *it );
+			weightedArea += NodeWeight( nodes[ *it ] ) * nodes[ *it ].Bound.SurfaceArea();
+		}
+	}
+
+	bool RebuildIfDegraded( Float maxDegradation )
+	{
+		if ( nodes.empty() || SAHCost() <= buildCost * ( 1 + maxDegradation ) ) return false;
+		Build();
+		return true;
+	}
+
+	/**
+	 * \brief An internal node of the linear build. Children are internal node indices, or the
+	 * complement of a leaf index for single primitives
+	 */
+	struct LinearNode
+	{
+		Bound3f Bound;
+		int Children[ 2 ];
+		int First, Last;
+		int Axis;
+		int NodeCount;	// of the flattened subtree
+	};
+
+	void BuildLinear()
+	{
+		VMAT_TRACE_ZONE( "BVHTreeAccelerator::BuildLinear" );
+		nodes.clear();
+		const auto n = primitiveBounds.size();
+		indices.resize( n );
+		if ( n == 0 ) return;
+		if ( n == 1 ) {
+			indices[ 0 ] = 0;
+			nodes.emplace_back();
+			nodes[ 0 ].Bound = primitiveBounds[ 0 ];
+			nodes[ 0 ].PrimitiveOffset = 0;
+			nodes[ 0 ].PrimitiveCount = 1;
+			return;
+		}
+		const std::size_t grain = 16 * 1024;
+
+		// Quantize the centroids to 10 bits per axis within their bound
+		std::vector<Bound3f> partial( ( n + grain - 1 ) / grain );
+		ParallelFor( 0, n, grain, [ & ]( std::size_t b, std::size_t e ) {
+			auto &r = partial[ b / grain ];
+			for ( auto i = b; i < e; i++ ) Grow( r, primitiveBounds[ i ].Center() );
+		} );
+		Bound3f centroidBound;
+		for ( const auto &r : partial ) centroidBound = centroidBound.UnionWith( r );
+		const auto extent = centroidBound.Diagonal();
+		Float scale[ 3 ];
+		for ( int a = 0; a < 3; a++ ) scale[ a ] = extent[ a ] > 0 ? Float( 1023.99 ) / extent[ a ] : 0;
+
+		// Each key holds the Morton code above the primitive index, which also breaks ties
+		std::vector<std::uint64_t> keys( n );
+		ParallelFor( 0, n, grain, [ & ]( std::size_t b, std::size_t e ) {
+			for ( auto i = b; i < e; i++ ) {
+				const auto c = primitiveBounds[ i ].Center();
+				std::uint32_t q[ 3 ];
+				for ( int a = 0; a < 3; a++ ) q[ a ] = static_cast<std::uint32_t>( ( c[ a ] - centroidBound.min[ a ] ) * scale[ a ] );
+				keys[ i ] = ( std::uint64_t( EncodeMorton3( q[ 0 ], q[ 1 ], q[ 2 ] ) ) << 32 ) | i;
+			}
+		} );
+		ParallelRadixSort( keys, 30, []( std::uint64_t k ) { return static_cast<std::uint32_t>( k >> 32 ); } );
+		ParallelFor( 0, n, grain, [ & ]( std::size_t b, std::size_t e ) {
+			for ( auto i = b; i < e; i++ ) indices[ i ] = static_cast<int>( keys[ i ] & 0xffffffff );
+		} );
+
+		// Karras, "Maximizing Parallelism in the Construction of BVHs, Octrees, and k-d Trees", 2012.
+		// Node i covers a range of sorted leaves starting or ending at leaf i, split where the
+		// common prefix of the codes gets longer, so every node is found independently.
+		const auto count = static_cast<int>( n );
+		auto delta = [ & ]( int i, int j ) {
+			if ( j < 0 || j >= count ) return -1;
+			const auto ci = static_cast<std::uint32_t>( keys[ i ] >> 32 ), cj = static_cast<std::uint32_t>( keys[ j ] >> 32 );
+			if ( ci == cj ) return 32 + CountLeadingZeros( std::uint32_t( i ) ^ std::uint32_t( j ) );
+			return CountLeadingZeros( ci ^ cj );
+		};
+		std::vector<LinearNode> internal( n - 1 );
+		std::vector<int> internalParent( n - 1, -1 ), leafParent( n );
+		ParallelFor( 0, n - 1, grain, [ & ]( std::size_t b, std::size_t e ) {
+			for ( auto k = b; k < e; k++ ) {
+				const auto i = static_cast<int>( k );
+				const auto d = delta( i, i + 1 ) > delta( i, i - 1 ) ? 1 : -1;
+				const auto deltaMin = delta( i, i - d );
+				int lMax = 2;
+				while ( delta( i, i + lMax * d ) > deltaMin ) lMax *= 2;
+				int l = 0;
+				for ( auto t = lMax / 2; t >= 1; t /= 2 ) {
+					if ( delta( i, i + ( l + t ) * d ) > deltaMin ) l += t;
+				}
+				const auto j = i + l * d;
+				const auto deltaNode = delta( i, j );
+				int s = 0, t, div = 2;
+				do {
+					t = ( l + div - 1 ) / div;
+					if ( delta( i, i + ( s + t ) * d ) > deltaNode ) s += t;
+					div *= 2;
+				} while ( t > 1 );
+				const auto split = i + s * d + ( std::min )( d, 0 );
+
+				auto &node = internal[ i ];
+				node.First = ( std::min )( i, j );
+				node.Last = ( std::max )( i, j );
+				// Morton bit 3k + a belongs to axis a
+				node.Axis = deltaNode < 32 ? ( 31 - deltaNode ) % 3 : 0;
+				if ( node.First == split ) {
+					node.Children[ 0 ] = ~split;
+					leafParent[ split ] = i;
+				} else {
+					node.Children[ 0 ] = split;
+					internalParent[ split ] = i;
+				}
+				if ( node.Last == split + 1 ) {
+					node.Children[ 1 ] = ~( split + 1 );
+					leafParent[ split + 1 ] = i;
+				} else {
+					node.Children[ 1 ] = split + 1;
+					internalParent[ split + 1 ] = i;
+				}
+			}
+		} );
+
+		// Fit the bounds bottom-up: the second child to finish continues with the parent
+		std::unique_ptr<std::atomic<int>[]> arrivals( new std::atomic<int>[ n - 1 ] );
+		for ( std::size_t i = 0; i < n - 1; i++ ) arrivals[ i ].store( 0, std::memory_order_relaxed );
+		auto subtree = [ & ]( int child, Bound3f &bound ) {
+			if ( child < 0 ) {
+				bound = primitiveBounds[ indices[ ~child ] ];
+				return 1;
+			}
+			bound = internal[ child ].Bound;
+			return internal[ child ].NodeCount;
+		};
+		ParallelFor( 0, n, grain, [ & ]( std::size_t b, std::size_t e ) {
+			for ( auto leaf = b; leaf < e; leaf++ ) {
+				auto i = leafParent[ leaf ];
+				while ( i >= 0 && arrivals[ i ].fetch_add( 1, std::memory_order_acq_rel ) == 1 ) {
+					auto &node = internal[ i ];
+					Bound3f left, right;
+					const auto nodeCount = subtree( node.Children[ 0 ], left ) + subtree( node.Children[ 1 ], right );
+					node.Bound = left.UnionWith( right );
+					node.NodeCount = node.Last - node.First < maxPrimitivesInNode ? 1 : 1 + nodeCount;
+					i = internalParent[ i ];
+				}
+			}
+		} );
+
+		nodes.resize( internal[ 0 ].NodeCount );
+		int spawnDepth = 0;
+		for ( unsigned c = 1; c < 4 * HardwareConcurrency(); c *= 2 ) spawnDepth++;
+		EmitLinear( internal, 0, 0, 0, spawnDepth );
+	}
+
+	/**
+	 * \brief Writes the subtree of internal node \a i to the flattened nodes from \a offset on.
+	 * Subtree sizes are known, so both children can be written concurrently
+	 */
+	void EmitLinear( const std::vector<LinearNode> &internal, int i, int offset, int depth, int spawnDepth )
+	{
+		assert( depth < MaxDepth && "BVHTreeAccelerator: the hierarchy is too deep" );
+		const auto &src = internal[ i ];
+		auto &node = nodes[ offset ];
+		node.Bound = src.Bound;
+		if ( src.Last - src.First < maxPrimitivesInNode ) {
+			node.PrimitiveOffset = src.First;
+			node.PrimitiveCount = static_cast<std::uint16_t>( src.Last - src.First + 1 );
+			return;
+		}
+		node.Axis = static_cast<std::uint8_t>( src.Axis );
+		int childOffset[ 2 ];
+		childOffset[ 0 ] = offset + 1;
+		childOffset[ 1 ] = offset + 1 + ( src.Children[ 0 ] < 0 ? 1 : internal[ src.Children[ 0 ] ].NodeCount );
+		node.SecondChildOffset = childOffset[ 1 ];
+
+		auto emit = [ & ]( int c ) {
+			const auto child = src.Children[ c ];
+			if ( child >= 0 ) {
+				EmitLinear( internal, child, childOffset[ c ], depth + 1, spawnDepth );
+				return;
+			}
+			auto &leaf = nodes[ childOffset[ c ] ];
+			leaf.Bound = primitiveBounds[ indices[ ~child ] ];
+			leaf.PrimitiveOffset = ~child;
+			leaf.PrimitiveCount = 1;
+		};
+		if ( depth < spawnDepth && src.Last - src.First >= int( ParallelSubtree ) ) {
+			std::exception_ptr error;
+			std::thread left( [ & ]() {
+				try {
+					emit( 0 );
+				} catch ( ... ) {
+					error = std::current_exception();
+				}
+			} );
+			try {
+				emit( 1 );
+			} catch ( ... ) {
+				left.join();
+				throw;
+			}
+			left.join();
+			if ( error ) std::rethrow_exception( error );
+		} else {
+			emit( 0 );
+			emit( 1 );
+		}
+	}
+
+	int Flatten( const BuildNode *node, int depth )
+	{
+		assert( depth < MaxDepth && "BVHTreeAccelerator: the hierarchy is too deep" );
+		const auto offset = static_cast<int>( nodes.size() );
+		nodes.emplace_back();
+		nodes[ offset ].Bound = node->Bound;
+		if ( node->Children[ 0 ] == nullptr ) {
+			nodes[ offset ].PrimitiveOffset = node->First;
+			nodes[ offset ].PrimitiveCount = static_cast<std::uint16_t>( node->Count );
+		} else {
+			nodes[ offset ].Axis = static_cast<std::uint8_t>( node->Axis );
+			Flatten( node->Children[ 0 ], depth + 1 );
+			const auto second = Flatten( node->Children[ 1 ], depth + 1 );
+			nodes[ offset ].SecondChildOffset = second;
+		}
+		return offset;
+	}
+
+	std::vector<Bound3f> primitiveBounds;
+	std::vector<Node> nodes;
+	std::vector<int> indices;
+	int maxPrimitivesInNode = 4;
+	SplitMethod method = SplitMethod::SAH;
+
+	std::vector<int> parents, leafOf;
+	std::vector<std::uint32_t> dirty;
+	std::uint32_t stamp = 0;
+	double weightedArea = 0;
+	Float buildCost = 0;
+};
+
+}  // namespace vm
+
+#endif	// BVH_H_
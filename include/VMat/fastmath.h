@@ -0,0 +1,293 @@
+#ifndef FASTMATH_H_
+#define FASTMATH_H_
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#include "geometry.h"
+#include "simd.h"
+
+/*
+ * Polynomial approximations of the transcendental functions used in the sampling and transform
+ * helpers, each in a scalar and an 8-wide form computing the same polynomials.
+ *
+ * The error bounds are measured against the correctly rounded result, in units in the last place:
+ *   FastSinCos  absolute error below 2.5e-7 for |x| <= 8192, at most 2 ulp on [-pi, pi]
+ *   FastAcos    at most 3 ulp on [-1, 1]
+ *   FastExp2    at most 2 ulp on [-126, 128), 0 below and infinity above
+ *   FastLog2    at most 2.5 ulp for normal positive x, -infinity below FLT_MIN and NaN below 0
+ *   FastPow     at most 2 + |y * log2(x)| ulp for x > 0, pow(0, y) = 0
+ *   FastRsqrt   at most 4 ulp, one Newton step on the hardware estimate with AVX2, otherwise
+ *               1 / sqrt(x) within 1 ulp
+ *
+ * Define VMAT_FAST_MATH (CMake option VMAT_ENABLE_FAST_MATH) to route SinCos(), Acos(), Pow()
+ * and Rsqrt(), and through them the helpers of arithmetic.h and transformation.h, to these
+ * kernels instead of <cmath>.
+ */
+
+namespace vm
+{
+static_assert( sizeof( Float ) == sizeof( std::uint32_t ), "the kernels operate on the bits of single precision floats" );
+
+namespace detail
+{
+inline std::uint32_t FloatBits( float f )
+{
+	std::uint32_t u;
+	std::memcpy( &u, &f, sizeof( u ) );
+	return u;
+}
+
+inline float BitsToFloat( std::uint32_t u )
+{
+	float f;
+	std::memcpy( &f, &u, sizeof( f ) );
+	return f;
+}
+}  // namespace detail
+
+inline void FastSinCos( Float x, Float &sinX, Float &cosX )
+{
+	const auto j = std::floor( x * 0.636619772367581343f + 0.5f );
+	auto r = x - j * 1.5703125f;
+	r = r - j * 4.837512969970703125e-4f;
+	r = r - j * 7.54978995489188216e-8f;
+	const auto r2 = r * r;
+	const auto s = ( ( -1.9515295891e-4f * r2 + 8.3321608736e-3f ) * r2 - 1.6666654611e-1f ) * r2 * r + r;
+	const auto c = ( ( 2.443315711809948e-5f * r2 - 1.388731625493765e-3f ) * r2 + 4.166664568298827e-2f ) * r2 * r2 + ( 1.f - 0.5f * r2 );
+	const auto q = static_cast<std::int32_t>( j ) & 3;
+	const auto sv = q & 1 ? c : s, cv = q & 1 ? s : c;
+	sinX = q & 2 ? -sv : sv;
+	cosX = ( q + 1 ) & 2 ? -cv : cv;
+}
+
+inline void FastSinCos( const Float8 &x, Float8 &sinX, Float8 &cosX )
+{
+	SinCos( x, sinX, cosX );
+}
+
+/**
+ * \brief The polynomial of Abramowitz and Stegun 4.4.46, acos(x) = sqrt(1 - x) * p(x) on [0, 1]
+ */
+inline Float FastAcos( Float x )
+{
+	const auto a = std::abs( x );
+	auto p = -0.0012624911f;
+	p = p * a + 0.0066700901f;
+	p = p * a - 0.0170881256f;
+	p = p * a + 0.0308918810f;
+	p = p * a - 0.0501743046f;
+	p = p * a + 0.0889789874f;
+	p = p * a - 0.2145988016f;
+	p = p * a + 1.5707963050f;
+	const auto r = std::sqrt( 1 - a ) * p;
+	return x < 0 ? Float( Pi ) - r : r;
+}
+
+inline Float8 FastAcos( const Float8 &x )
+{
+	const auto a = Abs( x );
+	auto p = MulAdd( Float8( -0.0012624911f ), a, Float8( 0.0066700901f ) );
+	p = MulAdd( p, a, Float8( -0.0170881256f ) );
+	p = MulAdd( p, a, Float8( 0.0308918810f ) );
+	p = MulAdd( p, a, Float8( -0.0501743046f ) );
+	p = MulAdd( p, a, Float8( 0.0889789874f ) );
+	p = MulAdd( p, a, Float8( -0.2145988016f ) );
+	p = MulAdd( p, a, Float8( 1.5707963050f ) );
+	const auto r = Sqrt( Float8( 1.f ) - a ) * p;
+	return Select( x < Float8::Zero(), Float8( Pi ) - r, r );
+}
+
+/**
+ * \brief 2^x from the Cephes exp2f polynomial on [-0.5, 0.5] and an exponent built from the bits.
+ * The power of two is applied in two halves so that the whole normal range is reached.
+ */
+inline Float FastExp2( Float x )
+{
+	if ( x >= 128 ) return std::numeric_limits<Float>::infinity();
+	if ( x < -126 ) return 0;
+	const auto i = std::floor( x + 0.5f );
+	const auto f = x - i;
+	auto p = 1.535336188319500e-4f;
+	p = p * f + 1.339887440266574e-3f;
+	p = p * f + 9.618437357674640e-3f;
+	p = p * f + 5.550332471162809e-2f;
+	p = p * f + 2.402264791363012e-1f;
+	p = p * f + 6.931472028550421e-1f;
+	p = p * f + 1.f;
+	const auto n = static_cast<std::int32_t>( i );
+	const auto h = ( ( n + 256 ) >> 1 ) - 128;
+	return p * detail::BitsToFloat( std::uint32_t( h + 127 ) << 23 ) * detail::BitsToFloat( std::uint32_t( n - h + 127 ) << 23 );
+}
+
+inline Float8 FastExp2( const Float8 &x )
+{
+	const auto xc = Min( Max( x, Float8( -126.f ) ), Float8( 128.f ) );
+	const auto i = Floor( xc + Float8( 0.5f ) );
+	const auto f = xc - i;
+	auto p = MulAdd( Float8( 1.535336188319500e-4f ), f, Float8( 1.339887440266574e-3f ) );
+	p = MulAdd( p, f, Float8( 9.618437357674640e-3f ) );
+	p = MulAdd( p, f, Float8( 5.550332471162809e-2f ) );
+	p = MulAdd( p, f, Float8( 2.402264791363012e-1f ) );
+	p = MulAdd( p, f, Float8( 6.931472028550421e-1f ) );
+	p = MulAdd( p, f, Float8( 1.f ) );
+	const auto n = ToInt8( i );
+	const auto h = ( ( n + Int8( 256 ) ) >> 1 ) - Int8( 128 );
+	const auto r = p * AsFloat8( ( h + Int8( 127 ) ) << 23 ) * AsFloat8( ( n - h + Int8( 127 ) ) << 23 );
+	const auto inf = Float8( std::numeric_limits<float>::infinity() );
+	return Select( x >= Float8( 128.f ), inf, Select( x < Float8( -126.f ), Float8::Zero(), r ) );
+}
+
+/**
+ * \brief log2(x) as the exponent plus the Cephes logf polynomial of the mantissa, which is
+ * taken from (sqrt(1/2), sqrt(2)]
+ */
+inline Float FastLog2( Float x )
+{
+	if ( !( x > 0 ) ) return x == 0 ? -std::numeric_limits<Float>::infinity() : std::numeric_limits<Float>::quiet_NaN();
+	if ( x < std::numeric_limits<Float>::min() ) return -std::numeric_limits<Float>::infinity();
+	if ( x == std::numeric_limits<Float>::infinity() ) return x;
+	const auto bits = detail::FloatBits( x );
+	auto e = static_cast<std::int32_t>( ( bits >> 23 ) & 0xff ) - 127;
+	auto m = detail::BitsToFloat( ( bits & 0x007fffff ) | 0x3f800000 );
+	if ( m > 1.41421356f ) {
+		m *= 0.5f;
+		e++;
+	}
+	const auto t = m - 1;
+	const auto z = t * t;
+	auto p = 7.0376836292e-2f;
+	p = p * t - 1.1514610310e-1f;
+	p = p * t + 1.1676998740e-1f;
+	p = p * t - 1.2420140846e-1f;
+	p = p * t + 1.4249322787e-1f;
+	p = p * t - 1.6668057665e-1f;
+	p = p * t + 2.0000714765e-1f;
+	p = p * t - 2.4999993993e-1f;
+	p = p * t + 3.3333331174e-1f;
+	const auto y = p * t * z - 0.5f * z;
+	return t * 1.44269504f + y * 1.44269504f + Float( e );
+}
+
+inline Float8 FastLog2( const Float8 &x )
+{
+	const auto bits = AsInt8( x );
+	auto e = ( ( bits >> 23 ) & Int8( 0xff ) ) - Int8( 127 );
+	auto m = AsFloat8( ( bits & Int8( 0x007fffff ) ) | Int8( 0x3f800000 ) );
+	const auto big = m > Float8( 1.41421356f );
+	m = Select( big, m * Float8( 0.5f ), m );
+	e = Select( big, e + Int8( 1 ), e );
+	const auto t = m - Float8( 1.f );
+	const auto z = t * t;
+	auto p = MulAdd( Float8( 7.0376836292e-2f ), t, Float8( -1.1514610310e-1f ) );
+	p = MulAdd( p, t, Float8( 1.1676998740e-1f ) );
+	p = MulAdd( p, t, Float8( -1.2420140846e-1f ) );
+	p = MulAdd( p, t, Float8( 1.4249322787e-1f ) );
+	p = MulAdd( p, t, Float8( -1.6668057665e-1f ) );
+	p = MulAdd( p, t, Float8( 2.0000714765e-1f ) );
+	p = MulAdd( p, t, Float8( -2.4999993993e-1f ) );
+	p = MulAdd( p, t, Float8( 3.3333331174e-1f ) );
+	const auto y = p * t * z - Float8( 0.5f ) * z;
+	const auto r = t * Float8( 1.44269504f ) + y * Float8( 1.44269504f ) + ToFloat8( e );
+
+	const auto inf = Float8( std::numeric_limits<float>::infinity() );
+	const auto tiny = x < Float8( std::numeric_limits<float>::min() );
+	const auto nan = Float8( std::numeric_limits<float>::quiet_NaN() );
+	return Select( x < Float8::Zero(), nan, Select( tiny, -inf, Select( x == inf, inf, r ) ) );
+}
+
+inline Float FastPow( Float x, Float y )
+{
+	return x == 0 ? Float( 0 ) : FastExp2( y * FastLog2( x ) );
+}
+
+inline Float8 FastPow( const Float8 &x, const Float8 &y )
+{
+	return Select( x == Float8::Zero(), Float8::Zero(), FastExp2( y * FastLog2( x ) ) );
+}
+
+inline Float FastRsqrt( Float x )
+{
+#ifdef VMAT_SIMD_AVX2
+	// The scalar form of the estimate RsqrtApprox() uses for the 8-wide form
+	const auto y = _mm_cvtss_f32( _mm_rsqrt_ss( _mm_set_ss( x ) ) );
+	return y * ( 1.5f - 0.5f * x * y * y );
+#else
+	return 1.f / std::sqrt( x );
+#endif
+}
+
+inline Float8 FastRsqrt( const Float8 &x )
+{
+#ifdef VMAT_SIMD_AVX2
+	const auto y = RsqrtApprox( x );
+	return y * ( Float8( 1.5f ) - Float8( 0.5f ) * x * y * y );
+#else
+	Float8 r;
+	for ( int i = 0; i < 8; i++ ) r.v[ i ] = FastRsqrt( x.v[ i ] );
+	return r;
+#endif
+}
+
+inline Vector3f FastNormalized( const Vector3f &v )
+{
+	return v * FastRsqrt( v.LengthSquared() );
+}
+
+/**
+ * \brief Normalizes 8 vectors in SoA layout
+ */
+inline void FastNormalize( Float8 &x, Float8 &y, Float8 &z )
+{
+	const auto s = FastRsqrt( MulAdd( x, x, MulAdd( y, y, z * z ) ) );
+	x = x * s;
+	y = y * s;
+	z = z * s;
+}
+
+/*
+ * The functions used by the helpers, fast with VMAT_FAST_MATH and from <cmath> otherwise
+ */
+
+inline void SinCos( Float x, Float &sinX, Float &cosX )
+{
+#ifdef VMAT_FAST_MATH
+	FastSinCos( x, sinX, cosX );
+#else
+	sinX = std::sin( x );
+	cosX = std::cos( x );
+#endif
+}
+
+inline Float Acos( Float x )
+{
+#ifdef VMAT_FAST_MATH
+	return FastAcos( x );
+#else
+	return std::acos( x );
+#endif
+}
+
+inline Float Pow( Float x, Float y )
+{
+#ifdef VMAT_FAST_MATH
+	return FastPow( x, y );
+#else
+	return std::pow( x, y );
+#endif
+}
+
+inline Float Rsqrt( Float x )
+{
+#ifdef VMAT_FAST_MATH
+	return FastRsqrt( x );
+#else
+	return 1 / std::sqrt( x );
+#endif
+}
+
+}  // namespace vm
+
+#endif	// FASTMATH_H_
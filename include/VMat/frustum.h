@@ -0,0 +1,233 @@
+#ifndef FRUSTUM_H_
+#define FRUSTUM_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "geometry.h"
+#include "transformation.h"
+#include "simd.h"
+
+namespace vm
+{
+/**
+ * \brief The plane Dot(Normal, p) + D = 0. Points with a non-negative signed distance are in front of it.
+ */
+class Plane
+{
+public:
+	Vec3f Normal;
+	Float D = 0;
+
+	Plane() = default;
+	Plane( const Vec3f &normal, Float d ) :
+	  Normal( normal ), D( d ) {}
+	Plane( const Vec3f &normal, const Point3f &p ) :
+	  Normal( normal ), D( -Vec3f::Dot( normal, p.ToVector3() ) ) {}
+
+	Float SignedDistance( const Point3f &p ) const
+	{
+		return Normal.x * p.x + Normal.y * p.y + Normal.z * p.z + D;
+	}
+
+	void Normalize()
+	{
+		const auto inv = 1 / Normal.Length();
+		Normal *= inv;
+		D *= inv;
+	}
+};
+
+enum class CullResult : std::uint8_t
+{
+	Outside,
+	Intersect,
+	Inside
+};
+
+/**
+ * \brief The six planes bounding a view volume, all facing inward
+ */
+class Frustum
+{
+public:
+	enum PlaneIndex
+	{
+		Left,
+		Right,
+		Bottom,
+		Top,
+		Near,
+		Far
+	};
+
+	Plane Planes[ 6 ];
+
+	Frustum() = default;
+
+	/**
+	 * \brief Extracts the planes from a world to clip space transform with OpenGL clip space
+	 * conventions (-w <= x, y, z <= w), e.g. Perspective(...) * LookAt(...) or Ortho(...) * LookAt(...)
+	 */
+	explicit Frustum( const Transform &worldToClip )
+	{
+		const auto &m = worldToClip.Matrix().m;
+		for ( int i = 0; i < 3; i++ ) {
+			for ( int s = 0; s < 2; s++ ) {
+				const Float sign = s == 0 ? 1 : -1;
+				auto &p = Planes[ 2 * i + s ];
+				p.Normal = Vec3f( m[ 3 ][ 0 ] + sign * m[ i ][ 0 ], m[ 3 ][ 1 ] + sign * m[ i ][ 1 ], m[ 3 ][ 2 ] + sign * m[ i ][ 2 ] );
+				p.D = m[ 3 ][ 3 ] + sign * m[ i ][ 3 ];
+				p.Normalize();
+			}
+		}
+	}
+
+	CullResult Classify( const Bound3f &bound ) const
+	{
+		const auto c = bound.Center();
+		const auto e = bound.max - c;
+		auto res = CullResult::Inside;
+		for ( const auto &p : Planes ) {
+			const auto d = p.SignedDistance( c );
+			const auto r = std::abs( p.Normal.x ) * e.x + std::abs( p.Normal.y ) * e.y + std::abs( p.Normal.z ) * e.z;
+			if ( d < -r ) return CullResult::Outside;
+			if ( d < r ) res = CullResult::Intersect;
+		}
+		return res;
+	}
+
+	/**
+	 * \brief Classifies 8 boxes given by their corners.
+	 *
+	 * \param outside The bit mask of the boxes completely outside of the frustum
+	 * \param inside The bit mask of the boxes completely inside of the frustum
+	 */
+	void Classify8( const Float8 &minX, const Float8 &minY, const Float8 &minZ,
+					const Float8 &maxX, const Float8 &maxY, const Float8 &maxZ,
+					int &outside, int &inside ) const
+	{
+		const Float8 half( 0.5f );
+		const auto cx = ( minX + maxX ) * half, cy = ( minY + maxY ) * half, cz = ( minZ + maxZ ) * half;
+		const auto ex = maxX - cx, ey = maxY - cy, ez = maxZ - cz;
+		Mask8 out = Float8::Zero() < Float8::Zero();
+		Mask8 in = ~out;
+		for ( const auto &p : Planes ) {
+			const auto d = MulAdd( Float8( p.Normal.x ), cx, MulAdd( Float8( p.Normal.y ), cy, MulAdd( Float8( p.Normal.z ), cz, Float8( p.D ) ) ) );
+			const auto r = MulAdd( Float8( std::abs( p.Normal.x ) ), ex, MulAdd( Float8( std::abs( p.Normal.y ) ), ey, Float8( std::abs( p.Normal.z ) ) * ez ) );
+			out = out | ( d < -r );
+			in = in & ( d >= r );
+		}
+		outside = out.Bits();
+		inside = in.Bits() & ~outside;
+	}
+
+	/**
+	 * \brief Classifies \a count boxes, 8 per pass
+	 */
+	void Classify( const Bound3f *bounds, std::size_t count, CullResult *results ) const
+	{
+		VMAT_TRACE_ZONE( "Frustum::Classify(bounds)" );
+		static_assert( sizeof( Bound3f ) == 6 * sizeof( float ), "boxes are gathered as 6 consecutive floats" );
+		const auto base = reinterpret_cast<const float *>( bounds );
+		const Int8 stride = Int8( 0, 6, 12, 18, 24, 30, 36, 42 );
+		std::size_t i = 0;
+		for ( ; i + 8 <= count; i += 8 ) {
+			const auto b = base + 6 * i;
+			int outside, inside;
+			Classify8( Gather( b, stride ), Gather( b, stride + Int8( 1 ) ), Gather( b, stride + Int8( 2 ) ),
+					   Gather( b, stride + Int8( 3 ) ), Gather( b, stride + Int8( 4 ) ), Gather( b, stride + Int8( 5 ) ),
+					   outside, inside );
+			WriteResults( outside, inside, 8, results + i );
+		}
+		for ( ; i < count; i++ ) results[ i ] = Classify( bounds[ i ] );
+	}
+
+	std::vector<CullResult> Classify( const std::vector<Bound3f> &bounds ) const
+	{
+		std::vector<CullResult> results( bounds.size() );
+		Classify( bounds.data(), bounds.size(), results.data() );
+		return results;
+	}
+
+	/**
+	 * \brief Classifies every cell of \a grid. The result of a cell is stored at Linear(cell, GridDimension).
+	 *
+	 * Blocks of cells are tested as a whole first and only split while they intersect the frustum,
+	 * so cells deep inside or outside are decided without being tested one by one.
+	 *
+	 * \param leafCells Blocks with at most this many cells are tested cell by cell
+	 */
+	template <typename T>
+	void Classify( const Grid<T> &grid, CullResult *results, int leafCells = 64 ) const
+	{
+		VMAT_TRACE_ZONE( "Frustum::Classify(grid)" );
+		ClassifyBlock( grid, Point3i( 0, 0, 0 ), grid.GridDimension.ToPoint3(), results, ( std::max )( leafCells, 1 ) );
+	}
+
+	template <typename T>
+	std::vector<CullResult> Classify( const Grid<T> &grid ) const
+	{
+		std::vector<CullResult> results( grid.GridDimension.Prod() );
+		Classify( grid, results.data() );
+		return results;
+	}
+
+private:
+	static void WriteResults( int outside, int inside, int n, CullResult *results )
+	{
+		for ( int l = 0; l < n; l++ ) {
+			results[ l ] = ( outside >> l ) & 1 ? CullResult::Outside : ( ( inside >> l ) & 1 ? CullResult::Inside : CullResult::Intersect );
+		}
+	}
+
+	template <typename T>
+	void ClassifyBlock( const Grid<T> &grid, const Point3i &lo, const Point3i &hi, CullResult *results, int leafCells ) const
+	{
+		const auto &dim = grid.GridDimension;
+		const auto size = hi - lo;
+		const auto count = size.x * size.y * size.z;
+		const auto blockResult = Classify( grid.CellBound( lo ).UnionWith( grid.CellBound( hi - Vec3i( 1, 1, 1 ) ) ) );
+
+		if ( blockResult != CullResult::Intersect || count == 1 ) {
+			for ( int z = lo.z; z < hi.z; z++ )
+				for ( int y = lo.y; y < hi.y; y++ ) {
+					const auto row = results + std::size_t( dim.x ) * ( y + std::size_t( dim.y ) * z );
+					std::fill( row + lo.x, row + hi.x, blockResult );
+				}
+			return;
+		}
+
+		if ( count > leafCells ) {
+			const auto axis = MaxDimension( size );
+			auto mid = hi;
+			mid[ axis ] = lo[ axis ] + size[ axis ] / 2;
+			auto lo2 = lo;
+			lo2[ axis ] = mid[ axis ];
+			ClassifyBlock( grid, lo, mid, results, leafCells );
+			ClassifyBlock( grid, lo2, hi, results, leafCells );
+			return;
+		}
+
+		// Cell bounds of a row are computed in registers, 8 cells per pass
+		const Float8 cellX( grid.Cell.x ), cellY( grid.Cell.y ), cellZ( grid.Cell.z );
+		const auto origin = static_cast<Point3f>( grid.Bound.min );
+		for ( int z = lo.z; z < hi.z; z++ ) {
+			const Float8 minZ( origin.z + z * grid.Cell.z );
+			for ( int y = lo.y; y < hi.y; y++ ) {
+				const Float8 minY( origin.y + y * grid.Cell.y );
+				const auto row = results + std::size_t( dim.x ) * ( y + std::size_t( dim.y ) * z );
+				for ( int x = lo.x; x < hi.x; x += 8 ) {
+					const auto minX = MulAdd( Float8::Iota() + Float8( float( x ) ), cellX, Float8( origin.x ) );
+					int outside, inside;
+					Classify8( minX, minY, minZ, minX + cellX, minY + cellY, minZ + cellZ, outside, inside );
+					WriteResults( outside, inside, ( std::min )( 8, hi.x - x ), row + x );
+				}
+			}
+		}
+	}
+};
+
+}  // namespace vm
+
+#endif	// FRUSTUM_H_
@@ -6,14 +6,19 @@
 #include <cmath>
 #include <algorithm>
 #include <type_traits>
+#include <vector>
 
 #include "vmattype.h"
+#include "accounting.h"
+#include "trace.h"
+#include "traversalstats.h"
 
 namespace vm
 {
 template <typename T>
 bool IsNaN( const T &t )
 {
+	VMAT_ACCOUNT( NaNChecks );
 	return std::isnan( t );
 }
 
@@ -46,8 +51,10 @@ class Vector4;
 
 using Vector3f = Vector3<Float>;
 using Vector3i = Vector3<int>;
+using Vector3d = Vector3<double>;
 using Point3f = Point3<Float>;
 using Point3i = Point3<int>;
+using Point3d = Point3<double>;
 using Vector4f = Vector4<Float>;
 
 using Normal3f = Normal3<Float>;
@@ -264,12 +271,14 @@ public:
 
 	Vector2<T> Normalized() const
 	{
+		VMAT_ACCOUNT( Normalizations );
 		const Float len = LengthSquared();
 		return *this / len;
 	}
 
 	void Normalize()
 	{
+		VMAT_ACCOUNT( Normalizations );
 		const Float len = LengthSquared();
 		*this /= len;
 	}
@@ -642,6 +651,7 @@ public:
 
 	constexpr Vector3<T> Normalized() const
 	{
+		VMAT_ACCOUNT( Normalizations );
 		//if len is too small?
 		const auto len = Length();
 		return ( *this ) / len;
@@ -649,6 +659,7 @@ public:
 
 	constexpr void Normalize()
 	{
+		VMAT_ACCOUNT( Normalizations );
 		//if len is too small?
 		const auto len = Length();
 		( *this ) /= len;
@@ -1034,6 +1045,7 @@ public:
 
 	constexpr Normal3<T> Normalized() const
 	{
+		VMAT_ACCOUNT( Normalizations );
 		//if len is too small?
 		const auto len = Length();
 		return ( *this ) / len;
@@ -1041,6 +1053,7 @@ public:
 
 	constexpr void Normalize()
 	{
+		VMAT_ACCOUNT( Normalizations );
 		//if len is too small?
 		const auto len = Length();
 		( *this ) /= len;
@@ -1292,6 +1305,7 @@ public:
 
 	constexpr Vector4<T> Normalized() const
 	{
+		VMAT_ACCOUNT( Normalizations );
 		//if len is too small?
 		const auto len = Length();
 		return ( *this ) / len;
@@ -1299,6 +1313,7 @@ public:
 
 	constexpr void Normalize()
 	{
+		VMAT_ACCOUNT( Normalizations );
 		//if len is too small?
 		const auto len = Length();
 		( *this ) /= len;
@@ -1576,19 +1591,24 @@ public:
 	}
 };
 
-class Ray
+/**
+ * \brief A ray with the scalar type \a T. Ray is the single precision ray used by the library,
+ * RayT<double> carries world space coordinates that need double precision.
+ */
+template <typename T>
+class RayT
 {
 	///TODO:: Add Medium class pointer later
 	//const Medium *medium;
 
 public:
-	Point3f o;
-	Vector3f d;
-	Float tMax;
-	Float Time;
+	Point3<T> o;
+	Vector3<T> d;
+	T tMax;
+	T Time;
 	bool negDirection[ 3 ];
-	Ray() = default;
-	Ray( const Vector3f &d, const Point3f &o, Float t = ( std::numeric_limits<float>::max )(), Float time = 0.f ) :
+	RayT() = default;
+	RayT( const Vector3<T> &d, const Point3<T> &o, T t = ( std::numeric_limits<T>::max )(), T time = 0 ) :
 	  o( o ),
 	  d( d.Normalized() ),
 	  tMax( t ),
@@ -1598,10 +1618,32 @@ public:
 		negDirection[ 1 ] = d.y < 0;
 		negDirection[ 2 ] = d.z < 0;
 	}
-	Point3f operator()( float t ) const noexcept { return o + t * d; }
-	const Point3f &Original() const { return o; }
-	const Vector3f &Direction() const { return d; }
-	void SetMaxLength( Float t ) { tMax = t; }
+	Point3<T> operator()( T t ) const noexcept { return o + t * d; }
+	const Point3<T> &Original() const { return o; }
+	const Vector3<T> &Direction() const { return d; }
+	void SetMaxLength( T t ) { tMax = t; }
+
+	/**
+	 * \brief Converts the ray to the scalar type \a U without normalizing the direction again. An
+	 * unbounded ray, whose \a tMax is the largest value of \a T, stays unbounded with the largest
+	 * value of \a U, finite lengths beyond the range of \a U are clamped to it.
+	 */
+	template <typename U>
+	explicit operator RayT<U>() const
+	{
+		RayT<U> r;
+		r.o = Point3<U>( o );
+		r.d = Vector3<U>( d );
+		const auto umax = ( std::numeric_limits<U>::max )();
+		if ( tMax == ( std::numeric_limits<T>::max )() || ( tMax > umax && tMax < std::numeric_limits<T>::infinity() ) ) {
+			r.tMax = umax;
+		} else {
+			r.tMax = U( tMax );
+		}
+		r.Time = U( Time );
+		for ( int i = 0; i < 3; i++ ) r.negDirection[ i ] = negDirection[ i ];
+		return r;
+	}
 
 	//friend class Bound3f;
 	friend class Triangle;
@@ -1609,6 +1651,9 @@ public:
 	friend class BVHTreeAccelerator;
 };
 
+using Ray = RayT<Float>;
+using Rayd = RayT<double>;
+
 class DifferentialRay : public Ray
 {
 public:
@@ -1660,7 +1705,7 @@ public:
 	{
 	}
 
-	const Point3f &operator[]( int i ) const
+	const Point3<T> &operator[]( int i ) const
 	{
 		assert( i >= 0 && i < 2 );
 		//if (i == 0)return m_min;
@@ -1686,14 +1731,15 @@ public:
 
 	/*inline function definitions for AABB*/
 
-	bool Intersect( const Ray &ray, Float *hit0 = nullptr, Float *hit1 = nullptr ) const noexcept
+	template <typename U>
+	bool Intersect( const RayT<U> &ray, U *hit0 = nullptr, U *hit1 = nullptr ) const noexcept
 	{
 		auto t1 = ray.tMax;
-		auto t0 = 0.0;
+		auto t0 = U( 0 );
 		for ( auto i = 0; i < 3; i++ ) {
 			const auto inv = 1 / ray.d[ i ];
-			auto tNear = ( min[ i ] - ray.o[ i ] ) * inv;
-			auto tFar = ( max[ i ] - ray.o[ i ] ) * inv;
+			auto tNear = ( U( min[ i ] ) - ray.o[ i ] ) * inv;
+			auto tFar = ( U( max[ i ] ) - ray.o[ i ] ) * inv;
 			if ( tNear > tFar ) std::swap( tNear, tFar );
 			t0 = tNear > t0 ? tNear : t0;
 			t1 = tFar < t1 ? tFar : t1;
@@ -1874,6 +1920,7 @@ class RayIntervalIter
 	Vec3f deltaT, accumT;
 	Vec3i grid;
 	bool negRayDir[ 3 ];
+	VMAT_TRAVERSAL_STATS_ONLY( detail::TraversalRayRecord record; )
 	RayIntervalIter( const Vec3f &rayDirection,	 // normalized
 					 const Vec3f &cellDimension,
 					 const Vec3f &rayOrigGrid,
@@ -1902,6 +1949,7 @@ class RayIntervalIter
 			assert( deltaT[ i ] >= 0 );
 		}
 		CellIndex = initCellIndex;
+		VMAT_TRAVERSAL_STATS_ONLY( record.Start(); )
 	}
 
 	inline void _next()
@@ -1934,6 +1982,9 @@ class RayIntervalIter
 			}
 		}
 		assert(cnt != 0);
+		VMAT_TRAVERSAL_STATS_ONLY(
+		  record.Step();
+		  if ( cnt > 1 ) CountTraversal( TraversalStats::AxisTies ); )
 		for ( int c = 0; c < cnt; c++ ) {
 			auto i = mini[c];
 			Pos = accumT[i];
@@ -2004,7 +2055,9 @@ public:
 
 	RayIntervalIter IntersectWith( const Ray &ray ) const
 	{
+		VMAT_TRACE_ZONE( "Grid::IntersectWith" );
 		float hit0, hit1;
+		VMAT_TRAVERSAL_STATS_ONLY( CountTraversal( TraversalStats::RaysTested ); )
 		if ( Bound.Intersect( ray, &hit0, &hit1 ) ) {
 			const auto hit = ray( hit0 + 0.001 );
 			const auto v = hit - Vec3f( Bound.min );
@@ -2012,13 +2065,114 @@ public:
 			const Point3i initCell( v.x / Cell.x, v.y / Cell.y, v.z / Cell.z );
 			return RayIntervalIter( ray.Direction().Normalized(), Cell, rayOrigGrid, initCell, GridDimension, hit0, hit1 );
 		}
+		VMAT_TRAVERSAL_STATS_ONLY( CountTraversal( TraversalStats::BoundMisses ); )
 		return RayIntervalIter();
 	};
 
+	/**
+	 * \brief Returns the world space bound of the cell at \a cellIndex
+	 */
+	Bound3f CellBound( const Point3i &cellIndex ) const
+	{
+		const auto min = static_cast<Point3f>( Bound.min ) + Vec3f( cellIndex.x * Cell.x, cellIndex.y * Cell.y, cellIndex.z * Cell.z );
+		return Bound3f( min, min + Cell );
+	}
+
+	/**
+	 * \brief Calls \a func(const Point3i &) for every cell in front-to-back order as seen from \a eye
+	 * under a perspective projection.
+	 *
+	 * If cell A occludes cell B, A lies between the eye and B along every axis, so visiting each axis
+	 * outward from the slab of the eye in nested loops is a valid visibility order. It costs O(N)
+	 * and needs no sorting.
+	 */
+	template <typename F>
+	void VisitFrontToBack( const Point3f &eye, F &&func ) const
+	{
+		int eyeCell[ 3 ];
+		for ( int i = 0; i < 3; i++ ) {
+			const auto c = std::floor( ( eye[ i ] - Float( Bound.min[ i ] ) ) / Cell[ i ] );
+			eyeCell[ i ] = static_cast<int>( ( std::max )( Float( -1 ), ( std::min )( c, Float( GridDimension[ i ] ) ) ) );
+		}
+		VisitInAxisOrder( eyeCell, std::forward<F>( func ) );
+	}
+
+	/**
+	 * \brief Calls \a func(const Point3i &) for every cell in front-to-back order along \a viewDirection
+	 * under an orthographic projection.
+	 */
+	template <typename F>
+	void VisitFrontToBack( const Vec3f &viewDirection, F &&func ) const
+	{
+		// An eye infinitely far behind the grid
+		int eyeCell[ 3 ];
+		for ( int i = 0; i < 3; i++ ) eyeCell[ i ] = viewDirection[ i ] >= 0 ? -1 : GridDimension[ i ];
+		VisitInAxisOrder( eyeCell, std::forward<F>( func ) );
+	}
+
+	/**
+	 * \brief Writes the cells in front-to-back order as seen from \a eye into \a cells,
+	 * which must hold GridDimension.Prod() elements
+	 */
+	void VisibilityOrder( const Point3f &eye, Point3i *cells ) const
+	{
+		VisitFrontToBack( eye, [ &cells ]( const Point3i &c ) { *cells++ = c; } );
+	}
+
+	std::vector<Point3i> VisibilityOrder( const Point3f &eye ) const
+	{
+		std::vector<Point3i> cells( GridDimension.Prod() );
+		VisibilityOrder( eye, cells.data() );
+		return cells;
+	}
+
+	/**
+	 * \brief Orthographic counterpart, \a viewDirection points from the eye into the scene
+	 */
+	void VisibilityOrder( const Vec3f &viewDirection, Point3i *cells ) const
+	{
+		VisitFrontToBack( viewDirection, [ &cells ]( const Point3i &c ) { *cells++ = c; } );
+	}
+
+	std::vector<Point3i> VisibilityOrder( const Vec3f &viewDirection ) const
+	{
+		std::vector<Point3i> cells( GridDimension.Prod() );
+		VisibilityOrder( viewDirection, cells.data() );
+		return cells;
+	}
+
 	void IntersectWith(const Ray & ray, Point3i*res, int* count)const{
 
 	}
 
+private:
+	/**
+	 * \brief Visits the cells with each axis ordered outward from \a eyeCell, the slab of the eye
+	 * first, then the cells below it, then the cells above it. \a eyeCell may lie outside of the grid.
+	 */
+	template <typename F>
+	void VisitInAxisOrder( const int eyeCell[ 3 ], F &&func ) const
+	{
+		std::vector<int> order[ 3 ];
+		for ( int i = 0; i < 3; i++ ) {
+			const auto n = GridDimension[ i ];
+			const auto e = eyeCell[ i ];
+			order[ i ].reserve( n );
+			for ( int c = ( std::min )( e, n - 1 ); c >= 0; c-- ) order[ i ].push_back( c );
+			for ( int c = ( std::max )( e + 1, 0 ); c < n; c++ ) order[ i ].push_back( c );
+		}
+		Point3i cell;
+		for ( const auto z : order[ 2 ] ) {
+			cell.z = z;
+			for ( const auto y : order[ 1 ] ) {
+				cell.y = y;
+				for ( const auto x : order[ 0 ] ) {
+					cell.x = x;
+					func( static_cast<const Point3i &>( cell ) );
+				}
+			}
+		}
+	}
 };
 
 template <typename T>
@@ -0,0 +1,217 @@
+#ifndef HALF_H_
+#define HALF_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "geometry.h"
+
+#if ( defined( __F16C__ ) || ( defined( _MSC_VER ) && defined( __AVX2__ ) ) ) && !defined( VMAT_DISABLE_SIMD )
+#define VMAT_SIMD_F16C 1
+#include <immintrin.h>
+#endif
+
+/*
+ * IEEE 754 binary16 storage for large point and normal buffers. Computation stays in single
+ * precision: the types only convert to and from it, halving the footprint of a Vector3f.
+ *
+ * Conversions round to nearest even, overflow to infinity, keep subnormals and keep the payload of
+ * NaNs, quieting them. With F16C (-mf16c, implied by /arch:AVX2) the conversions use the hardware
+ * instructions, 8 values per instruction for the array forms, otherwise a scalar fallback with
+ * bit identical results. Define VMAT_DISABLE_SIMD to force the fallback.
+ */
+
+namespace vm
+{
+namespace detail
+{
+inline std::uint16_t FloatToHalfBits( float f )
+{
+	std::uint32_t x;
+	std::memcpy( &x, &f, sizeof( x ) );
+	const auto sign = std::uint16_t( ( x >> 16 ) & 0x8000 );
+	x &= 0x7fffffff;
+	if ( x >= 0x7f800000 ) {
+		// Infinity, or a NaN keeping the top of its payload with the quiet bit set
+		return sign | 0x7c00 | ( x > 0x7f800000 ? 0x200 | ( ( x >> 13 ) & 0x3ff ) : 0 );
+	}
+	if ( x >= 0x47800000 ) return sign | 0x7c00;
+	if ( x < 0x38800000 ) {
+		// Below the smallest normal half: adding 0.5 aligns the subnormal mantissa to the lowest
+		// bits of the float, so the addition rounds it to nearest even
+		float a;
+		std::memcpy( &a, &x, sizeof( a ) );
+		a += 0.5f;
+		std::uint32_t r;
+		std::memcpy( &r, &a, sizeof( r ) );
+		return sign | std::uint16_t( r - 0x3f000000 );
+	}
+	// Rebias the exponent from 127 to 15 and round the 13 dropped bits to nearest even. A carry
+	// out of the mantissa increments the exponent, up to infinity.
+	const auto odd = ( x >> 13 ) & 1;
+	x += 0xc8000fff + odd;
+	return sign | std::uint16_t( x >> 13 );
+}
+
+inline float HalfBitsToFloat( std::uint16_t h )
+{
+	const auto sign = std::uint32_t( h & 0x8000 ) << 16;
+	const auto exponent = ( h >> 10 ) & 0x1f;
+	const auto mantissa = std::uint32_t( h & 0x3ff );
+	std::uint32_t x;
+	if ( exponent == 0x1f ) {
+		x = sign | 0x7f800000 | ( mantissa != 0 ? 0x400000 : 0 ) | ( mantissa << 13 );
+	} else if ( exponent != 0 ) {
+		x = sign | ( ( exponent + 112 ) << 23 ) | ( mantissa << 13 );
+	} else {
+		// Zero or subnormal, exactly mantissa * 2^-24
+		const auto f = float( mantissa ) * ( 1.0f / 16777216.0f );
+		std::memcpy( &x, &f, sizeof( x ) );
+		x |= sign;
+	}
+	float f;
+	std::memcpy( &f, &x, sizeof( f ) );
+	return f;
+}
+}  // namespace detail
+
+/**
+ * \brief An IEEE 754 binary16 value
+ */
+struct Half
+{
+	std::uint16_t Bits = 0;
+
+	Half() = default;
+	explicit Half( float f ) :
+	  Bits( FromFloat( f ) ) {}
+
+	static Half FromBits( std::uint16_t bits )
+	{
+		Half h;
+		h.Bits = bits;
+		return h;
+	}
+
+	explicit operator float() const
+	{
+#ifdef VMAT_SIMD_F16C
+		return _cvtsh_ss( Bits );
+#else
+		return detail::HalfBitsToFloat( Bits );
+#endif
+	}
+
+	bool operator==( const Half &h ) const { return Bits == h.Bits; }
+	bool operator!=( const Half &h ) const { return Bits != h.Bits; }
+
+private:
+	static std::uint16_t FromFloat( float f )
+	{
+#ifdef VMAT_SIMD_F16C
+		return std::uint16_t( _cvtss_sh( f, _MM_FROUND_TO_NEAREST_INT ) );
+#else
+		return detail::FloatToHalfBits( f );
+#endif
+	}
+};
+
+/**
+ * \brief Converts \a count floats of \a src to halves in \a dst
+ */
+inline void FloatToHalf( const float *src, std::size_t count, Half *dst )
+{
+	std::size_t i = 0;
+#ifdef VMAT_SIMD_F16C
+	for ( ; i + 8 <= count; i += 8 ) {
+		const auto h = _mm256_cvtps_ph( _mm256_loadu_ps( src + i ), _MM_FROUND_TO_NEAREST_INT );
+		_mm_storeu_si128( reinterpret_cast<__m128i *>( dst + i ), h );
+	}
+#endif
+	for ( ; i < count; i++ ) dst[ i ] = Half( src[ i ] );
+}
+
+/**
+ * \brief Converts \a count halves of \a src to floats in \a dst
+ */
+inline void HalfToFloat( const Half *src, std::size_t count, float *dst )
+{
+	std::size_t i = 0;
+#ifdef VMAT_SIMD_F16C
+	for ( ; i + 8 <= count; i += 8 ) {
+		const auto h = _mm_loadu_si128( reinterpret_cast<const __m128i *>( src + i ) );
+		_mm256_storeu_ps( dst + i, _mm256_cvtph_ps( h ) );
+	}
+#endif
+	for ( ; i < count; i++ ) dst[ i ] = float( src[ i ] );
+}
+
+/**
+ * \brief The storage form of a Vector3f, 6 bytes instead of 12
+ */
+class Vector3h
+{
+public:
+	Half x, y, z;
+
+	Vector3h() = default;
+	explicit Vector3h( const Vector3f &v ) :
+	  x( v.x ), y( v.y ), z( v.z ) {}
+
+	explicit operator Vector3f() const { return Vector3f( float( x ), float( y ), float( z ) ); }
+
+	bool operator==( const Vector3h &v ) const { return x == v.x && y == v.y && z == v.z; }
+	bool operator!=( const Vector3h &v ) const { return !( *this == v ); }
+};
+
+/**
+ * \brief The storage form of a Normal3f, 6 bytes instead of 12
+ */
+class Normal3h
+{
+public:
+	Half x, y, z;
+
+	Normal3h() = default;
+	explicit Normal3h( const Normal3f &n ) :
+	  x( n.x ), y( n.y ), z( n.z ) {}
+
+	explicit operator Normal3f() const { return Normal3f( float( x ), float( y ), float( z ) ); }
+
+	bool operator==( const Normal3h &n ) const { return x == n.x && y == n.y && z == n.z; }
+	bool operator!=( const Normal3h &n ) const { return !( *this == n ); }
+};
+
+static_assert( sizeof( Half ) == 2 && sizeof( Vector3h ) == 6 && sizeof( Normal3h ) == 6, "halves are stored tightly packed" );
+static_assert( sizeof( Vector3f ) == 3 * sizeof( float ) && sizeof( Normal3f ) == 3 * sizeof( float ), "vectors are converted as flat arrays" );
+
+/**
+ * \brief Converts \a count vectors of \a src to half precision in \a dst
+ */
+inline void ConvertToHalf( const Vector3f *src, std::size_t count, Vector3h *dst )
+{
+	FloatToHalf( reinterpret_cast<const float *>( src ), 3 * count, reinterpret_cast<Half *>( dst ) );
+}
+
+inline void ConvertToHalf( const Normal3f *src, std::size_t count, Normal3h *dst )
+{
+	FloatToHalf( reinterpret_cast<const float *>( src ), 3 * count, reinterpret_cast<Half *>( dst ) );
+}
+
+/**
+ * \brief Converts \a count half precision vectors of \a src to single precision in \a dst
+ */
+inline void ConvertToFloat( const Vector3h *src, std::size_t count, Vector3f *dst )
+{
+	HalfToFloat( reinterpret_cast<const Half *>( src ), 3 * count, reinterpret_cast<float *>( dst ) );
+}
+
+inline void ConvertToFloat( const Normal3h *src, std::size_t count, Normal3f *dst )
+{
+	HalfToFloat( reinterpret_cast<const Half *>( src ), 3 * count, reinterpret_cast<float *>( dst ) );
+}
+
+}  // namespace vm
+
+#endif	// HALF_H_
@@ -0,0 +1,436 @@
+#ifndef LOWDISCREPANCY_H_
+#define LOWDISCREPANCY_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "geometry.h"
+#include "numeric.h"
+#include "simd.h"
+
+/*
+ * Sample generators for the warps of arithmetic.h and sampling.h.
+ *
+ * All of them share one interface: Get1D/Get2D/Get3D(pixel, index, dim) return dimension
+ * group \a dim of sample \a index of a pixel, and the block forms of Get2D/Get3D write
+ * \a count consecutive samples into SoA arrays that feed the batched warps directly. The block
+ * forms of SobolSampler compute 8 samples per pass, those of the others are scalar loops.
+ * Different values of \a dim are decorrelated, so each consumer of samples (a lens, a light,
+ * a bounce) uses its own dim.
+ */
+
+namespace vm
+{
+/**
+ * \brief The generator matrices of the first 4 Sobol dimensions, from the direction numbers of
+ * Joe and Kuo. Column j is the contribution of bit j of the index.
+ */
+struct SobolMatrices
+{
+	std::uint32_t M[ 4 ][ 32 ];
+
+	constexpr SobolMatrices() :
+	  M{}
+	{
+		// s, a and the initial m of the primitive polynomials of dimensions 1 to 3
+		constexpr int degree[ 4 ] = { 0, 1, 2, 3 };
+		constexpr std::uint32_t coefficients[ 4 ] = { 0, 0, 1, 1 };
+		constexpr std::uint32_t initial[ 4 ][ 3 ] = { {}, { 1 }, { 1, 3 }, { 1, 3, 1 } };
+		for ( int j = 0; j < 32; j++ ) M[ 0 ][ j ] = 1u << ( 31 - j );
+		for ( int d = 1; d < 4; d++ ) {
+			const auto s = degree[ d ];
+			for ( int j = 0; j < s; j++ ) M[ d ][ j ] = initial[ d ][ j ] << ( 31 - j );
+			for ( int j = s; j < 32; j++ ) {
+				auto v = M[ d ][ j - s ] ^ ( M[ d ][ j - s ] >> s );
+				for ( int k = 1; k < s; k++ ) {
+					if ( ( coefficients[ d ] >> ( s - 1 - k ) ) & 1 ) v ^= M[ d ][ j - k ];
+				}
+				M[ d ][ j ] = v;
+			}
+		}
+	}
+};
+
+inline constexpr SobolMatrices SobolTable{};
+
+/**
+ * \brief Shuffled and Owen-scrambled Sobol points after Burley, "Practical Hash-based Owen
+ * Scrambling", JCGT 2020.
+ *
+ * Every dimension group draws from the first Sobol dimensions with its own index shuffle and
+ * scramble seeds. The shuffle maps each aligned block of 2^m indices onto another one, so the
+ * first 2^m samples of a pixel form a (0, m, 2)-net in Get2D().
+ */
+class SobolSampler
+{
+public:
+	explicit SobolSampler( std::uint32_t seed = 0 ) :
+	  seed( seed ) {}
+
+	Float Get1D( const Point2i &pixel, std::uint32_t index, int dim ) const
+	{
+		const auto s = Seed( pixel, dim );
+		return UnitFloat( Sample( index, s, 0 ) );
+	}
+
+	Point2f Get2D( const Point2i &pixel, std::uint32_t index, int dim ) const
+	{
+		const auto s = Seed( pixel, dim );
+		return Point2f( UnitFloat( Sample( index, s, 0 ) ), UnitFloat( Sample( index, s, 1 ) ) );
+	}
+
+	Point3f Get3D( const Point2i &pixel, std::uint32_t index, int dim ) const
+	{
+		const auto s = Seed( pixel, dim );
+		return Point3f( UnitFloat( Sample( index, s, 0 ) ), UnitFloat( Sample( index, s, 1 ) ), UnitFloat( Sample( index, s, 2 ) ) );
+	}
+
+	/**
+	 * \brief Writes samples [firstIndex, firstIndex + count) of Get2D(), 8 per pass
+	 */
+	void Get2D( const Point2i &pixel, std::uint32_t firstIndex, std::size_t count, int dim, float *u0, float *u1 ) const
+	{
+		float *const out[ 2 ] = { u0, u1 };
+		GetBlock( pixel, firstIndex, count, dim, 2, out );
+	}
+
+	void Get3D( const Point2i &pixel, std::uint32_t firstIndex, std::size_t count, int dim, float *u0, float *u1, float *u2 ) const
+	{
+		float *const out[ 3 ] = { u0, u1, u2 };
+		GetBlock( pixel, firstIndex, count, dim, 3, out );
+	}
+
+	static std::uint32_t LaineKarrasPermutation( std::uint32_t x, std::uint32_t seed )
+	{
+		x += seed;
+		x ^= x * 0x6c50b47cu;
+		x ^= x * 0xb82f1e52u;
+		x ^= x * 0xc7afe638u;
+		x ^= x * 0x8d22f6e6u;
+		return x;
+	}
+
+	/**
+	 * \brief A random Owen scramble of the bits of \a x. Each bit is flipped depending only on the bits above it.
+	 */
+	static std::uint32_t NestedUniformScramble( std::uint32_t x, std::uint32_t seed )
+	{
+		return ReverseBits32( LaineKarrasPermutation( ReverseBits32( x ), seed ) );
+	}
+
+private:
+	std::uint32_t Seed( const Point2i &pixel, int dim ) const
+	{
+		return static_cast<std::uint32_t>( Hash( ( std::uint64_t( std::uint32_t( pixel.y ) ) << 32 ) | std::uint32_t( pixel.x ), dim, seed ) );
+	}
+
+	static std::uint32_t DimensionSeed( std::uint32_t s, int d )
+	{
+		return static_cast<std::uint32_t>( MixBits( ( std::uint64_t( s ) << 8 ) | std::uint64_t( d + 1 ) ) );
+	}
+
+	static std::uint32_t Sample( std::uint32_t index, std::uint32_t s, int d )
+	{
+		const auto i = NestedUniformScramble( index, s );
+		std::uint32_t v = 0;
+		for ( int j = 0; j < 32; j++ ) {
+			if ( ( i >> j ) & 1 ) v ^= SobolTable.M[ d ][ j ];
+		}
+		return NestedUniformScramble( v, DimensionSeed( s, d ) );
+	}
+
+	static Int8 ReverseBits( Int8 v )
+	{
+		v = ( v << 16 ) | ( v >> 16 );
+		v = ( ( v & Int8( 0x00ff00ff ) ) << 8 ) | ( ( v >> 8 ) & Int8( 0x00ff00ff ) );
+		v = ( ( v & Int8( 0x0f0f0f0f ) ) << 4 ) | ( ( v >> 4 ) & Int8( 0x0f0f0f0f ) );
+		v = ( ( v & Int8( 0x33333333 ) ) << 2 ) | ( ( v >> 2 ) & Int8( 0x33333333 ) );
+		v = ( ( v & Int8( 0x55555555 ) ) << 1 ) | ( ( v >> 1 ) & Int8( 0x55555555 ) );
+		return v;
+	}
+
+	static Int8 NestedUniformScramble( const Int8 &x, std::uint32_t seed )
+	{
+		auto v = ReverseBits( x ) + Int8( std::int32_t( seed ) );
+		v = v ^ ( v * Int8( std::int32_t( 0x6c50b47cu ) ) );
+		v = v ^ ( v * Int8( std::int32_t( 0xb82f1e52u ) ) );
+		v = v ^ ( v * Int8( std::int32_t( 0xc7afe638u ) ) );
+		v = v ^ ( v * Int8( std::int32_t( 0x8d22f6e6u ) ) );
+		return ReverseBits( v );
+	}
+
+	void GetBlock( const Point2i &pixel, std::uint32_t firstIndex, std::size_t count, int dim, int dims, float *const *out ) const
+	{
+		const auto s = Seed( pixel, dim );
+		std::uint32_t dimSeed[ 3 ];
+		for ( int d = 0; d < dims; d++ ) dimSeed[ d ] = DimensionSeed( s, d );
+		const Int8 zero( 0 ), one( 1 );
+		for ( std::size_t i = 0; i < count; i += 8 ) {
+			const auto index = Int8( std::int32_t( firstIndex + std::uint32_t( i ) ) ) + Int8( 0, 1, 2, 3, 4, 5, 6, 7 );
+			const auto shuffled = NestedUniformScramble( index, s );
+			const auto n = static_cast<int>( ( std::min )( count - i, std::size_t( 8 ) ) );
+			for ( int d = 0; d < dims; d++ ) {
+				Int8 v = zero;
+				for ( int j = 0; j < 32; j++ ) {
+					const auto bit = ( ( shuffled >> j ) & one ) == one;
+					v = v ^ Select( bit, Int8( std::int32_t( SobolTable.M[ d ][ j ] ) ), zero );
+				}
+				const auto u = UnitFloat8( NestedUniformScramble( v, dimSeed[ d ] ) );
+				if ( n == 8 ) {
+					u.StoreU( out[ d ] + i );
+				} else {
+					u.StoreN( out[ d ] + i, n );
+				}
+			}
+		}
+	}
+
+	std::uint32_t seed;
+};
+
+/**
+ * \brief The Halton sequence with a random digit permutation per prime base, after pbrt's
+ * scrambled radical inverse.
+ *
+ * The points of a pixel are a run of consecutive Halton indices starting at an offset hashed
+ * from the pixel and \a dim. Any run of b^k consecutive indices stratifies each coordinate into
+ * b^k intervals, where b is its base. Dimension group \a dim of Get2D() uses the bases 2 dim and
+ * 2 dim + 1, of Get3D() the bases 3 dim to 3 dim + 2, so adjacent groups never share a base.
+ * Groups past the 64 primes reuse bases, decorrelated by their offsets only.
+ *
+ * The block forms run the scalar radical inverse per sample, computing the offset once: the
+ * divisions by the bases do not map onto the 8-wide types without giving up the exact match
+ * with the point forms.
+ */
+class HaltonSampler
+{
+public:
+	static constexpr int PrimeCount = 64;
+
+	explicit HaltonSampler( std::uint32_t seed = 0 ) :
+	  seed( seed )
+	{
+		std::mt19937 rng( seed );
+		for ( int p = 0; p < PrimeCount; p++ ) {
+			offsets[ p ] = static_cast<int>( permutations.size() );
+			for ( int i = 0; i < Primes()[ p ]; i++ ) permutations.push_back( static_cast<std::uint16_t>( i ) );
+			std::shuffle( permutations.begin() + offsets[ p ], permutations.end(), rng );
+		}
+	}
+
+	static const int *Primes()
+	{
+		static const int primes[ PrimeCount ] = {
+			2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53,
+			59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 127, 131,
+			137, 139, 149, 151, 157, 163, 167, 173, 179, 181, 191, 193, 197, 199, 211, 223,
+			227, 229, 233, 239, 241, 251, 257, 263, 269, 271, 277, 281, 283, 293, 307, 311
+		};
+		return primes;
+	}
+
+	/**
+	 * \brief The scrambled radical inverse of \a a in the base with index \a baseIndex
+	 */
+	Float RadicalInverse( int baseIndex, std::uint64_t a ) const
+	{
+		const auto base = Primes()[ baseIndex ];
+		const auto perm = permutations.data() + offsets[ baseIndex ];
+		const double invBase = 1.0 / base;
+		std::uint64_t reversed = 0;
+		double invBaseN = 1;
+		while ( a ) {
+			const auto next = a / base;
+			const auto digit = a - next * base;
+			reversed = reversed * base + perm[ digit ];
+			invBaseN *= invBase;
+			a = next;
+		}
+		// The permuted leading zeros contribute the geometric tail perm[0] / (base - 1)
+		const auto v = invBaseN * ( double( reversed ) + invBase * perm[ 0 ] / ( 1 - invBase ) );
+		return ( std::min )( Float( v ), OneMinusEpsilon );
+	}
+
+	Float Get1D( const Point2i &pixel, std::uint32_t index, int dim ) const
+	{
+		return RadicalInverse( dim % PrimeCount, Offset( pixel, dim ) + index );
+	}
+
+	Point2f Get2D( const Point2i &pixel, std::uint32_t index, int dim ) const
+	{
+		return Sample2D( Offset( pixel, dim ) + index, dim );
+	}
+
+	Point3f Get3D( const Point2i &pixel, std::uint32_t index, int dim ) const
+	{
+		return Sample3D( Offset( pixel, dim ) + index, dim );
+	}
+
+	void Get2D( const Point2i &pixel, std::uint32_t firstIndex, std::size_t count, int dim, float *u0, float *u1 ) const
+	{
+		const auto first = Offset( pixel, dim ) + firstIndex;
+		for ( std::size_t k = 0; k < count; k++ ) {
+			const auto p = Sample2D( first + k, dim );
+			u0[ k ] = p.x;
+			u1[ k ] = p.y;
+		}
+	}
+
+	void Get3D( const Point2i &pixel, std::uint32_t firstIndex, std::size_t count, int dim, float *u0, float *u1, float *u2 ) const
+	{
+		const auto first = Offset( pixel, dim ) + firstIndex;
+		for ( std::size_t k = 0; k < count; k++ ) {
+			const auto p = Sample3D( first + k, dim );
+			u0[ k ] = p.x;
+			u1[ k ] = p.y;
+			u2[ k ] = p.z;
+		}
+	}
+
+private:
+	static constexpr Float OneMinusEpsilon = 0x1.fffffep-1f;
+
+	std::uint64_t Offset( const Point2i &pixel, int dim ) const
+	{
+		return Hash( ( std::uint64_t( std::uint32_t( pixel.y ) ) << 32 ) | std::uint32_t( pixel.x ), dim, seed ) & 0xffffff;
+	}
+
+	Point2f Sample2D( std::uint64_t i, int dim ) const
+	{
+		const auto b = 2 * dim;
+		return Point2f( RadicalInverse( b % PrimeCount, i ), RadicalInverse( ( b + 1 ) % PrimeCount, i ) );
+	}
+
+	Point3f Sample3D( std::uint64_t i, int dim ) const
+	{
+		const auto b = 3 * dim;
+		return Point3f( RadicalInverse( b % PrimeCount, i ), RadicalInverse( ( b + 1 ) % PrimeCount, i ), RadicalInverse( ( b + 2 ) % PrimeCount, i ) );
+	}
+
+	std::uint32_t seed;
+	int offsets[ PrimeCount ];
+	std::vector<std::uint16_t> permutations;
+};
+
+/**
+ * \brief Jittered samples from nx * ny strata per pixel.
+ *
+ * Get2D() puts one sample in each cell of an nx x ny grid, Get1D() one in each of nx * ny
+ * intervals, and Get3D() combines both as a Latin hypercube in its third coordinate. The
+ * strata are visited in a hashed order that differs per pixel and dim, so dims do not correlate.
+ * Indices beyond nx * ny start over with new permutations.
+ *
+ * The block forms loop over the point forms: the rejection loop of Permute() runs a different
+ * number of rounds per sample.
+ */
+class StratifiedSampler
+{
+public:
+	StratifiedSampler( int nx, int ny, std::uint32_t seed = 0, bool jitter = true ) :
+	  nx( ( std::max )( nx, 1 ) ), ny( ( std::max )( ny, 1 ) ), seed( seed ), jitter( jitter ) {}
+
+	int SamplesPerPixel() const { return nx * ny; }
+
+	Float Get1D( const Point2i &pixel, std::uint32_t index, int dim ) const
+	{
+		const std::uint32_t n = nx * ny;
+		const auto h = Hash( PixelKey( pixel ), index / n, dim, seed );
+		const auto stratum = Permute( index % n, n, static_cast<std::uint32_t>( h ) );
+		const auto j = MixBits( h ^ index );
+		return ( std::min )( ( stratum + Jitter( j, 0 ) ) / n, OneMinusEpsilon );
+	}
+
+	Point2f Get2D( const Point2i &pixel, std::uint32_t index, int dim ) const
+	{
+		const std::uint32_t n = nx * ny;
+		const auto h = Hash( PixelKey( pixel ), index / n, dim, seed );
+		const auto stratum = Permute( index % n, n, static_cast<std::uint32_t>( h ) );
+		const auto j = MixBits( h ^ index );
+		return Point2f( ( std::min )( ( stratum % nx + Jitter( j, 0 ) ) / nx, OneMinusEpsilon ),
+						( std::min )( ( stratum / nx + Jitter( j, 32 ) ) / ny, OneMinusEpsilon ) );
+	}
+
+	Point3f Get3D( const Point2i &pixel, std::uint32_t index, int dim ) const
+	{
+		const auto p = Get2D( pixel, index, dim );
+		return Point3f( p.x, p.y, Get1D( pixel, index, dim + 0x10000 ) );
+	}
+
+	void Get2D( const Point2i &pixel, std::uint32_t firstIndex, std::size_t count, int dim, float *u0, float *u1 ) const
+	{
+		for ( std::size_t k = 0; k < count; k++ ) {
+			const auto p = Get2D( pixel, firstIndex + std::uint32_t( k ), dim );
+			u0[ k ] = p.x;
+			u1[ k ] = p.y;
+		}
+	}
+
+	void Get3D( const Point2i &pixel, std::uint32_t firstIndex, std::size_t count, int dim, float *u0, float *u1, float *u2 ) const
+	{
+		for ( std::size_t k = 0; k < count; k++ ) {
+			const auto p = Get3D( pixel, firstIndex + std::uint32_t( k ), dim );
+			u0[ k ] = p.x;
+			u1[ k ] = p.y;
+			u2[ k ] = p.z;
+		}
+	}
+
+	/**
+	 * \brief Element \a i of a random permutation of [0, l) selected by \a p, from Kensler,
+	 * "Correlated Multi-Jittered Sampling", 2013
+	 */
+	static std::uint32_t Permute( std::uint32_t i, std::uint32_t l, std::uint32_t p )
+	{
+		auto w = l - 1;
+		w |= w >> 1;
+		w |= w >> 2;
+		w |= w >> 4;
+		w |= w >> 8;
+		w |= w >> 16;
+		do {
+			i ^= p;
+			i *= 0xe170893d;
+			i ^= p >> 16;
+			i ^= ( i & w ) >> 4;
+			i ^= p >> 8;
+			i *= 0x0929eb3f;
+			i ^= p >> 23;
+			i ^= ( i & w ) >> 1;
+			i *= 1 | p >> 27;
+			i *= 0x6935fa69;
+			i ^= ( i & w ) >> 11;
+			i *= 0x74dcb303;
+			i ^= ( i & w ) >> 2;
+			i *= 0x9e501cc3;
+			i ^= ( i & w ) >> 2;
+			i *= 0xc860a3df;
+			i &= w;
+			i ^= i >> 5;
+		} while ( i >= l );
+		return ( i + p ) % l;
+	}
+
+private:
+	static constexpr Float OneMinusEpsilon = 0x1.fffffep-1f;
+
+	static std::uint64_t PixelKey( const Point2i &pixel )
+	{
+		return ( std::uint64_t( std::uint32_t( pixel.y ) ) << 32 ) | std::uint32_t( pixel.x );
+	}
+
+	Float Jitter( std::uint64_t h, int shift ) const
+	{
+		return jitter ? UnitFloat( static_cast<std::uint32_t>( h >> shift ) ) : Float( 0.5 );
+	}
+
+	int nx, ny;
+	std::uint32_t seed;
+	bool jitter;
+};
+
+}  // namespace vm
+
+#endif	// LOWDISCREPANCY_H_
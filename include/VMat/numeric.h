@@ -2,6 +2,9 @@
 #define SAMPLER_H_
 #include <cmath>
 #include <cstdint>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 #include "vmattype.h"
 #include "geometry.h"
 /*
@@ -88,6 +91,95 @@ namespace vm {
 		return(n&(n - 1)) == 0;
 	}
 
+	inline
+		int
+		CountLeadingZeros(std::uint32_t v)
+	{
+		if (v == 0)return 32;
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanReverse(&index, v);
+		return 31 - int(index);
+#else
+		return __builtin_clz(v);
+#endif
+	}
+
+	/*
+	* Spreads the lower 10 bits of v so that two zero bits follow each of them
+	*/
+	inline
+		std::uint32_t
+		LeftShift3(std::uint32_t v)
+	{
+		v &= 0x3ff;
+		v = (v | (v << 16)) & 0x030000ff;
+		v = (v | (v << 8)) & 0x0300f00f;
+		v = (v | (v << 4)) & 0x030c30c3;
+		v = (v | (v << 2)) & 0x09249249;
+		return v;
+	}
+
+	/*
+	* Interleaves three 10-bit coordinates into a 30-bit Morton code, x in the lowest bit
+	*/
+	inline
+		std::uint32_t
+		EncodeMorton3(std::uint32_t x, std::uint32_t y, std::uint32_t z)
+	{
+		return (LeftShift3(z) << 2) | (LeftShift3(y) << 1) | LeftShift3(x);
+	}
+
+	inline
+		std::uint32_t
+		ReverseBits32(std::uint32_t v)
+	{
+		v = (v << 16) | (v >> 16);
+		v = ((v & 0x00ff00ff) << 8) | ((v & 0xff00ff00) >> 8);
+		v = ((v & 0x0f0f0f0f) << 4) | ((v & 0xf0f0f0f0) >> 4);
+		v = ((v & 0x33333333) << 2) | ((v & 0xcccccccc) >> 2);
+		v = ((v & 0x55555555) << 1) | ((v & 0xaaaaaaaa) >> 1);
+		return v;
+	}
+
+	/*
+	* The 64-bit finalizer of MurmurHash3 as tuned for SplitMix64. Every input bit affects every output bit
+	*/
+	inline
+		std::uint64_t
+		MixBits(std::uint64_t v)
+	{
+		v ^= v >> 31;
+		v *= 0x7fb5d329728ea185ull;
+		v ^= v >> 27;
+		v *= 0x81dadef4bc2dd44dull;
+		v ^= v >> 33;
+		return v;
+	}
+
+	/*
+	* Hashes a few integers, e.g. a pixel, a sample index and a dimension, into one well mixed seed
+	*/
+	inline
+		std::uint64_t
+		Hash(std::uint64_t a, std::uint64_t b, std::uint64_t c = 0, std::uint64_t d = 0)
+	{
+		auto h = MixBits(a + 0x9e3779b97f4a7c15ull);
+		h = MixBits(h ^ (b + 0x9e3779b97f4a7c15ull));
+		h = MixBits(h ^ (c + 0x9e3779b97f4a7c15ull));
+		return MixBits(h ^ (d + 0x9e3779b97f4a7c15ull));
+	}
+
+	/*
+	* Maps the high 24 bits of v to [0, 1), every result is exactly representable
+	*/
+	inline
+		Float
+		UnitFloat(std::uint32_t v)
+	{
+		return Float(v >> 8) * Float(1.0 / (1 << 24));
+	}
+
 	template<typename T>
 	T Align(T val, T align)
 	{
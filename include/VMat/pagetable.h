@@ -0,0 +1,157 @@
+#ifndef PAGETABLE_H_
+#define PAGETABLE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "geometry.h"
+#include "numeric.h"
+#include "simd.h"
+
+namespace vm
+{
+/**
+ * \brief A flat, GPU style page table translating global voxel coordinates into
+ * (slot, offset) pairs of a brick pool.
+ *
+ * There is one 32-bit entry per brick of the grid holding the physical slot of the brick or
+ * PageTable::Unmapped. Entries are atomics, so loader threads can map and unmap bricks while
+ * other threads translate addresses without any lock.
+ *
+ * Address translation needs power of two brick sizes so that it is made of shifts and masks only.
+ */
+class PageTable
+{
+public:
+	static constexpr std::int32_t Unmapped = -1;
+
+	PageTable( const Vec3i &gridDimension, const Vec3i &brickSize ) :
+	  GridDimension( gridDimension ),
+	  BrickSize( brickSize ),
+	  entries( new std::atomic<std::int32_t>[ gridDimension.Prod() ] )
+	{
+		static_assert( sizeof( std::atomic<std::int32_t> ) == sizeof( std::int32_t ), "entries are gathered as plain integers" );
+		for ( std::size_t i = 0; i < gridDimension.Prod(); i++ ) entries[ i ].store( Unmapped, std::memory_order_relaxed );
+		addressable = IsPowerOfTwo( brickSize.x ) && IsPowerOfTwo( brickSize.y ) && IsPowerOfTwo( brickSize.z );
+		for ( int i = 0; i < 3; i++ ) {
+			int s = 0;
+			while ( ( 1 << s ) < brickSize[ i ] ) s++;
+			shift[ i ] = s;
+		}
+	}
+
+	PageTable( PageTable && ) = default;
+	PageTable &operator=( PageTable && ) = default;
+
+	std::size_t EntryIndex( const Point3i &brick ) const
+	{
+		assert( brick.x >= 0 && brick.x < GridDimension.x );
+		assert( brick.y >= 0 && brick.y < GridDimension.y );
+		assert( brick.z >= 0 && brick.z < GridDimension.z );
+		return std::size_t( brick.x ) + std::size_t( GridDimension.x ) * ( std::size_t( brick.y ) + std::size_t( GridDimension.y ) * brick.z );
+	}
+
+	std::int32_t Lookup( const Point3i &brick ) const
+	{
+		return entries[ EntryIndex( brick ) ].load( std::memory_order_acquire );
+	}
+
+	void Map( const Point3i &brick, std::int32_t slot )
+	{
+		assert( slot >= 0 );
+		entries[ EntryIndex( brick ) ].store( slot, std::memory_order_seq_cst );
+	}
+
+	void Unmap( const Point3i &brick )
+	{
+		entries[ EntryIndex( brick ) ].store( Unmapped, std::memory_order_seq_cst );
+	}
+
+	/**
+	 * \brief Maps \a brick to \a slot only if its entry is still \a expected.
+	 * Lets concurrent loaders race for a brick without a lock.
+	 */
+	bool CompareAndMap( const Point3i &brick, std::int32_t expected, std::int32_t slot )
+	{
+		return entries[ EntryIndex( brick ) ].compare_exchange_strong( expected, slot, std::memory_order_seq_cst );
+	}
+
+	bool IsAddressable() const { return addressable; }
+
+	/**
+	 * \brief The number of voxels of a brick, i.e. the stride between two slots of the pool
+	 */
+	int BrickVoxels() const { return 1 << ( shift[ 0 ] + shift[ 1 ] + shift[ 2 ] ); }
+
+	/**
+	 * \brief Translates a global voxel coordinate.
+	 *
+	 * \return false if the voxel is outside of the grid or its brick is not mapped
+	 */
+	bool Translate( const Point3i &voxel, std::int32_t &slot, std::int32_t &offset ) const
+	{
+		assert( addressable );
+		const Point3i brick( voxel.x >> shift[ 0 ], voxel.y >> shift[ 1 ], voxel.z >> shift[ 2 ] );
+		if ( voxel.x < 0 || voxel.y < 0 || voxel.z < 0 ||
+			 brick.x >= GridDimension.x || brick.y >= GridDimension.y || brick.z >= GridDimension.z ) {
+			return false;
+		}
+		slot = Lookup( brick );
+		offset = ( voxel.x & ( BrickSize.x - 1 ) ) |
+				 ( ( voxel.y & ( BrickSize.y - 1 ) ) << shift[ 0 ] ) |
+				 ( ( voxel.z & ( BrickSize.z - 1 ) ) << ( shift[ 0 ] + shift[ 1 ] ) );
+		return slot != Unmapped;
+	}
+
+	/**
+	 * \brief Translates 8 global voxel coordinates at once.
+	 *
+	 * \a slot and \a offset are only meaningful in the lanes set in the returned mask.
+	 * \return The bit mask of the lanes whose voxel lies in a mapped brick
+	 */
+	int Translate8( const Int8 &x, const Int8 &y, const Int8 &z, Int8 &slot, Int8 &offset ) const
+	{
+		assert( addressable );
+		const Int8 zero( 0 );
+		const auto bx = x >> shift[ 0 ], by = y >> shift[ 1 ], bz = z >> shift[ 2 ];
+		const auto inside = ( Int8( GridDimension.x ) > bx ) & ( Int8( GridDimension.y ) > by ) & ( Int8( GridDimension.z ) > bz ) &
+							~( zero > x ) & ~( zero > y ) & ~( zero > z );
+		// Lanes outside of the grid read the first entry and are masked out afterwards
+		const auto index = Select( inside, bx, zero ) +
+						   Int8( GridDimension.x ) * ( Select( inside, by, zero ) + Int8( GridDimension.y ) * Select( inside, bz, zero ) );
+		slot = Gather( reinterpret_cast<const std::int32_t *>( entries.get() ), index );
+		offset = ( x & Int8( BrickSize.x - 1 ) ) |
+				 ( ( y & Int8( BrickSize.y - 1 ) ) << shift[ 0 ] ) |
+				 ( ( z & Int8( BrickSize.z - 1 ) ) << ( shift[ 0 ] + shift[ 1 ] ) );
+		return ( inside & ( slot > Int8( Unmapped ) ) ).Bits();
+	}
+
+	/**
+	 * \brief Translates 8 sample positions given in voxel space of the whole volume
+	 */
+	int Translate8( const Float8 &x, const Float8 &y, const Float8 &z, Int8 &slot, Int8 &offset ) const
+	{
+		return Translate8( ToInt8( Floor( x ) ), ToInt8( Floor( y ) ), ToInt8( Floor( z ) ), slot, offset );
+	}
+
+	/**
+	 * \brief Returns the indices of the voxels into the brick pool, i.e. slot * BrickVoxels() + offset
+	 */
+	Int8 PoolIndex8( const Int8 &slot, const Int8 &offset ) const
+	{
+		return ( slot << ( shift[ 0 ] + shift[ 1 ] + shift[ 2 ] ) ) + offset;
+	}
+
+	Vec3i GridDimension;
+	Vec3i BrickSize;
+
+private:
+	std::unique_ptr<std::atomic<std::int32_t>[]> entries;
+	int shift[ 3 ];
+	bool addressable = false;
+};
+
+}  // namespace vm
+
+#endif	// PAGETABLE_H_
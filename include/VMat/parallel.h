@@ -0,0 +1,112 @@
+#ifndef PARALLEL_H_
+#define PARALLEL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vm
+{
+inline unsigned HardwareConcurrency()
+{
+	const auto n = std::thread::hardware_concurrency();
+	return n == 0 ? 1 : n;
+}
+
+/**
+ * \brief Splits [begin, end) into chunks of at most \a grain elements and calls
+ * \a func(chunkBegin, chunkEnd) for each of them on a pool of transient threads.
+ *
+ * The calling thread takes part in the work. The first exception thrown by \a func
+ * is rethrown after all threads have joined.
+ */
+template <typename F>
+void ParallelFor( std::size_t begin, std::size_t end, std::size_t grain, F &&func )
+{
+	if ( end <= begin ) return;
+	grain = ( std::max )( grain, std::size_t( 1 ) );
+	const auto chunkCount = ( end - begin + grain - 1 ) / grain;
+	const auto threadCount = static_cast<std::size_t>( ( std::min )( std::size_t( HardwareConcurrency() ), chunkCount ) );
+	if ( threadCount <= 1 ) {
+		for ( auto b = begin; b < end; b += grain ) func( b, ( std::min )( b + grain, end ) );
+		return;
+	}
+
+	std::atomic<std::size_t> next{ 0 };
+	std::exception_ptr error;
+	std::mutex errorMutex;
+	auto worker = [ & ]() {
+		std::size_t chunk;
+		while ( ( chunk = next.fetch_add( 1, std::memory_order_relaxed ) ) < chunkCount ) {
+			const auto b = begin + chunk * grain;
+			try {
+				func( b, ( std::min )( b + grain, end ) );
+			} catch ( ... ) {
+				std::lock_guard<std::mutex> lk( errorMutex );
+				if ( !error ) error = std::current_exception();
+				next.store( chunkCount, std::memory_order_relaxed );
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve( threadCount - 1 );
+	for ( std::size_t i = 0; i + 1 < threadCount; i++ ) threads.emplace_back( worker );
+	worker();
+	for ( auto &t : threads ) t.join();
+	if ( error ) std::rethrow_exception( error );
+}
+
+/**
+ * \brief Sorts \a values by the lowest \a keyBits bits of \a key(value), a 32-bit unsigned integer.
+ *
+ * A stable LSD radix sort with 8-bit digits. Each pass histograms chunks of the input in
+ * parallel, then every chunk scatters to its own precomputed offsets.
+ */
+template <typename T, typename K>
+void ParallelRadixSort( std::vector<T> &values, int keyBits, K &&key )
+{
+	constexpr int DigitBits = 8;
+	constexpr std::size_t Buckets = std::size_t( 1 ) << DigitBits;
+	const auto n = values.size();
+	if ( n < 2 ) return;
+	const auto chunkCount = ( std::max )( std::size_t( 1 ), ( std::min )( std::size_t( HardwareConcurrency() ) * 4, n / 4096 ) );
+	const auto grain = ( n + chunkCount - 1 ) / chunkCount;
+	const auto keyMask = keyBits >= 32 ? ~std::uint32_t( 0 ) : ( std::uint32_t( 1 ) << keyBits ) - 1;
+	auto digit = [ & ]( const T &v, int shift ) { return ( ( key( v ) & keyMask ) >> shift ) & ( Buckets - 1 ); };
+
+	std::vector<T> buffer( n );
+	std::vector<std::size_t> offsets( chunkCount * Buckets );
+	auto src = &values, dst = &buffer;
+	for ( int shift = 0; shift < keyBits; shift += DigitBits ) {
+		std::fill( offsets.begin(), offsets.end(), 0 );
+		ParallelFor( 0, n, grain, [ & ]( std::size_t b, std::size_t e ) {
+			const auto histogram = &offsets[ b / grain * Buckets ];
+			for ( auto i = b; i < e; i++ ) histogram[ digit( ( *src )[ i ], shift ) ]++;
+		} );
+		// Digit major, chunk minor prefix sums keep equal keys in input order
+		std::size_t sum = 0;
+		for ( std::size_t d = 0; d < Buckets; d++ ) {
+			for ( std::size_t c = 0; c < chunkCount; c++ ) {
+				const auto count = offsets[ c * Buckets + d ];
+				offsets[ c * Buckets + d ] = sum;
+				sum += count;
+			}
+		}
+		ParallelFor( 0, n, grain, [ & ]( std::size_t b, std::size_t e ) {
+			const auto offset = &offsets[ b / grain * Buckets ];
+			for ( auto i = b; i < e; i++ ) ( *dst )[ offset[ digit( ( *src )[ i ], shift ) ]++ ] = ( *src )[ i ];
+		} );
+		std::swap( src, dst );
+	}
+	if ( src != &values ) values.swap( buffer );
+}
+
+}  // namespace vm
+
+#endif	// PARALLEL_H_
@@ -0,0 +1,213 @@
+#ifndef PARTICLE_H_
+#define PARTICLE_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "geometry.h"
+#include "parallel.h"
+#include "simd.h"
+
+/*
+ * Batched versions of rungeKutta4() and integrateEuler() of arithmetic.h.
+ *
+ * The particles are stored as separate arrays of the position and velocity components. They are
+ * advanced 8 per pass, and large systems are split into chunks integrated on all hardware threads.
+ *
+ * The acceleration is a callback on 8 particles at a time:
+ *
+ *     acc( std::size_t first, int lanes, const Float8 p[ 3 ], const Float8 v[ 3 ], Float8 a[ 3 ] )
+ *
+ * It receives the state of particles [first, first + lanes) and writes their acceleration to \a a.
+ * Lanes past \a lanes hold zeros and their results are discarded. The callback runs concurrently
+ * on disjoint ranges of particles.
+ */
+
+namespace vm
+{
+/**
+ * \brief A non-owning view of the SoA arrays of a particle system
+ */
+struct ParticleView
+{
+	float *P[ 3 ];
+	float *V[ 3 ];
+	std::size_t Count;
+};
+
+/**
+ * \brief The SoA storage of a particle system
+ */
+class Particles
+{
+public:
+	Particles() = default;
+	explicit Particles( std::size_t n ) { Resize( n ); }
+
+	void Resize( std::size_t n )
+	{
+		for ( int k = 0; k < 3; k++ ) {
+			p[ k ].resize( n );
+			v[ k ].resize( n );
+		}
+	}
+
+	std::size_t Size() const { return p[ 0 ].size(); }
+
+	void Set( std::size_t i, const Point3f &position, const Vector3f &velocity )
+	{
+		for ( int k = 0; k < 3; k++ ) {
+			p[ k ][ i ] = position[ k ];
+			v[ k ][ i ] = velocity[ k ];
+		}
+	}
+
+	Point3f Position( std::size_t i ) const { return Point3f( p[ 0 ][ i ], p[ 1 ][ i ], p[ 2 ][ i ] ); }
+	Vector3f Velocity( std::size_t i ) const { return Vector3f( v[ 0 ][ i ], v[ 1 ][ i ], v[ 2 ][ i ] ); }
+
+	float *PositionData( int axis ) { return p[ axis ].data(); }
+	float *VelocityData( int axis ) { return v[ axis ].data(); }
+
+	ParticleView View()
+	{
+		return ParticleView{ { p[ 0 ].data(), p[ 1 ].data(), p[ 2 ].data() }, { v[ 0 ].data(), v[ 1 ].data(), v[ 2 ].data() }, Size() };
+	}
+
+private:
+	std::vector<float> p[ 3 ], v[ 3 ];
+};
+
+/**
+ * \brief An acceleration callback applying the same acceleration to every particle
+ */
+inline auto ConstantAcceleration( const Vector3f &acc )
+{
+	return [ acc ]( std::size_t, int, const Float8 *, const Float8 *, Float8 *a ) {
+		for ( int k = 0; k < 3; k++ ) a[ k ] = Float8( acc[ k ] );
+	};
+}
+
+/**
+ * \brief Adapts a scalar callback \a func(index, position, velocity) returning a Vector3f to the
+ * 8-wide acceleration interface. It is called once per particle.
+ */
+template <typename F>
+auto PerParticleAcceleration( F func )
+{
+	return [ func ]( std::size_t first, int lanes, const Float8 *p, const Float8 *v, Float8 *a ) {
+		alignas( 32 ) float in[ 6 ][ 8 ], out[ 3 ][ 8 ] = {};
+		for ( int k = 0; k < 3; k++ ) {
+			p[ k ].Store( in[ k ] );
+			v[ k ].Store( in[ 3 + k ] );
+		}
+		for ( int l = 0; l < lanes; l++ ) {
+			const auto r = func( first + l, Point3f( in[ 0 ][ l ], in[ 1 ][ l ], in[ 2 ][ l ] ), Vector3f( in[ 3 ][ l ], in[ 4 ][ l ], in[ 5 ][ l ] ) );
+			for ( int k = 0; k < 3; k++ ) out[ k ][ l ] = r[ k ];
+		}
+		for ( int k = 0; k < 3; k++ ) a[ k ] = Float8::Load( out[ k ] );
+	};
+}
+
+namespace detail
+{
+/**
+ * \brief Loads 8 particles starting at \a i, calls \a step on their state and stores it back.
+ * The work is split into chunks of \a grain particles run by ParallelFor.
+ */
+template <typename S>
+void ForEachParticle8( const ParticleView &particles, std::size_t grain, S &&step )
+{
+	// Chunks start at multiples of 8, so only the last pass of the last chunk is partial
+	grain = ( ( std::max )( grain, std::size_t( 8 ) ) + 7 ) / 8 * 8;
+	ParallelFor( 0, particles.Count, grain, [ & ]( std::size_t begin, std::size_t end ) {
+		Float8 p[ 3 ], v[ 3 ];
+		for ( auto i = begin; i < end; i += 8 ) {
+			const auto lanes = static_cast<int>( ( std::min )( end - i, std::size_t( 8 ) ) );
+			for ( int k = 0; k < 3; k++ ) {
+				p[ k ] = Float8::LoadN( particles.P[ k ] + i, lanes );
+				v[ k ] = Float8::LoadN( particles.V[ k ] + i, lanes );
+			}
+			step( i, lanes, p, v );
+			for ( int k = 0; k < 3; k++ ) {
+				p[ k ].StoreN( particles.P[ k ] + i, lanes );
+				v[ k ].StoreN( particles.V[ k ] + i, lanes );
+			}
+		}
+	} );
+}
+}  // namespace detail
+
+/**
+ * \brief The number of particles per parallel task of the integrators
+ */
+constexpr std::size_t ParticleGrain = 16 * 1024;
+
+/**
+ * \brief Advances every particle by one explicit Euler step of \a dt, as integrateEuler().
+ *
+ * \param damping The factor applied to the velocity after the step, 1 for none
+ * \param acc The acceleration callback, evaluated at the state before the step
+ */
+template <typename A>
+void IntegrateEuler( const ParticleView &particles, Float dt, Float damping, A &&acc, std::size_t grain = ParticleGrain )
+{
+	VMAT_TRACE_ZONE( "IntegrateEuler" );
+	const Float8 h( dt ), d( damping );
+	detail::ForEachParticle8( particles, grain, [ & ]( std::size_t i, int lanes, Float8 *p, Float8 *v ) {
+		Float8 a[ 3 ];
+		acc( i, lanes, p, v, a );
+		for ( int k = 0; k < 3; k++ ) {
+			p[ k ] = MulAdd( v[ k ], h, p[ k ] );
+			v[ k ] = d * MulAdd( a[ k ], h, v[ k ] );
+		}
+	} );
+}
+
+/**
+ * \brief Advances every particle by one classical fourth order Runge-Kutta step of \a dt, as
+ * rungeKutta4().
+ *
+ * The acceleration is evaluated at the four stages, so it may depend on the position and velocity.
+ * For a constant acceleration the result equals the one of rungeKutta4().
+ *
+ * \param damping The factor applied to the velocity after the step, 1 for none
+ */
+template <typename A>
+void IntegrateRungeKutta4( const ParticleView &particles, Float dt, Float damping, A &&acc, std::size_t grain = ParticleGrain )
+{
+	VMAT_TRACE_ZONE( "IntegrateRungeKutta4" );
+	const Float8 h( dt ), half( dt / 2 ), sixth( dt / 6 ), two( 2.f ), d( damping );
+	detail::ForEachParticle8( particles, grain, [ & ]( std::size_t i, int lanes, Float8 *p, Float8 *v ) {
+		// kp, kv are the position and velocity derivatives of the current stage, sp, sv the sums
+		Float8 kp[ 3 ], kv[ 3 ], sp[ 3 ], sv[ 3 ], ps[ 3 ], vs[ 3 ];
+		acc( i, lanes, p, v, kv );
+		for ( int k = 0; k < 3; k++ ) {
+			kp[ k ] = v[ k ];
+			sp[ k ] = kp[ k ];
+			sv[ k ] = kv[ k ];
+		}
+		for ( int stage = 1; stage < 4; stage++ ) {
+			const auto &s = stage == 3 ? h : half;
+			for ( int k = 0; k < 3; k++ ) {
+				ps[ k ] = MulAdd( kp[ k ], s, p[ k ] );
+				vs[ k ] = MulAdd( kv[ k ], s, v[ k ] );
+			}
+			acc( i, lanes, ps, vs, kv );
+			const auto &w = stage == 3 ? Float8( 1.f ) : two;
+			for ( int k = 0; k < 3; k++ ) {
+				kp[ k ] = vs[ k ];
+				sp[ k ] = MulAdd( kp[ k ], w, sp[ k ] );
+				sv[ k ] = MulAdd( kv[ k ], w, sv[ k ] );
+			}
+		}
+		for ( int k = 0; k < 3; k++ ) {
+			p[ k ] = MulAdd( sp[ k ], sixth, p[ k ] );
+			v[ k ] = d * MulAdd( sv[ k ], sixth, v[ k ] );
+		}
+	} );
+}
+
+}  // namespace vm
+
+#endif	// PARTICLE_H_
@@ -0,0 +1,294 @@
+#ifndef PYRAMID_H_
+#define PYRAMID_H_
+
+#include <cmath>
+#include <vector>
+#include <type_traits>
+
+#include "geometry.h"
+#include "transformation.h"
+#include "parallel.h"
+#include "simd.h"
+
+namespace vm
+{
+enum class DownsampleFilter
+{
+	Box,
+	Min,
+	Max
+};
+
+/**
+ * \brief Returns the dimension of the next coarser level. Odd extents are rounded up
+ */
+inline Size3 HalfDimension( const Size3 &dim )
+{
+	return Size3( ( dim.x + 1 ) / 2, ( dim.y + 1 ) / 2, ( dim.z + 1 ) / 2 );
+}
+
+/**
+ * \brief Reduces the 2x2x2 footprints of the destination voxels [\a dstBegin, \a dstEnd) of a row.
+ *
+ * \a rows are the four source rows (y, z), (y + 1, z), (y, z + 1), (y + 1, z + 1) of the footprint,
+ * already clamped to the volume. The last odd column is clamped as well.
+ */
+template <typename T>
+void DownsampleRow( const T *const rows[ 4 ], std::size_t srcWidth, T *dst, std::size_t dstBegin, std::size_t dstEnd, DownsampleFilter filter )
+{
+	using Acc = typename std::conditional<std::is_floating_point<T>::value, T, double>::type;
+	for ( auto x = dstBegin; x < dstEnd; x++ ) {
+		const auto x0 = 2 * x;
+		const auto x1 = ( std::min )( x0 + 1, srcWidth - 1 );
+		Acc v[ 8 ];
+		for ( int r = 0; r < 4; r++ ) {
+			v[ 2 * r ] = Acc( rows[ r ][ x0 ] );
+			v[ 2 * r + 1 ] = Acc( rows[ r ][ x1 ] );
+		}
+		Acc res = v[ 0 ];
+		switch ( filter ) {
+		case DownsampleFilter::Box:
+			for ( int i = 1; i < 8; i++ ) res += v[ i ];
+			res = res / Acc( 8 );
+			if ( std::is_integral<T>::value ) res = std::floor( res + Acc( 0.5 ) );
+			break;
+		case DownsampleFilter::Min:
+			for ( int i = 1; i < 8; i++ ) res = ( std::min )( res, v[ i ] );
+			break;
+		case DownsampleFilter::Max:
+			for ( int i = 1; i < 8; i++ ) res = ( std::max )( res, v[ i ] );
+			break;
+		}
+		dst[ x ] = static_cast<T>( res );
+	}
+}
+
+/**
+ * \brief The float specialization reduces 8 destination voxels per iteration
+ */
+inline void DownsampleRow( const float *const rows[ 4 ], std::size_t srcWidth, float *dst, std::size_t dstBegin, std::size_t dstEnd, DownsampleFilter filter )
+{
+	// 8 destination voxels read 16 source voxels, the last one must not be the clamped column
+	const auto simdEnd = ( std::max )( dstBegin, ( std::min )( dstEnd, srcWidth / 2 ) );
+	auto x = dstBegin;
+	for ( ; x + 8 <= simdEnd; x += 8 ) {
+		Float8 lo[ 4 ], hi[ 4 ];
+		for ( int r = 0; r < 4; r++ ) {
+			lo[ r ] = Float8::LoadU( rows[ r ] + 2 * x );
+			hi[ r ] = Float8::LoadU( rows[ r ] + 2 * x + 8 );
+		}
+		Float8 l, h, even, odd;
+		switch ( filter ) {
+		case DownsampleFilter::Box:
+			l = ( lo[ 0 ] + lo[ 1 ] ) + ( lo[ 2 ] + lo[ 3 ] );
+			h = ( hi[ 0 ] + hi[ 1 ] ) + ( hi[ 2 ] + hi[ 3 ] );
+			Deinterleave( l, h, even, odd );
+			( ( even + odd ) * 0.125f ).StoreU( dst + x );
+			break;
+		case DownsampleFilter::Min:
+			l = Min( Min( lo[ 0 ], lo[ 1 ] ), Min( lo[ 2 ], lo[ 3 ] ) );
+			h = Min( Min( hi[ 0 ], hi[ 1 ] ), Min( hi[ 2 ], hi[ 3 ] ) );
+			Deinterleave( l, h, even, odd );
+			Min( even, odd ).StoreU( dst + x );
+			break;
+		case DownsampleFilter::Max:
+			l = Max( Max( lo[ 0 ], lo[ 1 ] ), Max( lo[ 2 ], lo[ 3 ] ) );
+			h = Max( Max( hi[ 0 ], hi[ 1 ] ), Max( hi[ 2 ], hi[ 3 ] ) );
+			Deinterleave( l, h, even, odd );
+			Max( even, odd ).StoreU( dst + x );
+			break;
+		}
+	}
+	DownsampleRow<float>( rows, srcWidth, dst, x, dstEnd, filter );
+}
+
+/**
+ * \brief Halves the volume \a src of \a srcDim into \a dst, which must hold HalfDimension(srcDim).Prod() voxels.
+ * Rows of the destination are distributed over all hardware threads.
+ *
+ * \return The dimension of \a dst
+ */
+template <typename T>
+Size3 Downsample( const T *src, const Size3 &srcDim, T *dst, DownsampleFilter filter = DownsampleFilter::Box )
+{
+	VMAT_TRACE_ZONE( "Downsample" );
+	const auto dstDim = HalfDimension( srcDim );
+	const auto rowCount = dstDim.y * dstDim.z;
+	const auto grain = ( std::max )( std::size_t( 1 ), std::size_t( 16384 ) / dstDim.x );
+	ParallelFor( 0, rowCount, grain, [ & ]( std::size_t begin, std::size_t end ) {
+		for ( auto row = begin; row < end; row++ ) {
+			const auto y = row % dstDim.y;
+			const auto z = row / dstDim.y;
+			const std::size_t sy[ 2 ] = { 2 * y, ( std::min )( 2 * y + 1, srcDim.y - 1 ) };
+			const std::size_t sz[ 2 ] = { 2 * z, ( std::min )( 2 * z + 1, srcDim.z - 1 ) };
+			const T *rows[ 4 ];
+			for ( int r = 0; r < 4; r++ ) {
+				rows[ r ] = src + ( sy[ r & 1 ] + sz[ r >> 1 ] * srcDim.y ) * srcDim.x;
+			}
+			DownsampleRow( rows, srcDim.x, dst + row * dstDim.x, 0, dstDim.x, filter );
+		}
+	} );
+	return dstDim;
+}
+
+/**
+ * \brief Chooses pyramid levels by the screen space size of a projected bound.
+ *
+ * A level is acceptable when one of its voxels covers at most \a pixelError pixels on the screen.
+ */
+class LodSelector
+{
+public:
+	/**
+	 * \param worldToClip The view projection transform, e.g. Perspective(...) * LookAt(...)
+	 * \param viewport The size of the screen in pixels
+	 */
+	LodSelector( const Transform &worldToClip, const Vec2i &viewport, Float pixelError = 1 ) :
+	  worldToClip( worldToClip.Matrix() ), viewport( viewport ), pixelError( pixelError )
+	{
+	}
+
+	/**
+	 * \brief Returns the larger side of the screen space rectangle of \a bound in pixels,
+	 * or MAX_VALUE if the bound reaches behind the eye
+	 */
+	Float ProjectedExtent( const Bound3f &bound ) const
+	{
+		const auto &m = worldToClip.m;
+		Float minX = MAX_VALUE, minY = MAX_VALUE, maxX = LOWEST_FLOAT, maxY = LOWEST_FLOAT;
+		for ( int i = 0; i < 8; i++ ) {
+			const auto p = bound.Corner( i );
+			const auto w = m[ 3 ][ 0 ] * p.x + m[ 3 ][ 1 ] * p.y + m[ 3 ][ 2 ] * p.z + m[ 3 ][ 3 ];
+			if ( w <= 0 ) return MAX_VALUE;
+			const auto x = ( m[ 0 ][ 0 ] * p.x + m[ 0 ][ 1 ] * p.y + m[ 0 ][ 2 ] * p.z + m[ 0 ][ 3 ] ) / w;
+			const auto y = ( m[ 1 ][ 0 ] * p.x + m[ 1 ][ 1 ] * p.y + m[ 1 ][ 2 ] * p.z + m[ 1 ][ 3 ] ) / w;
+			minX = ( std::min )( minX, x );
+			maxX = ( std::max )( maxX, x );
+			minY = ( std::min )( minY, y );
+			maxY = ( std::max )( maxY, y );
+		}
+		// NDC spans 2 units across the viewport
+		return ( std::max )( ( maxX - minX ) * viewport.x, ( maxY - minY ) * viewport.y ) * Float( 0.5 );
+	}
+
+	/**
+	 * \brief Returns the coarsest level in [0, levelCount) meeting the pixel error budget
+	 *
+	 * \param bound The world space bound of the brick
+	 * \param voxelsAcross The number of level 0 voxels along the largest side of the brick
+	 */
+	int Select( const Bound3f &bound, Float voxelsAcross, int levelCount ) const
+	{
+		const auto extent = ProjectedExtent( bound );
+		if ( extent <= 0 ) return levelCount - 1;
+		// A level l voxel covers extent * 2^l / voxelsAcross pixels
+		const auto ratio = pixelError * voxelsAcross / extent;
+		if ( ratio < 2 ) return 0;
+		const auto level = static_cast<int>( std::floor( std::log2( ratio ) ) );
+		return Clamp( level, 0, levelCount - 1 );
+	}
+
+private:
+	Matrix4x4 worldToClip;
+	Vec2i viewport;
+	Float pixelError;
+};
+
+/**
+ * \brief A multi-resolution pyramid of a volume.
+ *
+ * Each level halves the dimension of the previous one. The bricks of every level share the same
+ * voxel size \a BrickSize and are described by a Grid over the world space bound, so a level l brick
+ * covers 2^l level 0 bricks along each axis.
+ */
+template <typename T>
+class VolumePyramid
+{
+public:
+	struct Level
+	{
+		Size3 Dimension;
+		std::vector<T> Data;
+		Grid<Float> Bricks;
+	};
+
+	/**
+	 * \param data The level 0 voxels, x varies fastest
+	 * \param maxLevels The maximum number of levels. 0 builds levels until a single brick remains
+	 */
+	VolumePyramid( const T *data, const Size3 &dimension, const Bound3f &bound, const Vec3i &brickSize,
+				   DownsampleFilter filter = DownsampleFilter::Box, int maxLevels = 0 ) :
+	  BrickSize( brickSize ), Bound( bound )
+	{
+		const auto diag = bound.Diagonal();
+		voxelSize = Vec3f( diag.x / dimension.x, diag.y / dimension.y, diag.z / dimension.z );
+		levels.push_back( Level{ dimension, std::vector<T>( data, data + dimension.Prod() ), MakeBrickGrid( dimension, 0 ) } );
+		while ( maxLevels <= 0 || int( levels.size() ) < maxLevels ) {
+			const auto &prev = levels.back();
+			if ( prev.Bricks.GridDimension == Vec3i( 1, 1, 1 ) ) break;
+			const auto dim = HalfDimension( prev.Dimension );
+			std::vector<T> next( dim.Prod() );
+			Downsample( prev.Data.data(), prev.Dimension, next.data(), filter );
+			levels.push_back( Level{ dim, std::move( next ), MakeBrickGrid( dim, int( levels.size() ) ) } );
+		}
+	}
+
+	int LevelCount() const { return int( levels.size() ); }
+
+	const Level &operator[]( int level ) const
+	{
+		assert( level >= 0 && level < LevelCount() );
+		return levels[ level ];
+	}
+
+	/**
+	 * \brief Returns the brick of \a level containing the level 0 brick \a brick
+	 */
+	static Point3i BrickAtLevel( const Point3i &brick, int level )
+	{
+		return Point3i( brick.x >> level, brick.y >> level, brick.z >> level );
+	}
+
+	/**
+	 * \brief Selects a level for every level 0 brick. The result is indexed by Linear(brick, GridDimension)
+	 */
+	std::vector<int> SelectLevels( const LodSelector &selector ) const
+	{
+		const auto &grid = levels[ 0 ].Bricks;
+		const auto dim = grid.GridDimension;
+		const auto voxelsAcross = Float( ( std::max )( BrickSize.x, ( std::max )( BrickSize.y, BrickSize.z ) ) );
+		std::vector<int> res( dim.Prod() );
+		ParallelFor( 0, res.size(), 1024, [ & ]( std::size_t begin, std::size_t end ) {
+			for ( auto i = begin; i < end; i++ ) {
+				const auto plane = std::size_t( dim.x ) * dim.y;
+				const Point3i cell( int( i % dim.x ), int( ( i % plane ) / dim.x ), int( i / plane ) );
+				res[ i ] = selector.Select( grid.CellBound( cell ), voxelsAcross, LevelCount() );
+			}
+		} );
+		return res;
+	}
+
+	Vec3i BrickSize;
+	Bound3f Bound;
+
+private:
+	Grid<Float> MakeBrickGrid( const Size3 &dim, int level ) const
+	{
+		const Vec3i gridDim( int( ( dim.x + BrickSize.x - 1 ) / BrickSize.x ),
+							 int( ( dim.y + BrickSize.y - 1 ) / BrickSize.y ),
+							 int( ( dim.z + BrickSize.z - 1 ) / BrickSize.z ) );
+		// The grid covers whole bricks, so it may extend beyond the volume
+		const auto scale = Float( 1 << level );
+		const Vec3f extent( gridDim.x * BrickSize.x * voxelSize.x * scale,
+							gridDim.y * BrickSize.y * voxelSize.y * scale,
+							gridDim.z * BrickSize.z * voxelSize.z * scale );
+		return Grid<Float>( Bound3f( Bound.min, Bound.min + extent ), gridDim );
+	}
+
+	Vec3f voxelSize;
+	std::vector<Level> levels;
+};
+
+}  // namespace vm
+
+#endif	// PYRAMID_H_
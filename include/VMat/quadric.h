@@ -0,0 +1,387 @@
+#ifndef QUADRIC_H_
+#define QUADRIC_H_
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+#include "arithmetic.h"
+#include "geometry.h"
+#include "simd.h"
+
+/*
+ * Ray intersection with spheres and general quadrics, one at a time and 8 at a time in SoA layout.
+ *
+ * All of them hit the nearest root in (0, tMax]. The roots are computed with the stable form of
+ * quadraticEquation(), and for spheres the discriminant is computed from the distance of the
+ * center to the ray as in Haines et al., "Precision Improvements for Ray/Sphere Intersection",
+ * Ray Tracing Gems, 2019, which keeps small spheres far from the origin intact.
+ *
+ * quadraticEquation() forms the discriminant of general quadrics in double precision. The 8-wide
+ * form stays in single precision but computes b^2 - 4ac with Kahan's error-free product, so the
+ * discriminant is correctly rounded up to an ulp and near-tangent rays hit or miss as in the
+ * scalar path. Only the remaining square root and divisions round in float instead of double.
+ */
+
+namespace vm
+{
+namespace detail
+{
+/**
+ * \brief b^2 - 4ac without the cancellation of the rounded products
+ */
+inline Float8 Discriminant8( const Float8 &a, const Float8 &b, const Float8 &c )
+{
+#if defined( VMAT_SIMD_AVX2 ) && defined( __FMA__ )
+	// w rounds 4ac, e = 4ac - w exactly, and b^2 - w is fused into a single rounding
+	const auto a4 = Float8( 4.f ) * a;
+	const auto w = a4 * c;
+	const auto e = Float8( _mm256_fmsub_ps( a4.v, c.v, w.v ) );
+	return MulAdd( b, b, -w ) - e;
+#else
+	alignas( 32 ) float d[ 8 ];
+	for ( int i = 0; i < 8; i++ ) d[ i ] = float( double( b[ i ] ) * b[ i ] - 4 * double( a[ i ] ) * c[ i ] );
+	return Float8::Load( d );
+#endif
+}
+}  // namespace detail
+
+/**
+ * \brief The 8-wide counterpart of quadraticEquation(). t1 and t2 are meaningful in the returned
+ * lanes only, a must not be 0.
+ */
+inline Mask8 quadraticEquation8( const Float8 &a, const Float8 &b, const Float8 &c, Float8 &t1, Float8 &t2 )
+{
+	const auto zero = Float8::Zero();
+	const auto delta = detail::Discriminant8( a, b, c );
+	const auto rd = Sqrt( Max( delta, zero ) );
+	const auto negative = b < zero;
+	const auto q = Float8( -0.5f ) * ( b + Select( negative, -rd, rd ) );
+	const auto large = q / a, small = Select( q == zero, zero, c / q );
+	t1 = Select( negative, large, small );
+	t2 = Select( negative, small, large );
+	return delta >= zero;
+}
+
+namespace detail
+{
+/**
+ * \brief Picks the nearest of the roots \a t1 and \a t2 in (0, tMax], returns false if there is none
+ */
+inline bool NearestRoot( Float t1, Float t2, Float tMax, Float *t )
+{
+	const auto near = ( std::min )( t1, t2 ), far = ( std::max )( t1, t2 );
+	const auto hit = near > 0 ? near : far;
+	if ( !( hit > 0 && hit <= tMax ) ) return false;
+	*t = hit;
+	return true;
+}
+
+inline Mask8 NearestRoot8( const Mask8 &valid, const Float8 &t1, const Float8 &t2, Float tMax, Float8 &t )
+{
+	const auto zero = Float8::Zero();
+	const auto near = Min( t1, t2 ), far = Max( t1, t2 );
+	t = Select( near > zero, near, far );
+	return valid & ( t > zero ) & ( t <= Float8( tMax ) );
+}
+}  // namespace detail
+
+struct Sphere
+{
+	Point3f Center;
+	Float Radius = 0;
+
+	Sphere() = default;
+	Sphere( const Point3f &center, Float radius ) :
+	  Center( center ), Radius( radius ) {}
+
+	Bound3f Bound() const
+	{
+		const Vector3f r( Radius, Radius, Radius );
+		return Bound3f( Center - r, Center + r );
+	}
+
+	bool Intersect( const Ray &ray, Float *tHit = nullptr ) const
+	{
+		const auto &d = ray.Direction();
+		const auto f = ray.Original() - Center;
+		const auto a = Vector3f::Dot( d, d );
+		const auto b = Vector3f::Dot( f, d );
+		const auto c = Vector3f::Dot( f, f ) - Radius * Radius;
+		// delta / 4a of the equation a t^2 + 2b t + c, from the closest point of the ray to the center
+		const auto l = f - ( b / a ) * d;
+		const auto delta = a * ( Radius * Radius - Vector3f::Dot( l, l ) );
+		if ( delta < 0 ) return false;
+		const auto q = -( b + ( b < 0 ? -std::sqrt( delta ) : std::sqrt( delta ) ) );
+		Float t;
+		if ( !detail::NearestRoot( q / a, q == 0 ? 0 : c / q, ray.tMax, &t ) ) return false;
+		if ( tHit != nullptr ) *tHit = t;
+		return true;
+	}
+};
+
+/**
+ * \brief 8 spheres in SoA layout, intersected with one ray at once
+ */
+struct alignas( 32 ) Sphere8
+{
+	float C[ 3 ][ 8 ] = {};
+	float R[ 8 ] = {};
+	int Count = 0;
+
+	void Set( int lane, const Sphere &sphere )
+	{
+		assert( lane >= 0 && lane < 8 );
+		for ( int a = 0; a < 3; a++ ) C[ a ][ lane ] = sphere.Center[ a ];
+		R[ lane ] = sphere.Radius;
+		Count = ( std::max )( Count, lane + 1 );
+	}
+
+	Sphere Get( int lane ) const
+	{
+		assert( lane >= 0 && lane < 8 );
+		return Sphere( Point3f( C[ 0 ][ lane ], C[ 1 ][ lane ], C[ 2 ][ lane ] ), R[ lane ] );
+	}
+
+	/**
+	 * \brief Intersects the first Count spheres with the ray
+	 *
+	 * \param t Receives the distances, meaningful in the hit lanes only
+	 * \return The bit mask of the spheres hit
+	 */
+	int Intersect( const Ray &ray, Float8 &t ) const
+	{
+		return IntersectSoA( C[ 0 ], C[ 1 ], C[ 2 ], R, Count, ray, t, Float8::Load );
+	}
+
+	/**
+	 * \brief Returns the lane of the closest hit or -1
+	 */
+	int IntersectClosest( const Ray &ray, Float *tHit = nullptr ) const
+	{
+		Float8 t;
+		const auto mask = Intersect( ray, t );
+		return ClosestLane( mask, t, tHit );
+	}
+
+	/**
+	 * \brief The kernel of Sphere8 and SphereSet on 8 spheres read by \a load from the given arrays
+	 */
+	template <typename L>
+	static int IntersectSoA( const float *x, const float *y, const float *z, const float *r, int count,
+							 const Ray &ray, Float8 &t, L &&load )
+	{
+		const auto &o = ray.Original();
+		const auto &d = ray.Direction();
+		const Float8 dx( d.x ), dy( d.y ), dz( d.z );
+		const auto fx = Float8( o.x ) - load( x ), fy = Float8( o.y ) - load( y ), fz = Float8( o.z ) - load( z );
+		const auto radius = load( r );
+		const auto r2 = radius * radius;
+		const Float8 a( Vector3f::Dot( d, d ) );
+		const auto b = fx * dx + fy * dy + fz * dz;
+		const auto c = fx * fx + fy * fy + fz * fz - r2;
+		const auto s = b / a;
+		const auto lx = fx - s * dx, ly = fy - s * dy, lz = fz - s * dz;
+		const auto delta = a * ( r2 - ( lx * lx + ly * ly + lz * lz ) );
+		const auto zero = Float8::Zero();
+		const auto rd = Sqrt( Max( delta, zero ) );
+		const auto q = zero - ( b + Select( b < zero, -rd, rd ) );
+		const auto t1 = q / a, t2 = Select( q == zero, zero, c / q );
+		const auto hit = detail::NearestRoot8( delta >= zero, t1, t2, ray.tMax, t );
+		return hit.Bits() & ( ( 1 << count ) - 1 );
+	}
+
+	static int ClosestLane( int mask, const Float8 &t, Float *tHit )
+	{
+		if ( !mask ) return -1;
+		int best = -1;
+		for ( int lane = 0; lane < 8; lane++ ) {
+			if ( ( ( mask >> lane ) & 1 ) && ( best < 0 || t[ lane ] < t[ best ] ) ) best = lane;
+		}
+		if ( tHit != nullptr ) *tHit = t[ best ];
+		return best;
+	}
+};
+
+/**
+ * \brief A set of spheres in SoA layout, such as particles or glyphs, intersected 8 at a time
+ */
+class SphereSet
+{
+public:
+	void Add( const Sphere &sphere )
+	{
+		for ( int a = 0; a < 3; a++ ) c[ a ].push_back( sphere.Center[ a ] );
+		r.push_back( sphere.Radius );
+	}
+
+	void Reserve( std::size_t n )
+	{
+		for ( int a = 0; a < 3; a++ ) c[ a ].reserve( n );
+		r.reserve( n );
+	}
+
+	std::size_t Size() const { return r.size(); }
+	Sphere Get( std::size_t i ) const { return Sphere( Point3f( c[ 0 ][ i ], c[ 1 ][ i ], c[ 2 ][ i ] ), r[ i ] ); }
+
+	/**
+	 * \brief Intersects spheres [first, first + 8) with the ray, lanes past the end never hit
+	 */
+	int Intersect8( std::size_t first, const Ray &ray, Float8 &t ) const
+	{
+		assert( first < Size() );
+		const auto n = static_cast<int>( ( std::min )( Size() - first, std::size_t( 8 ) ) );
+		return Sphere8::IntersectSoA( c[ 0 ].data() + first, c[ 1 ].data() + first, c[ 2 ].data() + first, r.data() + first, n, ray, t,
+									  [ n ]( const float *p ) { return Float8::LoadN( p, n ); } );
+	}
+
+	/**
+	 * \brief Returns the index of the sphere hit first or -1. The range tested shrinks as hits are found.
+	 */
+	std::ptrdiff_t IntersectClosest( const Ray &ray, Float *tHit = nullptr ) const
+	{
+		auto shrunk = ray;
+		std::ptrdiff_t best = -1;
+		for ( std::size_t i = 0; i < Size(); i += 8 ) {
+			Float8 t;
+			Float tLane;
+			const auto lane = Sphere8::ClosestLane( Intersect8( i, shrunk, t ), t, &tLane );
+			if ( lane < 0 ) continue;
+			best = std::ptrdiff_t( i ) + lane;
+			shrunk.tMax = tLane;
+		}
+		if ( best >= 0 && tHit != nullptr ) *tHit = shrunk.tMax;
+		return best;
+	}
+
+private:
+	std::vector<float> c[ 3 ], r;
+};
+
+/**
+ * \brief The implicit surface A x^2 + B y^2 + C z^2 + D xy + E xz + F yz + G x + H y + I z + J = 0
+ */
+struct Quadric
+{
+	Float A = 0, B = 0, C = 0, D = 0, E = 0, F = 0, G = 0, H = 0, I = 0, J = 0;
+
+	static Quadric FromSphere( const Point3f &center, Float radius )
+	{
+		Quadric q;
+		q.A = q.B = q.C = 1;
+		q.G = -2 * center.x;
+		q.H = -2 * center.y;
+		q.I = -2 * center.z;
+		q.J = center.x * center.x + center.y * center.y + center.z * center.z - radius * radius;
+		return q;
+	}
+
+	/**
+	 * \brief The coefficients of a t^2 + b t + c along the ray o + t d
+	 */
+	void RayCoefficients( const Point3f &o, const Vector3f &d, Float &a, Float &b, Float &c ) const
+	{
+		a = A * d.x * d.x + B * d.y * d.y + C * d.z * d.z + D * d.x * d.y + E * d.x * d.z + F * d.y * d.z;
+		b = 2 * ( A * o.x * d.x + B * o.y * d.y + C * o.z * d.z ) + D * ( o.x * d.y + o.y * d.x ) +
+			E * ( o.x * d.z + o.z * d.x ) + F * ( o.y * d.z + o.z * d.y ) + G * d.x + H * d.y + I * d.z;
+		c = A * o.x * o.x + B * o.y * o.y + C * o.z * o.z + D * o.x * o.y + E * o.x * o.z + F * o.y * o.z +
+			G * o.x + H * o.y + I * o.z + J;
+	}
+
+	/**
+	 * \brief The unnormalized normal, the gradient of the implicit function at \a p
+	 */
+	Vector3f Gradient( const Point3f &p ) const
+	{
+		return Vector3f( 2 * A * p.x + D * p.y + E * p.z + G,
+						 2 * B * p.y + D * p.x + F * p.z + H,
+						 2 * C * p.z + E * p.x + F * p.y + I );
+	}
+
+	bool Intersect( const Ray &ray, Float *tHit = nullptr ) const
+	{
+		Float a, b, c, t1, t2, t;
+		RayCoefficients( ray.Original(), ray.Direction(), a, b, c );
+		if ( a == 0 ) {
+			// The ray is parallel to an asymptotic direction, one root at most
+			if ( b == 0 ) return false;
+			t1 = t2 = -c / b;
+		} else if ( !quadraticEquation( a, b, c, t1, t2 ) ) {
+			return false;
+		}
+		if ( !detail::NearestRoot( t1, t2, ray.tMax, &t ) ) return false;
+		if ( tHit != nullptr ) *tHit = t;
+		return true;
+	}
+};
+
+/**
+ * \brief 8 quadrics in SoA layout, intersected with one ray at once
+ */
+struct alignas( 32 ) Quadric8
+{
+	/**
+	 * \brief Q[coefficient][lane], the coefficients in the order A to J
+	 */
+	float Q[ 10 ][ 8 ] = {};
+	int Count = 0;
+
+	void Set( int lane, const Quadric &q )
+	{
+		assert( lane >= 0 && lane < 8 );
+		const Float coefficients[ 10 ] = { q.A, q.B, q.C, q.D, q.E, q.F, q.G, q.H, q.I, q.J };
+		for ( int i = 0; i < 10; i++ ) Q[ i ][ lane ] = coefficients[ i ];
+		Count = ( std::max )( Count, lane + 1 );
+	}
+
+	Quadric Get( int lane ) const
+	{
+		assert( lane >= 0 && lane < 8 );
+		Quadric q;
+		Float *coefficients[ 10 ] = { &q.A, &q.B, &q.C, &q.D, &q.E, &q.F, &q.G, &q.H, &q.I, &q.J };
+		for ( int i = 0; i < 10; i++ ) *coefficients[ i ] = Q[ i ][ lane ];
+		return q;
+	}
+
+	/**
+	 * \brief Intersects the first Count quadrics with the ray
+	 *
+	 * \param t Receives the distances, meaningful in the hit lanes only
+	 * \return The bit mask of the quadrics hit
+	 */
+	int Intersect( const Ray &ray, Float8 &t ) const
+	{
+		const auto &o = ray.Original();
+		const auto &d = ray.Direction();
+		const auto A = Float8::Load( Q[ 0 ] ), B = Float8::Load( Q[ 1 ] ), C = Float8::Load( Q[ 2 ] );
+		const auto D = Float8::Load( Q[ 3 ] ), E = Float8::Load( Q[ 4 ] ), F = Float8::Load( Q[ 5 ] );
+		const auto G = Float8::Load( Q[ 6 ] ), H = Float8::Load( Q[ 7 ] ), I = Float8::Load( Q[ 8 ] );
+		const auto J = Float8::Load( Q[ 9 ] );
+		const auto a = A * ( d.x * d.x ) + B * ( d.y * d.y ) + C * ( d.z * d.z ) + D * ( d.x * d.y ) + E * ( d.x * d.z ) + F * ( d.y * d.z );
+		const auto b = Float8( 2.f ) * ( A * ( o.x * d.x ) + B * ( o.y * d.y ) + C * ( o.z * d.z ) ) + D * ( o.x * d.y + o.y * d.x ) +
+					   E * ( o.x * d.z + o.z * d.x ) + F * ( o.y * d.z + o.z * d.y ) + G * d.x + H * d.y + I * d.z;
+		const auto c = A * ( o.x * o.x ) + B * ( o.y * o.y ) + C * ( o.z * o.z ) + D * ( o.x * o.y ) + E * ( o.x * o.z ) + F * ( o.y * o.z ) +
+					   G * o.x + H * o.y + I * o.z + J;
+
+		const auto zero = Float8::Zero();
+		const auto linear = a == zero;
+		Float8 t1, t2;
+		// The linear lanes divide by a = 0 in quadraticEquation8() and are replaced by their single root
+		auto valid = quadraticEquation8( Select( linear, Float8( 1.f ), a ), b, c, t1, t2 );
+		const auto root = zero - c / b;
+		t1 = Select( linear, root, t1 );
+		t2 = Select( linear, root, t2 );
+		valid = ( linear & ( b != zero ) ) | ( ~linear & valid );
+		return detail::NearestRoot8( valid, t1, t2, ray.tMax, t ).Bits() & ( ( 1 << Count ) - 1 );
+	}
+
+	int IntersectClosest( const Ray &ray, Float *tHit = nullptr ) const
+	{
+		Float8 t;
+		return Sphere8::ClosestLane( Intersect( ray, t ), t, tHit );
+	}
+};
+
+}  // namespace vm
+
+#endif	// QUADRIC_H_
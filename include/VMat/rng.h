@@ -0,0 +1,185 @@
+#ifndef RNG_H_
+#define RNG_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include "arithmetic.h"
+#include "geometry.h"
+#include "numeric.h"
+#include "simd.h"
+
+namespace vm
+{
+/**
+ * \brief The Philox4x32-10 counter-based generator of Salmon et al., "Parallel Random Numbers:
+ * As Easy as 1, 2, 3", SC 2011.
+ *
+ * A block of 4 random words is a pure function of a 128-bit counter and a 64-bit key, so there is
+ * no state to share between threads and any number can be drawn in any order.
+ */
+struct Philox4x32
+{
+	static constexpr std::uint32_t M0 = 0xd2511f53, M1 = 0xcd9e8d57;
+	static constexpr std::uint32_t W0 = 0x9e3779b9, W1 = 0xbb67ae85;
+
+	static void Generate( const std::uint32_t counter[ 4 ], const std::uint32_t key[ 2 ], std::uint32_t out[ 4 ] )
+	{
+		std::uint32_t c0 = counter[ 0 ], c1 = counter[ 1 ], c2 = counter[ 2 ], c3 = counter[ 3 ];
+		std::uint32_t k0 = key[ 0 ], k1 = key[ 1 ];
+		for ( int round = 0; round < 10; round++ ) {
+			const auto p0 = std::uint64_t( M0 ) * c0, p1 = std::uint64_t( M1 ) * c2;
+			c0 = std::uint32_t( p1 >> 32 ) ^ c1 ^ k0;
+			c1 = std::uint32_t( p1 );
+			c2 = std::uint32_t( p0 >> 32 ) ^ c3 ^ k1;
+			c3 = std::uint32_t( p0 );
+			k0 += W0;
+			k1 += W1;
+		}
+		out[ 0 ] = c0;
+		out[ 1 ] = c1;
+		out[ 2 ] = c2;
+		out[ 3 ] = c3;
+	}
+
+	/**
+	 * \brief Generates 8 independent blocks at once, one per lane. The words are updated in place.
+	 */
+	static void Generate8( Int8 c[ 4 ], Int8 k0, Int8 k1 )
+	{
+		const auto w0 = Int8( std::int32_t( W0 ) ), w1 = Int8( std::int32_t( W1 ) );
+		for ( int round = 0; round < 10; round++ ) {
+			Int8 hi0, lo0, hi1, lo1;
+			MulHiLo( c[ 0 ], M0, hi0, lo0 );
+			MulHiLo( c[ 2 ], M1, hi1, lo1 );
+			c[ 0 ] = hi1 ^ c[ 1 ] ^ k0;
+			c[ 1 ] = lo1;
+			c[ 2 ] = hi0 ^ c[ 3 ] ^ k1;
+			c[ 3 ] = lo0;
+			k0 = k0 + w0;
+			k1 = k1 + w1;
+		}
+	}
+};
+
+/**
+ * \brief The random numbers of one sample of one pixel.
+ *
+ * The stream is keyed by (pixel, sample, seed) and dimension \a dim is the counter, so a render
+ * is reproducible however its samples are scheduled over threads. Copies are cheap and need no
+ * synchronization.
+ *
+ * Get2D() and Get3D() take the words of block \a dim. Uniform() packs four dimensions into a
+ * block of a separate counter range, dimension \a dim being word dim % 4 of block dim / 4, so
+ * Uniform8() uses every word of the two blocks it generates.
+ */
+class PhiloxRNG
+{
+public:
+	PhiloxRNG( const Point2i &pixel, std::uint32_t sample, std::uint32_t seed = 0 )
+	{
+		const auto k = Key( pixel, sample, seed );
+		key[ 0 ] = std::uint32_t( k );
+		key[ 1 ] = std::uint32_t( k >> 32 );
+	}
+
+	/**
+	 * \brief A uniform number in [0, 1) for dimension \a dim
+	 */
+	Float Uniform( std::uint32_t dim ) const
+	{
+		std::uint32_t w[ 4 ];
+		UniformBlock( dim >> 2, w );
+		return UnitFloat( w[ dim & 3 ] );
+	}
+
+	/**
+	 * \brief Dimensions [dim, dim + 8) in one pass, lane l equals Uniform(dim + l). Generates two
+	 * blocks when \a dim is a multiple of 4, three otherwise.
+	 */
+	Float8 Uniform8( std::uint32_t dim ) const
+	{
+		std::uint32_t w[ 12 ];
+		UniformBlock( dim >> 2, w );
+		UniformBlock( ( dim >> 2 ) + 1, w + 4 );
+		if ( dim & 3 ) UniformBlock( ( dim >> 2 ) + 2, w + 8 );
+		return UnitFloat8( Int8::LoadU( reinterpret_cast<const std::int32_t *>( w + ( dim & 3 ) ) ) );
+	}
+
+	/**
+	 * \brief The first two words of the block of \a dim, as a sample for the 2D warps
+	 */
+	Point2f Get2D( std::uint32_t dim ) const
+	{
+		std::uint32_t w[ 4 ];
+		Block( dim, w );
+		return Point2f( UnitFloat( w[ 0 ] ), UnitFloat( w[ 1 ] ) );
+	}
+
+	Point3f Get3D( std::uint32_t dim ) const
+	{
+		std::uint32_t w[ 4 ];
+		Block( dim, w );
+		return Point3f( UnitFloat( w[ 0 ] ), UnitFloat( w[ 1 ] ), UnitFloat( w[ 2 ] ) );
+	}
+
+	/**
+	 * \brief russianRoulette() with the number of dimension \a dim
+	 */
+	bool RussianRoulette( Float p, std::uint32_t dim ) const
+	{
+		return russianRoulette( p, Uniform( dim ) );
+	}
+
+	/**
+	 * \brief Writes Get2D(dim) of samples [firstSample, firstSample + count) of \a pixel, 8 samples
+	 * per pass, in the SoA layout of the batched warps
+	 */
+	static void Get2D( const Point2i &pixel, std::uint32_t firstSample, std::size_t count, std::uint32_t dim,
+					   float *u0, float *u1, std::uint32_t seed = 0 )
+	{
+		alignas( 32 ) std::int32_t k0[ 8 ], k1[ 8 ];
+		alignas( 32 ) float tmp[ 2 ][ 8 ];
+		for ( std::size_t i = 0; i < count; i += 8 ) {
+			for ( int l = 0; l < 8; l++ ) {
+				const auto k = Key( pixel, firstSample + std::uint32_t( i + l ), seed );
+				k0[ l ] = std::int32_t( std::uint32_t( k ) );
+				k1[ l ] = std::int32_t( std::uint32_t( k >> 32 ) );
+			}
+			Int8 c[ 4 ] = { Int8( std::int32_t( dim ) ), Int8( 0 ), Int8( 0 ), Int8( 0 ) };
+			Philox4x32::Generate8( c, Int8::LoadU( k0 ), Int8::LoadU( k1 ) );
+			UnitFloat8( c[ 0 ] ).Store( tmp[ 0 ] );
+			UnitFloat8( c[ 1 ] ).Store( tmp[ 1 ] );
+			const auto n = ( std::min )( count - i, std::size_t( 8 ) );
+			for ( std::size_t l = 0; l < n; l++ ) {
+				u0[ i + l ] = tmp[ 0 ][ l ];
+				u1[ i + l ] = tmp[ 1 ][ l ];
+			}
+		}
+	}
+
+private:
+	static std::uint64_t Key( const Point2i &pixel, std::uint32_t sample, std::uint32_t seed )
+	{
+		return Hash( ( std::uint64_t( std::uint32_t( pixel.y ) ) << 32 ) | std::uint32_t( pixel.x ), sample, seed );
+	}
+
+	void Block( std::uint32_t dim, std::uint32_t w[ 4 ] ) const
+	{
+		const std::uint32_t counter[ 4 ] = { dim, 0, 0, 0 };
+		Philox4x32::Generate( counter, key, w );
+	}
+
+	void UniformBlock( std::uint32_t block, std::uint32_t w[ 4 ] ) const
+	{
+		const std::uint32_t counter[ 4 ] = { block, 1, 0, 0 };
+		Philox4x32::Generate( counter, key, w );
+	}
+
+	std::uint32_t key[ 2 ];
+};
+
+}  // namespace vm
+
+#endif	// RNG_H_
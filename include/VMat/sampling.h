@@ -0,0 +1,175 @@
+#ifndef SAMPLING_H_
+#define SAMPLING_H_
+
+#include <cstddef>
+
+#include "arithmetic.h"
+#include "geometry.h"
+#include "simd.h"
+
+/*
+ * Batched versions of the sample warps of arithmetic.h.
+ *
+ * Each warp comes in three forms: an 8-wide kernel on Float8, an SoA form on separate arrays of
+ * the two sample dimensions and the output components, and an array form on Point2f in and
+ * Vector3f/Point2f out. The results match the scalar functions within 1e-6 per component, the
+ * difference being the error of SinCos().
+ */
+
+namespace vm
+{
+inline void uniformSampleSphere8( const Float8 &u0, const Float8 &u1, Float8 &x, Float8 &y, Float8 &z )
+{
+	y = Float8( 1.f ) - Float8( 2.f ) * u0;
+	const auto r = Sqrt( Max( Float8( 1.f ) - y * y, Float8::Zero() ) );
+	Float8 s, c;
+	SinCos( Float8( 2 * Pi ) * u1, s, c );
+	x = r * c;
+	z = r * s;
+}
+
+inline void uniformSampleHemiSphere8( const Float8 &u0, const Float8 &u1, Float8 &x, Float8 &y, Float8 &z )
+{
+	y = u0;
+	const auto sinTheta = Sqrt( Max( Float8( 1.f ) - y * y, Float8::Zero() ) );
+	Float8 s, c;
+	SinCos( Float8( 2 * Pi ) * u1, s, c );
+	x = c * sinTheta;
+	z = s * sinTheta;
+}
+
+inline void uniformSampleDisk8( const Float8 &u0, const Float8 &u1, Float8 &x, Float8 &y )
+{
+	const auto r = Sqrt( u0 );
+	Float8 s, c;
+	SinCos( Float8( 2 * Pi ) * u1, s, c );
+	x = r * s;
+	y = r * c;
+}
+
+inline void concentricDiskSample8( const Float8 &u0, const Float8 &u1, Float8 &x, Float8 &y )
+{
+	const auto ox = Float8( 2.f ) * u0 - Float8( 1.f ), oy = Float8( 2.f ) * u1 - Float8( 1.f );
+	const auto zero = Float8::Zero();
+	// Both ratios are computed, the one dividing by 0 is never selected except in the center
+	const auto xMajor = Abs( ox ) > Abs( oy );
+	const auto r = Select( xMajor, ox, oy );
+	const auto theta = Select( xMajor, Float8( Pi / 4 ) * ( oy / ox ), Float8( Pi / 2 ) - Float8( Pi / 4 ) * ( ox / oy ) );
+	Float8 s, c;
+	SinCos( theta, s, c );
+	const auto center = ( ox == zero ) & ( oy == zero );
+	x = Select( center, zero, r * c );
+	y = Select( center, zero, r * s );
+}
+
+inline void cosineSampleHemiSphere8( const Float8 &u0, const Float8 &u1, Float8 &x, Float8 &y, Float8 &z )
+{
+	uniformSampleDisk8( u0, u1, x, z );
+	y = Sqrt( Max( Float8( 1.f ) - u0, Float8::Zero() ) );
+}
+
+/**
+ * \param cosThetaMax The cosine of the half angle of the cone, as the angle of uniformSampleCone()
+ */
+inline void uniformSampleCone8( const Float8 &u0, const Float8 &u1, Float cosThetaMax, Float8 &x, Float8 &y, Float8 &z )
+{
+	y = ( Float8( 1.f ) - u0 ) + u0 * Float8( cosThetaMax );
+	const auto sinTheta = Sqrt( Max( Float8( 1.f ) - y * y, Float8::Zero() ) );
+	Float8 s, c;
+	SinCos( Float8( 2 * Pi ) * u1, s, c );
+	x = c * sinTheta;
+	z = s * sinTheta;
+}
+
+namespace detail
+{
+/**
+ * \brief Runs \a kernel over n SoA samples, 8 per pass. The last pass is padded.
+ */
+template <int N, typename K>
+void WarpSoA( const float *u0, const float *u1, std::size_t n, float *const ( &out )[ N ], K &&kernel )
+{
+	VMAT_TRACE_ZONE( "WarpSoA" );
+	Float8 r[ N ];
+	std::size_t i = 0;
+	for ( ; i + 8 <= n; i += 8 ) {
+		kernel( Float8::LoadU( u0 + i ), Float8::LoadU( u1 + i ), r );
+		for ( int k = 0; k < N; k++ ) r[ k ].StoreU( out[ k ] + i );
+	}
+	if ( i < n ) {
+		const auto m = static_cast<int>( n - i );
+		kernel( Float8::LoadN( u0 + i, m ), Float8::LoadN( u1 + i, m ), r );
+		for ( int k = 0; k < N; k++ ) r[ k ].StoreN( out[ k ] + i, m );
+	}
+}
+
+/**
+ * \brief Runs \a kernel over an array of Point2f samples, writing N consecutive floats per sample
+ */
+template <int N, typename K>
+void WarpArray( const Point2f *p, std::size_t n, float *out, K &&kernel )
+{
+	VMAT_TRACE_ZONE( "WarpArray" );
+	static_assert( sizeof( Point2f ) == 2 * sizeof( float ), "samples are deinterleaved as float pairs" );
+	const auto in = reinterpret_cast<const float *>( p );
+	Float8 r[ N ];
+	alignas( 32 ) float tmp[ N ][ 8 ];
+	for ( std::size_t i = 0; i < n; i += 8 ) {
+		const auto m = static_cast<int>( ( std::min )( n - i, std::size_t( 8 ) ) );
+		Float8 u0, u1;
+		if ( m == 8 ) {
+			Deinterleave( Float8::LoadU( in + 2 * i ), Float8::LoadU( in + 2 * i + 8 ), u0, u1 );
+		} else {
+			Deinterleave( Float8::LoadN( in + 2 * i, 2 * m ), Float8::LoadN( in + 2 * i + 8, 2 * m - 8 ), u0, u1 );
+		}
+		kernel( u0, u1, r );
+		for ( int k = 0; k < N; k++ ) r[ k ].Store( tmp[ k ] );
+		for ( int l = 0; l < m; l++ )
+			for ( int k = 0; k < N; k++ ) out[ N * ( i + l ) + k ] = tmp[ k ][ l ];
+	}
+}
+}  // namespace detail
+
+#define VMAT_SAMPLING_BATCH3( name, kernelCall )                                                                \
+	inline void name( const float *u0, const float *u1, std::size_t n, float *x, float *y, float *z )           \
+	{                                                                                                           \
+		float *const out[ 3 ] = { x, y, z };                                                                    \
+		detail::WarpSoA<3>( u0, u1, n, out, [ & ]( const Float8 &a, const Float8 &b, Float8 *r ) { kernelCall; } ); \
+	}                                                                                                           \
+	inline void name( const Point2f *p, std::size_t n, Vector3f *out )                                         \
+	{                                                                                                           \
+		static_assert( sizeof( Vector3f ) == 3 * sizeof( float ), "results are written as float triples" );     \
+		detail::WarpArray<3>( p, n, reinterpret_cast<float *>( out ),                                           \
+							  [ & ]( const Float8 &a, const Float8 &b, Float8 *r ) { kernelCall; } );           \
+	}
+
+VMAT_SAMPLING_BATCH3( uniformSampleSphere, uniformSampleSphere8( a, b, r[ 0 ], r[ 1 ], r[ 2 ] ) )
+VMAT_SAMPLING_BATCH3( uniformSampleHemiSphere, uniformSampleHemiSphere8( a, b, r[ 0 ], r[ 1 ], r[ 2 ] ) )
+VMAT_SAMPLING_BATCH3( cosineSampleHemiSphere, cosineSampleHemiSphere8( a, b, r[ 0 ], r[ 1 ], r[ 2 ] ) )
+#undef VMAT_SAMPLING_BATCH3
+
+inline void uniformSampleCone( const float *u0, const float *u1, std::size_t n, Float cosThetaMax, float *x, float *y, float *z )
+{
+	float *const out[ 3 ] = { x, y, z };
+	detail::WarpSoA<3>( u0, u1, n, out, [ & ]( const Float8 &a, const Float8 &b, Float8 *r ) { uniformSampleCone8( a, b, cosThetaMax, r[ 0 ], r[ 1 ], r[ 2 ] ); } );
+}
+
+inline void uniformSampleCone( const Point2f *p, std::size_t n, Float cosThetaMax, Vector3f *out )
+{
+	detail::WarpArray<3>( p, n, reinterpret_cast<float *>( out ), [ & ]( const Float8 &a, const Float8 &b, Float8 *r ) { uniformSampleCone8( a, b, cosThetaMax, r[ 0 ], r[ 1 ], r[ 2 ] ); } );
+}
+
+inline void concentricDiskSample( const float *u0, const float *u1, std::size_t n, float *x, float *y )
+{
+	float *const out[ 2 ] = { x, y };
+	detail::WarpSoA<2>( u0, u1, n, out, []( const Float8 &a, const Float8 &b, Float8 *r ) { concentricDiskSample8( a, b, r[ 0 ], r[ 1 ] ); } );
+}
+
+inline void concentricDiskSample( const Point2f *p, std::size_t n, Point2f *out )
+{
+	detail::WarpArray<2>( p, n, reinterpret_cast<float *>( out ), []( const Float8 &a, const Float8 &b, Float8 *r ) { concentricDiskSample8( a, b, r[ 0 ], r[ 1 ] ); } );
+}
+
+}  // namespace vm
+
+#endif	// SAMPLING_H_
@@ -0,0 +1,658 @@
+#ifndef SIMD_H_
+#define SIMD_H_
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#if defined( __AVX2__ ) && !defined( VMAT_DISABLE_SIMD )
+#define VMAT_SIMD_AVX2 1
+#include <immintrin.h>
+#endif
+
+/*
+ * 8-wide float/int lanes used by the batched kernels of the library.
+ * When the translation unit is compiled with AVX2 (-mavx2, /arch:AVX2) the types map
+ * directly onto __m256/__m256i, otherwise they degrade to plain arrays with identical semantics
+ * so that every kernel has a scalar fallback for free.
+ * Define VMAT_DISABLE_SIMD to force the fallback.
+ */
+
+namespace vm
+{
+struct Int8;
+
+/**
+ * \brief A lane mask produced by comparisons. Each active lane has all bits set.
+ */
+struct Mask8
+{
+#ifdef VMAT_SIMD_AVX2
+	__m256 v;
+	Mask8() = default;
+	Mask8( __m256 m ) :
+	  v( m ) {}
+#else
+	std::int32_t v[ 8 ];
+	Mask8() = default;
+#endif
+
+	int Bits() const
+	{
+#ifdef VMAT_SIMD_AVX2
+		return _mm256_movemask_ps( v );
+#else
+		int bits = 0;
+		for ( int i = 0; i < 8; i++ ) bits |= ( v[ i ] != 0 ) << i;
+		return bits;
+#endif
+	}
+
+	bool Any() const { return Bits() != 0; }
+	bool All() const { return Bits() == 0xFF; }
+	bool None() const { return Bits() == 0; }
+
+	Mask8 operator&( const Mask8 &m ) const
+	{
+#ifdef VMAT_SIMD_AVX2
+		return _mm256_and_ps( v, m.v );
+#else
+		Mask8 r;
+		for ( int i = 0; i < 8; i++ ) r.v[ i ] = v[ i ] & m.v[ i ];
+		return r;
+#endif
+	}
+
+	Mask8 operator|( const Mask8 &m ) const
+	{
+#ifdef VMAT_SIMD_AVX2
+		return _mm256_or_ps( v, m.v );
+#else
+		Mask8 r;
+		for ( int i = 0; i < 8; i++ ) r.v[ i ] = v[ i ] | m.v[ i ];
+		return r;
+#endif
+	}
+
+	Mask8 operator~() const
+	{
+#ifdef VMAT_SIMD_AVX2
+		return _mm256_xor_ps( v, _mm256_castsi256_ps( _mm256_set1_epi32( -1 ) ) );
+#else
+		Mask8 r;
+		for ( int i = 0; i < 8; i++ ) r.v[ i ] = ~v[ i ];
+		return r;
+#endif
+	}
+
+	/**
+	 * \brief Returns a mask whose first \a n lanes are active
+	 */
+	static Mask8 FirstN( int n )
+	{
+		Mask8 r;
+#ifdef VMAT_SIMD_AVX2
+		const auto idx = _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7 );
+		r.v = _mm256_castsi256_ps( _mm256_cmpgt_epi32( _mm256_set1_epi32( n ), idx ) );
+#else
+		for ( int i = 0; i < 8; i++ ) r.v[ i ] = i < n ? -1 : 0;
+#endif
+		return r;
+	}
+};
+
+struct alignas( 32 ) Float8
+{
+#ifdef VMAT_SIMD_AVX2
+	__m256 v;
+	Float8() = default;
+	Float8( __m256 a ) :
+	  v( a ) {}
+	explicit Float8( float a ) :
+	  v( _mm256_set1_ps( a ) ) {}
+	Float8( float a0, float a1, float a2, float a3, float a4, float a5, float a6, float a7 ) :
+	  v( _mm256_setr_ps( a0, a1, a2, a3, a4, a5, a6, a7 ) ) {}
+#else
+	float v[ 8 ];
+	Float8() = default;
+	explicit Float8( float a )
+	{
+		for ( int i = 0; i < 8; i++ ) v[ i ] = a;
+	}
+	Float8( float a0, float a1, float a2, float a3, float a4, float a5, float a6, float a7 ) :
+	  v{ a0, a1, a2, a3, a4, a5, a6, a7 } {}
+#endif
+
+	/**
+	 * \brief Loads 8 floats from a 32-byte aligned address
+	 */
+	static Float8 Load( const float *p )
+	{
+#ifdef VMAT_SIMD_AVX2
+		return _mm256_load_ps( p );
+#else
+		return LoadU( p );
+#endif
+	}
+
+	static Float8 LoadU( const float *p )
+	{
+#ifdef VMAT_SIMD_AVX2
+		return _mm256_loadu_ps( p );
+#else
+		Float8 r;
+		std::memcpy( r.v, p, sizeof( float ) * 8 );
+		return r;
+#endif
+	}
+
+	/**
+	 * \brief Loads the first \a n floats and fills the remaining lanes with \a fill
+	 */
+	static Float8 LoadN( const float *p, int n, float fill = 0.f )
+	{
+		alignas( 32 ) float tmp[ 8 ];
+		for ( int i = 0; i < 8; i++ ) tmp[ i ] = i < n ? p[ i ] : fill;
+		return Load( tmp );
+	}
+
+	void Store( float *p ) const
+	{
+#ifdef VMAT_SIMD_AVX2
+		_mm256_store_ps( p, v );
+#else
+		StoreU( p );
+#endif
+	}
+
+	void StoreU( float *p ) const
+	{
+#ifdef VMAT_SIMD_AVX2
+		_mm256_storeu_ps( p, v );
+#else
+		std::memcpy( p, v, sizeof( float ) * 8 );
+#endif
+	}
+
+	void StoreN( float *p, int n ) const
+	{
+		alignas( 32 ) float tmp[ 8 ];
+		Store( tmp );
+		for ( int i = 0; i < n; i++ ) p[ i ] = tmp[ i ];
+	}
+
+	float operator[]( int i ) const
+	{
+		alignas( 32 ) float tmp[ 8 ];
+		Store( tmp );
+		return tmp[ i ];
+	}
+
+	static Float8 Zero() { return Float8( 0.f ); }
+
+	/**
+	 * \brief Returns [0, 1, ..., 7]
+	 */
+	static Float8 Iota()
+	{
+		return Float8( 0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f );
+	}
+
+#ifdef VMAT_SIMD_AVX2
+#define VMAT_FLOAT8_BINARY( op, intrinsic ) \
+	Float8 operator op( const Float8 &a ) const { return intrinsic( v, a.v ); }
+#define VMAT_FLOAT8_COMPARE( op, pred ) \
+	Mask8 operator op( const Float8 &a ) const { return _mm256_cmp_ps( v, a.v, pred ); }
+#else
+#define VMAT_FLOAT8_BINARY( op, intrinsic )                     \
+	Float8 operator op( const Float8 &a ) const                   \
+	{                                                             \
+		Float8 r;                                                 \
+		for ( int i = 0; i < 8; i++ ) r.v[ i ] = v[ i ] op a.v[ i ]; \
+		return r;                                                 \
+	}
+#define VMAT_FLOAT8_COMPARE( op, pred )                                       \
+	Mask8 operator op( const Float8 &a ) const                                  \
+	{                                                                           \
+		Mask8 r;                                                                \
+		for ( int i = 0; i < 8; i++ ) r.v[ i ] = ( v[ i ] op a.v[ i ] ) ? -1 : 0; \
+		return r;                                                               \
+	}
+#endif
+	VMAT_FLOAT8_BINARY( +, _mm256_add_ps )
+	VMAT_FLOAT8_BINARY( -, _mm256_sub_ps )
+	VMAT_FLOAT8_BINARY( *, _mm256_mul_ps )
+	VMAT_FLOAT8_BINARY( /, _mm256_div_ps )
+	VMAT_FLOAT8_COMPARE( <, _CMP_LT_OQ )
+	VMAT_FLOAT8_COMPARE( <=, _CMP_LE_OQ )
+	VMAT_FLOAT8_COMPARE( >, _CMP_GT_OQ )
+	VMAT_FLOAT8_COMPARE( >=, _CMP_GE_OQ )
+	VMAT_FLOAT8_COMPARE( ==, _CMP_EQ_OQ )
+	VMAT_FLOAT8_COMPARE( !=, _CMP_NEQ_UQ )
+#undef VMAT_FLOAT8_BINARY
+#undef VMAT_FLOAT8_COMPARE
+
+	Float8 operator-() const
+	{
+		return Float8( 0.f ) - *this;
+	}
+
+	Float8 &operator+=( const Float8 &a ) { return *this = *this + a; }
+	Float8 &operator-=( const Float8 &a ) { return *this = *this - a; }
+	Float8 &operator*=( const Float8 &a ) { return *this = *this * a; }
+	Float8 &operator/=( const Float8 &a ) { return *this = *this / a; }
+};
+
+inline Float8 operator*( float s, const Float8 &a ) { return Float8( s ) * a; }
+inline Float8 operator*( const Float8 &a, float s ) { return a * Float8( s ); }
+inline Float8 operator+( const Float8 &a, float s ) { return a + Float8( s ); }
+inline Float8 operator-( const Float8 &a, float s ) { return a - Float8( s ); }
+
+#ifdef VMAT_SIMD_AVX2
+#define VMAT_FLOAT8_LANEWISE( expr, intrinsic ) intrinsic
+#else
+#define VMAT_FLOAT8_LANEWISE( expr, intrinsic )      \
+	Float8 r;                                        \
+	for ( int i = 0; i < 8; i++ ) r.v[ i ] = ( expr ); \
+	return r;
+#endif
+
+/**
+ * \brief Per lane minimum. Like the hardware instruction, \a b is returned where either is NaN
+ */
+inline Float8 Min( const Float8 &a, const Float8 &b )
+{
+	VMAT_FLOAT8_LANEWISE( a.v[ i ] < b.v[ i ] ? a.v[ i ] : b.v[ i ], return _mm256_min_ps( a.v, b.v ); )
+}
+
+/**
+ * \brief Per lane maximum. Like the hardware instruction, \a b is returned where either is NaN
+ */
+inline Float8 Max( const Float8 &a, const Float8 &b )
+{
+	VMAT_FLOAT8_LANEWISE( a.v[ i ] > b.v[ i ] ? a.v[ i ] : b.v[ i ], return _mm256_max_ps( a.v, b.v ); )
+}
+
+inline Float8 Sqrt( const Float8 &a )
+{
+	VMAT_FLOAT8_LANEWISE( std::sqrt( a.v[ i ] ), return _mm256_sqrt_ps( a.v ); )
+}
+
+/**
+ * \brief An estimate of 1 / sqrt(a) with a relative error below 1.5 * 2^-12
+ */
+inline Float8 RsqrtApprox( const Float8 &a )
+{
+	VMAT_FLOAT8_LANEWISE( 1.f / std::sqrt( a.v[ i ] ), return _mm256_rsqrt_ps( a.v ); )
+}
+
+inline Float8 Floor( const Float8 &a )
+{
+	VMAT_FLOAT8_LANEWISE( std::floor( a.v[ i ] ), return _mm256_floor_ps( a.v ); )
+}
+
+inline Float8 Abs( const Float8 &a )
+{
+	VMAT_FLOAT8_LANEWISE( std::abs( a.v[ i ] ), return _mm256_andnot_ps( _mm256_set1_ps( -0.f ), a.v ); )
+}
+
+/**
+ * \brief Returns a * b + c, fused when FMA is available
+ */
+inline Float8 MulAdd( const Float8 &a, const Float8 &b, const Float8 &c )
+{
+#if defined( VMAT_SIMD_AVX2 ) && defined( __FMA__ )
+	return _mm256_fmadd_ps( a.v, b.v, c.v );
+#else
+	return a * b + c;
+#endif
+}
+
+/**
+ * \brief Per lane \a m ? \a a : \a b
+ */
+inline Float8 Select( const Mask8 &m, const Float8 &a, const Float8 &b )
+{
+	VMAT_FLOAT8_LANEWISE( m.v[ i ] ? a.v[ i ] : b.v[ i ], return _mm256_blendv_ps( b.v, a.v, m.v ); )
+}
+
+#undef VMAT_FLOAT8_LANEWISE
+
+/**
+ * \brief Splits the 16 consecutive values [lo, hi] into the even and odd indexed values,
+ * i.e. even = [x0, x2, ..., x14] and odd = [x1, x3, ..., x15]
+ */
+inline void Deinterleave( const Float8 &lo, const Float8 &hi, Float8 &even, Float8 &odd )
+{
+#ifdef VMAT_SIMD_AVX2
+	const auto e = _mm256_shuffle_ps( lo.v, hi.v, _MM_SHUFFLE( 2, 0, 2, 0 ) );
+	const auto o = _mm256_shuffle_ps( lo.v, hi.v, _MM_SHUFFLE( 3, 1, 3, 1 ) );
+	even = _mm256_castpd_ps( _mm256_permute4x64_pd( _mm256_castps_pd( e ), _MM_SHUFFLE( 3, 1, 2, 0 ) ) );
+	odd = _mm256_castpd_ps( _mm256_permute4x64_pd( _mm256_castps_pd( o ), _MM_SHUFFLE( 3, 1, 2, 0 ) ) );
+#else
+	for ( int i = 0; i < 4; i++ ) {
+		even.v[ i ] = lo.v[ 2 * i ];
+		odd.v[ i ] = lo.v[ 2 * i + 1 ];
+		even.v[ i + 4 ] = hi.v[ 2 * i ];
+		odd.v[ i + 4 ] = hi.v[ 2 * i + 1 ];
+	}
+#endif
+}
+
+/**
+ * \brief Horizontal reductions
+ */
+inline float ReduceMin( const Float8 &a )
+{
+	alignas( 32 ) float tmp[ 8 ];
+	a.Store( tmp );
+	return *std::min_element( tmp, tmp + 8 );
+}
+
+inline float ReduceMax( const Float8 &a )
+{
+	alignas( 32 ) float tmp[ 8 ];
+	a.Store( tmp );
+	return *std::max_element( tmp, tmp + 8 );
+}
+
+inline float ReduceAdd( const Float8 &a )
+{
+	alignas( 32 ) float tmp[ 8 ];
+	a.Store( tmp );
+	return ( ( tmp[ 0 ] + tmp[ 1 ] ) + ( tmp[ 2 ] + tmp[ 3 ] ) ) + ( ( tmp[ 4 ] + tmp[ 5 ] ) + ( tmp[ 6 ] + tmp[ 7 ] ) );
+}
+
+struct alignas( 32 ) Int8
+{
+#ifdef VMAT_SIMD_AVX2
+	__m256i v;
+	Int8() = default;
+	Int8( __m256i a ) :
+	  v( a ) {}
+	explicit Int8( std::int32_t a ) :
+	  v( _mm256_set1_epi32( a ) ) {}
+	Int8( std::int32_t a0, std::int32_t a1, std::int32_t a2, std::int32_t a3,
+		  std::int32_t a4, std::int32_t a5, std::int32_t a6, std::int32_t a7 ) :
+	  v( _mm256_setr_epi32( a0, a1, a2, a3, a4, a5, a6, a7 ) ) {}
+#else
+	std::int32_t v[ 8 ];
+	Int8() = default;
+	explicit Int8( std::int32_t a )
+	{
+		for ( int i = 0; i < 8; i++ ) v[ i ] = a;
+	}
+	Int8( std::int32_t a0, std::int32_t a1, std::int32_t a2, std::int32_t a3,
+		  std::int32_t a4, std::int32_t a5, std::int32_t a6, std::int32_t a7 ) :
+	  v{ a0, a1, a2, a3, a4, a5, a6, a7 } {}
+#endif
+
+	static Int8 LoadU( const std::int32_t *p )
+	{
+#ifdef VMAT_SIMD_AVX2
+		return _mm256_loadu_si256( reinterpret_cast<const __m256i *>( p ) );
+#else
+		Int8 r;
+		std::memcpy( r.v, p, sizeof( std::int32_t ) * 8 );
+		return r;
+#endif
+	}
+
+	void StoreU( std::int32_t *p ) const
+	{
+#ifdef VMAT_SIMD_AVX2
+		_mm256_storeu_si256( reinterpret_cast<__m256i *>( p ), v );
+#else
+		std::memcpy( p, v, sizeof( std::int32_t ) * 8 );
+#endif
+	}
+
+	std::int32_t operator[]( int i ) const
+	{
+		std::int32_t tmp[ 8 ];
+		StoreU( tmp );
+		return tmp[ i ];
+	}
+
+#ifdef VMAT_SIMD_AVX2
+#define VMAT_INT8_BINARY( op, intrinsic ) \
+	Int8 operator op( const Int8 &a ) const { return intrinsic( v, a.v ); }
+#else
+#define VMAT_INT8_BINARY( op, intrinsic )                       \
+	Int8 operator op( const Int8 &a ) const                       \
+	{                                                             \
+		Int8 r;                                                   \
+		for ( int i = 0; i < 8; i++ ) r.v[ i ] = std::int32_t( std::uint32_t( v[ i ] ) op std::uint32_t( a.v[ i ] ) ); \
+		return r;                                                 \
+	}
+#endif
+	VMAT_INT8_BINARY( +, _mm256_add_epi32 )
+	VMAT_INT8_BINARY( -, _mm256_sub_epi32 )
+	VMAT_INT8_BINARY( *, _mm256_mullo_epi32 )
+	VMAT_INT8_BINARY( &, _mm256_and_si256 )
+	VMAT_INT8_BINARY( |, _mm256_or_si256 )
+	VMAT_INT8_BINARY( ^, _mm256_xor_si256 )
+#undef VMAT_INT8_BINARY
+
+	Int8 operator<<( int n ) const
+	{
+#ifdef VMAT_SIMD_AVX2
+		return _mm256_slli_epi32( v, n );
+#else
+		Int8 r;
+		for ( int i = 0; i < 8; i++ ) r.v[ i ] = std::int32_t( std::uint32_t( v[ i ] ) << n );
+		return r;
+#endif
+	}
+
+	/**
+	 * \brief Logical (zero filling) right shift
+	 */
+	Int8 operator>>( int n ) const
+	{
+#ifdef VMAT_SIMD_AVX2
+		return _mm256_srli_epi32( v, n );
+#else
+		Int8 r;
+		for ( int i = 0; i < 8; i++ ) r.v[ i ] = std::int32_t( std::uint32_t( v[ i ] ) >> n );
+		return r;
+#endif
+	}
+
+	Mask8 operator==( const Int8 &a ) const
+	{
+#ifdef VMAT_SIMD_AVX2
+		return _mm256_castsi256_ps( _mm256_cmpeq_epi32( v, a.v ) );
+#else
+		Mask8 r;
+		for ( int i = 0; i < 8; i++ ) r.v[ i ] = v[ i ] == a.v[ i ] ? -1 : 0;
+		return r;
+#endif
+	}
+
+	Mask8 operator>( const Int8 &a ) const
+	{
+#ifdef VMAT_SIMD_AVX2
+		return _mm256_castsi256_ps( _mm256_cmpgt_epi32( v, a.v ) );
+#else
+		Mask8 r;
+		for ( int i = 0; i < 8; i++ ) r.v[ i ] = v[ i ] > a.v[ i ] ? -1 : 0;
+		return r;
+#endif
+	}
+
+	Mask8 operator<( const Int8 &a ) const { return a > *this; }
+};
+
+/**
+ * \brief Converts with truncation toward zero
+ */
+inline Int8 ToInt8( const Float8 &a )
+{
+#ifdef VMAT_SIMD_AVX2
+	return _mm256_cvttps_epi32( a.v );
+#else
+	Int8 r;
+	for ( int i = 0; i < 8; i++ ) r.v[ i ] = static_cast<std::int32_t>( a.v[ i ] );
+	return r;
+#endif
+}
+
+inline Float8 ToFloat8( const Int8 &a )
+{
+#ifdef VMAT_SIMD_AVX2
+	return _mm256_cvtepi32_ps( a.v );
+#else
+	Float8 r;
+	for ( int i = 0; i < 8; i++ ) r.v[ i ] = static_cast<float>( a.v[ i ] );
+	return r;
+#endif
+}
+
+/**
+ * \brief Reinterprets the bits of the lanes, no conversion
+ */
+inline Int8 AsInt8( const Float8 &a )
+{
+#ifdef VMAT_SIMD_AVX2
+	return _mm256_castps_si256( a.v );
+#else
+	Int8 r;
+	std::memcpy( r.v, a.v, sizeof( r.v ) );
+	return r;
+#endif
+}
+
+inline Float8 AsFloat8( const Int8 &a )
+{
+#ifdef VMAT_SIMD_AVX2
+	return _mm256_castsi256_ps( a.v );
+#else
+	Float8 r;
+	std::memcpy( r.v, a.v, sizeof( r.v ) );
+	return r;
+#endif
+}
+
+inline Int8 Min( const Int8 &a, const Int8 &b )
+{
+#ifdef VMAT_SIMD_AVX2
+	return _mm256_min_epi32( a.v, b.v );
+#else
+	Int8 r;
+	for ( int i = 0; i < 8; i++ ) r.v[ i ] = ( std::min )( a.v[ i ], b.v[ i ] );
+	return r;
+#endif
+}
+
+inline Int8 Max( const Int8 &a, const Int8 &b )
+{
+#ifdef VMAT_SIMD_AVX2
+	return _mm256_max_epi32( a.v, b.v );
+#else
+	Int8 r;
+	for ( int i = 0; i < 8; i++ ) r.v[ i ] = ( std::max )( a.v[ i ], b.v[ i ] );
+	return r;
+#endif
+}
+
+inline Int8 Select( const Mask8 &m, const Int8 &a, const Int8 &b )
+{
+#ifdef VMAT_SIMD_AVX2
+	return _mm256_castps_si256( _mm256_blendv_ps( _mm256_castsi256_ps( b.v ), _mm256_castsi256_ps( a.v ), m.v ) );
+#else
+	Int8 r;
+	for ( int i = 0; i < 8; i++ ) r.v[ i ] = m.v[ i ] ? a.v[ i ] : b.v[ i ];
+	return r;
+#endif
+}
+
+/**
+ * \brief The full 64-bit products of the unsigned lanes of \a a and \a m, split into the high and low 32 bits
+ */
+inline void MulHiLo( const Int8 &a, std::uint32_t m, Int8 &hi, Int8 &lo )
+{
+#ifdef VMAT_SIMD_AVX2
+	const auto mm = _mm256_set1_epi32( static_cast<int>( m ) );
+	const auto even = _mm256_mul_epu32( a.v, mm );
+	const auto odd = _mm256_mul_epu32( _mm256_srli_epi64( a.v, 32 ), mm );
+	lo = _mm256_blend_epi32( even, _mm256_slli_epi64( odd, 32 ), 0xaa );
+	hi = _mm256_blend_epi32( _mm256_srli_epi64( even, 32 ), odd, 0xaa );
+#else
+	for ( int i = 0; i < 8; i++ ) {
+		const auto p = std::uint64_t( std::uint32_t( a.v[ i ] ) ) * m;
+		lo.v[ i ] = std::int32_t( std::uint32_t( p ) );
+		hi.v[ i ] = std::int32_t( std::uint32_t( p >> 32 ) );
+	}
+#endif
+}
+
+/**
+ * \brief Maps the high 24 bits of each lane to [0, 1), the 8-wide UnitFloat()
+ */
+inline Float8 UnitFloat8( const Int8 &v )
+{
+	return ToFloat8( v >> 8 ) * Float8( 1.f / ( 1 << 24 ) );
+}
+
+/**
+ * \brief Loads base[idx[i]] for each lane
+ */
+inline Int8 Gather( const std::int32_t *base, const Int8 &idx )
+{
+#ifdef VMAT_SIMD_AVX2
+	return _mm256_i32gather_epi32( reinterpret_cast<const int *>( base ), idx.v, 4 );
+#else
+	Int8 r;
+	for ( int i = 0; i < 8; i++ ) r.v[ i ] = base[ idx.v[ i ] ];
+	return r;
+#endif
+}
+
+inline Float8 Gather( const float *base, const Int8 &idx )
+{
+#ifdef VMAT_SIMD_AVX2
+	return _mm256_i32gather_ps( base, idx.v, 4 );
+#else
+	Float8 r;
+	for ( int i = 0; i < 8; i++ ) r.v[ i ] = base[ idx.v[ i ] ];
+	return r;
+#endif
+}
+
+/**
+ * \brief Per lane sine and cosine of \a x.
+ *
+ * The argument is reduced to [-pi/4, pi/4] with a three-part Cody-Waite split of pi/2 and
+ * evaluated with the minimax polynomials of Cephes sinf/cosf. The absolute error is below 2.5e-7
+ * for |x| <= 8192, beyond that the reduction loses precision.
+ */
+inline void SinCos( const Float8 &x, Float8 &sinX, Float8 &cosX )
+{
+	const auto j = Floor( MulAdd( x, Float8( 0.636619772367581343f ), Float8( 0.5f ) ) );
+	auto r = MulAdd( j, Float8( -1.5703125f ), x );
+	r = MulAdd( j, Float8( -4.837512969970703125e-4f ), r );
+	r = MulAdd( j, Float8( -7.54978995489188216e-8f ), r );
+	const auto r2 = r * r;
+
+	auto s = MulAdd( r2, Float8( -1.9515295891e-4f ), Float8( 8.3321608736e-3f ) );
+	s = MulAdd( r2, s, Float8( -1.6666654611e-1f ) );
+	s = MulAdd( r2 * r, s, r );
+	auto c = MulAdd( r2, Float8( 2.443315711809948e-5f ), Float8( -1.388731625493765e-3f ) );
+	c = MulAdd( r2, c, Float8( 4.166664568298827e-2f ) );
+	c = MulAdd( r2 * r2, c, MulAdd( r2, Float8( -0.5f ), Float8( 1.f ) ) );
+
+	// Quadrant q of x: (sin, cos) = (s, c), (c, -s), (-s, -c), (-c, s)
+	const auto q = ToInt8( j ) & Int8( 3 );
+	const auto swap = ( q & Int8( 1 ) ) == Int8( 1 );
+	const auto negSin = ( q & Int8( 2 ) ) == Int8( 2 );
+	const auto negCos = ( ( q + Int8( 1 ) ) & Int8( 2 ) ) == Int8( 2 );
+	const auto sv = Select( swap, c, s ), cv = Select( swap, s, c );
+	sinX = Select( negSin, -sv, sv );
+	cosX = Select( negCos, -cv, cv );
+}
+
+}  // namespace vm
+
+#endif	// SIMD_H_
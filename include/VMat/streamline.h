@@ -0,0 +1,294 @@
+#ifndef STREAMLINE_H_
+#define STREAMLINE_H_
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "geometry.h"
+#include "parallel.h"
+
+/*
+ * Streamline and pathline tracing through sampled vector fields.
+ *
+ * A field is any callable field(const Point3f &p, Float time) returning the Vector3f velocity at
+ * p. Streamlines follow a steady field, pathlines a field that depends on the time. Lines are
+ * integrated with the adaptive Dormand-Prince 5(4) pair and written into preallocated buffers,
+ * one fixed size slot per seed, with the seeds traced in parallel.
+ */
+
+namespace vm
+{
+/**
+ * \brief A Vector3f volume on a Grid, one sample per cell located at the cell center.
+ *
+ * Sample() interpolates trilinearly. Outside of the centers of the outer cells the samples are
+ * clamped to the border.
+ */
+class VectorVolume
+{
+public:
+	VectorVolume( const Grid<Float> &grid, std::vector<Vector3f> samples ) :
+	  grid( grid ), samples( std::move( samples ) )
+	{
+		assert( this->samples.size() == grid.GridDimension.Prod() );
+		for ( int i = 0; i < 3; i++ ) invCell[ i ] = 1 / grid.Cell[ i ];
+	}
+
+	const Grid<Float> &GetGrid() const { return grid; }
+
+	const Vector3f &At( int x, int y, int z ) const
+	{
+		return samples[ ( std::size_t( z ) * grid.GridDimension.y + y ) * grid.GridDimension.x + x ];
+	}
+
+	Vector3f Sample( const Point3f &p ) const
+	{
+		int i0[ 3 ], i1[ 3 ];
+		Float f[ 3 ];
+		for ( int i = 0; i < 3; i++ ) {
+			const auto u = ( p[ i ] - grid.Bound.min[ i ] ) * invCell[ i ] - Float( 0.5 );
+			const auto last = grid.GridDimension[ i ] - 1;
+			const auto c = std::floor( u );
+			f[ i ] = u - c;
+			i0[ i ] = static_cast<int>( c );
+			i1[ i ] = ( std::min )( ( std::max )( i0[ i ] + 1, 0 ), last );
+			i0[ i ] = ( std::min )( ( std::max )( i0[ i ], 0 ), last );
+		}
+		auto lerp = []( Float t, const Vector3f &a, const Vector3f &b ) { return a + ( b - a ) * t; };
+		const auto c00 = lerp( f[ 0 ], At( i0[ 0 ], i0[ 1 ], i0[ 2 ] ), At( i1[ 0 ], i0[ 1 ], i0[ 2 ] ) );
+		const auto c10 = lerp( f[ 0 ], At( i0[ 0 ], i1[ 1 ], i0[ 2 ] ), At( i1[ 0 ], i1[ 1 ], i0[ 2 ] ) );
+		const auto c01 = lerp( f[ 0 ], At( i0[ 0 ], i0[ 1 ], i1[ 2 ] ), At( i1[ 0 ], i0[ 1 ], i1[ 2 ] ) );
+		const auto c11 = lerp( f[ 0 ], At( i0[ 0 ], i1[ 1 ], i1[ 2 ] ), At( i1[ 0 ], i1[ 1 ], i1[ 2 ] ) );
+		return lerp( f[ 2 ], lerp( f[ 1 ], c00, c10 ), lerp( f[ 1 ], c01, c11 ) );
+	}
+
+	/**
+	 * \brief The field interface of the tracer, a steady field ignores the time
+	 */
+	Vector3f operator()( const Point3f &p, Float ) const { return Sample( p ); }
+
+private:
+	Grid<Float> grid;
+	std::vector<Vector3f> samples;
+	Float invCell[ 3 ];
+};
+
+struct StreamlineOptions
+{
+	Float InitialStep = Float( 1e-2 );
+	Float MinStep = Float( 1e-6 );
+	Float MaxStep = std::numeric_limits<Float>::infinity();
+	/**
+	 * \brief The allowed local error of a step, in world units
+	 */
+	Float Tolerance = Float( 1e-4 );
+	/**
+	 * \brief Tracing stops where the speed drops below this
+	 */
+	Float StagnationSpeed = Float( 1e-6 );
+	Float MaxLength = std::numeric_limits<Float>::infinity();
+	/**
+	 * \brief The capacity of the polyline of each seed, the seed included
+	 */
+	int MaxVertices = 256;
+	Float StartTime = 0;
+	/**
+	 * \brief Traces against the field, upstream of the seed
+	 */
+	bool Backward = false;
+};
+
+enum class StreamlineEnd
+{
+	LeftBound,
+	Stagnation,
+	MaxVertices,
+	MaxLength,
+	StepUnderflow
+};
+
+struct StreamlineResult
+{
+	int Count = 0;
+	StreamlineEnd End = StreamlineEnd::LeftBound;
+	Float Time = 0;
+};
+
+/**
+ * \brief The polylines of a batch of seeds, MaxVertices slots each. Allocated once and reused
+ * across traces of up to the same number of seeds.
+ */
+class StreamlineBuffer
+{
+public:
+	StreamlineBuffer() = default;
+	StreamlineBuffer( std::size_t seedCount, int maxVertices ) { Resize( seedCount, maxVertices ); }
+
+	void Resize( std::size_t seedCount, int maxVertices )
+	{
+		stride = maxVertices;
+		vertices.resize( seedCount * maxVertices );
+		results.resize( seedCount );
+	}
+
+	std::size_t Size() const { return results.size(); }
+	int MaxVertices() const { return stride; }
+
+	const Point3f *Line( std::size_t seed ) const { return vertices.data() + seed * stride; }
+	const StreamlineResult &Result( std::size_t seed ) const { return results[ seed ]; }
+
+	Point3f *VertexData() { return vertices.data(); }
+	StreamlineResult *ResultData() { return results.data(); }
+
+private:
+	int stride = 0;
+	std::vector<Point3f> vertices;
+	std::vector<StreamlineResult> results;
+};
+
+namespace detail
+{
+inline bool InsideInclusive( const Bound3f &bound, const Point3f &p )
+{
+	for ( int i = 0; i < 3; i++ )
+		if ( !( p[ i ] >= bound.min[ i ] && p[ i ] <= bound.max[ i ] ) ) return false;
+	return true;
+}
+
+/**
+ * \brief The point where the segment from \a a, which is inside, to \a b leaves \a bound
+ */
+inline Point3f ExitPoint( const Bound3f &bound, const Point3f &a, const Point3f &b )
+{
+	Float t = 1;
+	for ( int i = 0; i < 3; i++ ) {
+		const auto d = b[ i ] - a[ i ];
+		if ( d > 0 && b[ i ] > bound.max[ i ] ) t = ( std::min )( t, ( bound.max[ i ] - a[ i ] ) / d );
+		if ( d < 0 && b[ i ] < bound.min[ i ] ) t = ( std::min )( t, ( bound.min[ i ] - a[ i ] ) / d );
+	}
+	return a + ( b - a ) * t;
+}
+}  // namespace detail
+
+/**
+ * \brief Traces one line from \a seed through \a field and writes it to \a vertices, which holds
+ * options.MaxVertices points.
+ *
+ * Every accepted step adds a vertex. A line leaving \a bound ends with the point where its last
+ * step crosses the border.
+ */
+template <typename F>
+StreamlineResult TraceStreamline( const F &field, const Bound3f &bound, const Point3f &seed, const StreamlineOptions &options, Point3f *vertices )
+{
+	// Dormand-Prince 5(4) tableau, the last stage is the first one of the next step
+	constexpr Float c2 = 1. / 5, c3 = 3. / 10, c4 = 4. / 5, c5 = 8. / 9;
+	constexpr Float a21 = 1. / 5;
+	constexpr Float a31 = 3. / 40, a32 = 9. / 40;
+	constexpr Float a41 = 44. / 45, a42 = -56. / 15, a43 = 32. / 9;
+	constexpr Float a51 = 19372. / 6561, a52 = -25360. / 2187, a53 = 64448. / 6561, a54 = -212. / 729;
+	constexpr Float a61 = 9017. / 3168, a62 = -355. / 33, a63 = 46732. / 5247, a64 = 49. / 176, a65 = -5103. / 18656;
+	constexpr Float b1 = 35. / 384, b3 = 500. / 1113, b4 = 125. / 192, b5 = -2187. / 6784, b6 = 11. / 84;
+	// Differences of the 5th and 4th order weights
+	constexpr Float e1 = 71. / 57600, e3 = -71. / 16695, e4 = 71. / 1920, e5 = -17253. / 339200, e6 = 22. / 525, e7 = -1. / 40;
+
+	StreamlineResult result;
+	result.Time = options.StartTime;
+	if ( options.MaxVertices <= 0 ) return result;
+	vertices[ result.Count++ ] = seed;
+	if ( !detail::InsideInclusive( bound, seed ) ) return result;
+
+	const Float sign = options.Backward ? -1 : 1;
+	auto eval = [ & ]( const Point3f &p, Float t ) { return sign * field( p, t ); };
+
+	auto p = seed;
+	auto t = options.StartTime;
+	auto h = ( std::min )( options.InitialStep, options.MaxStep );
+	Float length = 0;
+	auto k1 = eval( p, t );
+	while ( true ) {
+		if ( k1.Length() < options.StagnationSpeed ) {
+			result.End = StreamlineEnd::Stagnation;
+			break;
+		}
+		if ( result.Count == options.MaxVertices ) {
+			result.End = StreamlineEnd::MaxVertices;
+			break;
+		}
+		// The time runs backward along with the direction, so pathlines are traced upstream correctly
+		const auto dt = sign * h;
+		const auto k2 = eval( p + h * ( a21 * k1 ), t + c2 * dt );
+		const auto k3 = eval( p + h * ( a31 * k1 + a32 * k2 ), t + c3 * dt );
+		const auto k4 = eval( p + h * ( a41 * k1 + a42 * k2 + a43 * k3 ), t + c4 * dt );
+		const auto k5 = eval( p + h * ( a51 * k1 + a52 * k2 + a53 * k3 + a54 * k4 ), t + c5 * dt );
+		const auto k6 = eval( p + h * ( a61 * k1 + a62 * k2 + a63 * k3 + a64 * k4 + a65 * k5 ), t + dt );
+		const auto next = p + h * ( b1 * k1 + b3 * k3 + b4 * k4 + b5 * k5 + b6 * k6 );
+		const auto k7 = eval( next, t + dt );
+		const auto error = ( h * ( e1 * k1 + e3 * k3 + e4 * k4 + e5 * k5 + e6 * k6 + e7 * k7 ) ).Length() / options.Tolerance;
+
+		// Standard controller with a safety factor, growth and shrink limited to [0.2, 5]
+		const auto scale = error == 0 ? Float( 5 ) : ( std::min )( Float( 5 ), ( std::max )( Float( 0.2 ), Float( 0.9 ) * std::pow( error, Float( -0.2 ) ) ) );
+		if ( error > 1 ) {
+			if ( h <= options.MinStep ) {
+				result.End = StreamlineEnd::StepUnderflow;
+				break;
+			}
+			h = ( std::max )( h * scale, options.MinStep );
+			continue;
+		}
+
+		if ( !detail::InsideInclusive( bound, next ) ) {
+			vertices[ result.Count++ ] = detail::ExitPoint( bound, p, next );
+			result.End = StreamlineEnd::LeftBound;
+			break;
+		}
+		const auto step = ( next - p ).Length();
+		if ( length + step > options.MaxLength ) {
+			vertices[ result.Count++ ] = p + ( next - p ) * ( ( options.MaxLength - length ) / step );
+			result.End = StreamlineEnd::MaxLength;
+			break;
+		}
+		length += step;
+		p = next;
+		t += dt;
+		k1 = k7;
+		vertices[ result.Count++ ] = p;
+		h = ( std::min )( h * scale, options.MaxStep );
+	}
+	result.Time = t;
+	return result;
+}
+
+/**
+ * \brief Traces \a seedCount lines in parallel. Line i is written to
+ * vertices + i * options.MaxVertices and its result to results[i].
+ */
+template <typename F>
+void TraceStreamlines( const F &field, const Bound3f &bound, const Point3f *seeds, std::size_t seedCount,
+					   const StreamlineOptions &options, Point3f *vertices, StreamlineResult *results )
+{
+	VMAT_TRACE_ZONE( "TraceStreamlines" );
+	ParallelFor( 0, seedCount, 64, [ & ]( std::size_t b, std::size_t e ) {
+		for ( auto i = b; i < e; i++ ) results[ i ] = TraceStreamline( field, bound, seeds[ i ], options, vertices + i * options.MaxVertices );
+	} );
+}
+
+/**
+ * \brief Traces the seeds through a volume within its bound, into \a buffer which is resized to
+ * the seeds and options.MaxVertices if needed
+ */
+inline void TraceStreamlines( const VectorVolume &volume, const Point3f *seeds, std::size_t seedCount,
+							  const StreamlineOptions &options, StreamlineBuffer &buffer )
+{
+	if ( buffer.Size() != seedCount || buffer.MaxVertices() != options.MaxVertices ) buffer.Resize( seedCount, options.MaxVertices );
+	const auto &bound = volume.GetGrid().Bound;
+	TraceStreamlines( volume, bound, seeds, seedCount, options, buffer.VertexData(), buffer.ResultData() );
+}
+
+}  // namespace vm
+
+#endif	// STREAMLINE_H_
@@ -0,0 +1,240 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+/*
+ * Scoped tracing zones exported as Chrome trace_event JSON, to be loaded into Perfetto or
+ * chrome://tracing.
+ *
+ * VMAT_TRACE_ZONE( "name" ) records the time from its declaration to the end of the scope. The
+ * zones are compiled in only when VMAT_TRACE is defined (CMake option VMAT_ENABLE_TRACE), the
+ * macros expand to nothing otherwise. Zone names must be string literals or otherwise outlive
+ * the export.
+ *
+ * Every thread writes into its own ring buffer without locks. A full buffer drops new zones
+ * until the next flush, the number of dropped zones is reported. Flushing drains all buffers
+ * lock-free as well, while the threads keep recording.
+ */
+
+#ifdef VMAT_TRACE
+#define VMAT_TRACE_CONCAT_( a, b ) a##b
+#define VMAT_TRACE_CONCAT( a, b ) VMAT_TRACE_CONCAT_( a, b )
+#define VMAT_TRACE_ZONE( name ) const ::vm::TraceZone VMAT_TRACE_CONCAT( vmatTraceZone, __LINE__ )( name )
+#define VMAT_TRACE_FUNCTION() VMAT_TRACE_ZONE( __func__ )
+#else
+#define VMAT_TRACE_ZONE( name )
+#define VMAT_TRACE_FUNCTION()
+#endif
+
+namespace vm
+{
+struct TraceEvent
+{
+	const char *Name;
+	std::uint64_t Begin;	// nanoseconds since the first use of the trace clock
+	std::uint64_t End;
+	std::uint32_t Thread;
+};
+
+/**
+ * \brief The nanoseconds elapsed since the first call
+ */
+inline std::uint64_t TraceNow()
+{
+	using Clock = std::chrono::steady_clock;
+	static const auto epoch = Clock::now();
+	return static_cast<std::uint64_t>( std::chrono::duration_cast<std::chrono::nanoseconds>( Clock::now() - epoch ).count() );
+}
+
+namespace detail
+{
+/**
+ * \brief A single producer, single consumer ring of the zones of one thread
+ */
+struct TraceBuffer
+{
+	static constexpr std::uint64_t Capacity = 1 << 16;
+
+	TraceEvent Events[ Capacity ];
+	std::atomic<std::uint64_t> Head{ 0 };	 // written by the owning thread
+	std::atomic<std::uint64_t> Tail{ 0 };	 // written by the flushing thread
+	std::atomic<std::uint64_t> Dropped{ 0 };
+	std::atomic<bool> Owned{ true };		 // false once the owning thread exited
+	std::uint32_t Thread = 0;
+	TraceBuffer *Next = nullptr;
+
+	void Push( const char *name, std::uint64_t begin, std::uint64_t end )
+	{
+		const auto head = Head.load( std::memory_order_relaxed );
+		if ( head - Tail.load( std::memory_order_acquire ) == Capacity ) {
+			Dropped.fetch_add( 1, std::memory_order_relaxed );
+			return;
+		}
+		Events[ head % Capacity ] = TraceEvent{ name, begin, end, Thread };
+		Head.store( head + 1, std::memory_order_release );
+	}
+
+	template <typename F>
+	void Drain( F &&func )
+	{
+		const auto head = Head.load( std::memory_order_acquire );
+		auto tail = Tail.load( std::memory_order_relaxed );
+		for ( ; tail != head; tail++ ) func( Events[ tail % Capacity ] );
+		Tail.store( tail, std::memory_order_release );
+	}
+};
+
+/**
+ * \brief The buffers of all threads that ever traced, a lock-free list that only grows. The
+ * buffers outlive their threads so late flushes still see their zones, new threads take over
+ * the buffers of exited ones since ParallelFor() starts threads on every call.
+ */
+struct TraceRegistry
+{
+	std::atomic<TraceBuffer *> First{ nullptr };
+	std::atomic<std::uint32_t> Threads{ 0 };
+	// Only one flush runs at a time, concurrent flushes see an empty trace
+	std::atomic<bool> Flushing{ false };
+
+	~TraceRegistry()
+	{
+		for ( auto b = First.load(); b != nullptr; ) {
+			const auto next = b->Next;
+			delete b;
+			b = next;
+		}
+	}
+
+	static TraceRegistry &Instance()
+	{
+		static TraceRegistry registry;
+		return registry;
+	}
+
+	TraceBuffer *Acquire()
+	{
+		for ( auto b = First.load( std::memory_order_acquire ); b != nullptr; b = b->Next ) {
+			bool owned = false;
+			if ( b->Owned.compare_exchange_strong( owned, true, std::memory_order_acquire, std::memory_order_relaxed ) ) return b;
+		}
+		const auto b = new TraceBuffer;
+		b->Thread = Threads.fetch_add( 1, std::memory_order_relaxed ) + 1;
+		b->Next = First.load( std::memory_order_relaxed );
+		while ( !First.compare_exchange_weak( b->Next, b, std::memory_order_release, std::memory_order_relaxed ) ) {
+		}
+		return b;
+	}
+
+	static TraceBuffer &ThreadBuffer()
+	{
+		struct Owner
+		{
+			TraceBuffer *Buffer = Instance().Acquire();
+			~Owner() { Buffer->Owned.store( false, std::memory_order_release ); }
+		};
+		thread_local Owner owner;
+		return *owner.Buffer;
+	}
+};
+}  // namespace detail
+
+/**
+ * \brief Records the lifetime of the object as a zone of the calling thread
+ */
+class TraceZone
+{
+public:
+	explicit TraceZone( const char *name ) :
+	  name( name ), begin( TraceNow() ) {}
+	TraceZone( const TraceZone & ) = delete;
+	TraceZone &operator=( const TraceZone & ) = delete;
+	~TraceZone() { detail::TraceRegistry::ThreadBuffer().Push( name, begin, TraceNow() ); }
+
+private:
+	const char *name;
+	std::uint64_t begin;
+};
+
+struct TraceFlush
+{
+	std::vector<TraceEvent> Events;
+	std::uint64_t Dropped = 0;
+};
+
+/**
+ * \brief Moves the zones recorded so far by all threads out of their buffers
+ */
+inline TraceFlush FlushTrace()
+{
+	TraceFlush flush;
+	auto &r = detail::TraceRegistry::Instance();
+	if ( r.Flushing.exchange( true, std::memory_order_acquire ) ) return flush;
+	for ( auto b = r.First.load( std::memory_order_acquire ); b != nullptr; b = b->Next ) {
+		b->Drain( [ &flush ]( const TraceEvent &e ) { flush.Events.push_back( e ); } );
+		flush.Dropped += b->Dropped.exchange( 0, std::memory_order_relaxed );
+	}
+	r.Flushing.store( false, std::memory_order_release );
+	return flush;
+}
+
+namespace detail
+{
+inline void WriteJsonString( std::ostream &os, const char *s )
+{
+	static const char hex[] = "0123456789abcdef";
+	os << '"';
+	for ( ; *s; s++ ) {
+		const auto c = static_cast<unsigned char>( *s );
+		if ( c == '"' || c == '\\' ) {
+			os << '\\' << *s;
+		} else if ( c < 0x20 ) {
+			os << "\\u00" << hex[ c >> 4 ] << hex[ c & 15 ];
+		} else {
+			os << *s;
+		}
+	}
+	os << '"';
+}
+}  // namespace detail
+
+/**
+ * \brief Writes \a events as a Chrome trace_event JSON object of complete ("X") events
+ */
+inline void WriteChromeTrace( std::ostream &os, const std::vector<TraceEvent> &events, std::uint64_t dropped = 0 )
+{
+	os << "{\"displayTimeUnit\":\"ns\",\"otherData\":{\"droppedZones\":" << dropped << "},\"traceEvents\":[";
+	const auto flags = os.flags();
+	const auto precision = os.precision();
+	os.setf( std::ios::fixed, std::ios::floatfield );
+	os.precision( 3 );
+	bool first = true;
+	for ( const auto &e : events ) {
+		os << ( first ? "\n" : ",\n" ) << "{\"name\":";
+		detail::WriteJsonString( os, e.Name );
+		// The format counts in microseconds, three decimals keep the nanoseconds
+		os << ",\"cat\":\"vmat\",\"ph\":\"X\",\"ts\":" << e.Begin / 1e3 << ",\"dur\":" << ( e.End - e.Begin ) / 1e3
+		   << ",\"pid\":1,\"tid\":" << e.Thread << "}";
+		first = false;
+	}
+	os << "\n]}\n";
+	os.flags( flags );
+	os.precision( precision );
+}
+
+/**
+ * \brief Flushes the zones of all threads and writes them to \a os
+ */
+inline void WriteChromeTrace( std::ostream &os )
+{
+	const auto flush = FlushTrace();
+	WriteChromeTrace( os, flush.Events, flush.Dropped );
+}
+
+}  // namespace vm
+
+#endif	// TRACE_H_
@@ -2,17 +2,26 @@
 #define TRANSFORMATION_H_
 #include <iostream>
 #include <cstring>
+#include <atomic>
+#include <thread>
 
 #include "geometry.h"
 #include "numeric.h"
+#include "fastmath.h"
 
 
 
 namespace  vm
 {
-	struct Matrix4x4;
+	namespace detail
+	{
+		inline Float Radians(Float degrees) { return DegreesToRadians(degrees); }
+		inline double Radians(double degrees) { return degrees * (3.14159265358979323846 / 180); }
+		inline void SinCos(Float x, Float& sinX, Float& cosX) { vm::SinCos(x, sinX, cosX); }
+		inline void SinCos(double x, double& sinX, double& cosX) { sinX = std::sin(x); cosX = std::cos(x); }
+	}
 
-	struct Matrix3x3;
+	template <typename T> struct Matrix4x4T;
 
 	//template<typename Ty, int Col,int Row>
 	//struct GenericMatrix
@@ -21,105 +30,149 @@ namespace  vm
 
 	//};
 
-	struct Matrix3x3
-	{
-		typedef	Float(*Matrix3x3DataType)[3];
-		Float m[3][3];
-		Matrix3x3();
-		Matrix3x3(Float mat[3][3]);
-		Matrix3x3(Float t00, Float t01, Float t02, Float t10, Float t11, Float t12, Float t20, Float t21, Float t22);
-		Matrix3x3(const Matrix4x4 & mat);
-		Matrix3x3(Float mat[4][4]);
-		bool operator==(const Matrix3x3& m2) const;
-		bool operator!=(const Matrix3x3& m2) const;
-		Matrix3x3& operator/=(const Float& s);
-		Matrix3x3& operator*=(const Float& s);
+	template <typename T>
+	struct Matrix3x3T
+	{
+		typedef	T(*Matrix3x3DataType)[3];
+		T m[3][3];
+		Matrix3x3T();
+		Matrix3x3T(T mat[3][3]);
+		Matrix3x3T(T t00, T t01, T t02, T t10, T t11, T t12, T t20, T t21, T t22);
+		Matrix3x3T(const Matrix4x4T<T> & mat);
+		Matrix3x3T(T mat[4][4]);
+		bool operator==(const Matrix3x3T<T>& m2) const;
+		bool operator!=(const Matrix3x3T<T>& m2) const;
+		Matrix3x3T<T>& operator/=(const T& s);
+		Matrix3x3T<T>& operator*=(const T& s);
 
 		void SetToIdentity();
 
 		void Transpose();
-		Matrix3x3 Transposed() const;
-		Float Det() const;
-		Float * FlatData() { return *m; }
-		const Float * FlatData()const { return *m; }
+		Matrix3x3T<T> Transposed() const;
+		T Det() const;
+		T * FlatData() { return *m; }
+		const T * FlatData()const { return *m; }
 		Matrix3x3DataType MatrixData() { return m; }
 		void Inverse() { *this = Inversed(); }
-		Matrix3x3 Inversed() const;
+		Matrix3x3T<T> Inversed() const;
+
+		template<typename U> explicit operator Matrix3x3T<U>() const
+		{
+			Matrix3x3T<U> mat;
+			for (auto i = 0; i < 3; ++i)
+				for (auto j = 0; j < 3; ++j)
+					mat.m[i][j] = U(m[i][j]);
+			return mat;
+		}
 	};
 
-	struct Matrix4x4
+	template <typename T>
+	struct Matrix4x4T
 	{
-		typedef	Float(*Matrix4x4DataType)[4];
-		Matrix4x4();
-		Matrix4x4(const Matrix3x3 & mat33);
-		Matrix4x4(Float mat[4][4]);
-		Matrix4x4(Float t00, Float t01, Float t02, Float t03, Float t10, Float t11,
-			Float t12, Float t13, Float t20, Float t21, Float t22, Float t23,
-			Float t30, Float t31, Float t32, Float t33);
+		typedef	T(*Matrix4x4DataType)[4];
+		Matrix4x4T();
+		Matrix4x4T(const Matrix3x3T<T> & mat33);
+		Matrix4x4T(T mat[4][4]);
+		Matrix4x4T(T t00, T t01, T t02, T t03, T t10, T t11,
+			T t12, T t13, T t20, T t21, T t22, T t23,
+			T t30, T t31, T t32, T t33);
 
 
-		bool operator==(const Matrix4x4& m2) const;
-		bool operator!=(const Matrix4x4& m2) const;
+		bool operator==(const Matrix4x4T<T>& m2) const;
+		bool operator!=(const Matrix4x4T<T>& m2) const;
 
 		void SetToIdentity();
 
 		void Transpose();
-		Matrix4x4 Transposed() const;
+		Matrix4x4T<T> Transposed() const;
 
-		Matrix3x3 NormalMatrix() const;
+		Matrix3x3T<T> NormalMatrix() const;
 		void Inverse() { *this = Inversed(); }
-		Matrix4x4 Inversed() const;
+		Matrix4x4T<T> Inversed() const;
 
-		static Matrix4x4 Mul(const Matrix4x4& m1, const Matrix4x4& m2);
-		friend std::ostream& operator<<(std::ostream& os, const Matrix4x4& m);
+		static Matrix4x4T<T> Mul(const Matrix4x4T<T>& m1, const Matrix4x4T<T>& m2);
+		friend std::ostream& operator<<(std::ostream& os, const Matrix4x4T<T>& m)
+		{
+			os << "[" <<
+				m.m[0][0] << ", " << m.m[0][1] << ", " << m.m[0][2] << ", " << m.m[0][3] << "]\n" <<
+				m.m[1][0] << ", " << m.m[1][1] << ", " << m.m[1][2] << ", " << m.m[1][3] << "]\n" <<
+				m.m[2][0] << ", " << m.m[2][1] << ", " << m.m[2][2] << ", " << m.m[2][3] << "]\n" <<
+				m.m[3][0] << ", " << m.m[3][1] << ", " << m.m[3][2] << ", " << m.m[3][3] << "]\n";
+			return os;
+		}
 
-		Float * FlatData() { return *m; }
-		const Float * FlatData()const { return *m; }
+		T * FlatData() { return *m; }
+		const T * FlatData()const { return *m; }
 		Matrix4x4DataType MatrixData() { return m; }
-		Float m[4][4];
+
+		template<typename U> explicit operator Matrix4x4T<U>() const
+		{
+			Matrix4x4T<U> mat;
+			for (auto i = 0; i < 4; ++i)
+				for (auto j = 0; j < 4; ++j)
+					mat.m[i][j] = U(m[i][j]);
+			return mat;
+		}
+
+		T m[4][4];
 	};
 
-	inline
-		Matrix4x4
-		operator*(const Matrix4x4 & m1, const Matrix4x4 & m2)
+	template <typename T> inline
+		Matrix4x4T<T>
+		operator*(const Matrix4x4T<T> & m1, const Matrix4x4T<T> & m2)
 	{
-		return Matrix4x4::Mul(m1, m2);
+		return Matrix4x4T<T>::Mul(m1, m2);
 	}
 
-	class Transform
+	/*
+	 * TransformT<T> is a transform with the scalar type T, Transform the single precision one used
+	 * by the library. TransformT<double> composes world space transforms whose translations do not
+	 * fit single precision, RelativeTo() converts them to single precision once.
+	 *
+	 * Transform keeps the inverse of its matrix. By default the inverse is computed as soon as the
+	 * matrix is set, with VMAT_LAZY_INVERSE defined (CMake option VMAT_ENABLE_LAZY_INVERSE) it is
+	 * computed on the first call of Inversed(), InverseMatrix() or of an operation that needs it.
+	 * The deferred inverse may be requested from several threads at once.
+	 */
+	template <typename T>
+	class TransformT
 	{
 	public:
 		// Transform Public Methods
-		Transform() = default;
+		TransformT() = default;
+#ifdef VMAT_LAZY_INVERSE
+		TransformT(const TransformT<T>& t);
+		TransformT<T>& operator=(const TransformT<T>& t);
+#endif
 
-		explicit Transform(const Float mat[4][4]);
-		Transform(const Matrix4x4& m, const Matrix4x4& inv);
-		explicit Transform(const Matrix4x4& m);
-		Transform Transposed() const;
+		explicit TransformT(const T mat[4][4]);
+		TransformT(const Matrix4x4T<T>& m, const Matrix4x4T<T>& inv);
+		explicit TransformT(const Matrix4x4T<T>& m);
+		TransformT<T> Transposed() const;
 		void Transpose();
-		bool operator==(const Transform& t) const;
-		bool operator!=(const Transform& t) const;
+		bool operator==(const TransformT<T>& t) const;
+		bool operator!=(const TransformT<T>& t) const;
 		bool IsIdentity() const;
-		Transform Inversed()const { return Transform{ m_inv,m_m }; }
-		const Matrix4x4& Matrix() const;
-		const Matrix4x4& InverseMatrix() const;
-
-		void SetLookAt(const Point3f & eye, const Point3f & center, const Vector3f & up);
-		void SetGLOrtho(Float left, Float right, Float bottom, Float top, Float nearPlane, Float farPlane);
-		void SetGLPerspective(Float vertcialAngle, Float aspectRation, Float nearPlane, Float farPlane);
-		void SetFrustum(Float left, Float right, Float bottom, Float top, Float nearPlane, Float farPlane);
-		void SetTranslate(const Vector3f& t);
-		void SetTranslate(Float x, Float y, Float z);
-		void SetTranslate(Float * t);
-		void SetScale(const Vector3f & s);
-		void SetScale(Float x, Float y, Float z);
-		void SetScale(Float * s);
-		void SetRotate(const Vector3f & axis, Float degrees);
-		void SetRotate(Float x, Float y, Float z, Float degrees);
-		void SetRotate(Float *a, Float degrees);
-		void SetRotateX(Float degrees);
-		void SetRotateY(Float degrees);
-		void SetRotateZ(Float degrees);
+		TransformT<T> Inversed()const { return TransformT<T>{ InverseMatrix(),m_m }; }
+		const Matrix4x4T<T>& Matrix() const;
+		const Matrix4x4T<T>& InverseMatrix() const;
+
+		void SetLookAt(const Point3<T> & eye, const Point3<T> & center, const Vector3<T> & up);
+		void SetGLOrtho(T left, T right, T bottom, T top, T nearPlane, T farPlane);
+		void SetGLPerspective(T vertcialAngle, T aspectRation, T nearPlane, T farPlane);
+		void SetFrustum(T left, T right, T bottom, T top, T nearPlane, T farPlane);
+		void SetTranslate(const Vector3<T>& t);
+		void SetTranslate(T x, T y, T z);
+		void SetTranslate(T * t);
+		void SetScale(const Vector3<T> & s);
+		void SetScale(T x, T y, T z);
+		void SetScale(T * s);
+		void SetRotate(const Vector3<T> & axis, T degrees);
+		void SetRotate(T x, T y, T z, T degrees);
+		void SetRotate(T *a, T degrees);
+		void SetRotateX(T degrees);
+		void SetRotateY(T degrees);
+		void SetRotateZ(T degrees);
 		void SetIdentity();
 
 		//const Float * ConstMatrixData()const;
@@ -127,30 +180,48 @@ namespace  vm
 		//const Float * ConstInverseMatrixData()const;
 		//Float* InverseMatrixData();
 
-		Matrix4x4 ColumnMajorMatrix() const;
-		Transform operator*(const Transform & trans)const;
-		template<typename T> Point3<T> operator*(const Point3<T> & p)const;
-		template<typename T> Vector3<T> operator*(const Vector3<T> & v)const;
+		Matrix4x4T<T> ColumnMajorMatrix() const;
+		TransformT<T> operator*(const TransformT<T> & trans)const;
+		template<typename U> Point3<U> operator*(const Point3<U> & p)const;
+		template<typename U> Vector3<U> operator*(const Vector3<U> & v)const;
+
+		template<typename U> RayT<U> operator*(const RayT<U> & ray)const;
+		Bound3<T> operator*(const Bound3<T> & aabb)const;
 
-		Ray operator*(const Ray & ray)const;
-		Bound3f operator*(const Bound3f & aabb)const;
+		/**
+		 * \brief Converts both matrices to the scalar type \a U without inverting again
+		 */
+		template<typename U> explicit operator TransformT<U>() const
+		{
+			return TransformT<U>{ Matrix4x4T<U>(m_m), Matrix4x4T<U>(InverseMatrix()) };
+		}
 
-		friend std::ostream &operator<<(std::ostream &os, const Transform & t)
+		friend std::ostream &operator<<(std::ostream &os, const TransformT<T> & t)
 		{
-			os << "t = " << t.m_m << " t' = " << t.m_inv;
+			os << "t = " << t.m_m << " t' = " << t.InverseMatrix();
 			return os;
 		}
 
 	private:
-		Matrix4x4 m_m;
-		Matrix4x4 m_inv;
+		void UpdateInverse();
+		void SetInverse(const Matrix4x4T<T>& inv);
+		bool HasInverse() const;
+
+		Matrix4x4T<T> m_m;
+#ifdef VMAT_LAZY_INVERSE
+		enum { InverseStale, InverseComputing, InverseValid };
+		mutable Matrix4x4T<T> m_inv;
+		mutable std::atomic<int> m_invState{ InverseValid };
+#else
+		Matrix4x4T<T> m_inv;
+#endif
 	};
 
 
 
-	template<typename T> inline
-		Point3<T>
-		Transform::operator*(const Point3<T> & p) const
+	template <typename T> template<typename U> inline
+		Point3<U>
+		TransformT<T>::operator*(const Point3<U> & p) const
 	{
 		const auto x = p[0], y = p[1], z = p[2];
 		const auto rx = m_m.m[0][0] * x + m_m.m[0][1] * y + m_m.m[0][2] * z + m_m.m[0][3];
@@ -158,21 +229,28 @@ namespace  vm
 		const auto rz = m_m.m[2][0] * x + m_m.m[2][1] * y + m_m.m[2][2] * z + m_m.m[2][3];
 		const auto rw = m_m.m[3][0] * x + m_m.m[3][1] * y + m_m.m[3][2] * z + m_m.m[3][3];
 
-		if (rw == 1)return Point3<T>{rx, ry, rz};
-		return Point3<T>{ rx, ry, rz } / rw;
+		if (rw == 1)return Point3<U>(rx, ry, rz);
+		return Point3<U>(rx, ry, rz) / U(rw);
 	}
 
-	template<typename T> inline
-		Vector3<T>
-		Transform::operator*(const Vector3<T>& v) const
+	template <typename T> template<typename U> inline
+		Vector3<U>
+		TransformT<T>::operator*(const Vector3<U>& v) const
 	{
 		const auto x = v[0], y = v[1], z = v[2];
 		const auto rx = m_m.m[0][0] * x + m_m.m[0][1] * y + m_m.m[0][2] * z;
 		const auto ry = m_m.m[1][0] * x + m_m.m[1][1] * y + m_m.m[1][2] * z;
 		const auto rz = m_m.m[2][0] * x + m_m.m[2][1] * y + m_m.m[2][2] * z;
-		return Vector3<T>{rx, ry, rz};
+		return Vector3<U>(rx, ry, rz);
 	}
 
+	using Matrix3x3 = Matrix3x3T<Float>;
+	using Matrix4x4 = Matrix4x4T<Float>;
+	using Transform = TransformT<Float>;
+	using Matrix3x3d = Matrix3x3T<double>;
+	using Matrix4x4d = Matrix4x4T<double>;
+	using Transformd = TransformT<double>;
+
 	inline Transform Scale(Float x,Float y,Float z)
 	{
 		Transform t;
@@ -294,22 +372,25 @@ namespace  vm
 		return Scale(cot, cot, 1.0)*Transform(persp);
 	}
 
+	template <typename T>
 	inline 
-	Matrix3x3::Matrix3x3()
+	Matrix3x3T<T>::Matrix3x3T()
 	{
-		m[0][0] = m[1][1] = m[2][3] = 1.0f;
+		m[0][0] = m[1][1] = m[2][2] = 1.0f;
 		m[0][1] = m[0][2] = m[1][0] = m[1][2] = m[2][0] = m[2][1] = 0.f;
 	}
 
+	template <typename T>
 	inline 
-	Matrix3x3::Matrix3x3(Float mat[3][3])
+	Matrix3x3T<T>::Matrix3x3T(T mat[3][3])
 	{
-		std::memcpy(m, mat, sizeof(Float) * 9);
+		std::memcpy(m, mat, sizeof(T) * 9);
 	}
 
+	template <typename T>
 	inline 
-	Matrix3x3::Matrix3x3(Float t00, Float t01, Float t02, Float t10, Float t11, Float t12, Float t20, Float t21,
-		Float t22)
+	Matrix3x3T<T>::Matrix3x3T(T t00, T t01, T t02, T t10, T t11, T t12, T t20, T t21,
+		T t22)
 	{
 		m[0][0] = t00;
 		m[0][1] = t01;
@@ -322,8 +403,9 @@ namespace  vm
 		m[2][2] = t22;
 	}
 
+	template <typename T>
 	inline 
-	Matrix3x3::Matrix3x3(const Matrix4x4& mat)
+	Matrix3x3T<T>::Matrix3x3T(const Matrix4x4T<T>& mat)
 	{
 		m[0][0] = mat.m[0][0];
 		m[0][1] = mat.m[0][1];
@@ -336,8 +418,9 @@ namespace  vm
 		m[2][2] = mat.m[2][2];
 	}
 
+	template <typename T>
 	inline 
-	Matrix3x3::Matrix3x3(Float mat[4][4])
+	Matrix3x3T<T>::Matrix3x3T(T mat[4][4])
 	{
 		m[0][0] = mat[0][0];
 		m[0][1] = mat[0][1];
@@ -350,8 +433,9 @@ namespace  vm
 		m[2][2] = mat[2][2];
 	}
 
+	template <typename T>
 	inline 
-	bool Matrix3x3::operator==(const Matrix3x3& m2) const
+	bool Matrix3x3T<T>::operator==(const Matrix3x3T<T>& m2) const
 	{
 		for (auto i = 0; i < 3; ++i)
 			for (auto j = 0; j < 3; ++j)
@@ -359,8 +443,9 @@ namespace  vm
 		return true;
 	}
 
+	template <typename T>
 	inline 
-	bool Matrix3x3::operator!=(const Matrix3x3& m2) const
+	bool Matrix3x3T<T>::operator!=(const Matrix3x3T<T>& m2) const
 	{
 		for (auto i = 0; i < 3; ++i)
 			for (auto j = 0; j < 3; ++j)
@@ -368,16 +453,18 @@ namespace  vm
 		return false;
 	}
 
+	template <typename T>
 	inline 
-	Matrix3x3& Matrix3x3::operator/=(const Float& s)
+	Matrix3x3T<T>& Matrix3x3T<T>::operator/=(const T& s)
 	{
 		const auto inv = 1.0 / s;
 		(*this) *= inv;
 		return *this;
 	}
 
+	template <typename T>
 	inline 
-	Matrix3x3& Matrix3x3::operator*=(const Float& s)
+	Matrix3x3T<T>& Matrix3x3T<T>::operator*=(const T& s)
 	{
 		for (auto i = 0; i < 3; ++i)
 			for (auto j = 0; j < 3; ++j)
@@ -385,15 +472,17 @@ namespace  vm
 		return *this;
 	}
 
+	template <typename T>
 	inline 
-	void Matrix3x3::SetToIdentity()
+	void Matrix3x3T<T>::SetToIdentity()
 	{
 		m[0][0] = m[1][1] = m[2][2] = 1;
 		m[0][1] = m[0][2] = m[1][0] = m[1][2] = m[2][0] = m[2][1] = 0;
 	}
 
+	template <typename T>
 	inline 
-	void Matrix3x3::Transpose()
+	void Matrix3x3T<T>::Transpose()
 	{
 		for (auto i = 0; i < 3; i++)
 		{
@@ -406,10 +495,11 @@ namespace  vm
 		}
 	}
 
+	template <typename T>
 	inline 
-	Matrix3x3 Matrix3x3::Transposed() const
+	Matrix3x3T<T> Matrix3x3T<T>::Transposed() const
 	{
-		Matrix3x3 mat
+		Matrix3x3T<T> mat
 		{
 			m[0][0], m[1][0], m[2][0],
 			m[0][1], m[1][1], m[2][1],
@@ -418,8 +508,9 @@ namespace  vm
 		return mat;
 	}
 
+	template <typename T>
 	inline 
-	Float Matrix3x3::Det() const
+	T Matrix3x3T<T>::Det() const
 	{
 		return m[0][0] * m[1][1] * m[2][2] +
 			m[0][1] * m[1][2] * m[2][0]
@@ -429,15 +520,18 @@ namespace  vm
 			- m[0][2] * m[1][1] * m[2][0];
 	}
 
+	template <typename T>
 	inline 
-	Matrix3x3 Matrix3x3::Inversed() const
+	Matrix3x3T<T> Matrix3x3T<T>::Inversed() const
 	{
+		VMAT_TRACE_ZONE("Matrix3x3::Inversed");
+		VMAT_ACCOUNT(Inversions);
 		const auto det = Det();
 		if (std::fabs(det) <= 0.00001)
 		{
-			return Matrix3x3{};
+			return Matrix3x3T<T>{};
 		}
-		Matrix3x3 mat
+		Matrix3x3T<T> mat
 		{
 			m[1][1] * m[2][2] - m[2][1] * m[1][2], -(m[0][1] * m[2][2] - m[2][1] * m[0][2]),
 			m[0][1] * m[1][2] - m[0][2] * m[1][1],
@@ -450,16 +544,18 @@ namespace  vm
 		return mat;
 	}
 
+	template <typename T>
 	inline 
-	Matrix4x4::Matrix4x4()
+	Matrix4x4T<T>::Matrix4x4T()
 	{
 		m[0][0] = m[1][1] = m[2][2] = m[3][3] = 1.f;
 		m[0][1] = m[0][2] = m[0][3] = m[1][0] = m[1][2] = m[1][3] = m[2][0] =
 			m[2][1] = m[2][3] = m[3][0] = m[3][1] = m[3][2] = 0.f;
 	}
 
+	template <typename T>
 	inline 
-	Matrix4x4::Matrix4x4(const Matrix3x3& mat33)
+	Matrix4x4T<T>::Matrix4x4T(const Matrix3x3T<T>& mat33)
 	{
 		// Row 1
 		m[0][0] = mat33.m[0][0];
@@ -483,15 +579,17 @@ namespace  vm
 		m[3][3] = 1;
 	}
 
+	template <typename T>
 	inline 
-	Matrix4x4::Matrix4x4(Float mat[4][4])
+	Matrix4x4T<T>::Matrix4x4T(T mat[4][4])
 	{
-		std::memcpy(m, mat, sizeof(Float) * 16);
+		std::memcpy(m, mat, sizeof(T) * 16);
 	}
 
+	template <typename T>
 	inline 
-	Matrix4x4::Matrix4x4(Float t00, Float t01, Float t02, Float t03, Float t10, Float t11, Float t12, Float t13,
-		Float t20, Float t21, Float t22, Float t23, Float t30, Float t31, Float t32, Float t33)
+	Matrix4x4T<T>::Matrix4x4T(T t00, T t01, T t02, T t03, T t10, T t11, T t12, T t13,
+		T t20, T t21, T t22, T t23, T t30, T t31, T t32, T t33)
 	{
 		m[0][0] = t00;
 		m[0][1] = t01;
@@ -511,8 +609,9 @@ namespace  vm
 		m[3][3] = t33;
 	}
 
+	template <typename T>
 	inline 
-	bool Matrix4x4::operator==(const Matrix4x4& m2) const
+	bool Matrix4x4T<T>::operator==(const Matrix4x4T<T>& m2) const
 	{
 		for (int i = 0; i < 4; ++i)
 			for (int j = 0; j < 4; ++j)
@@ -520,8 +619,9 @@ namespace  vm
 		return true;
 	}
 
+	template <typename T>
 	inline 
-	bool Matrix4x4::operator!=(const Matrix4x4& m2) const
+	bool Matrix4x4T<T>::operator!=(const Matrix4x4T<T>& m2) const
 	{
 		for (int i = 0; i < 4; ++i)
 			for (int j = 0; j < 4; ++j)
@@ -529,16 +629,18 @@ namespace  vm
 		return false;
 	}
 
+	template <typename T>
 	inline 
-	void Matrix4x4::SetToIdentity()
+	void Matrix4x4T<T>::SetToIdentity()
 	{
 
 		m[0][0] = m[1][1] = m[2][2] = m[3][3] = 1;
 		m[0][1] = m[0][2] = m[0][3] = m[1][0] = m[1][2] = m[1][3] = m[2][0] = m[2][1] = m[2][3] = m[3][0] = m[3][1] = m[3][2] = 0;
 	}
 
+	template <typename T>
 	inline 
-	void Matrix4x4::Transpose()
+	void Matrix4x4T<T>::Transpose()
 	{
 		for (auto i = 0; i < 3; i++)
 		{
@@ -551,35 +653,41 @@ namespace  vm
 		}
 	}
 
+	template <typename T>
 	inline 
-	Matrix4x4 Matrix4x4::Transposed() const
+	Matrix4x4T<T> Matrix4x4T<T>::Transposed() const
 	{
-		Matrix4x4 mat(m[0][0], m[1][0], m[2][0], m[3][0],
+		Matrix4x4T<T> mat(m[0][0], m[1][0], m[2][0], m[3][0],
 			m[0][1], m[1][1], m[2][1], m[3][1],
 			m[0][2], m[1][2], m[2][2], m[3][2],
 			m[0][3], m[1][3], m[2][3], m[3][3]);
 		return mat;
 	}
 
+	template <typename T>
 	inline 
-	Matrix3x3 Matrix4x4::NormalMatrix() const
+	Matrix3x3T<T> Matrix4x4T<T>::NormalMatrix() const
 	{
-		Matrix3x3 mat3x3{ Inversed().Transposed() };
+		VMAT_ACCOUNTING_SITE("Matrix4x4::NormalMatrix");
+		Matrix3x3T<T> mat3x3{ Inversed().Transposed() };
 		return mat3x3;
 	}
 
 
+	template <typename T>
 	inline 
-	Matrix4x4 Matrix4x4::Inversed() const
+	Matrix4x4T<T> Matrix4x4T<T>::Inversed() const
 	{
+		VMAT_TRACE_ZONE("Matrix4x4::Inversed");
+		VMAT_ACCOUNT(Inversions);
 		int indxc[4], indxr[4];
 		int ipiv[4] = { 0, 0, 0, 0 };
-		Float minv[4][4];
-		std::memcpy(minv, this->m, 4 * 4 * sizeof(Float));
+		T minv[4][4];
+		std::memcpy(minv, this->m, 4 * 4 * sizeof(T));
 		for (int i = 0; i < 4; i++)
 		{
 			int irow = 0, icol = 0;
-			Float big = 0.f;
+			T big = 0.f;
 			// Choose pivot
 			for (int j = 0; j < 4; j++)
 			{
@@ -591,7 +699,7 @@ namespace  vm
 						{
 							if (std::abs(minv[j][k]) >= big)
 							{
-								big = Float(std::abs(minv[j][k]));
+								big = T(std::abs(minv[j][k]));
 								irow = j;
 								icol = k;
 							}
@@ -613,7 +721,7 @@ namespace  vm
 				assert(false);
 
 			// Set $m[icol][icol]$ to one by scaling row _icol_ appropriately
-			Float pivinv = 1. / minv[icol][icol];
+			T pivinv = 1. / minv[icol][icol];
 			minv[icol][icol] = 1.;
 			for (int j = 0; j < 4; j++) minv[icol][j] *= pivinv;
 
@@ -622,7 +730,7 @@ namespace  vm
 			{
 				if (j != icol)
 				{
-					Float save = minv[j][icol];
+					T save = minv[j][icol];
 					minv[j][icol] = 0;
 					for (int k = 0; k < 4; k++) minv[j][k] -= minv[icol][k] * save;
 				}
@@ -637,13 +745,14 @@ namespace  vm
 					std::swap(minv[k][indxr[j]], minv[k][indxc[j]]);
 			}
 		}
-		return Matrix4x4{ minv };
+		return Matrix4x4T<T>{ minv };
 	}
 
+	template <typename T>
 	inline 
-	Matrix4x4 Matrix4x4::Mul(const Matrix4x4& m1, const Matrix4x4& m2)
+	Matrix4x4T<T> Matrix4x4T<T>::Mul(const Matrix4x4T<T>& m1, const Matrix4x4T<T>& m2)
 	{
-		Matrix4x4 r;
+		Matrix4x4T<T> r;
 		for (auto i = 0; i < 4; ++i)
 			for (auto j = 0; j < 4; ++j)
 				r.m[i][j] = m1.m[i][0] * m2.m[0][j] + m1.m[i][1] * m2.m[1][j] +
@@ -651,96 +760,162 @@ namespace  vm
 		return r;
 	}
 
+	template <typename T>
 	inline 
-	Transform::Transform(const Float mat[4][4])
+	TransformT<T>::TransformT(const T mat[4][4])
 	{
-		m_m = Matrix4x4(mat[0][0], mat[0][1], mat[0][2], mat[0][3], mat[1][0],
+		VMAT_ACCOUNTING_SITE("Transform::Transform");
+		m_m = Matrix4x4T<T>(mat[0][0], mat[0][1], mat[0][2], mat[0][3], mat[1][0],
 			mat[1][1], mat[1][2], mat[1][3], mat[2][0], mat[2][1],
 			mat[2][2], mat[2][3], mat[3][0], mat[3][1], mat[3][2],
 			mat[3][3]);
-		m_inv = m_m.Inversed();
+		UpdateInverse();
 	}
 
+	template <typename T>
 	inline 
-	Transform::Transform(const Matrix4x4& m, const Matrix4x4& inv) : m_m(m), m_inv(inv)
+	TransformT<T>::TransformT(const Matrix4x4T<T>& m, const Matrix4x4T<T>& inv) : m_m(m), m_inv(inv)
 	{
 	}
 
+	template <typename T>
 	inline 
-	Transform::Transform(const Matrix4x4& m) : m_m(m), m_inv(m.Inversed())
+	TransformT<T>::TransformT(const Matrix4x4T<T>& m) : m_m(m)
 	{
+		VMAT_ACCOUNTING_SITE("Transform::Transform");
+		UpdateInverse();
 	}
 
+#ifdef VMAT_LAZY_INVERSE
+	template <typename T>
 	inline 
-	std::ostream& operator<<(std::ostream& os, const Matrix4x4& m)
+	TransformT<T>::TransformT(const TransformT<T>& t) : m_m(t.m_m)
+	{
+		if (t.HasInverse()) SetInverse(t.m_inv);
+		else UpdateInverse();
+	}
+
+	template <typename T>
+	inline 
+	TransformT<T>&
+		TransformT<T>::operator=(const TransformT<T>& t)
+	{
+		if (this != &t)
+		{
+			m_m = t.m_m;
+			if (t.HasInverse()) SetInverse(t.m_inv);
+			else UpdateInverse();
+		}
+		return *this;
+	}
+#endif
+
+	template <typename T>
+	inline 
+	void
+		TransformT<T>::UpdateInverse()
+	{
+#ifdef VMAT_LAZY_INVERSE
+		m_invState.store(InverseStale, std::memory_order_relaxed);
+#else
+		m_inv = m_m.Inversed();
+#endif
+	}
+
+	template <typename T>
+	inline 
+	void
+		TransformT<T>::SetInverse(const Matrix4x4T<T>& inv)
 	{
-		os << "[" <<
-			m.m[0][0] << ", " << m.m[0][1] << ", " << m.m[0][2] << ", " << m.m[0][3] << "]\n" <<
-			m.m[1][0] << ", " << m.m[1][1] << ", " << m.m[1][2] << ", " << m.m[1][3] << "]\n" <<
-			m.m[2][0] << ", " << m.m[2][1] << ", " << m.m[2][2] << ", " << m.m[2][3] << "]\n" <<
-			m.m[3][0] << ", " << m.m[3][1] << ", " << m.m[3][2] << ", " << m.m[3][3] << "]\n";
-		return os;
+		m_inv = inv;
+#ifdef VMAT_LAZY_INVERSE
+		m_invState.store(InverseValid, std::memory_order_relaxed);
+#endif
 	}
 
+	template <typename T>
+	inline 
+	bool
+		TransformT<T>::HasInverse() const
+	{
+#ifdef VMAT_LAZY_INVERSE
+		return m_invState.load(std::memory_order_acquire) == InverseValid;
+#else
+		return true;
+#endif
+	}
 
+	template <typename T>
 	inline 
-	Transform
-		Transform::Transposed() const
+	TransformT<T>
+		TransformT<T>::Transposed() const
 	{
-		return { m_inv.Transposed(), m_m.Transposed() };
+		return { InverseMatrix().Transposed(), m_m.Transposed() };
 	}
 
 
+	template <typename T>
 	inline 
 	void
-		Transform::Transpose()
+		TransformT<T>::Transpose()
 	{
-		m_inv.Transpose();
+		// The inverse of the transpose is the transpose of the inverse, a stale inverse stays stale
+		if (HasInverse()) m_inv.Transpose();
 		m_m.Transpose();
 	}
 
 
+	template <typename T>
 	inline 
 	bool
-		Transform::operator==(const Transform& t) const
+		TransformT<T>::operator==(const TransformT<T>& t) const
 	{
 		return t.m_m == m_m;
 	}
 
 
+	template <typename T>
 	inline 
 	bool
-		Transform::operator!=(const Transform& t) const
+		TransformT<T>::operator!=(const TransformT<T>& t) const
 	{
 		return !(*this == t);
 	}
 
-	inline 
-	Ray
-		Transform::operator*(const Ray& ray) const
+	template <typename T> template<typename U> inline
+		RayT<U>
+		TransformT<T>::operator*(const RayT<U>& ray) const
 	{
 		return { (*this) * ray.Direction() ,(*this) * ray.Original() };
 	}
 
+	template <typename T>
 	inline 
-	Bound3f
-		Transform::operator*(const Bound3f& aabb) const
+	Bound3<T>
+		TransformT<T>::operator*(const Bound3<T>& aabb) const
 	{
 		assert(false);
 		return Bound3f{};
 	}
 
+	template <typename T>
 	inline 
-	Transform
-		Transform::operator*(const Transform& trans)const
-	{
-		return { this->m_m * trans.m_m,trans.m_inv * this->m_inv };
+	TransformT<T>
+		TransformT<T>::operator*(const TransformT<T>& trans)const
+	{
+		if (HasInverse() && trans.HasInverse())
+			return { this->m_m * trans.m_m,trans.m_inv * this->m_inv };
+		TransformT<T> t;
+		t.m_m = this->m_m * trans.m_m;
+		t.UpdateInverse();
+		return t;
 	}
 
 
+	template <typename T>
 	inline 
 	bool
-		Transform::IsIdentity() const
+		TransformT<T>::IsIdentity() const
 	{
 		return (m_m.m[0][0] == 1.f && m_m.m[0][1] == 0.f && m_m.m[0][2] == 0.f &&
 			m_m.m[0][3] == 0.f && m_m.m[1][0] == 0.f && m_m.m[1][1] == 1.f &&
@@ -750,29 +925,50 @@ namespace  vm
 			m_m.m[3][3] == 1.f);
 	}
 
+	template <typename T>
 	inline 
-	const Matrix4x4&
-		Transform::Matrix() const
+	const Matrix4x4T<T>&
+		TransformT<T>::Matrix() const
 	{
 		return m_m;
 	}
 
+	template <typename T>
 	inline 
-	const Matrix4x4&
-		Transform::InverseMatrix() const
+	const Matrix4x4T<T>&
+		TransformT<T>::InverseMatrix() const
 	{
+#ifdef VMAT_LAZY_INVERSE
+		if (!HasInverse())
+		{
+			// The first thread computes the inverse, the others wait for it
+			int state = InverseStale;
+			if (m_invState.compare_exchange_strong(state, InverseComputing, std::memory_order_acquire))
+			{
+				VMAT_ACCOUNTING_SITE("Transform::InverseMatrix");
+				m_inv = m_m.Inversed();
+				m_invState.store(InverseValid, std::memory_order_release);
+			}
+			else
+			{
+				while (!HasInverse()) std::this_thread::yield();
+			}
+		}
+#endif
 		return m_inv;
 	}
 
+	template <typename T>
 	inline 
 	void
-		Transform::SetLookAt(const Point3f& eye, const Point3f& center, const Vector3f& up)
+		TransformT<T>::SetLookAt(const Point3<T>& eye, const Point3<T>& center, const Vector3<T>& up)
 	{
+		VMAT_ACCOUNTING_SITE("Transform::SetLookAt");
 		const auto direction = (center - eye).Normalized();
-		const auto right = Vector3f::Cross(direction, up).Normalized();
-		const auto newUp = Vector3f::Cross(right, direction).Normalized();
+		const auto right = Vector3<T>::Cross(direction, up).Normalized();
+		const auto newUp = Vector3<T>::Cross(right, direction).Normalized();
 
-		m_inv = Matrix4x4
+		m_inv = Matrix4x4T<T>
 		{
 			right.x,newUp.x,-direction.x,eye.x,
 			right.y,newUp.y,-direction.y,eye.y,
@@ -782,12 +978,15 @@ namespace  vm
 
 		// In right-hand coordinates system, the direction of direction components is different from left-hand coordinates system.
 		m_m = m_inv.Inversed();
+		SetInverse(m_inv);
 	}
 
+	template <typename T>
 	inline 
 	void
-		Transform::SetGLOrtho(Float left, Float right, Float bottom, Float top, Float nearPlane, Float farPlane)
+		TransformT<T>::SetGLOrtho(T left, T right, T bottom, T top, T nearPlane, T farPlane)
 	{
+		VMAT_ACCOUNTING_SITE("Transform::SetGLOrtho");
 		const auto width = right - left;
 		const auto height = top - bottom;
 		const auto clip = farPlane - nearPlane;
@@ -796,28 +995,31 @@ namespace  vm
 			return;
 		}
 
-		m_m = Matrix4x4{
+		m_m = Matrix4x4T<T>{
 			2.0f / width,0.0f,0.0f,-(right + left) / width,
 			0.0f,2.0f / height,0.0f,-(top + bottom) / height,
 			0.0f,0.0f,-2.0f / clip,-(farPlane + nearPlane) / clip,
 			0.0f,0.0f,0.0f,1.0f
 		};
-		m_inv = m_m.Inversed();
+		UpdateInverse();
 	}
 
+	template <typename T>
 	inline 
 	void
-		Transform::SetGLPerspective(Float vertcialAngle, Float aspectRation, Float nearPlane, Float farPlane)
+		TransformT<T>::SetGLPerspective(T vertcialAngle, T aspectRation, T nearPlane, T farPlane)
 	{
-		const auto top = std::tan(DegreesToRadians(vertcialAngle / 2)) * nearPlane;
+		const auto top = std::tan(detail::Radians(vertcialAngle / 2)) * nearPlane;
 		const auto right = top * aspectRation;
 		SetFrustum(-right, right, -top, top, nearPlane, farPlane);
 	}
 
+	template <typename T>
 	inline 
 	void
-		Transform::SetFrustum(Float left, Float right, Float bottom, Float top, Float nearPlane, Float farPlane)
+		TransformT<T>::SetFrustum(T left, T right, T bottom, T top, T nearPlane, T farPlane)
 	{
+		VMAT_ACCOUNTING_SITE("Transform::SetFrustum");
 		const auto width = right - left;
 		const auto height = top - bottom;
 		const auto clip = farPlane - nearPlane;
@@ -827,7 +1029,7 @@ namespace  vm
 			return;
 		}
 
-		m_m = Matrix4x4
+		m_m = Matrix4x4T<T>
 		{
 			2.f * nearPlane / width,0.0f,(right + left) / width,0.0f,
 			0.0f,2.f * nearPlane / height,(top + bottom) / height,0.0f,
@@ -835,89 +1037,98 @@ namespace  vm
 			0.0f,0.0f,-1.0f,0.0f
 		};
 
-		m_inv = m_m.Inversed();
+		UpdateInverse();
 	}
 
 
+	template <typename T>
 	inline 
 	void
-		Transform::SetTranslate(const Vector3f& t)
+		TransformT<T>::SetTranslate(const Vector3<T>& t)
 	{
 		SetTranslate(t[0], t[1], t[2]);
 	}
 
+	template <typename T>
 	inline 
 	void
-		Transform::SetTranslate(Float x, Float y, Float z)
+		TransformT<T>::SetTranslate(T x, T y, T z)
 	{
-		m_m = Matrix4x4{ 1.f,0.f,0.f,x,
+		m_m = Matrix4x4T<T>{ 1.f,0.f,0.f,x,
 				   0.f,1.f,0.f,y,
 				   0.f,0.f,1.f,z,
 				   0.f,0.f,0.f,1.f };
-		m_inv = Matrix4x4{ 1.f, 0.f, 0.f, -x,
+		SetInverse(Matrix4x4T<T>{ 1.f, 0.f, 0.f, -x,
 		   0.f, 1.f, 0.f, -y,
 		   0.f, 0.f, 1.f, -z,
-		   0.f, 0.f, 0.f, 1.f };
+		   0.f, 0.f, 0.f, 1.f });
 	}
 
+	template <typename T>
 	inline 
 	void
-		Transform::SetTranslate(Float* t)
+		TransformT<T>::SetTranslate(T* t)
 	{
 		SetTranslate(t[0], t[1], t[2]);
 	}
 
+	template <typename T>
 	inline 
 	void
-		Transform::SetScale(const Vector3f& s)
+		TransformT<T>::SetScale(const Vector3<T>& s)
 	{
 		SetScale(s[0], s[1], s[2]);
 	}
 
+	template <typename T>
 	inline 
 	void
-		Transform::SetScale(Float x, Float y, Float z)
+		TransformT<T>::SetScale(T x, T y, T z)
 	{
-		m_m = Matrix4x4
+		m_m = Matrix4x4T<T>
 		{
 		   x,0.f,0.f,0.f,
 		   0.f,y,0.f,0.f,
 		   0.f,0.f,z,0.f,
 		   0.f,0.f,0.f,1.f
 		};
-		m_inv = Matrix4x4
+		SetInverse(Matrix4x4T<T>
 		{
 			1 / x, 0.f, 0.f, 0.f,
 		   0.f, 1 / y, 0.f, 0.f,
 		   0.f, 0.f, 1 / z, 0.f,
 		   0.f, 0.f, 0.f, 1.f
-		};
+		});
 	}
 
+	template <typename T>
 	inline 
 	void
-		Transform::SetScale(Float* s)
+		TransformT<T>::SetScale(T* s)
 	{
 		SetScale(s[0], s[1], s[2]);
 	}
 
+	template <typename T>
 	inline 
 	void
-		Transform::SetRotate(const Vector3f& axis, Float degrees)
+		TransformT<T>::SetRotate(const Vector3<T>& axis, T degrees)
 	{
 		SetRotate(axis[0], axis[1], axis[2], degrees);
 	}
 
+	template <typename T>
 	inline 
 	void
-		Transform::SetRotate(Float x, Float y, Float z, Float degrees)
+		TransformT<T>::SetRotate(T x, T y, T z, T degrees)
 	{
+		VMAT_ACCOUNTING_SITE("Transform::SetRotate");
 		//YSL_ASSERT_X(false, "Transform::SetRotate", "Not implemented yet.");
-		Vector3f axis = { x,y,z };
-		Vector3f a = axis.Normalized();
-		const auto sinTheta = std::sin(DegreesToRadians(degrees));
-		const auto cosTheta = std::cos(DegreesToRadians(degrees));
-		Matrix4x4 m;
+		Vector3<T> axis = { x,y,z };
+		Vector3<T> a = axis.Normalized();
+		T sinTheta, cosTheta;
+		detail::SinCos(detail::Radians(degrees), sinTheta, cosTheta);
+		Matrix4x4T<T> m;
 		// Compute rotation of first basis vector
 		m.m[0][0] = a.x * a.x + (1 - a.x * a.x) * cosTheta;
 		m.m[0][1] = a.x * a.y * (1 - cosTheta) - a.z * sinTheta;
@@ -936,62 +1147,69 @@ namespace  vm
 		m.m[2][3] = 0;
 
 		m_m = m;
-		m_inv = m.Inversed();
+		UpdateInverse();
 	}
 
+	template <typename T>
 	inline 
 	void
-		Transform::SetRotate(Float* a, Float degrees)
+		TransformT<T>::SetRotate(T* a, T degrees)
 	{
 		SetRotate(a[0], a[1], a[2], degrees);
 	}
 
+	template <typename T>
 	inline 
 	void
-		Transform::SetRotateX(Float degrees)
+		TransformT<T>::SetRotateX(T degrees)
 	{
-		const auto radians = DegreesToRadians(degrees);
-		const auto sinTheta = std::sin(radians);
-		const auto cosTheta = std::cos(radians);
+		VMAT_ACCOUNTING_SITE("Transform::SetRotateX");
+		const auto radians = detail::Radians(degrees);
+		T sinTheta, cosTheta;
+		detail::SinCos(radians, sinTheta, cosTheta);
 
-		m_m = Matrix4x4
+		m_m = Matrix4x4T<T>
 		{
 		   1.f,0.f,0.f,0.f,
 		   0.f,cosTheta,-sinTheta,0.f,
 		   0.f,sinTheta,cosTheta,0.f,
 		   0.f,0.f,0.f,1.f
 		};
-		m_inv = m_m.Inversed();
+		UpdateInverse();
 
 	}
 
+	template <typename T>
 	inline 
 	void
-		Transform::SetRotateY(Float degrees)
+		TransformT<T>::SetRotateY(T degrees)
 	{
-		const auto radians = DegreesToRadians(degrees);
-		const auto sinTheta = std::sin(radians);
-		const auto cosTheta = std::cos(radians);
+		VMAT_ACCOUNTING_SITE("Transform::SetRotateY");
+		const auto radians = detail::Radians(degrees);
+		T sinTheta, cosTheta;
+		detail::SinCos(radians, sinTheta, cosTheta);
 
-		m_m = Matrix4x4
+		m_m = Matrix4x4T<T>
 		{
 		   cosTheta,0.f,-sinTheta,0.f,
 		   0.f,1.f,0.f,0.f,
 		   sinTheta,0.f,cosTheta,0.f,
 		   0.f,0.f,0.f,1.f
 		};
-		m_inv = m_m.Inversed();
+		UpdateInverse();
 	}
 
+	template <typename T>
 	inline 
 	void
-		Transform::SetRotateZ(Float degrees)
+		TransformT<T>::SetRotateZ(T degrees)
 	{
-		const auto radians = DegreesToRadians(degrees);
-		const auto sinTheta = std::sin(radians);
-		const auto cosTheta = std::cos(radians);
+		VMAT_ACCOUNTING_SITE("Transform::SetRotateZ");
+		const auto radians = detail::Radians(degrees);
+		T sinTheta, cosTheta;
+		detail::SinCos(radians, sinTheta, cosTheta);
 
-		m_m = Matrix4x4
+		m_m = Matrix4x4T<T>
 		{
 		   cosTheta,-sinTheta,0.f,0.f,
 		   sinTheta,cosTheta,0.f,0.f,
@@ -999,24 +1217,70 @@ namespace  vm
 		   0.f,0.f,0.f,1.f
 		};
 
-		m_inv = m_m.Inversed();
+		UpdateInverse();
 	}
 
+	template <typename T>
 	inline 
-	void Transform::SetIdentity()
+	void TransformT<T>::SetIdentity()
 	{
 		m_m.SetToIdentity();
-		m_inv.SetToIdentity();
+		SetInverse(m_m);
 	}
 
+	template <typename T>
 	inline 
-	Matrix4x4
-		Transform::ColumnMajorMatrix() const
+	Matrix4x4T<T>
+		TransformT<T>::ColumnMajorMatrix() const
 	{
 		return m_m.Transposed();
 	}
 	
 
+	/**
+	 * \brief The transform \a t followed by a translation by -\a origin, converted to the scalar
+	 * type \a U once. The translation is applied in the precision of \a t, so a single precision
+	 * result keeps its precision near \a origin however far \a origin is from zero.
+	 */
+	template <typename U, typename T>
+	inline 
+	TransformT<U>
+		RelativeTo(const TransformT<T>& t, const Point3<T>& origin)
+	{
+		TransformT<T> shift;
+		shift.SetTranslate(-origin.x, -origin.y, -origin.z);
+		return TransformT<U>(shift * t);
+	}
+
+	template <typename U, typename T>
+	inline 
+	Point3<U>
+		RelativeTo(const Point3<T>& p, const Point3<T>& origin)
+	{
+		return Point3<U>(U(p.x - origin.x), U(p.y - origin.y), U(p.z - origin.z));
+	}
+
+	template <typename U, typename T>
+	inline 
+	RayT<U>
+		RelativeTo(const RayT<T>& ray, const Point3<T>& origin)
+	{
+		auto r = RayT<U>(ray);
+		r.o = RelativeTo<U>(ray.o, origin);
+		return r;
+	}
+
+	/**
+	 * \brief Maps a point returned by RelativeTo() back to the precision of \a origin
+	 */
+	template <typename T, typename U>
+	inline 
+	Point3<T>
+		AbsoluteFrom(const Point3<U>& p, const Point3<T>& origin)
+	{
+		return Point3<T>(origin.x + T(p.x), origin.y + T(p.y), origin.z + T(p.z));
+	}
+
 }
 
 
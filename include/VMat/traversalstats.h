@@ -0,0 +1,271 @@
+#ifndef TRAVERSALSTATS_H_
+#define TRAVERSALSTATS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+/*
+ * Counters of the grid traversal of Grid::IntersectWith() and RayIntervalIter.
+ *
+ * The instrumentation is compiled in only when VMAT_TRAVERSAL_STATS is defined (CMake option
+ * VMAT_ENABLE_TRAVERSAL_STATS), otherwise VMAT_TRAVERSAL_STATS_ONLY() expands to nothing and
+ * RayIntervalIter keeps its size. The whole program must agree on the definition.
+ *
+ * Every thread counts into its own counters. CollectTraversalStats() merges the counters of all
+ * threads, those of exited threads included.
+ */
+
+#ifdef VMAT_TRAVERSAL_STATS
+#define VMAT_TRAVERSAL_STATS_ONLY( ... ) __VA_ARGS__
+#else
+#define VMAT_TRAVERSAL_STATS_ONLY( ... )
+#endif
+
+namespace vm
+{
+struct TraversalStats
+{
+	enum Counter
+	{
+		RaysTested,		// calls of Grid::IntersectWith()
+		BoundMisses,	// rays missing the bound of the grid
+		CellsStepped,	// advances of RayIntervalIter
+		AxisTies,		// advances crossing two or three cell faces at once
+		EmptyCellSkips, // cells skipped as empty, reported by the caller with CountTraversal()
+		CounterCount
+	};
+
+	/**
+	 * \brief Bin 0 counts the rays stepping 0 cells, bin b > 0 those stepping [2^(b-1), 2^b), the
+	 * last bin is open ended
+	 */
+	static constexpr int HistogramBins = 16;
+
+	std::uint64_t Counters[ CounterCount ] = {};
+	std::uint64_t CellsPerRay[ HistogramBins ] = {};
+
+	std::uint64_t operator[]( Counter c ) const { return Counters[ c ]; }
+
+	static int HistogramBin( std::uint64_t cells )
+	{
+		int bin = 0;
+		while ( cells != 0 && bin < HistogramBins - 1 ) {
+			cells >>= 1;
+			bin++;
+		}
+		return bin;
+	}
+
+	void Merge( const TraversalStats &s )
+	{
+		for ( int i = 0; i < CounterCount; i++ ) Counters[ i ] += s.Counters[ i ];
+		for ( int i = 0; i < HistogramBins; i++ ) CellsPerRay[ i ] += s.CellsPerRay[ i ];
+	}
+
+	void Report( std::ostream &os ) const
+	{
+		static const char *const names[ CounterCount ] = { "rays tested", "bound misses", "cells stepped", "axis ties", "empty cell skips" };
+		for ( int i = 0; i < CounterCount; i++ ) os << names[ i ] << ": " << Counters[ i ] << "\n";
+		const auto hits = Counters[ RaysTested ] - Counters[ BoundMisses ];
+		if ( hits != 0 ) os << "cells per ray: " << double( Counters[ CellsStepped ] ) / double( hits ) << "\n";
+		int last = HistogramBins - 1;
+		while ( last > 0 && CellsPerRay[ last ] == 0 ) last--;
+		for ( int b = 0; b <= last; b++ ) {
+			os << "  ";
+			if ( b == 0 ) {
+				os << "0";
+			} else if ( b == HistogramBins - 1 ) {
+				os << ">= " << ( std::uint64_t( 1 ) << ( b - 1 ) );
+			} else {
+				os << "[" << ( std::uint64_t( 1 ) << ( b - 1 ) ) << ", " << ( std::uint64_t( 1 ) << b ) << ")";
+			}
+			os << ": " << CellsPerRay[ b ] << "\n";
+		}
+	}
+
+	friend std::ostream &operator<<( std::ostream &os, const TraversalStats &s )
+	{
+		s.Report( os );
+		return os;
+	}
+};
+
+namespace detail
+{
+/**
+ * \brief The counters of one thread. Only the owning thread writes them, the relaxed atomics let
+ * the collecting thread read them while they change.
+ */
+struct TraversalCounters
+{
+	std::atomic<std::uint64_t> Counters[ TraversalStats::CounterCount ] = {};
+	std::atomic<std::uint64_t> CellsPerRay[ TraversalStats::HistogramBins ] = {};
+
+	static void Add( std::atomic<std::uint64_t> &c, std::uint64_t n )
+	{
+		c.store( c.load( std::memory_order_relaxed ) + n, std::memory_order_relaxed );
+	}
+
+	TraversalStats Snapshot() const
+	{
+		TraversalStats s;
+		for ( int i = 0; i < TraversalStats::CounterCount; i++ ) s.Counters[ i ] = Counters[ i ].load( std::memory_order_relaxed );
+		for ( int i = 0; i < TraversalStats::HistogramBins; i++ ) s.CellsPerRay[ i ] = CellsPerRay[ i ].load( std::memory_order_relaxed );
+		return s;
+	}
+
+	void Reset()
+	{
+		for ( auto &c : Counters ) c.store( 0, std::memory_order_relaxed );
+		for ( auto &c : CellsPerRay ) c.store( 0, std::memory_order_relaxed );
+	}
+};
+
+struct TraversalRegistry
+{
+	std::mutex Mutex;
+	std::vector<TraversalCounters *> Live;
+	TraversalStats Retired;
+
+	static TraversalRegistry &Instance()
+	{
+		static TraversalRegistry registry;
+		return registry;
+	}
+};
+
+struct ThreadTraversalCounters
+{
+	TraversalCounters Counters;
+
+	ThreadTraversalCounters()
+	{
+		auto &r = TraversalRegistry::Instance();
+		std::lock_guard<std::mutex> lk( r.Mutex );
+		r.Live.push_back( &Counters );
+	}
+
+	~ThreadTraversalCounters()
+	{
+		auto &r = TraversalRegistry::Instance();
+		std::lock_guard<std::mutex> lk( r.Mutex );
+		r.Retired.Merge( Counters.Snapshot() );
+		for ( auto &c : r.Live ) {
+			if ( c == &Counters ) {
+				c = r.Live.back();
+				r.Live.pop_back();
+				break;
+			}
+		}
+	}
+
+	static TraversalCounters &Get()
+	{
+		thread_local ThreadTraversalCounters counters;
+		return counters.Counters;
+	}
+};
+}  // namespace detail
+
+/**
+ * \brief Adds \a n to counter \a c of the calling thread
+ */
+inline void CountTraversal( TraversalStats::Counter c, std::uint64_t n = 1 )
+{
+	detail::TraversalCounters::Add( detail::ThreadTraversalCounters::Get().Counters[ c ], n );
+}
+
+/**
+ * \brief Records a ray that stepped \a cells cells
+ */
+inline void CountTraversalRay( std::uint64_t cells )
+{
+	auto &t = detail::ThreadTraversalCounters::Get();
+	detail::TraversalCounters::Add( t.Counters[ TraversalStats::CellsStepped ], cells );
+	detail::TraversalCounters::Add( t.CellsPerRay[ TraversalStats::HistogramBin( cells ) ], 1 );
+}
+
+/**
+ * \brief The counters of the calling thread
+ */
+inline TraversalStats ThreadTraversalStats()
+{
+	return detail::ThreadTraversalCounters::Get().Snapshot();
+}
+
+/**
+ * \brief The merged counters of all threads. Counts of threads still traversing may be partial.
+ */
+inline TraversalStats CollectTraversalStats()
+{
+	auto &r = detail::TraversalRegistry::Instance();
+	std::lock_guard<std::mutex> lk( r.Mutex );
+	auto s = r.Retired;
+	for ( const auto c : r.Live ) s.Merge( c->Snapshot() );
+	return s;
+}
+
+/**
+ * \brief Clears the counters of all threads. Call it while no thread traverses.
+ */
+inline void ResetTraversalStats()
+{
+	auto &r = detail::TraversalRegistry::Instance();
+	std::lock_guard<std::mutex> lk( r.Mutex );
+	r.Retired = TraversalStats();
+	for ( const auto c : r.Live ) c->Reset();
+}
+
+namespace detail
+{
+/**
+ * \brief The cells stepped by the ray of a RayIntervalIter, recorded when the iterator returned by
+ * Grid::IntersectWith() is destroyed. Copies do not record, moves take the record along.
+ */
+class TraversalRayRecord
+{
+public:
+	TraversalRayRecord() = default;
+	TraversalRayRecord( const TraversalRayRecord &r ) :
+	  steps( r.steps ) {}
+	TraversalRayRecord( TraversalRayRecord &&r ) noexcept :
+	  steps( r.steps ), owner( r.owner ) { r.owner = false; }
+	TraversalRayRecord &operator=( const TraversalRayRecord &r )
+	{
+		Flush();
+		steps = r.steps;
+		return *this;
+	}
+	TraversalRayRecord &operator=( TraversalRayRecord &&r ) noexcept
+	{
+		if ( this != &r ) {
+			Flush();
+			steps = r.steps;
+			owner = r.owner;
+			r.owner = false;
+		}
+		return *this;
+	}
+	~TraversalRayRecord() { Flush(); }
+
+	void Start() { owner = true; }
+	void Step() { steps++; }
+
+private:
+	void Flush()
+	{
+		if ( owner ) CountTraversalRay( steps );
+		owner = false;
+	}
+
+	std::uint64_t steps = 0;
+	bool owner = false;
+};
+}  // namespace detail
+
+}  // namespace vm
+
+#endif	// TRAVERSALSTATS_H_
@@ -0,0 +1,265 @@
+#ifndef TRIANGLE_H_
+#define TRIANGLE_H_
+
+#include <cassert>
+#include <limits>
+#include <utility>
+
+#include "arithmetic.h"
+#include "geometry.h"
+#include "simd.h"
+
+namespace vm
+{
+/**
+ * \brief The per-ray constants of the watertight ray-triangle test.
+ *
+ * The ray is translated to the origin and sheared so that it points along +z. Kz is the axis
+ * of the largest direction component, Kx and Ky follow it and are swapped for a negative
+ * direction so that the winding of the triangles is preserved.
+ */
+struct RayShear
+{
+	Point3f Origin;
+	int Kx, Ky, Kz;
+	Float Sx, Sy, Sz;
+	Float TMax;
+
+	explicit RayShear( const Ray &ray ) :
+	  Origin( ray.Original() ), TMax( ray.tMax )
+	{
+		const auto &d = ray.Direction();
+		Kz = findMaxVector3fComponent( absOfVector3f( d ) );
+		Kx = ( Kz + 1 ) % 3;
+		Ky = ( Kx + 1 ) % 3;
+		if ( d[ Kz ] < 0 ) std::swap( Kx, Ky );
+		Sx = d[ Kx ] / d[ Kz ];
+		Sy = d[ Ky ] / d[ Kz ];
+		Sz = 1 / d[ Kz ];
+	}
+};
+
+struct TriangleHit
+{
+	Float T = 0;
+	/**
+	 * \brief The barycentric weights of P0, P1 and P2
+	 */
+	Float B0 = 0, B1 = 0, B2 = 0;
+	/**
+	 * \brief true if the ray enters through the side the normal (P1 - P0) x (P2 - P0) points to
+	 */
+	bool FrontFacing = false;
+};
+
+/**
+ * \brief A triangle with the watertight intersection of Woop, Benthin and Wald, "Watertight
+ * Ray/Triangle Intersection", JCGT 2013.
+ *
+ * Rays through a shared edge or vertex hit at least one of the adjacent triangles, which keeps
+ * volume entry and exit points on closed proxy meshes from leaking through cracks. Both sides
+ * are hit, unlike Moller-Trumbore there is no epsilon to tune.
+ */
+class Triangle
+{
+public:
+	Point3f P0, P1, P2;
+
+	Triangle() = default;
+	Triangle( const Point3f &p0, const Point3f &p1, const Point3f &p2 ) :
+	  P0( p0 ), P1( p1 ), P2( p2 ) {}
+
+	Bound3f Bound() const
+	{
+		return Bound3f( P0, P1 ).UnionWith( P2 );
+	}
+
+	Vector3f Normal() const
+	{
+		return Vector3f::Cross( P1 - P0, P2 - P0 );
+	}
+
+	bool Intersect( const Ray &ray, TriangleHit *hit = nullptr ) const
+	{
+		return Intersect( RayShear( ray ), hit );
+	}
+
+	bool Intersect( const RayShear &ray, TriangleHit *hit = nullptr ) const
+	{
+		const auto a = P0 - ray.Origin, b = P1 - ray.Origin, c = P2 - ray.Origin;
+		return IntersectSheared( a[ ray.Kx ] - ray.Sx * a[ ray.Kz ], a[ ray.Ky ] - ray.Sy * a[ ray.Kz ], ray.Sz * a[ ray.Kz ],
+								 b[ ray.Kx ] - ray.Sx * b[ ray.Kz ], b[ ray.Ky ] - ray.Sy * b[ ray.Kz ], ray.Sz * b[ ray.Kz ],
+								 c[ ray.Kx ] - ray.Sx * c[ ray.Kz ], c[ ray.Ky ] - ray.Sy * c[ ray.Kz ], ray.Sz * c[ ray.Kz ],
+								 ray.TMax, hit );
+	}
+
+	/**
+	 * \brief The hit test on vertices already translated, permuted and sheared into the space of the ray.
+	 *
+	 * The edge functions are evaluated in double. Products of floats are exact there, so their
+	 * signs are exact and an edge shared by two triangles gets opposite signs in both, whether or not
+	 * the compiler contracts the arithmetic into FMA.
+	 */
+	static bool IntersectSheared( Float ax, Float ay, Float az, Float bx, Float by, Float bz,
+								  Float cx, Float cy, Float cz, Float tMax, TriangleHit *hit )
+	{
+		const auto u = double( cx ) * double( by ) - double( cy ) * double( bx );
+		const auto v = double( ax ) * double( cy ) - double( ay ) * double( cx );
+		const auto w = double( bx ) * double( ay ) - double( by ) * double( ax );
+		if ( ( u < 0 || v < 0 || w < 0 ) && ( u > 0 || v > 0 || w > 0 ) ) return false;
+		const auto det = u + v + w;
+		if ( det == 0 ) return false;
+
+		const auto t = u * az + v * bz + w * cz;
+		if ( det > 0 ? ( t < 0 || t > tMax * det ) : ( t > 0 || t < tMax * det ) ) return false;
+
+		if ( hit != nullptr ) {
+			const auto inv = 1 / det;
+			hit->T = Float( t * inv );
+			hit->B0 = Float( u * inv );
+			hit->B1 = Float( v * inv );
+			hit->B2 = Float( w * inv );
+			hit->FrontFacing = det > 0;
+		}
+		return true;
+	}
+};
+
+/**
+ * \brief 8 triangles in SoA layout, intersected with one ray at once
+ */
+struct alignas( 32 ) Triangle8
+{
+	/**
+	 * \brief P[vertex][axis][lane]
+	 */
+	float P[ 3 ][ 3 ][ 8 ] = {};
+	int Count = 0;
+
+	void Set( int lane, const Triangle &tri )
+	{
+		assert( lane >= 0 && lane < 8 );
+		const Point3f *v[ 3 ] = { &tri.P0, &tri.P1, &tri.P2 };
+		for ( int i = 0; i < 3; i++ )
+			for ( int a = 0; a < 3; a++ ) P[ i ][ a ][ lane ] = ( *v[ i ] )[ a ];
+		Count = ( std::max )( Count, lane + 1 );
+	}
+
+	Triangle Get( int lane ) const
+	{
+		assert( lane >= 0 && lane < 8 );
+		auto vertex = [ & ]( int i ) { return Point3f( P[ i ][ 0 ][ lane ], P[ i ][ 1 ][ lane ], P[ i ][ 2 ][ lane ] ); };
+		return Triangle( vertex( 0 ), vertex( 1 ), vertex( 2 ) );
+	}
+
+	/**
+	 * \brief Intersects the first Count triangles with the ray.
+	 *
+	 * The edge functions are evaluated in float. Lanes where one of them is too close to 0 for
+	 * its sign to be certain are decided again by Triangle::IntersectSheared() on the same sheared
+	 * vertices, so the packets are as watertight as the scalar test.
+	 *
+	 * \param t, b0, b1, b2 Receive the distances and barycentric weights, meaningful in the hit lanes only
+	 * \param frontFacing Receives the bit mask of the hits on the front side
+	 * \return The bit mask of the triangles hit
+	 */
+	int Intersect( const RayShear &ray, Float8 &t, Float8 &b0, Float8 &b1, Float8 &b2, int *frontFacing = nullptr ) const
+	{
+		Float8 x[ 3 ], y[ 3 ], z[ 3 ];
+		const Float8 sx( ray.Sx ), sy( ray.Sy ), sz( ray.Sz );
+		for ( int i = 0; i < 3; i++ ) {
+			const auto pz = Float8::Load( P[ i ][ ray.Kz ] ) - Float8( ray.Origin[ ray.Kz ] );
+			x[ i ] = Float8::Load( P[ i ][ ray.Kx ] ) - Float8( ray.Origin[ ray.Kx ] ) - sx * pz;
+			y[ i ] = Float8::Load( P[ i ][ ray.Ky ] ) - Float8( ray.Origin[ ray.Ky ] ) - sy * pz;
+			z[ i ] = sz * pz;
+		}
+		const Float8 zero = Float8::Zero();
+		// A bound on the rounding error of a difference of products, FMA contracted or not
+		const Float8 eps( 4 * std::numeric_limits<float>::epsilon() );
+		auto uncertain = Mask8::FirstN( 0 );
+		auto edge = [ & ]( int i, int j ) {
+			const auto p = x[ i ] * y[ j ], q = y[ i ] * x[ j ];
+			const auto e = p - q;
+			uncertain = uncertain | ( Abs( e ) <= eps * ( Abs( p ) + Abs( q ) ) );
+			return e;
+		};
+		const auto u = edge( 2, 1 ), v = edge( 0, 2 ), w = edge( 1, 0 );
+		const auto det = u + v + w;
+		const auto tScaled = u * z[ 0 ] + v * z[ 1 ] + w * z[ 2 ];
+
+		const auto anyNegative = ( u < zero ) | ( v < zero ) | ( w < zero );
+		const auto anyPositive = ( u > zero ) | ( v > zero ) | ( w > zero );
+		const auto positive = det > zero;
+		const auto tMaxDet = Float8( ray.TMax ) * det;
+		const auto inRange = ( positive & ( tScaled >= zero ) & ( tScaled <= tMaxDet ) ) |
+							 ( ( det < zero ) & ( tScaled <= zero ) & ( tScaled >= tMaxDet ) );
+		const auto lanes = ( 1 << Count ) - 1;
+		auto mask = ( ~( anyNegative & anyPositive ) & inRange ).Bits() & lanes;
+		auto facing = positive.Bits();
+
+		const auto inv = Float8( 1.f ) / det;
+		t = tScaled * inv;
+		b0 = u * inv;
+		b1 = v * inv;
+		b2 = w * inv;
+
+		auto fallback = uncertain.Bits() & lanes;
+		if ( fallback ) {
+			alignas( 32 ) float tt[ 8 ], bb0[ 8 ], bb1[ 8 ], bb2[ 8 ];
+			t.Store( tt );
+			b0.Store( bb0 );
+			b1.Store( bb1 );
+			b2.Store( bb2 );
+			for ( int lane = 0; fallback; lane++, fallback >>= 1 ) {
+				if ( !( fallback & 1 ) ) continue;
+				TriangleHit hit;
+				const auto bit = 1 << lane;
+				mask &= ~bit;
+				facing &= ~bit;
+				if ( Triangle::IntersectSheared( x[ 0 ][ lane ], y[ 0 ][ lane ], z[ 0 ][ lane ],
+												 x[ 1 ][ lane ], y[ 1 ][ lane ], z[ 1 ][ lane ],
+												 x[ 2 ][ lane ], y[ 2 ][ lane ], z[ 2 ][ lane ], ray.TMax, &hit ) ) {
+					mask |= bit;
+					facing |= hit.FrontFacing ? bit : 0;
+					tt[ lane ] = hit.T;
+					bb0[ lane ] = hit.B0;
+					bb1[ lane ] = hit.B1;
+					bb2[ lane ] = hit.B2;
+				}
+			}
+			t = Float8::Load( tt );
+			b0 = Float8::Load( bb0 );
+			b1 = Float8::Load( bb1 );
+			b2 = Float8::Load( bb2 );
+		}
+		if ( frontFacing != nullptr ) *frontFacing = facing & mask;
+		return mask;
+	}
+
+	/**
+	 * \brief Returns the lane of the closest hit or -1
+	 */
+	int IntersectClosest( const RayShear &ray, TriangleHit *hit = nullptr ) const
+	{
+		Float8 t, b0, b1, b2;
+		int facing;
+		auto mask = Intersect( ray, t, b0, b1, b2, &facing );
+		if ( !mask ) return -1;
+		int best = -1;
+		for ( int lane = 0; lane < Count; lane++ ) {
+			if ( ( ( mask >> lane ) & 1 ) && ( best < 0 || t[ lane ] < t[ best ] ) ) best = lane;
+		}
+		if ( hit != nullptr ) {
+			hit->T = t[ best ];
+			hit->B0 = b0[ best ];
+			hit->B1 = b1[ best ];
+			hit->B2 = b2[ best ];
+			hit->FrontFacing = ( facing >> best ) & 1;
+		}
+		return best;
+	}
+};
+
+}  // namespace vm
+
+#endif	// TRIANGLE_H_
@@ -0,0 +1,113 @@
+#ifndef VISIBILITY_H_
+#define VISIBILITY_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "geometry.h"
+#include "transformation.h"
+#include "parallel.h"
+
+namespace vm
+{
+struct VisibleCell
+{
+	Point3i Cell;
+	/**
+	 * \brief The smallest ray parameter, measured from the near plane, at which a sparse ray entered
+	 * the cell or a cell it was dilated from
+	 */
+	Float Distance;
+};
+
+/**
+ * \brief Estimates the cells of \a grid a frame will touch, before any data is loaded.
+ *
+ * Only one ray every \a stride pixels along each axis of the viewport is cast through the grid.
+ * Each visited cell is dilated by the footprint of a sample, i.e. by how far the ray of the
+ * neighboring sample has drifted away at the far end of the cell, so the pixels in between can
+ * not reach a cell outside of the set.
+ *
+ * \param worldToClip A world to clip space transform with OpenGL clip space conventions
+ * \return The visited cells ordered by first-hit distance, nearest first
+ */
+template <typename T>
+std::vector<VisibleCell> EstimateVisibleCells( const Grid<T> &grid, const Transform &worldToClip, const Vec2i &viewport, int stride = 8 )
+{
+	stride = ( std::max )( stride, 1 );
+	const auto clipToWorld = worldToClip.Inversed();
+	const auto &dim = grid.GridDimension;
+	const auto cellDiagonal = grid.Cell.Length();
+
+	// The last pixel of each axis is always sampled so the border of the viewport is covered
+	auto samples = []( int extent, int stride ) {
+		std::vector<int> s;
+		for ( int p = 0; p < extent; p += stride ) s.push_back( p );
+		if ( s.empty() || s.back() != extent - 1 ) s.push_back( extent - 1 );
+		return s;
+	};
+	const auto xs = samples( viewport.x, stride ), ys = samples( viewport.y, stride );
+
+	auto pixelRay = [ & ]( int px, int py ) {
+		const Float x = 2 * ( px + Float( 0.5 ) ) / viewport.x - 1;
+		const Float y = 2 * ( py + Float( 0.5 ) ) / viewport.y - 1;
+		const auto nearPoint = clipToWorld * Point3f( x, y, -1 );
+		const auto farPoint = clipToWorld * Point3f( x, y, 1 );
+		const auto d = farPoint - nearPoint;
+		return Ray( d, nearPoint, d.Length() );
+	};
+
+	std::unique_ptr<std::atomic<Float>[]> distance( new std::atomic<Float>[ dim.Prod() ] );
+	for ( std::size_t i = 0; i < dim.Prod(); i++ ) distance[ i ].store( MAX_VALUE, std::memory_order_relaxed );
+	auto visit = [ & ]( int x, int y, int z, Float t ) {
+		auto &d = distance[ std::size_t( x ) + std::size_t( dim.x ) * ( std::size_t( y ) + std::size_t( dim.y ) * z ) ];
+		auto cur = d.load( std::memory_order_relaxed );
+		while ( t < cur && !d.compare_exchange_weak( cur, t, std::memory_order_relaxed ) ) {
+		}
+	};
+
+	ParallelFor( 0, ys.size(), 1, [ & ]( std::size_t begin, std::size_t end ) {
+		for ( auto j = begin; j < end; j++ ) {
+			const auto py = ys[ j ];
+			for ( const auto px : xs ) {
+				const auto ray = pixelRay( px, py );
+				// The footprint grows linearly along the ray: |delta o| + t * |delta d| towards each neighbor
+				const auto nx = pixelRay( px + ( px + stride < viewport.x ? stride : -stride ), py );
+				const auto ny = pixelRay( px, py + ( py + stride < viewport.y ? stride : -stride ) );
+				const auto spreadO = ( std::max )( ( nx.o - ray.o ).Length(), ( ny.o - ray.o ).Length() );
+				const auto spreadD = ( std::max )( ( nx.d - ray.d ).Length(), ( ny.d - ray.d ).Length() );
+
+				for ( auto it = grid.IntersectWith( ray ); it.Valid() && it.Pos <= ray.tMax; ++it ) {
+					const auto radius = spreadO + ( std::min )( it.Pos + cellDiagonal, ray.tMax ) * spreadD;
+					Point3i lo, hi;
+					for ( int a = 0; a < 3; a++ ) {
+						const auto r = static_cast<int>( std::ceil( radius / grid.Cell[ a ] ) );
+						lo[ a ] = ( std::max )( it.CellIndex[ a ] - r, 0 );
+						hi[ a ] = ( std::min )( it.CellIndex[ a ] + r, dim[ a ] - 1 );
+					}
+					for ( int z = lo.z; z <= hi.z; z++ )
+						for ( int y = lo.y; y <= hi.y; y++ )
+							for ( int x = lo.x; x <= hi.x; x++ ) visit( x, y, z, it.Pos );
+				}
+			}
+		}
+	} );
+
+	std::vector<VisibleCell> cells;
+	for ( int z = 0; z < dim.z; z++ )
+		for ( int y = 0; y < dim.y; y++ )
+			for ( int x = 0; x < dim.x; x++ ) {
+				const auto d = distance[ std::size_t( x ) + std::size_t( dim.x ) * ( std::size_t( y ) + std::size_t( dim.y ) * z ) ].load( std::memory_order_relaxed );
+				if ( d != MAX_VALUE ) cells.push_back( VisibleCell{ Point3i( x, y, z ), d } );
+			}
+	// Cells are collected in linear order, so a stable sort keeps equal distances deterministic
+	std::stable_sort( cells.begin(), cells.end(), []( const VisibleCell &a, const VisibleCell &b ) { return a.Distance < b.Distance; } );
+	return cells;
+}
+
+}  // namespace vm
+
+#endif	// VISIBILITY_H_
@@ -0,0 +1,274 @@
+#ifndef WIDEBVH_H_
+#define WIDEBVH_H_
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#include "bvh.h"
+#include "geometry.h"
+#include "simd.h"
+
+namespace vm
+{
+/**
+ * \brief The per-ray constants of the slab test against Bound3x8, broadcast to all lanes
+ */
+struct RayReciprocal
+{
+	Float8 Origin[ 3 ];
+	Float8 InvDir[ 3 ];
+	bool NegDirection[ 3 ];
+
+	explicit RayReciprocal( const Ray &ray )
+	{
+		for ( int a = 0; a < 3; a++ ) {
+			Origin[ a ] = Float8( ray.o[ a ] );
+			InvDir[ a ] = Float8( 1 / ray.d[ a ] );
+			NegDirection[ a ] = ray.negDirection[ a ];
+		}
+	}
+};
+
+/**
+ * \brief 8 bounding boxes in SoA layout for testing one ray against all of them at once
+ */
+struct alignas( 32 ) Bound3x8
+{
+	float Min[ 3 ][ 8 ];
+	float Max[ 3 ][ 8 ];
+
+	Bound3x8() { Clear(); }
+
+	/**
+	 * \brief Resets all lanes to empty bounds
+	 */
+	void Clear()
+	{
+		for ( int a = 0; a < 3; a++ ) {
+			for ( int l = 0; l < 8; l++ ) {
+				Min[ a ][ l ] = MAX_VALUE;
+				Max[ a ][ l ] = LOWEST_FLOAT;
+			}
+		}
+	}
+
+	void Set( int lane, const Bound3f &b )
+	{
+		assert( lane >= 0 && lane < 8 );
+		for ( int a = 0; a < 3; a++ ) {
+			Min[ a ][ lane ] = b.min[ a ];
+			Max[ a ][ lane ] = b.max[ a ];
+		}
+	}
+
+	Bound3f Get( int lane ) const
+	{
+		assert( lane >= 0 && lane < 8 );
+		Bound3f b;
+		for ( int a = 0; a < 3; a++ ) {
+			b.min[ a ] = Min[ a ][ lane ];
+			b.max[ a ] = Max[ a ][ lane ];
+		}
+		return b;
+	}
+
+	/**
+	 * \brief The slab test of one ray against the 8 boxes over [0, \a tMax].
+	 *
+	 * The near and far planes of every axis are picked once per ray from its direction signs,
+	 * so there is no per-lane swap. Rays parallel to an axis get infinite slab distances, and the
+	 * NaN of a ray starting exactly on such a plane is ignored by the min/max order.
+	 *
+	 * \param tNear Receives the entry distances, meaningful in the hit lanes only
+	 * \return The bit mask of the boxes hit
+	 */
+	int Intersect( const RayReciprocal &ray, Float tMax, Float8 &tNear ) const
+	{
+		Float8 t0 = Float8::Zero(), t1( tMax );
+		for ( int a = 0; a < 3; a++ ) {
+			const auto nearPlane = Float8::Load( ray.NegDirection[ a ] ? Max[ a ] : Min[ a ] );
+			const auto farPlane = Float8::Load( ray.NegDirection[ a ] ? Min[ a ] : Max[ a ] );
+			t0 = vm::Max( ( nearPlane - ray.Origin[ a ] ) * ray.InvDir[ a ], t0 );
+			t1 = vm::Min( ( farPlane - ray.Origin[ a ] ) * ray.InvDir[ a ], t1 );
+		}
+		tNear = t0;
+		return ( t0 <= t1 ).Bits();
+	}
+
+	/**
+	 * \brief Intersects the boxes of the lanes in \a laneMask and sorts the hits front to back.
+	 *
+	 * \param order Receives the hit lanes, nearest first
+	 * \param distances Receives the entry distances of the lanes in \a order
+	 * \return The number of hits
+	 */
+	int IntersectSorted( const RayReciprocal &ray, Float tMax, int order[ 8 ], float distances[ 8 ], int laneMask = 0xff ) const
+	{
+		Float8 tNear;
+		auto mask = Intersect( ray, tMax, tNear ) & laneMask;
+		alignas( 32 ) float t[ 8 ];
+		tNear.Store( t );
+		int n = 0;
+		while ( mask ) {
+			const auto lane = CountTrailingZeros( mask );
+			mask &= mask - 1;
+			// Insertion sort, there are 8 lanes at most
+			auto k = n++;
+			for ( ; k > 0 && distances[ k - 1 ] > t[ lane ]; k-- ) {
+				distances[ k ] = distances[ k - 1 ];
+				order[ k ] = order[ k - 1 ];
+			}
+			distances[ k ] = t[ lane ];
+			order[ k ] = lane;
+		}
+		return n;
+	}
+
+private:
+	static int CountTrailingZeros( int mask )
+	{
+		int n = 0;
+		while ( !( mask & 1 ) ) {
+			mask >>= 1;
+			n++;
+		}
+		return n;
+	}
+};
+
+/**
+ * \brief An 8-wide BVH collapsed from a binary BVHTreeAccelerator.
+ *
+ * Every node tests a ray against up to 8 children at once, which about halves the traversal
+ * depth of the binary tree. Nodes are stored parent before children.
+ */
+class WideBVHAccelerator
+{
+public:
+	struct alignas( 32 ) Node
+	{
+		Bound3x8 Bounds;
+		/**
+		 * \brief A node index for interior children, the first entry in PrimitiveIndices() for leaves
+		 */
+		int Child[ 8 ] = {};
+		std::uint16_t PrimitiveCount[ 8 ] = {};	 // 0 for interior children
+		std::uint8_t ChildCount = 0;
+	};
+
+	WideBVHAccelerator() = default;
+
+	/**
+	 * \brief Collapses \a bvh. Each wide node greedily opens the interior child with the largest
+	 * surface area until it holds 8 children or only leaves are left.
+	 */
+	explicit WideBVHAccelerator( const BVHTreeAccelerator &bvh ) :
+	  indices( bvh.PrimitiveIndices() )
+	{
+		const auto &binary = bvh.Nodes();
+		if ( binary.empty() ) return;
+		nodes.reserve( binary.size() / 4 + 1 );
+		Collapse( binary, 0 );
+	}
+
+	const std::vector<Node> &Nodes() const { return nodes; }
+	const std::vector<int> &PrimitiveIndices() const { return indices; }
+
+	/**
+	 * \brief Finds the closest intersection along \a ray, visiting the children of each node
+	 * front to back.
+	 *
+	 * \sa BVHTreeAccelerator::Intersect()
+	 */
+	template <typename F>
+	bool Intersect( const Ray &ray, F &&intersectPrimitive ) const
+	{
+		if ( nodes.empty() ) return false;
+		const RayReciprocal rr( ray );
+		Float tMax = ray.tMax;
+		struct Entry
+		{
+			int Index;
+			int Count;	// of primitives, 0 for nodes
+			Float TNear;
+		};
+		Entry stack[ 8 * BVHTreeAccelerator::MaxDepth ];
+		int top = 0;
+		stack[ top++ ] = Entry{ 0, 0, 0 };
+		bool hit = false;
+		while ( top > 0 ) {
+			const auto e = stack[ --top ];
+			if ( e.TNear > tMax ) continue;
+			if ( e.Count > 0 ) {
+				for ( int i = 0; i < e.Count; i++ ) {
+					if ( intersectPrimitive( indices[ e.Index + i ], tMax ) ) hit = true;
+				}
+				continue;
+			}
+			const auto &node = nodes[ e.Index ];
+			int order[ 8 ];
+			float distances[ 8 ];
+			const auto n = node.Bounds.IntersectSorted( rr, tMax, order, distances, ( 1 << node.ChildCount ) - 1 );
+			// The nearest child goes on top
+			for ( int k = n - 1; k >= 0; k-- ) {
+				const auto lane = order[ k ];
+				stack[ top++ ] = Entry{ node.Child[ lane ], node.PrimitiveCount[ lane ], distances[ k ] };
+			}
+		}
+		return hit;
+	}
+
+private:
+	int Collapse( const std::vector<BVHTreeAccelerator::Node> &binary, int root )
+	{
+		const auto index = static_cast<int>( nodes.size() );
+		nodes.emplace_back();
+
+		int children[ 8 ];
+		int n = 0;
+		if ( binary[ root ].IsLeaf() ) {
+			children[ n++ ] = root;
+		} else {
+			children[ n++ ] = root + 1;
+			children[ n++ ] = binary[ root ].SecondChildOffset;
+			while ( n < 8 ) {
+				int best = -1;
+				Float bestArea = -1;
+				for ( int k = 0; k < n; k++ ) {
+					const auto &c = binary[ children[ k ] ];
+					if ( !c.IsLeaf() && c.Bound.SurfaceArea() > bestArea ) {
+						bestArea = c.Bound.SurfaceArea();
+						best = k;
+					}
+				}
+				if ( best < 0 ) break;
+				const auto opened = children[ best ];
+				children[ best ] = opened + 1;
+				children[ n++ ] = binary[ opened ].SecondChildOffset;
+			}
+		}
+
+		nodes[ index ].ChildCount = static_cast<std::uint8_t>( n );
+		for ( int k = 0; k < n; k++ ) {
+			const auto &c = binary[ children[ k ] ];
+			nodes[ index ].Bounds.Set( k, c.Bound );
+			if ( c.IsLeaf() ) {
+				nodes[ index ].Child[ k ] = c.PrimitiveOffset;
+				nodes[ index ].PrimitiveCount[ k ] = c.PrimitiveCount;
+			} else {
+				// The recursion grows nodes, so no reference into it is held across the call
+				const auto child = Collapse( binary, children[ k ] );
+				nodes[ index ].Child[ k ] = child;
+			}
+		}
+		return index;
+	}
+
+	std::vector<Node> nodes;
+	std::vector<int> indices;
+};
+
+}  // namespace vm
+
+#endif	// WIDEBVH_H_
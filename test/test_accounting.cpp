@@ -0,0 +1,89 @@
+#include <gtest/gtest.h>
+#include <VMat/transformation.h>
+#include <sstream>
+#include <thread>
+using namespace vm;
+
+namespace
+{
+void expectInverse(const Transform & t){
+    const auto id = Matrix4x4::Mul(t.Matrix(),t.InverseMatrix());
+    for(int i = 0;i<4;i++)
+        for(int j = 0;j<4;j++) EXPECT_NEAR(id.m[i][j],i == j ? 1 : 0,1e-5);
+}
+}
+
+TEST(test_accounting, sites){
+    ResetAccountingStats();
+    Account(AccountingStats::Inversions);
+    {
+        const AccountingSite frame("frame");
+        Account(AccountingStats::Normalizations);
+        {
+            const AccountingSite setter("setter");
+            Account(AccountingStats::Inversions);
+            Account(AccountingStats::Inversions);
+        }
+    }
+    std::thread([](){
+        const AccountingSite frame("frame");
+        Account(AccountingStats::NaNChecks);
+    }).join();
+
+    auto s = EndAccountingFrame();
+    ASSERT_EQ(s[AccountingStats::Inversions],3u);
+    ASSERT_EQ(s.Sites["(unattributed)"][AccountingStats::Inversions],1u);
+    ASSERT_EQ(s.Sites["frame"][AccountingStats::Normalizations],1u);
+    ASSERT_EQ(s.Sites["frame"][AccountingStats::NaNChecks],1u);
+    ASSERT_EQ(s.Sites["frame > setter"][AccountingStats::Inversions],2u);
+
+    std::ostringstream os;
+    os << s;
+    ASSERT_NE(os.str().find("frame > setter: inversions 2"),std::string::npos);
+
+    // the frame starts over
+    ASSERT_TRUE(EndAccountingFrame().Sites.empty());
+}
+
+TEST(test_accounting, inverse){
+    auto t = Translate(1,2,3) * Rotate(Vector3f(1,1,0),30) * Scale(2,3,4);
+    expectInverse(t);
+    expectInverse(t.Inversed());
+    const auto copy = t;
+    expectInverse(copy);
+    t.Transpose();
+    expectInverse(t);
+    expectInverse(Perspective(45,1.5f,0.1f,100));
+    expectInverse(Transform(Matrix4x4(2,0,0,1,0,3,0,2,0,0,4,3,0,0,0,1)));
+    expectInverse(LookAt({1,2,3},{0,0,0},{0,1,0}));
+}
+
+#ifdef VMAT_ACCOUNTING
+TEST(test_accounting, transform){
+    ResetAccountingStats();
+    {
+        VMAT_ACCOUNTING_SITE("scene");
+        const auto t = RotateX(30) * Translate(1,0,0);
+        t.InverseMatrix();
+        t.InverseMatrix();
+    }
+    const auto s = EndAccountingFrame();
+#ifdef VMAT_LAZY_INVERSE
+    // only the composed transform is inverted, when its inverse is first used
+    ASSERT_EQ(s[AccountingStats::Inversions],1u);
+    ASSERT_EQ(s.Sites.at("scene > Transform::InverseMatrix")[AccountingStats::Inversions],1u);
+#else
+    ASSERT_EQ(s[AccountingStats::Inversions],1u);
+    ASSERT_EQ(s.Sites.at("scene > Transform::SetRotateX")[AccountingStats::Inversions],1u);
+#endif
+}
+#endif
+
+#ifdef VMAT_LAZY_INVERSE
+TEST(test_accounting, concurrent){
+    const auto t = Transform(Matrix4x4(2,0,0,1,0,3,0,2,0,0,4,3,0,0,0,1));
+    std::vector<std::thread> threads;
+    for(int i = 0;i<4;i++) threads.emplace_back([&t](){ expectInverse(t); });
+    for(auto & th : threads) th.join();
+}
+#endif
@@ -145,4 +145,48 @@ TEST(test_rayiterator, raycast){
             }
 		}
 	}
-}
\ No newline at end of file
+}
+// every ray from the eye must enter the cells in increasing visibility order
+void test_visibility_order(const Grid<int> & grid, const std::vector<Point3i> & order, const Point3f & eye, const Vec3f & dir){
+    std::vector<int> rank(order.size(),-1);
+    for(std::size_t i = 0;i<order.size();i++){
+        const auto & c = order[i];
+        rank[c.x + grid.GridDimension.x*(c.y + grid.GridDimension.y*c.z)] = int(i);
+    }
+    for(auto r : rank) ASSERT_GE(r,0);
+
+    auto iter = grid.IntersectWith(Ray{dir,eye});
+    int prev = -1;
+    while(iter.Valid()){
+        const auto & c = iter.CellIndex;
+        const auto cur = rank[c.x + grid.GridDimension.x*(c.y + grid.GridDimension.y*c.z)];
+        ASSERT_GT(cur,prev);
+        prev = cur;
+        ++iter;
+    }
+}
+
+TEST(test_geometry, visibility_order){
+    const Bound3i bound{{0,0,0},{256,128,192}};
+    const auto grid = bound.GenGrid({8,4,6});
+    const Point3f eyes[] = {{-100,-50,-70},{100,60,90},{300,-20,100},{130,200,-500},{17,120,185}};
+    for(const auto & eye : eyes){
+        const auto order = grid.VisibilityOrder(eye);
+        ASSERT_EQ(order.size(),std::size_t(8*4*6));
+        for(int i = 0;i<200;i++){
+            const Point3f target(float((i*37)%256),float((i*53)%128),float((i*71)%192));
+            if(target == eye)continue;
+            test_visibility_order(grid,order,eye,target - eye);
+        }
+    }
+
+    // orthographic, parallel rays entering from the far outside
+    const Vec3f dirs[] = {{1,1,1},{-1,0.5,0.25},{0.3,-1,-0.7}};
+    for(const auto & dir : dirs){
+        const auto order = grid.VisibilityOrder(dir);
+        for(int i = 0;i<200;i++){
+            const Point3f target(float((i*37)%256),float((i*53)%128),float((i*71)%192));
+            test_visibility_order(grid,order,target - 1000.f * dir.Normalized(),dir);
+        }
+    }
+}
@@ -0,0 +1,127 @@
+#include <gtest/gtest.h>
+#include <VMat/brickcache.h>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+#include <vector>
+using namespace vm;
+
+namespace
+{
+// voxel value encodes its coordinate so bricks can be validated
+unsigned char voxel(std::size_t x,std::size_t y,std::size_t z){
+    return (unsigned char)(x + 10*y + 100*z);
+}
+
+std::string writeVolume(const Size3 & dim){
+    const std::string fileName = "vmat_test_brickcache.raw";
+    std::ofstream out(fileName,std::ios::binary);
+    for(std::size_t z = 0;z<dim.z;z++)
+        for(std::size_t y = 0;y<dim.y;y++)
+            for(std::size_t x = 0;x<dim.x;x++)
+                out.put((char)voxel(x,y,z));
+    return fileName;
+}
+}
+
+TEST(test_brickcache, lru){
+    const Size3 dim{6,4,2};
+    const auto fileName = writeVolume(dim);
+    {
+        const Vec3i brick{4,4,2};
+        BrickCache cache(fileName,dim,1,brick,2 * brick.Prod());
+        ASSERT_EQ(cache.GridDimension,Vec3i(2,1,1));
+        ASSERT_EQ(cache.SlotCount(),2);
+
+        {
+            auto h = cache.Request({1,0,0});
+            // the second brick is 2 voxels wide, the rest is padded
+            const auto v = h.Voxels<unsigned char>();
+            ASSERT_EQ(v[0],voxel(4,0,0));
+            ASSERT_EQ(v[1],voxel(5,0,0));
+            ASSERT_EQ(v[2],0);
+            ASSERT_EQ(v[0 + 4*(3 + 4*1)],voxel(4,3,1));
+        }
+        {
+            auto h = cache.Request({0,0,0});
+            ASSERT_EQ(h.Voxels<unsigned char>()[3 + 4*2],voxel(3,2,0));
+        }
+        auto h = cache.Request({1,0,0});
+        auto s = cache.Stats();
+        ASSERT_EQ(s.Hits,1u);
+        ASSERT_EQ(s.Misses,2u);
+        ASSERT_EQ(s.Evictions,0u);
+        ASSERT_TRUE(cache.Contains({0,0,0}));
+    }
+    std::remove(fileName.c_str());
+}
+
+TEST(test_brickcache, eviction){
+    const Size3 dim{8,8,8};
+    const auto fileName = writeVolume(dim);
+    {
+        BrickCache cache(fileName,dim,1,Vec3i{4,4,4},64);
+        ASSERT_EQ(cache.SlotCount(),1);
+        for(int i = 0;i<8;i++){
+            const Point3i cell{i&1,(i>>1)&1,(i>>2)&1};
+            auto h = cache.Request(cell);
+            ASSERT_EQ(h.Voxels<unsigned char>()[0],voxel(4*cell.x,4*cell.y,4*cell.z));
+        }
+        ASSERT_EQ(cache.Stats().Evictions,7u);
+        auto pinned = cache.Request({0,0,0});
+        // a pinned brick is never evicted
+        ASSERT_THROW(cache.Request({1,0,0}),std::runtime_error);
+        pinned.Release();
+
+        // every cell a ray enters is requested in traversal order
+        cache.ResetStats();
+        const auto grid = Bound3f{{0,0,0},{8,8,8}}.GenGrid(cache.GridDimension);
+        std::vector<Point3i> cells;
+        cache.RequestAlong(grid,Ray{{1,0,0},{0.5,0.5,0.5}},[&](const BrickCache::Handle & h,const RayIntervalIter & iter){
+            ASSERT_EQ(h.CellIndex(),iter.CellIndex);
+            cells.push_back(h.CellIndex());
+        });
+        ASSERT_EQ(cells.size(),2u);
+        ASSERT_EQ(cells[1],Point3i(1,0,0));
+        ASSERT_EQ(cache.Stats().Hits,1u);
+        ASSERT_EQ(cache.Stats().Misses,1u);
+    }
+    std::remove(fileName.c_str());
+}
+
+TEST(test_brickcache, concurrent){
+    const Size3 dim{16,16,8};
+    const auto fileName = writeVolume(dim);
+    {
+        // 8 bricks in 6 slots, so hits race with evictions of the same slots
+        BrickCache cache(fileName,dim,1,Vec3i{8,8,4},6 * 256);
+        ASSERT_EQ(cache.SlotCount(),6);
+        const int threads = 4,requests = 20000;
+        std::vector<int> errors(threads);
+        std::vector<std::thread> workers;
+        for(int t = 0;t<threads;t++)
+            workers.emplace_back([&,t]{
+                std::uint32_t state = 12345u + t;
+                for(int i = 0;i<requests;i++){
+                    state = state * 1664525u + 1013904223u;
+                    const int c = int(state >> 29);
+                    const Point3i cell{c&1,(c>>1)&1,(c>>2)&1};
+                    auto h = cache.Request(cell);
+                    const auto v = h.Voxels<unsigned char>();
+                    // the brick must not be replaced while the handle pins it
+                    for(int k = 0;k<4;k++){
+                        const int x = (i + 3*k) & 7,y = (i >> 3) & 7,z = k;
+                        errors[t] += v[x + 8*(y + 8*z)] != voxel(8*cell.x + x,8*cell.y + y,4*cell.z + z);
+                    }
+                    h.Release();
+                }
+            });
+        for(auto & w : workers) w.join();
+        for(auto e : errors) ASSERT_EQ(e,0);
+        const auto s = cache.Stats();
+        ASSERT_EQ(s.Hits + s.Misses,std::uint64_t(threads) * requests);
+        ASSERT_GT(s.Hits,0u);
+        ASSERT_GT(s.Evictions,0u);
+    }
+    std::remove(fileName.c_str());
+}
@@ -0,0 +1,185 @@
+#include <gtest/gtest.h>
+#include <VMat/bvh.h>
+#include <VMat/widebvh.h>
+#include <random>
+using namespace vm;
+
+namespace
+{
+std::vector<Bound3f> randomBounds(int count,unsigned seed){
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> pos(-50,50),size(0.01f,2);
+    std::vector<Bound3f> bounds;
+    for(int i = 0;i<count;i++){
+        const Point3f p{pos(rng),pos(rng),pos(rng)};
+        bounds.push_back(Bound3f{p,p + Vec3f{size(rng),size(rng),size(rng)}});
+    }
+    return bounds;
+}
+
+// checks that every node encloses its children and every primitive is referenced once
+void validate(const BVHTreeAccelerator & bvh){
+    const auto & nodes = bvh.Nodes();
+    std::vector<int> seen(bvh.PrimitiveCount());
+    for(std::size_t i = 0;i<nodes.size();i++){
+        const auto & n = nodes[i];
+        if(n.IsLeaf()){
+            for(int j = 0;j<n.PrimitiveCount;j++){
+                const auto p = bvh.PrimitiveIndices()[n.PrimitiveOffset + j];
+                seen[p]++;
+                ASSERT_TRUE(n.Bound.InsideEx(bvh.PrimitiveBounds()[p]));
+            }
+        }else{
+            ASSERT_TRUE(n.Bound.InsideEx(nodes[i + 1].Bound));
+            ASSERT_TRUE(n.Bound.InsideEx(nodes[n.SecondChildOffset].Bound));
+        }
+    }
+    for(auto s : seen) ASSERT_EQ(s,1);
+}
+
+void closestHits(const BVHTreeAccelerator & bvh,const std::vector<Bound3f> & bounds){
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> u(-1,1);
+    for(int r = 0;r<200;r++){
+        const Ray ray{{u(rng),u(rng),u(rng)},{u(rng) * 60,u(rng) * 60,u(rng) * 60}};
+        float expected = MAX_VALUE;
+        for(const auto & b : bounds){
+            float t0;
+            if(b.Intersect(ray,&t0)) expected = (std::min)(expected,t0);
+        }
+        float actual = MAX_VALUE;
+        const auto hit = bvh.Intersect(ray,[&](int p,Float & tMax){
+            float t0;
+            if(!bounds[p].Intersect(ray,&t0) || t0 > tMax) return false;
+            tMax = t0;
+            actual = t0;
+            return true;
+        });
+        ASSERT_EQ(hit,expected != MAX_VALUE);
+        if(hit){ ASSERT_FLOAT_EQ(actual,expected); }
+    }
+}
+}
+
+TEST(test_bvh, sah){
+    ASSERT_EQ(sizeof(BVHTreeAccelerator::Node),32u);
+    for(int count : {1,7,1000,40000}){
+        const auto bounds = randomBounds(count,count);
+        const BVHTreeAccelerator bvh(bounds);
+        validate(bvh);
+        closestHits(bvh,bounds);
+    }
+    // coincident centroids can not be binned and are split by count
+    const std::vector<Bound3f> same(100,Bound3f{{0,0,0},{1,1,1}});
+    validate(BVHTreeAccelerator(same,4));
+    ASSERT_FALSE(BVHTreeAccelerator(std::vector<Bound3f>{}).Intersect(Ray{{1,0,0},{0,0,0}},[](int,Float &){return true;}));
+}
+
+TEST(test_bvh, linear){
+    for(int count : {1,2,5,1000,40000}){
+        const auto bounds = randomBounds(count,count + 1);
+        const BVHTreeAccelerator bvh(bounds,4,BVHTreeAccelerator::SplitMethod::Linear);
+        validate(bvh);
+        closestHits(bvh,bounds);
+    }
+    // equal Morton codes are ordered by primitive index
+    const std::vector<Bound3f> same(100,Bound3f{{0,0,0},{1,1,1}});
+    validate(BVHTreeAccelerator(same,4,BVHTreeAccelerator::SplitMethod::Linear));
+
+    std::vector<std::uint32_t> values(50000);
+    for(std::size_t i = 0;i<values.size();i++) values[i] = std::uint32_t(i * 2654435761u);
+    auto expected = values;
+    std::stable_sort(expected.begin(),expected.end(),[](std::uint32_t a,std::uint32_t b){return (a & 0xfffff) < (b & 0xfffff);});
+    ParallelRadixSort(values,20,[](std::uint32_t v){return v;});
+    ASSERT_EQ(values,expected);
+}
+
+TEST(test_bvh, refit){
+    auto bounds = randomBounds(5000,11);
+    for(auto method : {BVHTreeAccelerator::SplitMethod::SAH,BVHTreeAccelerator::SplitMethod::Linear}){
+        BVHTreeAccelerator bvh(bounds,4,method);
+        ASSERT_FLOAT_EQ(bvh.SAHCost(),bvh.BuildSAHCost());
+
+        // move a few primitives and refit their ancestors only
+        std::vector<int> moved;
+        std::vector<Bound3f> movedBounds;
+        for(int p = 0;p<5000;p += 97){
+            moved.push_back(p);
+            movedBounds.push_back(Bound3f{bounds[p].min + Vec3f{3,-2,1},bounds[p].max + Vec3f{3,-2,1}});
+        }
+        auto animated = bounds;
+        for(std::size_t k = 0;k<moved.size();k++) animated[moved[k]] = movedBounds[k];
+        ASSERT_FALSE(bvh.Refit(moved,movedBounds));
+        validate(bvh);
+        closestHits(bvh,animated);
+
+        // the incremental refit matches a full one, including the maintained cost
+        BVHTreeAccelerator full(bounds,4,method);
+        full.Refit(animated.data());
+        ASSERT_EQ(full.Nodes().size(),bvh.Nodes().size());
+        for(std::size_t i = 0;i<full.Nodes().size();i++) { ASSERT_EQ(full.Nodes()[i].Bound.min,bvh.Nodes()[i].Bound.min); ASSERT_EQ(full.Nodes()[i].Bound.max,bvh.Nodes()[i].Bound.max); }
+        ASSERT_NEAR(full.SAHCost(),bvh.SAHCost(),1e-3f * full.SAHCost());
+
+        // scrambling every primitive degrades the tree enough to rebuild it
+        auto scrambled = randomBounds(5000,12);
+        ASSERT_TRUE(full.Refit(scrambled.data(),0.5f));
+        ASSERT_FLOAT_EQ(full.SAHCost(),full.BuildSAHCost());
+        validate(full);
+        closestHits(full,scrambled);
+    }
+}
+
+TEST(test_bvh, wide){
+    // one ray against 8 boxes agrees with the scalar slab test and sorts the hits
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<float> u(-1,1);
+    const auto bounds = randomBounds(8,21);
+    Bound3x8 wide;
+    for(int l = 0;l<8;l++) wide.Set(l,bounds[l]);
+    ASSERT_EQ(wide.Get(3).min,bounds[3].min);
+    for(int r = 0;r<500;r++){
+        const Ray ray{{u(rng),u(rng),u(rng)},{u(rng) * 60,u(rng) * 60,u(rng) * 60}};
+        int order[8];
+        float distances[8];
+        const auto n = wide.IntersectSorted(RayReciprocal(ray),ray.tMax,order,distances);
+        int expected = 0;
+        for(int l = 0;l<8;l++){
+            float t0;
+            if(bounds[l].Intersect(ray,&t0)) expected |= 1 << l;
+        }
+        int mask = 0;
+        for(int k = 0;k<n;k++){
+            mask |= 1 << order[k];
+            float t0;
+            bounds[order[k]].Intersect(ray,&t0);
+            ASSERT_NEAR(distances[k],t0,1e-3f);
+            if(k > 0){ ASSERT_LE(distances[k - 1],distances[k]); }
+        }
+        ASSERT_EQ(mask,expected);
+    }
+
+    for(auto method : {BVHTreeAccelerator::SplitMethod::SAH,BVHTreeAccelerator::SplitMethod::Linear}){
+        const auto prims = randomBounds(20000,22);
+        const BVHTreeAccelerator bvh(prims,4,method);
+        const WideBVHAccelerator bvh8(bvh);
+        ASSERT_LT(bvh8.Nodes().size() * 4,bvh.Nodes().size());
+
+        std::uniform_real_distribution<float> v(-1,1);
+        for(int r = 0;r<200;r++){
+            const Ray ray{{v(rng),v(rng),v(rng)},{v(rng) * 60,v(rng) * 60,v(rng) * 60}};
+            float expected = MAX_VALUE, actual = MAX_VALUE;
+            auto closest = [&](float & result){
+                return [&](int p,Float & tMax){
+                    float t0;
+                    if(!prims[p].Intersect(ray,&t0) || t0 > tMax) return false;
+                    tMax = result = t0;
+                    return true;
+                };
+            };
+            ASSERT_EQ(bvh.Intersect(ray,closest(expected)),bvh8.Intersect(ray,closest(actual)));
+            ASSERT_FLOAT_EQ(actual,expected);
+        }
+    }
+    const std::vector<Bound3f> single{Bound3f{{0,0,0},{1,1,1}}};
+    ASSERT_TRUE(WideBVHAccelerator(BVHTreeAccelerator(single)).Intersect(Ray{{1,0,0},{-1,0.5f,0.5f}},[](int,Float &){return true;}));
+}
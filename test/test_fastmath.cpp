@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+#include <VMat/fastmath.h>
+#include <functional>
+using namespace vm;
+
+namespace
+{
+// the distance in units in the last place between a and the correctly rounded reference
+double ulps(float a,double reference){
+    const auto r = float(reference);
+    if(a == r) return 0;
+    if(std::isinf(r) || std::isinf(a)) return 1e30;
+    return std::abs(double(a) - reference) / std::abs(double(std::nextafter(r,INFINITY)) - double(r));
+}
+
+// the largest error of the scalar and the 8-wide form over n points of [lo, hi]
+double maxUlps(float lo,float hi,int n,const std::function<double(double)> & reference,
+               const std::function<float(float)> & scalar,const std::function<Float8(Float8)> & wide){
+    double worst = 0;
+    for(int i = 0;i<n;i += 8){
+        alignas(32) float x[8];
+        for(int l = 0;l<8;l++) x[l] = lo + (hi - lo) * float(i + l) / float(n - 1);
+        const auto w = wide(Float8::Load(x));
+        for(int l = 0;l<8;l++){
+            const auto ref = reference(x[l]);
+            worst = (std::max)(worst,ulps(scalar(x[l]),ref));
+            worst = (std::max)(worst,ulps(w[l],ref));
+        }
+    }
+    return worst;
+}
+}
+
+TEST(test_fastmath, bounds){
+    const int n = 1 << 20;
+    auto sinUlps = maxUlps(-Pi,Pi,n,[](double x){ return std::sin(x); },
+                           [](float x){ Float s,c; FastSinCos(x,s,c); return s; },
+                           [](Float8 x){ Float8 s,c; FastSinCos(x,s,c); return s; });
+    auto cosUlps = maxUlps(-Pi,Pi,n,[](double x){ return std::cos(x); },
+                           [](float x){ Float s,c; FastSinCos(x,s,c); return c; },
+                           [](Float8 x){ Float8 s,c; FastSinCos(x,s,c); return c; });
+    auto acosUlps = maxUlps(-1,1,n,[](double x){ return std::acos(x); },
+                            [](float x){ return FastAcos(x); },[](Float8 x){ return FastAcos(x); });
+    auto exp2Ulps = maxUlps(-126,127.99f,n,[](double x){ return std::exp2(x); },
+                            [](float x){ return FastExp2(x); },[](Float8 x){ return FastExp2(x); });
+    auto log2Ulps = maxUlps(1e-30f,1e30f,n,[](double x){ return std::log2(x); },
+                            [](float x){ return FastLog2(x); },[](Float8 x){ return FastLog2(x); });
+    auto log2NearOne = maxUlps(0.5f,2,n,[](double x){ return std::log2(x); },
+                               [](float x){ return FastLog2(x); },[](Float8 x){ return FastLog2(x); });
+    auto rsqrtUlps = maxUlps(1e-20f,1e20f,n,[](double x){ return 1 / std::sqrt(x); },
+                             [](float x){ return FastRsqrt(x); },[](Float8 x){ return FastRsqrt(x); });
+    ASSERT_LE(sinUlps,2);
+    ASSERT_LE(cosUlps,2);
+    ASSERT_LE(acosUlps,3);
+    ASSERT_LE(exp2Ulps,2);
+    ASSERT_LE((std::max)(log2Ulps,log2NearOne),2.5);
+    ASSERT_LE(rsqrtUlps,4);
+
+    // the absolute sin/cos error holds far from the origin too
+    for(float x = -8192;x<=8192;x += 0.37f){
+        Float s,c;
+        FastSinCos(x,s,c);
+        ASSERT_NEAR(s,std::sin(double(x)),2.5e-7);
+        ASSERT_NEAR(c,std::cos(double(x)),2.5e-7);
+    }
+}
+
+TEST(test_fastmath, special){
+    ASSERT_EQ(FastExp2(0),1);
+    ASSERT_EQ(FastExp2(10),1024);
+    ASSERT_EQ(FastExp2(-127),0);
+    ASSERT_TRUE(std::isinf(FastExp2(128)));
+    ASSERT_EQ(FastLog2(1),0);
+    ASSERT_EQ(FastLog2(1024),10);
+    ASSERT_TRUE(std::isinf(FastLog2(0)) && FastLog2(0)<0);
+    ASSERT_TRUE(std::isnan(FastLog2(-1)));
+    const auto l = FastLog2(Float8(0.f,-1.f,1.f,1024.f,1e-40f,INFINITY,0.5f,3.f));
+    ASSERT_TRUE(std::isinf(l[0]) && l[0]<0);
+    ASSERT_TRUE(std::isnan(l[1]));
+    ASSERT_EQ(l[2],0);
+    ASSERT_EQ(l[3],10);
+    ASSERT_TRUE(std::isinf(l[4]) && l[4]<0);
+    ASSERT_TRUE(std::isinf(l[5]) && l[5]>0);
+    ASSERT_EQ(l[6],-1);
+    ASSERT_EQ(FastAcos(1),0);
+    ASSERT_NEAR(FastAcos(-1),Pi,1e-6);
+
+    // the exponents of the glossy lobes
+    for(float y : {0.5f,1.f / 11,1.f / 101,2.5f,-3.f})
+        for(float x = 0.001f;x<1;x += 0.001f){
+            const auto e = std::abs(y * std::log2(x));
+            ASSERT_LE(ulps(FastPow(x,y),std::pow(double(x),double(y))),2 + e);
+            ASSERT_LE(ulps(FastPow(Float8(x),Float8(y))[3],std::pow(double(x),double(y))),2 + e);
+        }
+    ASSERT_EQ(FastPow(0,2),0);
+
+    const auto n = FastNormalized(Vector3f(3,-4,12));
+    ASSERT_NEAR(n.Length(),1,1e-6);
+    ASSERT_NEAR(n.x,3.f / 13,1e-6);
+    Float8 x(3.f),y(-4.f),z(12.f);
+    FastNormalize(x,y,z);
+    ASSERT_NEAR(x[0],3.f / 13,1e-6);
+    ASSERT_NEAR(z[7],12.f / 13,1e-6);
+}
@@ -0,0 +1,56 @@
+#include <gtest/gtest.h>
+#include <VMat/frustum.h>
+#include <random>
+using namespace vm;
+
+namespace
+{
+Transform camera(){
+    return Perspective(60,1,0.1,100) * LookAt({0,0,10},{0,0,0},{0,1,0});
+}
+}
+
+TEST(test_frustum, classify){
+    const Frustum f(camera());
+    ASSERT_EQ(f.Classify(Bound3f{{-1,-1,-1},{1,1,1}}),CullResult::Inside);
+    ASSERT_EQ(f.Classify(Bound3f{{-1,-1,11},{1,1,12}}),CullResult::Outside);   // behind the eye
+    ASSERT_EQ(f.Classify(Bound3f{{-1,-1,-200},{1,1,-150}}),CullResult::Outside); // beyond the far plane
+    ASSERT_EQ(f.Classify(Bound3f{{-100,-1,-1},{100,1,1}}),CullResult::Intersect);
+    ASSERT_EQ(f.Classify(Bound3f{{20,-1,-1},{21,1,1}}),CullResult::Outside);
+
+    // the batch path agrees with the scalar one, including the remainder
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> pos(-30,30),size(0.1f,8);
+    std::vector<Bound3f> bounds;
+    for(int i = 0;i<1003;i++){
+        const Point3f p{pos(rng),pos(rng),pos(rng)};
+        bounds.push_back(Bound3f{p,p + Vec3f{size(rng),size(rng),size(rng)}});
+    }
+    const auto results = f.Classify(bounds);
+    int count[3] = {};
+    for(std::size_t i = 0;i<bounds.size();i++){
+        ASSERT_EQ(results[i],f.Classify(bounds[i])) << i;
+        count[(int)results[i]]++;
+    }
+    ASSERT_GT(count[0],0);
+    ASSERT_GT(count[1],0);
+    ASSERT_GT(count[2],0);
+}
+
+TEST(test_frustum, grid){
+    const Frustum f(camera());
+    const auto grid = Bound3f{{-20,-20,-40},{20,20,20}}.GenGrid({37,29,41});
+    for(int leaf : {1,64}){
+        std::vector<CullResult> results(grid.GridDimension.Prod());
+        f.Classify(grid,results.data(),leaf);
+        for(int z = 0;z<grid.GridDimension.z;z++)
+            for(int y = 0;y<grid.GridDimension.y;y++)
+                for(int x = 0;x<grid.GridDimension.x;x++){
+                    const auto expected = f.Classify(grid.CellBound({x,y,z}));
+                    const auto actual = results[x + grid.GridDimension.x * (y + grid.GridDimension.y * z)];
+                    // a block may be decided as a whole where single cells are borderline
+                    if(expected != CullResult::Intersect) ASSERT_EQ(actual,expected) << x << " " << y << " " << z;
+                    else ASSERT_NE(actual,CullResult::Outside);
+                }
+    }
+}
@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+#include <VMat/half.h>
+#include <cmath>
+#include <cstring>
+#include <random>
+using namespace vm;
+
+namespace
+{
+std::uint32_t bitsOf(float f){
+    std::uint32_t u;
+    std::memcpy(&u,&f,sizeof(u));
+    return u;
+}
+}
+
+TEST(test_half, rounding){
+    const auto h = [](float f){ return Half(f).Bits; };
+    ASSERT_EQ(h(0.f),0x0000);
+    ASSERT_EQ(h(-0.f),0x8000);
+    ASSERT_EQ(h(1.f),0x3c00);
+    ASSERT_EQ(h(-2.f),0xc000);
+    // ties round to even
+    ASSERT_EQ(h(1.f + std::ldexp(1.f,-11)),0x3c00);
+    ASSERT_EQ(h(1.f + 3 * std::ldexp(1.f,-11)),0x3c02);
+    ASSERT_EQ(h(65504.f),0x7bff);
+    ASSERT_EQ(h(65519.f),0x7bff);
+    ASSERT_EQ(h(65520.f),0x7c00);
+    ASSERT_EQ(h(1e10f),0x7c00);
+    ASSERT_EQ(h(-INFINITY),0xfc00);
+    // subnormals
+    ASSERT_EQ(h(std::ldexp(1.f,-24)),0x0001);
+    ASSERT_EQ(h(std::ldexp(1.f,-25)),0x0000);
+    ASSERT_EQ(h(3 * std::ldexp(1.f,-26)),0x0001);
+    ASSERT_EQ(h(std::ldexp(1.f,-14) - std::ldexp(1.f,-25)),0x0400);
+    ASSERT_TRUE(std::isnan(float(Half(NAN))));
+}
+
+TEST(test_half, exhaustive){
+    // every half converts to float and back unchanged, and the fallback matches the hardware path
+    for(std::uint32_t b = 0;b<0x10000;b++){
+        const auto h = Half::FromBits(std::uint16_t(b));
+        const auto f = float(h);
+        ASSERT_EQ(bitsOf(f),bitsOf(detail::HalfBitsToFloat(h.Bits))) << b;
+        if(std::isnan(f)) continue;
+        ASSERT_EQ(Half(f),h) << b;
+        ASSERT_EQ(detail::FloatToHalfBits(f),h.Bits) << b;
+    }
+    std::mt19937 rng(7);
+    for(int i = 0;i<1 << 20;i++){
+        std::uint32_t u = rng();
+        float f;
+        std::memcpy(&f,&u,sizeof(f));
+        ASSERT_EQ(Half(f).Bits,detail::FloatToHalfBits(f)) << u;
+    }
+}
+
+TEST(test_half, arrays){
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> d(-100,100);
+    std::vector<Vector3f> v;
+    std::vector<Normal3f> n;
+    for(int i = 0;i<1001;i++){
+        v.emplace_back(d(rng),d(rng),d(rng));
+        n.push_back(Normal3f(v.back().Normalized()));
+    }
+    std::vector<Vector3h> vh(v.size());
+    std::vector<Normal3h> nh(n.size());
+    ConvertToHalf(v.data(),v.size(),vh.data());
+    ConvertToHalf(n.data(),n.size(),nh.data());
+    std::vector<Vector3f> vf(v.size());
+    std::vector<Normal3f> nf(n.size(),Normal3f(0,0,0));
+    ConvertToFloat(vh.data(),vh.size(),vf.data());
+    ConvertToFloat(nh.data(),nh.size(),nf.data());
+    for(std::size_t i = 0;i<v.size();i++){
+        ASSERT_EQ(vh[i],Vector3h(v[i]));
+        ASSERT_EQ(nh[i],Normal3h(n[i]));
+        const auto s = Vector3f(Vector3h(v[i]));
+        ASSERT_EQ(vf[i].x,s.x);
+        ASSERT_EQ(vf[i].y,s.y);
+        ASSERT_EQ(vf[i].z,s.z);
+        // 11 significant bits
+        ASSERT_NEAR(vf[i].x,v[i].x,std::abs(v[i].x) * std::ldexp(1.f,-11));
+        ASSERT_NEAR(nf[i].z,n[i].z,std::ldexp(1.f,-11));
+    }
+}
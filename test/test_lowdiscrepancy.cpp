@@ -0,0 +1,148 @@
+#include <gtest/gtest.h>
+#include <VMat/lowdiscrepancy.h>
+#include <VMat/sampling.h>
+#include <algorithm>
+#include <cmath>
+using namespace vm;
+
+namespace
+{
+// every elementary interval of area 1 / n with power of two sides holds exactly one point
+void checkNet(const std::vector<Point2f> & p){
+    const int n = int(p.size());
+    for(int nx = 1;nx<=n;nx *= 2){
+        const int ny = n / nx;
+        std::vector<int> count(n);
+        for(const auto & s : p) count[int(s.x * nx) + nx * int(s.y * ny)]++;
+        for(auto c : count) ASSERT_EQ(c,1) << nx << "x" << ny;
+    }
+}
+}
+
+TEST(test_lowdiscrepancy, sobol){
+    // the unscrambled dimensions are the known Sobol sequence
+    const std::uint32_t expected[4][4] = {{0,0x80000000,0x40000000,0xc0000000},
+                                          {0,0x80000000,0xc0000000,0x40000000},
+                                          {0,0x80000000,0xc0000000,0x40000000},
+                                          {0,0x80000000,0xc0000000,0x40000000}};
+    for(int d = 0;d<4;d++)
+        for(std::uint32_t i = 0;i<4;i++){
+            std::uint32_t v = 0;
+            for(int j = 0;j<32;j++) if((i >> j) & 1) v ^= SobolTable.M[d][j];
+            ASSERT_EQ(v,expected[d][i]) << d << " " << i;
+        }
+
+    const SobolSampler sampler(7);
+    for(int dim = 0;dim<3;dim++){
+        std::vector<Point2f> p;
+        for(std::uint32_t i = 0;i<256;i++) p.push_back(sampler.Get2D({3,5},i,dim));
+        checkNet(p);
+        // the next aligned block is a net too, and different pixels get different points
+        p.clear();
+        for(std::uint32_t i = 256;i<512;i++) p.push_back(sampler.Get2D({3,5},i,dim));
+        checkNet(p);
+        ASSERT_NE(sampler.Get2D({3,5},0,dim).x,sampler.Get2D({4,5},0,dim).x);
+    }
+
+    // blocks match the scalar path exactly, including the padded tail
+    std::vector<float> u0(45),u1(45),u2(45);
+    sampler.Get3D({1,2},13,45,4,u0.data(),u1.data(),u2.data());
+    for(std::uint32_t i = 0;i<45;i++){
+        const auto p = sampler.Get3D({1,2},13 + i,4);
+        ASSERT_EQ(u0[i],p.x);
+        ASSERT_EQ(u1[i],p.y);
+        ASSERT_EQ(u2[i],p.z);
+    }
+}
+
+TEST(test_lowdiscrepancy, halton){
+    const HaltonSampler sampler(3);
+    // any b^k consecutive points stratify a base b dimension into b^k intervals
+    for(int dim = 0;dim<2;dim++){
+        const int n = dim == 0 ? 1024 : 729;
+        std::vector<int> count(n);
+        for(int i = 0;i<n;i++){
+            const auto u = sampler.Get1D({9,2},100 + i,dim);
+            ASSERT_GE(u,0);
+            ASSERT_LT(u,1);
+            count[int(u * n)]++;
+        }
+        for(auto c : count) ASSERT_EQ(c,1);
+    }
+    std::vector<float> u0(20),u1(20);
+    sampler.Get2D({9,2},5,20,6,u0.data(),u1.data());
+    for(std::uint32_t i = 0;i<20;i++) ASSERT_EQ(u1[i],sampler.Get2D({9,2},5 + i,6).y);
+    std::vector<float> v0(20),v1(20),v2(20);
+    sampler.Get3D({9,2},5,20,6,v0.data(),v1.data(),v2.data());
+    for(std::uint32_t i = 0;i<20;i++) ASSERT_EQ(v2[i],sampler.Get3D({9,2},5 + i,6).z);
+
+    // adjacent dims share no coordinates, neither within a form nor across forms
+    for(int dim = 0;dim<3;dim++){
+        int shared = 0;
+        for(std::uint32_t i = 0;i<64;i++){
+            const auto a = sampler.Get2D({9,2},i,dim),b = sampler.Get2D({9,2},i,dim + 1);
+            const auto c = sampler.Get3D({9,2},i,dim),d = sampler.Get3D({9,2},i,dim + 1);
+            const auto e = sampler.Get1D({9,2},i,dim + 1);
+            shared += a.y == b.x;
+            shared += c.y == d.x || c.z == d.x || c.z == d.y;
+            shared += a.y == e || c.y == e;
+        }
+        ASSERT_LE(shared,2) << dim;
+    }
+}
+
+TEST(test_lowdiscrepancy, stratified){
+    const StratifiedSampler sampler(4,8,11);
+    ASSERT_EQ(sampler.SamplesPerPixel(),32);
+    for(std::uint32_t round = 0;round<2;round++){
+        std::vector<int> cells(32),intervals(32),third(32);
+        for(std::uint32_t i = 0;i<32;i++){
+            const auto p = sampler.Get3D({0,1},32 * round + i,2);
+            cells[int(p.x * 4) + 4 * int(p.y * 8)]++;
+            third[int(p.z * 32)]++;
+            intervals[int(sampler.Get1D({0,1},32 * round + i,5) * 32)]++;
+        }
+        for(int k = 0;k<32;k++){
+            ASSERT_EQ(cells[k],1);
+            ASSERT_EQ(intervals[k],1);
+            ASSERT_EQ(third[k],1);
+        }
+    }
+}
+
+TEST(test_lowdiscrepancy, jitter){
+    // every sample of a round is jittered on its own, not shifted by a common offset
+    const StratifiedSampler sampler(4,4,7);
+    std::vector<float> offsets1D,offsetsZ;
+    for(std::uint32_t i = 0;i<16;i++){
+        const auto u = sampler.Get1D({2,3},i,1) * 16;
+        const auto z = sampler.Get3D({2,3},i,1).z * 16;
+        offsets1D.push_back(u - std::floor(u));
+        offsetsZ.push_back(z - std::floor(z));
+    }
+    for(auto * offsets : {&offsets1D,&offsetsZ}){
+        std::sort(offsets->begin(),offsets->end());
+        ASSERT_EQ(std::unique(offsets->begin(),offsets->end()) - offsets->begin(),16);
+    }
+}
+
+TEST(test_lowdiscrepancy, convergence){
+    // a smooth integrand, integral 1/4, converges much faster than with independent samples
+    const SobolSampler sobol(1);
+    const StratifiedSampler stratified(16,16,1);
+    std::vector<float> u0(256),u1(256),x(256),y(256),z(256);
+    sobol.Get2D({0,0},0,256,0,u0.data(),u1.data());
+    double sum = 0;
+    for(int i = 0;i<256;i++) sum += u0[i] * u1[i];
+    ASSERT_NEAR(sum / 256,0.25,2e-3);
+    stratified.Get2D({0,0},0,256,0,u0.data(),u1.data());
+    sum = 0;
+    for(int i = 0;i<256;i++) sum += u0[i] * u1[i];
+    ASSERT_NEAR(sum / 256,0.25,2e-3);
+
+    // the blocks feed the batched warps, the mean direction of the sphere is ~0
+    uniformSampleSphere(u0.data(),u1.data(),256,x.data(),y.data(),z.data());
+    double m[3] = {};
+    for(int i = 0;i<256;i++){ m[0] += x[i]; m[1] += y[i]; m[2] += z[i]; }
+    for(auto v : m) ASSERT_NEAR(v / 256,0,2e-2);
+}
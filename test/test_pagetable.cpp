@@ -0,0 +1,57 @@
+#include <gtest/gtest.h>
+#include <VMat/pagetable.h>
+#include <VMat/parallel.h>
+using namespace vm;
+
+TEST(test_pagetable, translate){
+    PageTable table(Vec3i{4,2,3},Vec3i{8,4,16});
+    ASSERT_TRUE(table.IsAddressable());
+    ASSERT_EQ(table.BrickVoxels(),8*4*16);
+    table.Map({1,1,2},5);
+    table.Map({0,0,0},2);
+    ASSERT_EQ(table.Lookup({1,1,2}),5);
+    ASSERT_EQ(table.Lookup({3,1,2}),PageTable::Unmapped);
+
+    std::int32_t slot,offset;
+    ASSERT_TRUE(table.Translate({9,6,37},slot,offset));
+    ASSERT_EQ(slot,5);
+    ASSERT_EQ(offset,1 + 8*(2 + 4*5));
+    ASSERT_FALSE(table.Translate({-1,0,0},slot,offset));
+    ASSERT_FALSE(table.Translate({32,0,0},slot,offset));
+    ASSERT_FALSE(table.Translate({31,0,0},slot,offset));
+
+    // the 8-wide path must agree with the scalar one in every lane
+    std::int32_t xs[8] = {9,0,-3,7,31,32,15,8};
+    std::int32_t ys[8] = {6,0,0,3,7,0,4,4};
+    std::int32_t zs[8] = {37,0,0,15,47,0,40,33};
+    Int8 slots,offsets;
+    const auto mask = table.Translate8(Int8::LoadU(xs),Int8::LoadU(ys),Int8::LoadU(zs),slots,offsets);
+    for(int i = 0;i<8;i++){
+        const bool resident = table.Translate({xs[i],ys[i],zs[i]},slot,offset);
+        ASSERT_EQ(((mask>>i)&1) != 0,resident) << i;
+        if(resident){
+            ASSERT_EQ(slots[i],slot);
+            ASSERT_EQ(offsets[i],offset);
+            ASSERT_EQ(table.PoolIndex8(slots,offsets)[i],slot*table.BrickVoxels()+offset);
+        }
+    }
+    ASSERT_EQ(mask,0b11001011);
+
+    const auto fmask = table.Translate8(Float8(9.5f),Float8(6.9f),Float8(37.2f),slots,offsets);
+    ASSERT_EQ(fmask,0xFF);
+    ASSERT_EQ(offsets[3],1 + 8*(2 + 4*5));
+}
+
+TEST(test_pagetable, concurrent_map){
+    PageTable table(Vec3i{64,64,16},Vec3i{16,16,16});
+    // loaders race for the same bricks, exactly one of them wins each entry
+    std::atomic<int> wins{0};
+    ParallelFor(0,8 * 64*64*16,4096,[&](std::size_t begin,std::size_t end){
+        for(auto i = begin;i<end;i++){
+            const auto b = i % (64*64*16);
+            const Point3i brick(int(b%64),int((b/64)%64),int(b/(64*64)));
+            if(table.CompareAndMap(brick,PageTable::Unmapped,int(i)))wins++;
+        }
+    });
+    ASSERT_EQ(wins.load(),64*64*16);
+}
@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+#include <VMat/arithmetic.h>
+#include <VMat/particle.h>
+#include <random>
+using namespace vm;
+
+namespace
+{
+Particles randomParticles(std::size_t n,unsigned seed){
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> dist(-1,1);
+    Particles particles(n);
+    for(std::size_t i = 0;i<n;i++) particles.Set(i,{dist(rng),dist(rng),dist(rng)},{dist(rng),dist(rng),dist(rng)});
+    return particles;
+}
+}
+
+TEST(test_particle, constant){
+    // a size off the multiples of 8 and a small grain for several parallel chunks
+    const std::size_t n = 1003;
+    auto euler = randomParticles(n,1),rk4 = euler;
+    std::vector<Point3f> x(n),y(n);
+    std::vector<Vector3f> v(n),w(n);
+    for(std::size_t i = 0;i<n;i++){
+        x[i] = y[i] = euler.Position(i);
+        v[i] = w[i] = euler.Velocity(i);
+    }
+    const Vector3f g(0,-9.8f,0.5f);
+    for(int step = 0;step<10;step++){
+        IntegrateEuler(euler.View(),0.01f,0.9f,ConstantAcceleration(g),64);
+        IntegrateRungeKutta4(rk4.View(),0.01f,0.9f,ConstantAcceleration(g),64);
+        for(std::size_t i = 0;i<n;i++){
+            integrateEuler(&x[i],&v[i],g,0.01f);
+            rungeKutta4(&y[i],&w[i],g,0.01f);
+        }
+    }
+    for(std::size_t i = 0;i<n;i++){
+        for(int k = 0;k<3;k++){
+            ASSERT_NEAR(euler.Position(i)[k],x[i][k],1e-5);
+            ASSERT_NEAR(euler.Velocity(i)[k],v[i][k],1e-5);
+            ASSERT_NEAR(rk4.Position(i)[k],y[i][k],1e-5);
+            ASSERT_NEAR(rk4.Velocity(i)[k],w[i][k],1e-5);
+        }
+    }
+}
+
+TEST(test_particle, spring){
+    // x'' = -x, the exact solution is x0 cos t + v0 sin t
+    const std::size_t n = 100;
+    auto particles = randomParticles(n,2);
+    const auto start = particles;
+    auto spring = [](std::size_t,int,const Float8 * p,const Float8 *,Float8 * a){
+        for(int k = 0;k<3;k++) a[k] = Float8(0.f) - p[k];
+    };
+    const int steps = 1000;
+    const float dt = 0.002f;
+    for(int step = 0;step<steps;step++) IntegrateRungeKutta4(particles.View(),dt,1,spring);
+    const auto t = steps * dt;
+    for(std::size_t i = 0;i<n;i++){
+        const auto expected = start.Position(i) * std::cos(t) + start.Velocity(i) * std::sin(t);
+        for(int k = 0;k<3;k++) ASSERT_NEAR(particles.Position(i)[k],expected[k],1e-4);
+    }
+
+    // the scalar adapter sees the right particle index and state
+    auto adapted = start;
+    for(int step = 0;step<steps;step++){
+        IntegrateRungeKutta4(adapted.View(),dt,1,PerParticleAcceleration([&](std::size_t i,const Point3f & p,const Vector3f &){
+            EXPECT_LT(i,n);
+            return Vector3f(-p.x,-p.y,-p.z);
+        }),16);
+    }
+    for(std::size_t i = 0;i<n;i++)
+        for(int k = 0;k<3;k++) ASSERT_NEAR(adapted.Position(i)[k],particles.Position(i)[k],1e-6);
+}
@@ -0,0 +1,70 @@
+#include <gtest/gtest.h>
+#include <VMat/transformation.h>
+using namespace vm;
+
+TEST(test_precision, matrix){
+    const Matrix3x3 id;
+    ASSERT_EQ(id,Matrix3x3(1,0,0,0,1,0,0,0,1));
+
+    Transformd t;
+    t.SetRotate(Vector3d(1,2,3),33);
+    const auto m = Matrix4x4d::Mul(t.Matrix(),t.InverseMatrix());
+    for(int i = 0;i<4;i++)
+        for(int j = 0;j<4;j++) ASSERT_NEAR(m.m[i][j],i == j ? 1 : 0,1e-14);
+
+    // the conversion keeps the inverse computed in double
+    const auto f = Transform(t);
+    const auto r = Rotate(Vector3f(1,2,3),33);
+    for(int i = 0;i<4;i++){
+        for(int j = 0;j<4;j++){
+            ASSERT_EQ(f.Matrix().m[i][j],float(t.Matrix().m[i][j]));
+            ASSERT_EQ(f.InverseMatrix().m[i][j],float(t.InverseMatrix().m[i][j]));
+            ASSERT_NEAR(f.Matrix().m[i][j],r.Matrix().m[i][j],1e-6);
+        }
+    }
+}
+
+TEST(test_precision, ray){
+    const Rayd ray(Vector3d(1,0,0),Point3d(-1e9,0.25,0.25));
+    const Bound3<double> b(Point3d(0,0,0),Point3d(1,1,1));
+    double t0,t1;
+    ASSERT_TRUE(b.Intersect(ray,&t0,&t1));
+    ASSERT_EQ(t0,1e9);
+    ASSERT_EQ(t1,1e9 + 1);
+
+    const auto rf = Ray(ray);
+    ASSERT_EQ(rf.tMax,(std::numeric_limits<float>::max)());
+    ASSERT_EQ(rf.o.x,-1e9f);
+    ASSERT_EQ(rf.d.x,1);
+
+    // unbounded rays stay unbounded both ways, bounded ones keep their length
+    ASSERT_EQ(Rayd(rf).tMax,(std::numeric_limits<double>::max)());
+    ASSERT_EQ(Rayd(Ray({0,0,1},{0,0,0},2.5f)).tMax,2.5);
+    ASSERT_EQ(Ray(Rayd({0,0,1},{0,0,0},1e300)).tMax,(std::numeric_limits<float>::max)());
+}
+
+TEST(test_precision, relative){
+    // a volume placed far from the world origin, viewed from a camera next to it
+    const Point3d center(6.4e6,-3.2e6,1.6e6);
+    Transformd localToWorld;
+    localToWorld.SetTranslate(center.x,center.y,center.z);
+    const Point3d camera(center.x + 3.25,center.y - 1.5,center.z + 0.125);
+
+    const auto local = RelativeTo<float>(localToWorld,camera);
+    const Point3f p(0.1f,0.2f,0.3f);
+    const auto q = local * p;
+    const auto expect = localToWorld * Point3d(p.x,p.y,p.z);
+    ASSERT_NEAR(q.x,expect.x - camera.x,1e-6);
+    ASSERT_NEAR(q.y,expect.y - camera.y,1e-6);
+    ASSERT_NEAR(q.z,expect.z - camera.z,1e-6);
+    const auto back = AbsoluteFrom(q,camera);
+    ASSERT_NEAR(back.x,expect.x,1e-6);
+
+    // converting the world transform alone loses the offset of the camera to the rounding
+    const auto naive = Transform(localToWorld) * p;
+    ASSERT_GT(std::abs(naive.x - float(camera.x) - q.x),1e-3);
+
+    const auto ray = RelativeTo<float>(Rayd(Vector3d(0,0,1),camera),camera);
+    ASSERT_EQ(ray.o,Point3f(0,0,0));
+    ASSERT_EQ(ray.d,Vector3f(0,0,1));
+}
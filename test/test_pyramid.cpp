@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+#include <VMat/pyramid.h>
+using namespace vm;
+
+TEST(test_pyramid, downsample){
+    // odd extents exercise the clamped borders, a long x exercises the 8-wide path
+    const Size3 dim{37,5,3};
+    std::vector<float> src(dim.Prod());
+    for(std::size_t i = 0;i<src.size();i++) src[i] = float((i * 7919) % 251);
+
+    for(auto filter : {DownsampleFilter::Box,DownsampleFilter::Min,DownsampleFilter::Max}){
+        const auto half = HalfDimension(dim);
+        ASSERT_EQ(half, Size3(19,3,2));
+        std::vector<float> dst(half.Prod());
+        ASSERT_EQ(Downsample(src.data(),dim,dst.data(),filter),half);
+
+        for(std::size_t z = 0;z<half.z;z++){
+            for(std::size_t y = 0;y<half.y;y++){
+                for(std::size_t x = 0;x<half.x;x++){
+                    float sum = 0, mn = MAX_VALUE, mx = LOWEST_FLOAT;
+                    for(int i = 0;i<8;i++){
+                        const auto sx = std::min(2*x+(i&1),dim.x-1);
+                        const auto sy = std::min(2*y+((i>>1)&1),dim.y-1);
+                        const auto sz = std::min(2*z+((i>>2)&1),dim.z-1);
+                        const auto v = src[sx + dim.x*(sy + dim.y*sz)];
+                        sum += v; mn = std::min(mn,v); mx = std::max(mx,v);
+                    }
+                    const auto res = dst[x + half.x*(y + half.y*z)];
+                    if(filter == DownsampleFilter::Box){
+                        ASSERT_NEAR(res,sum/8,1e-4);
+                    }else if(filter == DownsampleFilter::Min){
+                        ASSERT_EQ(res,mn);
+                    }else{
+                        ASSERT_EQ(res,mx);
+                    }
+                }
+            }
+        }
+    }
+
+    std::vector<unsigned char> bytes{10,11,20,21,30,31,40,41};
+    unsigned char avg;
+    Downsample(bytes.data(),Size3{2,2,2},&avg);
+    ASSERT_EQ(avg,26);
+}
+
+TEST(test_pyramid, levels_and_lod){
+    const Size3 dim{64,64,64};
+    std::vector<float> data(dim.Prod(),1.f);
+    VolumePyramid<float> pyramid(data.data(),dim,Bound3f{{0,0,0},{64,64,64}},Vec3i{16,16,16});
+    ASSERT_EQ(pyramid.LevelCount(),3);
+    ASSERT_EQ(pyramid[1].Dimension,Size3(32,32,32));
+    ASSERT_EQ(pyramid[1].Bricks.GridDimension,Vec3i(2,2,2));
+    ASSERT_EQ(pyramid[2].Bricks.GridDimension,Vec3i(1,1,1));
+    ASSERT_EQ(pyramid[2].Data[0],1.f);
+    ASSERT_EQ(pyramid[1].Bricks.CellBound({1,1,1}).min,Point3f(32,32,32));
+    ASSERT_EQ(VolumePyramid<float>::BrickAtLevel({3,2,1},1),Point3i(1,1,0));
+
+    const Vec2i viewport{1024,768};
+    const auto proj = Perspective(60.f,1.0f*viewport.x/viewport.y,0.01f,10000.f);
+    LodSelector near(proj*LookAt({32,32,-100},{32,32,32},{0,1,0}),viewport);
+    LodSelector far(proj*LookAt({32,32,-5000},{32,32,32},{0,1,0}),viewport);
+    const auto nearLevels = pyramid.SelectLevels(near);
+    const auto farLevels = pyramid.SelectLevels(far);
+    for(std::size_t i = 0;i<nearLevels.size();i++){
+        ASSERT_EQ(nearLevels[i],0);
+        ASSERT_EQ(farLevels[i],2);
+    }
+
+    // a bound behind the eye always takes the finest level
+    LodSelector inside(proj*LookAt({32,32,32},{32,32,100},{0,1,0}),viewport);
+    ASSERT_EQ(inside.Select(Bound3f{{0,0,0},{64,64,64}},16,3),0);
+}
@@ -0,0 +1,159 @@
+#include <gtest/gtest.h>
+#include <VMat/quadric.h>
+#include <random>
+using namespace vm;
+
+TEST(test_quadric, quadraticEquation){
+    Float t1,t2;
+    // the small root would lose all its digits to cancellation in (-b + sqrt(delta)) / 2a
+    ASSERT_TRUE(quadraticEquation(1,1e4f,1,t1,t2));
+    ASSERT_NEAR(t1,-1.00000001e-4,1e-11);
+    ASSERT_NEAR(t2,-9999.9999,1e-3);
+    ASSERT_TRUE(quadraticEquation(1,-1e4f,1,t1,t2));
+    ASSERT_NEAR(t1,9999.9999,1e-3);
+    ASSERT_NEAR(t2,1.00000001e-4,1e-11);
+    // t1 is the + root for a negative a as well
+    ASSERT_TRUE(quadraticEquation(-2,2,12,t1,t2));
+    ASSERT_FLOAT_EQ(t1,-2);
+    ASSERT_FLOAT_EQ(t2,3);
+    ASSERT_TRUE(quadraticEquation(1,0,0,t1,t2));
+    ASSERT_EQ(t1,0);
+    ASSERT_EQ(t2,0);
+    ASSERT_FALSE(quadraticEquation(1,0,1,t1,t2));
+    ASSERT_FALSE(quadraticEquation(0,1,1,t1,t2));
+
+    Float8 w1,w2;
+    const auto mask = quadraticEquation8(Float8(1.f),Float8(-1e4f),Float8(1.f),w1,w2);
+    ASSERT_EQ(mask.Bits(),0xFF);
+    ASSERT_NEAR(w2[3],1.00000001e-4,1e-11);
+
+    // b^2 - 4ac = 1, but b^2 rounds to 4ac in float: the roots stay apart in both paths
+    ASSERT_TRUE(quadraticEquation(1,4097,4196352,t1,t2));
+    ASSERT_EQ(quadraticEquation8(Float8(1.f),Float8(4097.f),Float8(4196352.f),w1,w2).Bits(),0xFF);
+    ASSERT_EQ(w1[0],t1);
+    ASSERT_EQ(w2[0],t2);
+    ASSERT_EQ((std::min)(t1,t2),-2049);
+    ASSERT_EQ((std::max)(t1,t2),-2048);
+}
+
+TEST(test_quadric, sphere){
+    Float t;
+    // a tiny sphere far away, where b^2 - ac in float has no digits left
+    const Sphere far({1e4f,0,0},0.01f);
+    ASSERT_TRUE(far.Intersect(Ray({1,5e-7f,0},{0,0,0}),&t));
+    ASSERT_NEAR(t,1e4 - 0.00866,2e-3);
+    Sphere8 single;
+    single.Set(0,far);
+    ASSERT_EQ(single.IntersectClosest(Ray({1,5e-7f,0},{0,0,0}),&t),0);
+    ASSERT_NEAR(t,1e4 - 0.00866,2e-3);
+    ASSERT_FALSE(far.Intersect(Ray({1,2e-6f,0},{0,0,0})));
+
+    // from the inside the far side is hit, behind and beyond tMax nothing is
+    const Sphere unit({0,0,0},1);
+    ASSERT_TRUE(unit.Intersect(Ray({0,0,2},{0,0,0}),&t));
+    ASSERT_FLOAT_EQ(t,1);
+    ASSERT_FALSE(unit.Intersect(Ray({0,0,1},{0,0,3})));
+    ASSERT_FALSE(unit.Intersect(Ray({0,0,-1},{0,0,3},1.5f)));
+
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> pos(-5,5),radius(0.05f,0.5f);
+    SphereSet set;
+    std::vector<Sphere> spheres;
+    for(int i = 0;i<203;i++){
+        spheres.emplace_back(Point3f{pos(rng),pos(rng),pos(rng)},radius(rng));
+        set.Add(spheres.back());
+    }
+    std::vector<Sphere8> packets((spheres.size() + 7) / 8);
+    for(std::size_t i = 0;i<spheres.size();i++) packets[i / 8].Set(i % 8,spheres[i]);
+    int hits = 0;
+    for(int r = 0;r<500;r++){
+        const Point3f o{pos(rng) * 2,pos(rng) * 2,pos(rng) * 2};
+        const auto & target = spheres[rng() % spheres.size()];
+        const Ray ray(target.Center + Vector3f(pos(rng),pos(rng),pos(rng)) * (target.Radius * 0.1f) - o,o);
+        std::ptrdiff_t expected = -1;
+        Float tExpected = 0;
+        for(std::size_t i = 0;i<spheres.size();i++){
+            Float ti;
+            if(spheres[i].Intersect(ray,&ti) && (expected<0 || ti<tExpected)){
+                expected = std::ptrdiff_t(i);
+                tExpected = ti;
+            }
+        }
+        for(std::size_t p = 0;p<packets.size();p++){
+            Float8 tp;
+            const auto mask = packets[p].Intersect(ray,tp);
+            for(int l = 0;l<packets[p].Count;l++){
+                Float ti;
+                ASSERT_EQ(((mask >> l) & 1) != 0,spheres[p * 8 + l].Intersect(ray,&ti));
+                if((mask >> l) & 1){
+                    ASSERT_NEAR(tp[l],ti,1e-4 * (1 + ti));
+                }
+            }
+        }
+        const auto index = set.IntersectClosest(ray,&t);
+        ASSERT_EQ(index,expected);
+        if(index>=0){
+            ASSERT_NEAR(t,tExpected,1e-4 * (1 + t));
+            hits++;
+        }
+    }
+    ASSERT_GT(hits,400);
+}
+
+TEST(test_quadric, quadric){
+    Float t;
+    // the quadric form of a sphere agrees with the sphere
+    const auto q = Quadric::FromSphere({1,2,3},0.5f);
+    ASSERT_TRUE(q.Intersect(Ray({0,0,1},{1,2,0}),&t));
+    ASSERT_NEAR(t,2.5,1e-5);
+    ASSERT_NEAR(q.Gradient({1,2,2.5f}).Normalized().z,-1,1e-6);
+
+    // the infinite cylinder x^2 + y^2 = 1, a ray along its axis has a = b = 0
+    Quadric cylinder;
+    cylinder.A = cylinder.B = 1;
+    cylinder.J = -1;
+    ASSERT_TRUE(cylinder.Intersect(Ray({1,0,0},{0,0,5}),&t));
+    ASSERT_NEAR(t,1,1e-6);
+    ASSERT_FALSE(cylinder.Intersect(Ray({0,0,1},{0,0,0})));
+
+    // the paraboloid z = x^2 + y^2 along its axis has a single root
+    Quadric paraboloid;
+    paraboloid.A = paraboloid.B = 1;
+    paraboloid.I = -1;
+    ASSERT_TRUE(paraboloid.Intersect(Ray({0,0,-1},{0,0,5}),&t));
+    ASSERT_NEAR(t,5,1e-6);
+
+    Quadric8 packet;
+    packet.Set(0,q);
+    packet.Set(1,cylinder);
+    packet.Set(2,paraboloid);
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> coef(-1,1);
+    for(int l = 3;l<8;l++){
+        Quadric r;
+        r.A = coef(rng); r.B = coef(rng); r.C = coef(rng); r.D = coef(rng); r.E = coef(rng);
+        r.F = coef(rng); r.G = coef(rng); r.H = coef(rng); r.I = coef(rng); r.J = coef(rng);
+        packet.Set(l,r);
+    }
+    for(int r = 0;r<500;r++){
+        const Ray ray(Vector3f{coef(rng),coef(rng),coef(rng)},Point3f{coef(rng) * 3,coef(rng) * 3,coef(rng) * 3});
+        Float8 tp;
+        const auto mask = packet.Intersect(ray,tp);
+        for(int l = 0;l<8;l++){
+            Float ti;
+            const auto expected = packet.Get(l).Intersect(ray,&ti);
+            ASSERT_EQ(((mask >> l) & 1) != 0,expected) << r << " " << l;
+            if(expected){
+                ASSERT_NEAR(tp[l],ti,1e-3 * (1 + ti));
+            }
+        }
+    }
+    const auto closest = packet.IntersectClosest(Ray({0,0,-1},{0,0,5}),&t);
+    ASSERT_GE(closest,0);
+    for(int l = 0;l<8;l++){
+        Float ti;
+        if(packet.Get(l).Intersect(Ray({0,0,-1},{0,0,5}),&ti)){
+            ASSERT_LE(t,ti * (1 + 1e-5));
+        }
+    }
+}
@@ -0,0 +1,68 @@
+#include <gtest/gtest.h>
+#include <VMat/rng.h>
+#include <VMat/sampling.h>
+using namespace vm;
+
+TEST(test_rng, philox){
+    // known answers of the Random123 reference implementation
+    const std::uint32_t zero[4] = {},zeroKey[2] = {};
+    const std::uint32_t ones[4] = {0xffffffff,0xffffffff,0xffffffff,0xffffffff},onesKey[2] = {0xffffffff,0xffffffff};
+    const std::uint32_t pi[4] = {0x243f6a88,0x85a308d3,0x13198a2e,0x03707344},piKey[2] = {0xa4093822,0x299f31d0};
+    const std::uint32_t expected[3][4] = {{0x6627e8d5,0xe169c58d,0xbc57ac4c,0x9b00dbd8},
+                                          {0x408f276d,0x41c83b0e,0xa20bc7c6,0x6d5451fd},
+                                          {0xd16cfe09,0x94fdcceb,0x5001e420,0x24126ea1}};
+    const std::uint32_t * counters[3] = {zero,ones,pi},* keys[3] = {zeroKey,onesKey,piKey};
+    for(int t = 0;t<3;t++){
+        std::uint32_t out[4];
+        Philox4x32::Generate(counters[t],keys[t],out);
+        for(int i = 0;i<4;i++) ASSERT_EQ(out[i],expected[t][i]) << t << " " << i;
+
+        Int8 c[4];
+        for(int i = 0;i<4;i++) c[i] = Int8(std::int32_t(counters[t][i]));
+        Philox4x32::Generate8(c,Int8(std::int32_t(keys[t][0])),Int8(std::int32_t(keys[t][1])));
+        for(int i = 0;i<4;i++)
+            for(int l = 0;l<8;l++) ASSERT_EQ(std::uint32_t(c[i][l]),expected[t][i]);
+    }
+}
+
+TEST(test_rng, streams){
+    const PhiloxRNG rng({3,4},17,5);
+    // reproducible, and the 8-wide and block forms agree with the scalar one
+    ASSERT_EQ(rng.Uniform(9),PhiloxRNG({3,4},17,5).Uniform(9));
+    ASSERT_NE(rng.Uniform(9),PhiloxRNG({3,4},18,5).Uniform(9));
+    ASSERT_NE(rng.Uniform(9),PhiloxRNG({4,4},17,5).Uniform(9));
+    ASSERT_NE(rng.Uniform(9),PhiloxRNG({3,4},17,6).Uniform(9));
+    for(std::uint32_t d : {100u,101u,103u}){
+        const auto u8 = rng.Uniform8(d);
+        for(std::uint32_t l = 0;l<8;l++) ASSERT_EQ(u8[l],rng.Uniform(d + l));
+    }
+    // the 1D dimensions do not repeat the words of the 2D ones
+    ASSERT_NE(rng.Uniform(7),rng.Get2D(7).x);
+
+    std::vector<float> u0(21),u1(21);
+    PhiloxRNG::Get2D({3,4},10,21,7,u0.data(),u1.data(),5);
+    for(std::uint32_t i = 0;i<21;i++){
+        const auto p = PhiloxRNG({3,4},10 + i,5).Get2D(7);
+        ASSERT_EQ(u0[i],p.x);
+        ASSERT_EQ(u1[i],p.y);
+    }
+
+    // uniform over 64 bins within a loose chi-square bound
+    std::vector<int> bins(64);
+    const int n = 64 * 1024;
+    for(int d = 0;d<n;d += 8){
+        const auto u = rng.Uniform8(d);
+        for(int l = 0;l<8;l++){
+            ASSERT_GE(u[l],0);
+            ASSERT_LT(u[l],1);
+            bins[int(u[l] * 64)]++;
+        }
+    }
+    double chi2 = 0;
+    for(auto b : bins) chi2 += (b - 1024.0) * (b - 1024.0) / 1024.0;
+    ASSERT_LT(chi2,120);   // 63 degrees of freedom
+
+    int survived = 0;
+    for(std::uint32_t s = 0;s<1000;s++) survived += PhiloxRNG({0,0},s).RussianRoulette(0.3f,2);
+    ASSERT_NEAR(survived,300,60);
+}
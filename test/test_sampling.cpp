@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+#include <VMat/sampling.h>
+#include <random>
+using namespace vm;
+
+namespace
+{
+std::vector<Point2f> randomSamples(int count,unsigned seed){
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> u(0,1);
+    // the corners and the center of the square are the edge cases of the warps
+    std::vector<Point2f> p{{0,0},{1,1},{0,1},{1,0},{0.5f,0.5f},{0.5f,0},{0,0.5f}};
+    while(int(p.size())<count) p.emplace_back(u(rng),u(rng));
+    return p;
+}
+
+// checks the SoA and the array form of a warp against the scalar one
+template<typename S,typename SoA,typename Array>
+void compare3(const std::vector<Point2f> & p,S scalar,SoA soa,Array array){
+    std::vector<float> u0,u1;
+    for(const auto & s : p){ u0.push_back(s.x); u1.push_back(s.y); }
+    std::vector<float> x(p.size()),y(p.size()),z(p.size());
+    std::vector<Vector3f> v(p.size());
+    soa(u0.data(),u1.data(),p.size(),x.data(),y.data(),z.data());
+    array(p.data(),p.size(),v.data());
+    for(std::size_t i = 0;i<p.size();i++){
+        const auto e = scalar(p[i]);
+        for(int a = 0;a<3;a++) ASSERT_NEAR(v[i][a],e[a],1e-6) << i;
+        ASSERT_NEAR(x[i],e.x,1e-6) << i;
+        ASSERT_NEAR(y[i],e.y,1e-6) << i;
+        ASSERT_NEAR(z[i],e.z,1e-6) << i;
+    }
+}
+}
+
+TEST(test_sampling, sincos){
+    double maxError = 0;
+    for(int i = -200000;i<=200000;i += 8){
+        const Float8 x = (Float8::Iota() + Float8(float(i))) * Float8(8192.f / 200000);
+        Float8 s,c;
+        SinCos(x,s,c);
+        for(int l = 0;l<8;l++){
+            maxError = (std::max)(maxError,std::abs(s[l] - std::sin(double(x[l]))));
+            maxError = (std::max)(maxError,std::abs(c[l] - std::cos(double(x[l]))));
+        }
+    }
+    ASSERT_LT(maxError,2.5e-7);
+}
+
+TEST(test_sampling, warps){
+    for(int count : {5,8,1003}){
+        const auto p = randomSamples(count,3);
+        compare3(p,[](const Point2f & s){ return uniformSampleSphere(s); },
+                 [](auto... a){ uniformSampleSphere(a...); },[](auto... a){ uniformSampleSphere(a...); });
+        compare3(p,[](const Point2f & s){ return uniformSampleHemiSphere(s); },
+                 [](auto... a){ uniformSampleHemiSphere(a...); },[](auto... a){ uniformSampleHemiSphere(a...); });
+        compare3(p,[](const Point2f & s){ return cosineSampleHemiSphere(s); },
+                 [](auto... a){ cosineSampleHemiSphere(a...); },[](auto... a){ cosineSampleHemiSphere(a...); });
+        compare3(p,[](const Point2f & s){ return uniformSampleCone(s,0.8f); },
+                 [](const float * u0,const float * u1,std::size_t n,float * x,float * y,float * z){ uniformSampleCone(u0,u1,n,0.8f,x,y,z); },
+                 [](const Point2f * s,std::size_t n,Vector3f * v){ uniformSampleCone(s,n,0.8f,v); });
+
+        std::vector<float> u0,u1;
+        for(const auto & s : p){ u0.push_back(s.x); u1.push_back(s.y); }
+        std::vector<float> x(p.size()),y(p.size());
+        std::vector<Point2f> d(p.size());
+        concentricDiskSample(u0.data(),u1.data(),p.size(),x.data(),y.data());
+        concentricDiskSample(p.data(),p.size(),d.data());
+        for(std::size_t i = 0;i<p.size();i++){
+            const auto e = concentricDiskSample(p[i]);
+            ASSERT_NEAR(x[i],e.x,1e-6);
+            ASSERT_NEAR(y[i],e.y,1e-6);
+            ASSERT_NEAR(d[i].x,e.x,1e-6);
+            ASSERT_NEAR(d[i].y,e.y,1e-6);
+        }
+    }
+}
@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+#include <VMat/streamline.h>
+using namespace vm;
+
+namespace
+{
+// a volume of the rotation (-y, x, 0) around the z axis, linear so trilinear interpolation is exact
+VectorVolume rotationVolume(){
+    const Grid<Float> grid(Bound3f({-2,-2,-1},{2,2,1}),Vec3i(16,16,8));
+    std::vector<Vector3f> samples;
+    for(int z = 0;z<8;z++)
+        for(int y = 0;y<16;y++)
+            for(int x = 0;x<16;x++){
+                const auto c = grid.CellBound({x,y,z}).Center();
+                samples.emplace_back(-c.y,c.x,0);
+            }
+    return VectorVolume(grid,std::move(samples));
+}
+}
+
+TEST(test_streamline, sample){
+    const auto volume = rotationVolume();
+    for(const auto & p : {Point3f(0.3f,-0.7f,0.1f),Point3f(-1.1f,1.6f,-0.5f),Point3f(0,0,0)}){
+        const auto v = volume.Sample(p);
+        ASSERT_NEAR(v.x,-p.y,1e-5);
+        ASSERT_NEAR(v.y,p.x,1e-5);
+        ASSERT_NEAR(v.z,0,1e-6);
+    }
+    // clamped outside of the outer cell centers
+    const auto v = volume.Sample({5,0,0});
+    ASSERT_NEAR(v.y,1.875,1e-5);
+}
+
+TEST(test_streamline, circle){
+    const auto volume = rotationVolume();
+    StreamlineOptions options;
+    options.MaxVertices = 200;
+    options.Tolerance = 1e-6f;
+    const Point3f seeds[3] = {{1,0,0},{0,0.5f,0.2f},{-1.5f,0,-0.3f}};
+    StreamlineBuffer buffer;
+    TraceStreamlines(volume,seeds,3,options,buffer);
+    for(int s = 0;s<3;s++){
+        const auto & result = buffer.Result(s);
+        ASSERT_EQ(result.End,StreamlineEnd::MaxVertices);
+        ASSERT_EQ(result.Count,200);
+        const auto r = Vector2f(seeds[s].x,seeds[s].y).Length();
+        for(int i = 0;i<result.Count;i++){
+            const auto & p = buffer.Line(s)[i];
+            ASSERT_NEAR(Vector2f(p.x,p.y).Length(),r,1e-3);
+            ASSERT_NEAR(p.z,seeds[s].z,1e-6);
+        }
+        // the time of the trace is the angle traveled, the end point is the rotated seed
+        const auto & end = buffer.Line(s)[result.Count - 1];
+        ASSERT_NEAR(end.x,r * std::cos(result.Time + std::atan2(seeds[s].y,seeds[s].x)),1e-3);
+    }
+
+    // tracing backward turns the other way
+    options.Backward = true;
+    Point3f line[200];
+    TraceStreamline(volume,volume.GetGrid().Bound,seeds[0],options,line);
+    ASSERT_LT(line[1].y,0);
+}
+
+TEST(test_streamline, termination){
+    const Bound3f bound({0,0,0},{1,1,1});
+    StreamlineOptions options;
+    options.MaxVertices = 1000;
+    std::vector<Point3f> line(options.MaxVertices);
+
+    // leaving the bound ends on its border
+    auto uniform = [](const Point3f &,Float){ return Vector3f(1,0.5f,0); };
+    auto result = TraceStreamline(uniform,bound,{0.1f,0.1f,0.5f},options,line.data());
+    ASSERT_EQ(result.End,StreamlineEnd::LeftBound);
+    ASSERT_NEAR(line[result.Count - 1].x,1,1e-6);
+    ASSERT_NEAR(line[result.Count - 1].y,0.55f,1e-5);
+
+    // a sink stagnates at its center
+    auto sink = [](const Point3f & p,Float){ return Vector3f(0.5f,0.5f,0.5f) - Vector3f(p); };
+    options.StagnationSpeed = 1e-3f;
+    result = TraceStreamline(sink,bound,{0.9f,0.2f,0.3f},options,line.data());
+    ASSERT_EQ(result.End,StreamlineEnd::Stagnation);
+    ASSERT_NEAR(line[result.Count - 1].x,0.5f,1e-3);
+
+    // the length limit cuts the last segment
+    options.MaxLength = 0.25f;
+    result = TraceStreamline(uniform,bound,{0.1f,0.1f,0.5f},options,line.data());
+    ASSERT_EQ(result.End,StreamlineEnd::MaxLength);
+    ASSERT_NEAR((line[result.Count - 1] - line[0]).Length(),0.25f,1e-5);
+}
+
+TEST(test_streamline, pathline){
+    // v = (t, 0, 0) moves x by t^2 / 2
+    auto field = [](const Point3f &,Float t){ return Vector3f(t,0,0); };
+    StreamlineOptions options;
+    options.MaxVertices = 20;
+    options.MaxStep = 0.5f;   // the solution is a polynomial, the error estimate is 0 at any step
+    options.StartTime = 1;
+    std::vector<Point3f> line(options.MaxVertices);
+    const auto result = TraceStreamline(field,Bound3f({-100,-1,-1},{100,1,1}),{0,0,0},options,line.data());
+    ASSERT_EQ(result.End,StreamlineEnd::MaxVertices);
+    ASSERT_NEAR(line[result.Count - 1].x,(result.Time * result.Time - 1) / 2,1e-4);
+}
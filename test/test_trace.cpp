@@ -0,0 +1,76 @@
+#include <gtest/gtest.h>
+#include <VMat/transformation.h>
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <thread>
+using namespace vm;
+
+TEST(test_trace, zones){
+    FlushTrace();
+    {
+        const TraceZone outer("outer");
+        const TraceZone inner("inner");
+    }
+    std::vector<std::thread> threads;
+    for(int i = 0;i<4;i++){
+        threads.emplace_back([](){ const TraceZone zone("worker"); });
+    }
+    for(auto & t : threads) t.join();
+
+    const auto flush = FlushTrace();
+    ASSERT_EQ(flush.Dropped,0u);
+    ASSERT_EQ(flush.Events.size(),6u);
+    const TraceEvent * outer = nullptr, * inner = nullptr;
+    int workers = 0;
+    for(const auto & e : flush.Events){
+        ASSERT_LE(e.Begin,e.End);
+        if(std::strcmp(e.Name,"outer") == 0) outer = &e;
+        if(std::strcmp(e.Name,"inner") == 0) inner = &e;
+        if(std::strcmp(e.Name,"worker") == 0) workers++;
+    }
+    ASSERT_EQ(workers,4);
+    ASSERT_TRUE(outer && inner);
+    ASSERT_EQ(outer->Thread,inner->Thread);
+    ASSERT_LE(outer->Begin,inner->Begin);
+    ASSERT_GE(outer->End,inner->End);
+    ASSERT_TRUE(FlushTrace().Events.empty());
+}
+
+TEST(test_trace, overflow){
+    FlushTrace();
+    const auto n = detail::TraceBuffer::Capacity + 10;
+    for(std::uint64_t i = 0;i<n;i++){ const TraceZone zone("zone"); }
+    auto flush = FlushTrace();
+    ASSERT_EQ(flush.Events.size(),detail::TraceBuffer::Capacity);
+    ASSERT_EQ(flush.Dropped,10u);
+    // the buffer accepts zones again once drained
+    { const TraceZone zone("zone"); }
+    flush = FlushTrace();
+    ASSERT_EQ(flush.Events.size(),1u);
+    ASSERT_EQ(flush.Dropped,0u);
+}
+
+TEST(test_trace, chrome){
+    const std::vector<TraceEvent> events = {{"a\"b\\c\n",1500,4000,1},{"d",2000,2001,2}};
+    std::ostringstream os;
+    WriteChromeTrace(os,events,3);
+    const auto s = os.str();
+    ASSERT_NE(s.find("\"traceEvents\":["),std::string::npos);
+    ASSERT_NE(s.find("\"droppedZones\":3"),std::string::npos);
+    ASSERT_NE(s.find("{\"name\":\"a\\\"b\\\\c\\u000a\",\"cat\":\"vmat\",\"ph\":\"X\",\"ts\":1.500,\"dur\":2.500,\"pid\":1,\"tid\":1}"),std::string::npos);
+    ASSERT_NE(s.find("\"ts\":2.000,\"dur\":0.001,\"pid\":1,\"tid\":2}"),std::string::npos);
+    ASSERT_EQ(std::count(s.begin(),s.end(),'{'),std::count(s.begin(),s.end(),'}'));
+}
+
+#ifdef VMAT_TRACE
+TEST(test_trace, instrumented){
+    FlushTrace();
+    const auto m = Translate(1,2,3).Matrix().Inversed();
+    (void)m;
+    const auto flush = FlushTrace();
+    ASSERT_TRUE(std::any_of(flush.Events.begin(),flush.Events.end(),[](const TraceEvent & e){
+        return std::strcmp(e.Name,"Matrix4x4::Inversed") == 0;
+    }));
+}
+#endif
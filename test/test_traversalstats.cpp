@@ -0,0 +1,65 @@
+#include <gtest/gtest.h>
+#include <VMat/geometry.h>
+#include <sstream>
+#include <thread>
+using namespace vm;
+
+TEST(test_traversalstats, counters){
+    ASSERT_EQ(TraversalStats::HistogramBin(0),0);
+    ASSERT_EQ(TraversalStats::HistogramBin(1),1);
+    ASSERT_EQ(TraversalStats::HistogramBin(3),2);
+    ASSERT_EQ(TraversalStats::HistogramBin(4),3);
+    ASSERT_EQ(TraversalStats::HistogramBin(~std::uint64_t(0)),TraversalStats::HistogramBins - 1);
+
+    ResetTraversalStats();
+    // the counts of exited threads are kept
+    std::vector<std::thread> threads;
+    for(int i = 0;i<4;i++){
+        threads.emplace_back([i](){
+            CountTraversal(TraversalStats::EmptyCellSkips,i + 1);
+            CountTraversalRay(5);
+            ASSERT_EQ(ThreadTraversalStats()[TraversalStats::EmptyCellSkips],std::uint64_t(i + 1));
+        });
+    }
+    for(auto & t : threads) t.join();
+    CountTraversalRay(0);
+    auto s = CollectTraversalStats();
+    ASSERT_EQ(s[TraversalStats::EmptyCellSkips],10u);
+    ASSERT_EQ(s[TraversalStats::CellsStepped],20u);
+    ASSERT_EQ(s.CellsPerRay[0],1u);
+    ASSERT_EQ(s.CellsPerRay[3],4u);
+
+    std::ostringstream os;
+    os << s;
+    ASSERT_NE(os.str().find("empty cell skips: 10"),std::string::npos);
+    ASSERT_NE(os.str().find("[4, 8): 4"),std::string::npos);
+
+    ResetTraversalStats();
+    s = CollectTraversalStats();
+    ASSERT_EQ(s[TraversalStats::EmptyCellSkips],0u);
+    ASSERT_EQ(s.CellsPerRay[3],0u);
+}
+
+#ifdef VMAT_TRAVERSAL_STATS
+TEST(test_traversalstats, grid){
+    const Bound3f bound({0,0,0},{4,4,4});
+    const Grid<Float> grid(bound,Vec3i(4,4,4));
+    ResetTraversalStats();
+    {
+        // 4 cells along x, the last advance leaves the grid
+        int cells = 0;
+        for(auto it = grid.IntersectWith(Ray({1,0,0},{-1,0.5f,0.5f}));it.Valid();++it) cells++;
+        ASSERT_EQ(cells,4);
+        ASSERT_FALSE(grid.IntersectWith(Ray({1,0,0},{-1,8,8})).Valid());
+        // crossing the edges of the cells on the diagonal of the xy plane ties two axes
+        for(auto it = grid.IntersectWith(Ray({1,1,0},{-1,-1,0.5f}));it.Valid();it++){
+        }
+    }
+    const auto s = CollectTraversalStats();
+    ASSERT_EQ(s[TraversalStats::RaysTested],3u);
+    ASSERT_EQ(s[TraversalStats::BoundMisses],1u);
+    ASSERT_EQ(s[TraversalStats::CellsStepped],8u);
+    ASSERT_EQ(s[TraversalStats::AxisTies],4u);
+    ASSERT_EQ(s.CellsPerRay[3],2u);
+}
+#endif
@@ -0,0 +1,119 @@
+#include <gtest/gtest.h>
+#include <VMat/triangle.h>
+#include <random>
+using namespace vm;
+
+namespace
+{
+// a height field of n x n quads, two triangles each, with counterclockwise winding seen from +z
+std::vector<Triangle> heightField(int n,unsigned seed){
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> height(-0.3f,0.3f);
+    std::vector<Point3f> v;
+    for(int y = 0;y<=n;y++)
+        for(int x = 0;x<=n;x++) v.emplace_back(x * 0.37f,y * 0.37f,height(rng));
+    std::vector<Triangle> tris;
+    for(int y = 0;y<n;y++)
+        for(int x = 0;x<n;x++){
+            const auto i = y * (n + 1) + x;
+            tris.emplace_back(v[i],v[i + 1],v[i + n + 2]);
+            tris.emplace_back(v[i],v[i + n + 2],v[i + n + 1]);
+        }
+    return tris;
+}
+}
+
+TEST(test_triangle, intersect){
+    const Triangle tri({0,0,0},{1,0,0},{0,1,0});
+    TriangleHit hit;
+    ASSERT_TRUE(tri.Intersect(Ray({0,0,-1},{0.25f,0.5f,2}),&hit));
+    ASSERT_NEAR(hit.T,2,1e-6);
+    ASSERT_NEAR(hit.B0,0.25,1e-6);
+    ASSERT_NEAR(hit.B1,0.25,1e-6);
+    ASSERT_NEAR(hit.B2,0.5,1e-6);
+    ASSERT_TRUE(hit.FrontFacing);
+
+    // both sides are hit, the back one is reported as such
+    ASSERT_TRUE(tri.Intersect(Ray({0,0,1},{0.25f,0.5f,-2}),&hit));
+    ASSERT_NEAR(hit.T,2,1e-6);
+    ASSERT_FALSE(hit.FrontFacing);
+
+    ASSERT_FALSE(tri.Intersect(Ray({0,0,-1},{0.75f,0.5f,2})));      // outside of the hypotenuse
+    ASSERT_FALSE(tri.Intersect(Ray({0,0,1},{0.25f,0.5f,2})));       // pointing away
+    ASSERT_FALSE(tri.Intersect(Ray({0,0,-1},{0.25f,0.5f,2},1.5f))); // beyond tMax
+    ASSERT_FALSE(tri.Intersect(Ray({1,0,0},{-1,0.5f,0})));          // in the plane of the triangle
+}
+
+TEST(test_triangle, watertight){
+    const auto tris = heightField(16,3);
+    std::vector<Point3f> targets;
+    for(const auto & t : tris){
+        // vertices and points on the edges in float precision, the hardest cases for gaps
+        targets.push_back(t.P0);
+        targets.push_back(t.P0 + (t.P1 - t.P0) * 0.5f);
+        targets.push_back(t.P0 + (t.P2 - t.P0) * 0.3f);
+        targets.push_back(t.P1 + (t.P2 - t.P1) * 0.7f);
+    }
+    std::vector<Triangle8> packets((tris.size() + 7) / 8);
+    for(std::size_t i = 0;i<tris.size();i++) packets[i / 8].Set(i % 8,tris[i]);
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> offset(-4,4);
+    int rays = 0;
+    for(const auto & p : targets){
+        // stay off the border of the mesh, where a ray may exit through the side
+        if(p.x<0.5f || p.y<0.5f || p.x>16 * 0.37f - 0.5f || p.y>16 * 0.37f - 0.5f) continue;
+        for(int k = 0;k<4;k++){
+            const Point3f o{p.x + offset(rng),p.y + offset(rng),5};
+            const Ray ray(p - o,o);
+            const RayShear shear(ray);
+            int hits = 0;
+            for(const auto & t : tris) hits += t.Intersect(shear);
+            ASSERT_GE(hits,1) << p.x << " " << p.y << " " << p.z;
+            int wideHits = 0;
+            for(const auto & packet : packets){
+                Float8 t,b0,b1,b2;
+                for(auto m = packet.Intersect(shear,t,b0,b1,b2);m;m &= m - 1) wideHits++;
+            }
+            ASSERT_GE(wideHits,1) << p.x << " " << p.y << " " << p.z;
+            rays++;
+        }
+    }
+    ASSERT_GT(rays,1000);
+}
+
+TEST(test_triangle, wide){
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<float> pos(-1,1);
+    const auto tris = heightField(4,9);   // 32 triangles, shared edges included
+    std::vector<Triangle> all = tris;
+    for(int i = 0;i<13;i++) all.emplace_back(Point3f{pos(rng),pos(rng),pos(rng)},Point3f{pos(rng),pos(rng),pos(rng)},Point3f{pos(rng),pos(rng),pos(rng)});
+
+    std::vector<Triangle8> packets((all.size() + 7) / 8);
+    for(std::size_t i = 0;i<all.size();i++) packets[i / 8].Set(i % 8,all[i]);
+    ASSERT_EQ(packets.back().Count,int(all.size() % 8));
+
+    for(int r = 0;r<2000;r++){
+        const Point3f o{pos(rng) * 3,pos(rng) * 3,pos(rng) * 3};
+        // rays exactly through edges and vertices may be decided differently when the compiler
+        // contracts the shear of one path into FMA, the watertight test covers them
+        const Ray ray(Point3f{pos(rng),pos(rng),pos(rng)} - o,o);
+        const RayShear shear(ray);
+        for(std::size_t p = 0;p<packets.size();p++){
+            Float8 t,b0,b1,b2;
+            int front;
+            const auto mask = packets[p].Intersect(shear,t,b0,b1,b2,&front);
+            for(int l = 0;l<8;l++){
+                const auto i = p * 8 + l;
+                TriangleHit hit;
+                const auto expected = i<all.size() && all[i].Intersect(shear,&hit);
+                ASSERT_EQ(((mask >> l) & 1) != 0,expected);
+                if(!expected) continue;
+                ASSERT_NEAR(t[l],hit.T,1e-4 * (1 + hit.T));
+                ASSERT_NEAR(b0[l],hit.B0,1e-4);
+                ASSERT_NEAR(b1[l],hit.B1,1e-4);
+                ASSERT_NEAR(b2[l],hit.B2,1e-4);
+                ASSERT_EQ(((front >> l) & 1) != 0,hit.FrontFacing);
+            }
+        }
+    }
+}
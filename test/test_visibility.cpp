@@ -0,0 +1,24 @@
+#include <gtest/gtest.h>
+#include <VMat/visibility.h>
+#include <set>
+using namespace vm;
+
+TEST(test_visibility, estimate){
+    const Vec2i viewport{64,48};
+    const auto worldToClip = Perspective(30,float(viewport.x) / viewport.y,0.1,100) * LookAt({5,4,20},{6,5,0},{0,1,0});
+    const auto grid = Bound3f{{-8,-8,-8},{8,8,8}}.GenGrid({16,16,16});
+
+    const auto full = EstimateVisibleCells(grid,worldToClip,viewport,1);
+    const auto coarse = EstimateVisibleCells(grid,worldToClip,viewport,8);
+    ASSERT_FALSE(full.empty());
+    ASSERT_LT(coarse.size(),grid.GridDimension.Prod()) << full.size();
+
+    // the dilated coarse set covers every cell the full resolution pass visits
+    std::set<std::tuple<int,int,int>> estimated;
+    for(const auto & c : coarse) estimated.insert({c.Cell.x,c.Cell.y,c.Cell.z});
+    for(const auto & c : full) ASSERT_TRUE(estimated.count({c.Cell.x,c.Cell.y,c.Cell.z})) << c.Cell;
+
+    for(std::size_t i = 1;i<coarse.size();i++) ASSERT_LE(coarse[i - 1].Distance,coarse[i].Distance);
+    // distances are estimated from the sparse rays only
+    ASSERT_NEAR(coarse.front().Distance,full.front().Distance,grid.Cell.Length());
+}